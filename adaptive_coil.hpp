@@ -0,0 +1,205 @@
+#ifndef ADAPTIVE_COIL_HPP
+#define ADAPTIVE_COIL_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "wiringPiContext.hpp"
+
+namespace plotter{
+
+    /**
+     * How an adaptive coil drives its sequence
+     */
+    enum class step_mode{
+        half,       // Every state of the sequence
+        full        // Only the odd states, two coils energized
+    };
+
+    /**
+     * Step rates at which an adaptive coil changes mode. The gap between
+     * the two keeps the coil from flapping between modes at a steady speed.
+     */
+    struct step_mode_profile{
+        /**
+         * Switch to full steps at or above this many half steps per second
+         */
+        std::uint32_t full_step_above = 1600;
+
+        /**
+         * Switch back to half steps below this many half steps per second
+         */
+        std::uint32_t half_step_below = 1200;
+    };
+
+    /**
+     * Coil that walks a half-step sequence and switches to full steps when
+     * driven fast. The full-step table is the odd states of the half-step
+     * table, so both modes share those states and the mode only changes
+     * while the coils are in one of them. A step always counts as one half
+     * step; in full-step mode the even states are skipped and the coils
+     * move on every second step. Positions stay in half steps whichever
+     * mode is active.
+     *
+     * @param Backend: policy with write(pin_mask mask, pin_mask values)
+     * @param Sequence: half-step sequence with an even number of states
+     */
+    template<class Backend, class Sequence>
+    class adaptive_stepper_coil{
+        //Member Variables
+        private:
+            Backend m_backend;
+            Sequence m_sequence;
+
+            /**
+             * Index into m_sequence of the half step the coil is at
+             */
+            std::size_t m_state_index;
+
+            /**
+             * Index of the state last written to the coils, which lags
+             * m_state_index by a half step in full-step mode
+             */
+            std::size_t m_applied_index;
+
+            step_mode_profile m_profile;
+            step_mode m_mode;
+
+            /**
+             * Mode chosen from the step rate, applied at the next shared
+             * state
+             */
+            step_mode m_requested_mode;
+
+        //Public Interface
+        public:
+            /**
+             * @param backend: writes the coil pins
+             * @param sequence: half-step sequence this coil iterates
+             * @param profile: step rates at which the mode changes
+             * @param starting_index: optional state to initialize the coil to
+             */
+            adaptive_stepper_coil(Backend backend, Sequence sequence,
+                    step_mode_profile profile={}, std::size_t starting_index=0)
+                :   m_backend(backend),
+                    m_sequence(std::move(sequence)),
+                    m_state_index(starting_index),
+                    m_applied_index(starting_index),
+                    m_profile(profile),
+                    m_mode(step_mode::half),
+                    m_requested_mode(step_mode::half){
+                if(m_sequence.size() == 0 || m_sequence.size() % 2 != 0){
+                    throw std::invalid_argument("Adaptive coil needs a half-step sequence with an even number of states");
+                }
+            }
+
+            /**
+             * Applies the current state of the coils, enables the stepper
+             * if previously disabled
+             */
+            void enable(){
+                m_backend.write(m_sequence.pins(), m_sequence[m_applied_index]);
+            }
+
+            /**
+             * Clears the coils and disengages the stepper
+             */
+            void disable(){
+                m_backend.write(m_sequence.pins(), 0);
+            }
+
+            /**
+             * Step the coils a half step forward
+             */
+            void forward(){
+                m_state_index++;
+                if(m_state_index == m_sequence.size()){
+                    m_state_index = 0;
+                }
+                apply();
+            }
+
+            /**
+             * Step the coils a half step backward
+             */
+            void backward(){
+                if(m_state_index == 0){
+                    m_state_index = m_sequence.size();
+                }
+                m_state_index--;
+                apply();
+            }
+
+            /**
+             * Explicitly change the coil state to the given index. Invalid
+             * indices are ignored.
+             *
+             * @param new_state_index: state to set the coils to
+             */
+            void set_state(std::size_t new_state_index){
+                if(new_state_index < m_sequence.size()){
+                    m_state_index = new_state_index;
+                    m_applied_index = new_state_index;
+                    enable();
+                    switch_if_shared();
+                }
+            }
+
+            /**
+             * Choose the step mode for the rate the coil is being driven at
+             *
+             * @param half_steps_per_second: current planned step rate
+             */
+            void set_step_rate(std::uint32_t half_steps_per_second){
+                if(half_steps_per_second >= m_profile.full_step_above){
+                    m_requested_mode = step_mode::full;
+                }
+                else if(half_steps_per_second < m_profile.half_step_below){
+                    m_requested_mode = step_mode::half;
+                }
+                switch_if_shared();
+            }
+
+            void set_profile(step_mode_profile profile){m_profile = profile;}
+
+            /**
+             * @return: mode the coil is stepping in
+             */
+            step_mode mode() const{return m_mode;}
+
+            /**
+             * @return: index of the half step the coil is at
+             */
+            std::size_t state_index() const{return m_state_index;}
+
+            /**
+             * @return: half-step sequence the coils step through
+             */
+            const Sequence& sequence() const{return m_sequence;}
+
+        private:
+            /**
+             * @return: true if the coil is at a state both modes share
+             */
+            bool is_shared_state() const{return (m_state_index & 1) != 0;}
+
+            void apply(){
+                if(m_mode == step_mode::half || is_shared_state()){
+                    m_applied_index = m_state_index;
+                    enable();
+                }
+                switch_if_shared();
+            }
+
+            void switch_if_shared(){
+                if(m_requested_mode != m_mode && is_shared_state() && m_applied_index == m_state_index){
+                    m_mode = m_requested_mode;
+                }
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,439 @@
+#ifndef BASIC_STEPPER_HPP
+#define BASIC_STEPPER_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ratio>
+
+#include "wiringPiContext.hpp"
+#include "units.hpp"
+#include "homing.hpp"
+
+namespace plotter{
+
+    /**
+     * Coil state machine parameterized on how pins are written and how the
+     * coil sequence is stored. With a fixed_sequence and an inline backend
+     * a step compiles down to an index update, a table lookup and a
+     * register write.
+     *
+     * @param Backend: policy with write(pin_mask mask, pin_mask values)
+     * @param Sequence: fixed_sequence or runtime_sequence
+     */
+    template<class Backend, class Sequence>
+    class basic_stepper_coil{
+        //Member Variables
+        private:
+            Backend m_backend;
+            Sequence m_sequence;
+
+            /**
+             * Index into m_sequence of the state the coils are in
+             */
+            std::size_t m_state_index;
+
+        //Public Interface
+        public:
+            /**
+             * @param backend: writes the coil pins
+             * @param sequence: ordered set of states this coil iterates
+             * @param starting_index: optional state to initialize the coil to
+             */
+            basic_stepper_coil(Backend backend, Sequence sequence, std::size_t starting_index=0)
+                :   m_backend(backend),
+                    m_sequence(std::move(sequence)),
+                    m_state_index(starting_index){}
+
+            /**
+             * Applies the current state of the coils, enables the stepper
+             * if previously disabled
+             */
+            void enable(){
+                m_backend.write(m_sequence.pins(), m_sequence[m_state_index]);
+            }
+
+            /**
+             * Clears the coils and disengages the stepper
+             */
+            void disable(){
+                m_backend.write(m_sequence.pins(), 0);
+            }
+
+            /**
+             * Step the coils forward in the set of coil states
+             */
+            void forward(){
+                m_state_index++;
+                if(m_state_index == m_sequence.size()){
+                    m_state_index = 0;
+                }
+                enable();
+            }
+
+            /**
+             * Step the coils backward in the set of coil states
+             */
+            void backward(){
+                if(m_state_index == 0){
+                    m_state_index = m_sequence.size();
+                }
+                m_state_index--;
+                enable();
+            }
+
+            /**
+             * Explicitly change the coil state to the given index. Invalid
+             * indices are ignored.
+             *
+             * @param new_state_index: state to set the coils to
+             */
+            void set_state(std::size_t new_state_index){
+                if(new_state_index < m_sequence.size()){
+                    m_state_index = new_state_index;
+                    enable();
+                }
+            }
+
+            /**
+             * @return: index of the current coil state
+             */
+            std::size_t state_index() const{return m_state_index;}
+
+            /**
+             * @return: sequence the coils step through
+             */
+            const Sequence& sequence() const{return m_sequence;}
+    };
+
+    namespace detail{
+        template<class Coil>
+        Coil& deref_coil(Coil& coil){return coil;}
+
+        template<class Coil>
+        Coil& deref_coil(std::unique_ptr<Coil>& coil){return *coil;}
+
+        template<class Coil>
+        const Coil& deref_coil(const Coil& coil){return coil;}
+
+        template<class Coil>
+        const Coil& deref_coil(const std::unique_ptr<Coil>& coil){return *coil;}
+
+        template<class Coil>
+        auto forward_step_rate(Coil& coil, std::uint32_t rate, int) -> decltype(coil.set_step_rate(rate), void()){
+            coil.set_step_rate(rate);
+        }
+
+        template<class Coil>
+        void forward_step_rate(Coil&, std::uint32_t, long){}
+    }
+
+    /**
+     * Stepper motor logic parameterized on the coil type. Holding the coil
+     * by value lets the compiler inline tick() all the way to the backend
+     * write; holding a std::unique_ptr to a coil gives the runtime adapter
+     * used by plotter::stepper.
+     *
+     * @param Coil: a basic_stepper_coil, or a std::unique_ptr to any type
+     *              with forward() and backward()
+     */
+    template<class Coil>
+    class basic_stepper{
+        //Members
+        private:
+            Coil m_coil;
+
+            /**
+             * Reconfigurable step resolution
+             */
+            step_scale m_scale;
+
+            /**
+             * Current step this stepper motor is at
+             */
+            int m_current_step;
+
+            /**
+             * Current target step this stepper motor is trying to get to
+             */
+            int m_target_step;
+
+            /**
+             * Marks homing as a special state of the stepper to continue
+             * in a single direction until stop() is called
+             */
+            bool m_is_homing;
+
+            /**
+             * Optional switch that marks the home position
+             */
+            std::shared_ptr<const limit_switch> m_limit_switch;
+
+            /**
+             * Seek, back-off and re-seek cycle used when homing against
+             * m_limit_switch
+             */
+            homing_cycle m_homing;
+
+        //Interface
+        public:
+            /**
+             * @param coil: coil this stepper owns
+             * @param steps_per_mm: movement resolution of this stepper
+             */
+            basic_stepper(Coil coil, double steps_per_mm)
+                :basic_stepper(std::move(coil), step_scale::from_steps_per_millimeter(steps_per_mm)){}
+
+            /**
+             * @param coil: coil this stepper owns
+             * @param scale: exact movement resolution of this stepper
+             */
+            basic_stepper(Coil coil, step_scale scale)
+                :   m_coil(std::move(coil)),
+                    m_scale(scale),
+                    m_current_step(0),
+                    m_target_step(0),
+                    m_is_homing(false),
+                    m_limit_switch(),
+                    m_homing(){}
+
+            /**
+             * Set the target this stepper should move towards
+             *
+             * @param target_step: absolute position to move to in steps
+             */
+            void set_target(step target_step){
+                set_target(target_step.value);
+            }
+
+            /**
+             * Teleport the stepper position to the given step without
+             * actuating the stepper motor
+             *
+             * @param target_step: step value to teleport to
+             */
+            void teleport(step target_step){
+                teleport(target_step.value);
+            }
+
+            /**
+             * Set the target this stepper should move towards
+             *
+             * @param target_position: absolute position to move to
+             * @param mode: how to round to a whole step
+             */
+            void set_target(position target_position, rounding mode=rounding::nearest){
+                set_target(static_cast<int>(m_scale.to_steps(target_position, mode)));
+            }
+
+            /**
+             * Teleport the stepper position to the given position without
+             * actuating the stepper motor
+             *
+             * @param target_position: position to teleport to
+             * @param mode: how to round to a whole step
+             */
+            void teleport(position target_position, rounding mode=rounding::nearest){
+                teleport(static_cast<int>(m_scale.to_steps(target_position, mode)));
+            }
+
+            /**
+             * Immediately make a single step, moving the target along with
+             * the stepper. Used by executors that generate the step timing
+             * themselves.
+             *
+             * @param direction: negative to step backward, otherwise forward
+             */
+            void step(int direction){
+                if(direction < 0){
+                    step_backward();
+                }
+                else{
+                    step_forward();
+                }
+                m_target_step = m_current_step;
+            }
+
+            /**
+             * Tell the coil how fast it is being stepped so that coils which
+             * adapt to speed can pick a step mode. Ignored by other coils.
+             *
+             * @param steps_per_second: current planned step rate
+             */
+            void set_step_rate(std::uint32_t steps_per_second){
+                detail::forward_step_rate(coil(), steps_per_second, 0);
+            }
+
+            /**
+             * Stop actuating the stepper motor on the next tick
+             */
+            void stop(){
+                m_is_homing = false;
+                if(m_homing.is_active()){
+                    m_homing.cancel();
+                }
+                m_target_step = m_current_step;
+            }
+
+            /**
+             * Set the stepper in homing mode where it'll move toward the home
+             * position. With a limit switch the stepper runs a homing cycle
+             * and sets its position to zero once the switch is found,
+             * otherwise it moves until stop() is called
+             */
+            void home(){
+                if(m_limit_switch){
+                    m_homing.start();
+                }
+                else{
+                    m_is_homing = true;
+                }
+            }
+
+            /**
+             * Use a limit switch for homing
+             *
+             * @param limit: switch at the home position
+             * @param profile: speeds and distances of the homing cycle
+             */
+            void set_limit_switch(std::shared_ptr<const limit_switch> limit,
+                    homing_profile profile={}){
+                m_limit_switch = std::move(limit);
+                m_homing.set_profile(profile);
+            }
+
+            /**
+             * Tick function for the stepper motor. The stepper will move
+             * towards its target position each time this is called. Intended
+             * for use in a process loop to syncronize multiple steppers.
+             */
+            void tick(){
+                if(m_homing.is_active()){
+                    tick_homing();
+                }
+                else if(m_is_homing || m_target_step < m_current_step){
+                    step_backward();
+                }
+                else if(m_target_step > m_current_step){
+                    step_forward();
+                }
+            }
+
+            /**
+             * @return: phase of the current or last homing cycle
+             */
+            homing_cycle::phase homing_phase() const{return m_homing.get_phase();}
+
+            /**
+             * @return: step this stepper motor is currently at
+             */
+            int get_current_step() const{return m_current_step;}
+
+            /**
+             * @return: step this stepper motor is moving towards
+             */
+            int get_target_step() const{return m_target_step;}
+
+            /**
+             * @return: movement resolution of this stepper
+             */
+            const step_scale& scale() const{return m_scale;}
+
+            /**
+             * @return: the coils driven by this stepper
+             */
+            auto& coil(){return detail::deref_coil(m_coil);}
+            const auto& coil() const{return detail::deref_coil(m_coil);}
+
+        //Templates
+        public:
+
+            /**
+             * Set the target this stepper should move towards. Converts
+             * the travel to a fixed-point position and rounds it to the
+             * nearest step
+             *
+             * @param R: Ratio of travel unit relative to meters
+             * @param target_position: travel position and unit to move to
+             */
+            template<class R>
+            void set_target(travel<R> target_position){
+                set_target(position::from(target_position));
+            }
+
+            /**
+             * Teleport the stepper position to the given travel value without
+             * actuating the stepper motor. Automatically converts travel unit
+             * into the nearest step
+             *
+             * @param R: Ratio of travel unit relative to meters
+             * @param target_position: travel position and unit to teleport to
+             */
+            template<class R>
+            void teleport(travel<R> target_position){
+                teleport(position::from(target_position));
+            }
+
+        private:
+
+            /**
+             * Directly sets the member target value. Base function call for
+             * the other set_target functions
+             *
+             * @param step: step to target
+             */
+            void set_target(int step){
+                m_target_step = step;
+            }
+
+            /**
+             * Directly sets the member stepper position. Base function call
+             * for the other teleport functions
+             *
+             * @param step: step to set position to
+             */
+            void teleport(int step){
+                m_current_step = step;
+            }
+
+            void step_forward(){
+                coil().forward();
+                m_current_step++;
+            }
+
+            void step_backward(){
+                coil().backward();
+                m_current_step--;
+            }
+
+            /**
+             * Advance the homing cycle, kept out of tick() so the common
+             * path stays small
+             */
+            void tick_homing(){
+                int direction = m_homing.tick(m_limit_switch->is_triggered());
+                if(direction < 0){
+                    step_backward();
+                }
+                else if(direction > 0){
+                    step_forward();
+                }
+                if(m_homing.get_phase() == homing_cycle::phase::homed){
+                    teleport(0);
+                    m_target_step = 0;
+                }
+                else if(!m_homing.is_active()){
+                    m_target_step = m_current_step;
+                }
+            }
+    };
+
+    /**
+     * Fully inlined stepper for a given backend and coil sequence
+     */
+    template<class Backend, class Sequence>
+    using static_stepper = basic_stepper<basic_stepper_coil<Backend, Sequence>>;
+}
+
+#endif
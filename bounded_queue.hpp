@@ -0,0 +1,157 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace plotter{
+
+    /**
+     * Fixed capacity queue between two threads. push() waits while the
+     * queue is full, which is what holds a fast producer back to the pace
+     * of its consumer. Closing the queue ends the stream: the consumer
+     * drains what is left and then pop() returns false.
+     *
+     * The time each side spends waiting is counted, so a pipeline can tell
+     * which stage is holding it up.
+     */
+    template<class T>
+    class bounded_queue{
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_not_empty;
+            std::condition_variable m_not_full;
+            std::vector<T> m_items;
+            std::size_t m_first;
+            std::size_t m_count;
+            bool m_closed;
+
+            std::atomic<std::uint64_t> m_pushed;
+            std::atomic<std::uint64_t> m_push_wait_ns;
+            std::atomic<std::uint64_t> m_pop_wait_ns;
+
+            static std::uint64_t since(std::chrono::steady_clock::time_point start){
+                return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+            }
+
+        public:
+            /**
+             * @param capacity: most items held at once
+             */
+            explicit bounded_queue(std::size_t capacity)
+                :   m_mutex(),
+                    m_not_empty(),
+                    m_not_full(),
+                    m_items(capacity),
+                    m_first(0),
+                    m_count(0),
+                    m_closed(false),
+                    m_pushed(0),
+                    m_push_wait_ns(0),
+                    m_pop_wait_ns(0){
+                if(capacity == 0){
+                    throw std::invalid_argument("Queue capacity must be positive");
+                }
+            }
+
+            bounded_queue(const bounded_queue&) = delete;
+            bounded_queue& operator=(const bounded_queue&) = delete;
+
+            /**
+             * Add an item, waiting for room
+             *
+             * @param item: item to add
+             * @return: false if the queue was closed and the item dropped
+             */
+            bool push(const T& item){
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if(m_count == m_items.size() && !m_closed){
+                    auto start = std::chrono::steady_clock::now();
+                    m_not_full.wait(lock, [this]{return m_count < m_items.size() || m_closed;});
+                    m_push_wait_ns.fetch_add(since(start), std::memory_order_relaxed);
+                }
+                if(m_closed){
+                    return false;
+                }
+                m_items[(m_first + m_count) % m_items.size()] = item;
+                m_count++;
+                m_pushed.fetch_add(1, std::memory_order_relaxed);
+                lock.unlock();
+                m_not_empty.notify_one();
+                return true;
+            }
+
+            /**
+             * Take the oldest item, waiting for one
+             *
+             * @param item: receives the item
+             * @return: false once the queue is closed and empty
+             */
+            bool pop(T& item){
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if(m_count == 0 && !m_closed){
+                    auto start = std::chrono::steady_clock::now();
+                    m_not_empty.wait(lock, [this]{return m_count > 0 || m_closed;});
+                    m_pop_wait_ns.fetch_add(since(start), std::memory_order_relaxed);
+                }
+                if(m_count == 0){
+                    return false;
+                }
+                take(item);
+                lock.unlock();
+                m_not_full.notify_one();
+                return true;
+            }
+
+            /**
+             * Take the oldest item if there is one
+             *
+             * @param item: receives the item
+             * @return: false if the queue is empty
+             */
+            bool try_pop(T& item){
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if(m_count == 0){
+                    return false;
+                }
+                take(item);
+                lock.unlock();
+                m_not_full.notify_one();
+                return true;
+            }
+
+            /**
+             * End the stream. Waiting producers give up and the consumer
+             * drains what is left.
+             */
+            void close(){
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_closed = true;
+                }
+                m_not_empty.notify_all();
+                m_not_full.notify_all();
+            }
+
+            std::uint64_t pushed() const{return m_pushed.load(std::memory_order_relaxed);}
+            std::uint64_t push_wait_ns() const{return m_push_wait_ns.load(std::memory_order_relaxed);}
+            std::uint64_t pop_wait_ns() const{return m_pop_wait_ns.load(std::memory_order_relaxed);}
+
+        private:
+            void take(T& item){
+                item = m_items[m_first];
+                m_first = (m_first + 1) % m_items.size();
+                m_count--;
+            }
+    };
+}
+
+#endif
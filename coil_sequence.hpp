@@ -0,0 +1,136 @@
+#ifndef COIL_SEQUENCE_HPP
+#define COIL_SEQUENCE_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "wiringPiContext.hpp"
+
+namespace plotter{
+
+    /**
+     * Converts a single coil state into the pin levels it represents
+     *
+     * @param pins: GPIO pin for each coil
+     * @param state: on/off value for each coil
+     * @return: mask of the pins that are high in this state
+     */
+    template<class Pins, class State>
+    constexpr pin_mask pack_coil_state(const Pins& pins, const State& state){
+        pin_mask packed = 0;
+        std::size_t i = 0;
+        for(auto coil : state){
+            if(coil){
+                packed |= to_mask(pins[i]);
+            }
+            i++;
+        }
+        return packed;
+    }
+
+    /**
+     * Coil sequence whose length is known at compile time. Each state is
+     * stored pre-packed as the pin levels it drives so that stepping is a
+     * single table lookup and mask write.
+     *
+     * @param StateCount: number of states in the sequence
+     */
+    template<std::size_t StateCount>
+    class fixed_sequence{
+        private:
+            std::array<pin_mask, StateCount> m_states;
+            pin_mask m_pins;
+
+        public:
+            constexpr fixed_sequence(const std::array<pin_mask, StateCount>& states, pin_mask pins)
+                :   m_states(states),
+                    m_pins(pins){}
+
+            /**
+             * @return: number of states in the sequence
+             */
+            static constexpr std::size_t size(){return StateCount;}
+
+            /**
+             * @return: every pin driven by this sequence
+             */
+            constexpr pin_mask pins() const{return m_pins;}
+
+            /**
+             * @param index: state to retrieve, must be less than size()
+             * @return: pin levels of the state
+             */
+            constexpr pin_mask operator[](std::size_t index) const{return m_states[index];}
+    };
+
+    /**
+     * Pack a table of coil states for the given pins
+     *
+     * @param pins: GPIO pin for each coil
+     * @param states: on/off value of each coil for every state
+     * @return: packed sequence
+     */
+    template<std::size_t StateCount, std::size_t PinCount, class Coil>
+    constexpr fixed_sequence<StateCount> make_fixed_sequence(
+            const std::array<pin, PinCount>& pins,
+            const std::array<std::array<Coil, PinCount>, StateCount>& states){
+        std::array<pin_mask, StateCount> packed{};
+        pin_mask all_pins = 0;
+        for(std::size_t i = 0; i < PinCount; i++){
+            all_pins |= to_mask(pins[i]);
+        }
+        for(std::size_t i = 0; i < StateCount; i++){
+            packed[i] = pack_coil_state(pins, states[i]);
+        }
+        return fixed_sequence<StateCount>(packed, all_pins);
+    }
+
+    /**
+     * Coil sequence whose length is only known at run time, i.e. when it is
+     * loaded from configuration. States are packed the same way as
+     * fixed_sequence.
+     */
+    class runtime_sequence{
+        private:
+            std::vector<pin_mask> m_states;
+            pin_mask m_pins;
+
+        public:
+            runtime_sequence() :m_states(), m_pins(0){}
+
+            runtime_sequence(std::vector<pin_mask> states, pin_mask pins)
+                :   m_states(std::move(states)),
+                    m_pins(pins){}
+
+            /**
+             * Pack a table of coil states for the given pins
+             *
+             * @param pins: GPIO pin for each coil
+             * @param states: on/off value of each coil for every state
+             */
+            template<class State>
+            runtime_sequence(const std::vector<pin>& pins, const std::vector<State>& states)
+                :   m_states(),
+                    m_pins(0){
+                for(pin coil_pin : pins){
+                    m_pins |= to_mask(coil_pin);
+                }
+                m_states.reserve(states.size());
+                for(const State& state : states){
+                    if(state.size() != pins.size()){
+                        throw std::invalid_argument("Coil state does not match the number of coil pins");
+                    }
+                    m_states.push_back(pack_coil_state(pins, state));
+                }
+            }
+
+            std::size_t size() const{return m_states.size();}
+            pin_mask pins() const{return m_pins;}
+            pin_mask operator[](std::size_t index) const{return m_states[index];}
+    };
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include "encoder.hpp"
+
+#include <stdexcept>
+
+namespace plotter{
+    namespace{
+        /**
+         * Count change indexed by (previous state << 2) | current state,
+         * where a state is (A << 1) | B. The forward sequence is
+         * 00, 01, 11, 10. Entries that change both channels at once are
+         * marked 2 as they can't be decoded.
+         */
+        constexpr std::int8_t transition_table[16] = {
+             0,  1, -1,  2,
+            -1,  0,  2,  1,
+             1,  2,  0, -1,
+             2, -1,  1,  0
+        };
+    }
+
+    quadrature_encoder::quadrature_encoder(pin line_a, pin line_b, bool level_a, bool level_b)
+        :   m_line_a(line_a),
+            m_line_b(line_b),
+            m_state(static_cast<std::uint8_t>((level_a ? 2 : 0) | (level_b ? 1 : 0))),
+            m_count(0),
+            m_errors(0){}
+
+    void quadrature_encoder::on_edge(const edge_event& event){
+        std::uint8_t bit;
+        if(event.line == m_line_a){
+            bit = 2;
+        }
+        else if(event.line == m_line_b){
+            bit = 1;
+        }
+        else{
+            return;
+        }
+        std::uint8_t next = event.rising ? (m_state | bit) : (m_state & ~bit);
+        if(next == m_state){
+            // The opposite edge on this channel was missed
+            m_errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::int8_t change = transition_table[(m_state << 2) | next];
+        m_state = next;
+        if(change == 2){
+            m_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if(change != 0){
+            m_count.fetch_add(change, std::memory_order_release);
+        }
+    }
+
+    std::shared_ptr<quadrature_encoder> connect_encoder(edge_monitor& monitor,
+            std::shared_ptr<edge_source> source,
+            pin line_a,
+            pin line_b){
+        auto encoder = std::make_shared<quadrature_encoder>(line_a, line_b,
+                source->level(line_a), source->level(line_b));
+        monitor.add(source, [encoder](const edge_event& event){
+            encoder->on_edge(event);
+        });
+        return encoder;
+    }
+
+/******************************************************************************/
+/*                                Stall Monitor                               */
+/******************************************************************************/
+    stall_monitor::stall_monitor(std::shared_ptr<const quadrature_encoder> encoder,
+            std::size_t axis,
+            std::int64_t counts,
+            std::int64_t steps,
+            std::int64_t tolerance_steps,
+            stall_handler handler)
+        :   m_encoder(std::move(encoder)),
+            m_axis(axis),
+            m_counts(counts),
+            m_steps(steps),
+            m_tolerance(tolerance_steps),
+            m_count_origin(0),
+            m_step_origin(0),
+            m_stalled(false),
+            m_handler(std::move(handler)){
+        if(counts == 0 || steps <= 0 || axis >= max_axes){
+            throw std::invalid_argument("Stall monitor needs a non-zero encoder ratio and a valid axis");
+        }
+        m_count_origin = m_encoder->count();
+    }
+
+    bool stall_monitor::check(motion_executor& executor){
+        return check(executor, executor.position()[m_axis]);
+    }
+
+    bool stall_monitor::check(motion_executor& executor, std::int64_t commanded_steps){
+        if(m_stalled){
+            return true;
+        }
+        std::int64_t commanded = commanded_steps - m_step_origin;
+        std::int64_t counted = m_encoder->count() - m_count_origin;
+
+        // Compare in encoder counts times steps so no division is needed
+        std::int64_t error = counted * m_steps - commanded * m_counts;
+        std::int64_t limit = m_tolerance * (m_counts < 0 ? -m_counts : m_counts);
+        if(error <= limit && error >= -limit){
+            return false;
+        }
+
+        m_stalled = true;
+        executor.halt();
+        if(m_handler){
+            m_handler(stall_event{m_axis, commanded + m_step_origin,
+                    divide(counted * m_steps, m_counts, rounding::nearest) + m_step_origin});
+        }
+        return true;
+    }
+
+    void stall_monitor::rebase(std::int64_t commanded_steps){
+        m_count_origin = m_encoder->count();
+        m_step_origin = commanded_steps;
+        m_stalled = false;
+    }
+}
@@ -0,0 +1,185 @@
+#ifndef ENCODER_HPP
+#define ENCODER_HPP
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "gpio_edge.hpp"
+#include "motion.hpp"
+
+namespace plotter{
+
+    /**
+     * A/B quadrature decoder fed from edge events. The previous and current
+     * levels of both channels index a 16 entry table that gives the count
+     * change for every transition, so each edge costs one table lookup.
+     * Missed edges can't be decoded and are counted as errors instead.
+     */
+    class quadrature_encoder{
+        private:
+            pin m_line_a;
+            pin m_line_b;
+
+            /**
+             * Levels of A (bit 1) and B (bit 0), only touched by the thread
+             * dispatching the edges
+             */
+            std::uint8_t m_state;
+
+            std::atomic<std::int64_t> m_count;
+            std::atomic<std::uint32_t> m_errors;
+
+        public:
+            /**
+             * @param line_a: line of channel A
+             * @param line_b: line of channel B
+             * @param level_a: level of channel A before any edges arrive
+             * @param level_b: level of channel B before any edges arrive
+             */
+            quadrature_encoder(pin line_a, pin line_b, bool level_a=false, bool level_b=false);
+
+            /**
+             * Update the count from an edge on either channel
+             *
+             * @param event: edge that occurred
+             */
+            void on_edge(const edge_event& event);
+
+            /**
+             * @return: counts since construction or the last reset()
+             */
+            std::int64_t count() const{return m_count.load(std::memory_order_acquire);}
+
+            /**
+             * @return: number of edges that could not be decoded
+             */
+            std::uint32_t errors() const{return m_errors.load(std::memory_order_relaxed);}
+
+            /**
+             * Set the count, i.e. to match the commanded position after homing
+             *
+             * @param value: new count
+             */
+            void reset(std::int64_t value=0){m_count.store(value, std::memory_order_release);}
+    };
+
+    /**
+     * Create an encoder that follows the edges of two lines
+     *
+     * @param monitor: monitor to dispatch the edges from
+     * @param source: source that reports edges for both lines
+     * @param line_a: line of channel A
+     * @param line_b: line of channel B
+     * @return: encoder that stays in sync with the lines
+     */
+    std::shared_ptr<quadrature_encoder> connect_encoder(edge_monitor& monitor,
+            std::shared_ptr<edge_source> source,
+            pin line_a,
+            pin line_b);
+
+    /**
+     * Reported when an axis falls too far behind or ahead of its commanded
+     * position
+     */
+    struct stall_event{
+        std::size_t axis;
+        std::int64_t commanded_steps;
+
+        /**
+         * Encoder position converted to steps
+         */
+        std::int64_t measured_steps;
+    };
+
+    using stall_handler = std::function<void(const stall_event&)>;
+
+    /**
+     * Compares the encoder of an axis against the steps its executor has
+     * commanded and halts the executor when they drift apart by more than
+     * the tolerance. Checking is a handful of integer operations, cheap
+     * enough for every tick.
+     */
+    class stall_monitor{
+        private:
+            std::shared_ptr<const quadrature_encoder> m_encoder;
+            std::size_t m_axis;
+
+            /**
+             * m_counts encoder counts per m_steps motor steps
+             */
+            std::int64_t m_counts;
+            std::int64_t m_steps;
+
+            /**
+             * Largest allowed following error in steps
+             */
+            std::int64_t m_tolerance;
+
+            /**
+             * Encoder count and commanded step that line up
+             */
+            std::int64_t m_count_origin;
+            std::int64_t m_step_origin;
+
+            bool m_stalled;
+            stall_handler m_handler;
+
+        public:
+            /**
+             * @param encoder: encoder on the axis
+             * @param axis: executor axis to watch
+             * @param counts: encoder counts per revolution, negative if the
+             *                encoder counts against the motor
+             * @param steps: motor steps per revolution
+             * @param tolerance_steps: largest allowed following error
+             * @param handler: optional callback when a stall is detected
+             */
+            stall_monitor(std::shared_ptr<const quadrature_encoder> encoder,
+                    std::size_t axis,
+                    std::int64_t counts,
+                    std::int64_t steps,
+                    std::int64_t tolerance_steps=8,
+                    stall_handler handler=stall_handler());
+
+            /**
+             * Compare the encoder against the executor, halting the executor
+             * on a stall
+             *
+             * @param executor: executor driving the axis
+             * @return: true if the axis has stalled
+             */
+            bool check(motion_executor& executor);
+
+            /**
+             * Compare the encoder against a commanded position that trails
+             * the executor, i.e. the output of an input_shaper, halting the
+             * executor on a stall
+             *
+             * @param executor: executor driving the axis
+             * @param commanded_steps: position the axis was stepped to
+             * @return: true if the axis has stalled
+             */
+            bool check(motion_executor& executor, std::int64_t commanded_steps);
+
+            /**
+             * Line the encoder up with a commanded position and clear the
+             * stall, i.e. after homing
+             *
+             * @param commanded_steps: current commanded position of the axis
+             */
+            void rebase(std::int64_t commanded_steps);
+
+            bool is_stalled() const{return m_stalled;}
+
+            /**
+             * @return: executor axis watched
+             */
+            std::size_t axis() const{return m_axis;}
+    };
+}
+
+#endif
@@ -0,0 +1,58 @@
+#include "gpio_backend.hpp"
+
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace plotter{
+    namespace{
+        constexpr std::size_t register_block_size = 4096;
+        constexpr unsigned int pin_count = 54;
+    }
+
+    gpio_memory::gpio_memory(const std::string& device)
+        :m_registers(nullptr){
+        int fd = ::open(device.c_str(), O_RDWR | O_SYNC | O_CLOEXEC);
+        if(fd < 0){
+            throw std::system_error(errno, std::generic_category(), "Unable to open " + device);
+        }
+        void* mapping = ::mmap(nullptr, register_block_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int map_errno = errno;
+        ::close(fd);
+        if(mapping == MAP_FAILED){
+            throw std::system_error(map_errno, std::generic_category(), "Unable to map " + device);
+        }
+        m_registers = static_cast<volatile std::uint32_t*>(mapping);
+    }
+
+    gpio_memory::~gpio_memory(){
+        ::munmap(const_cast<std::uint32_t*>(m_registers), register_block_size);
+    }
+
+    void gpio_memory::configure_outputs(pin_mask pins){
+        for(unsigned int pin_number = 0; pin_number < pin_count; pin_number++){
+            if(pins & to_mask(pin_number)){
+                // Each function select register holds 3 bits for 10 pins
+                volatile std::uint32_t& select = m_registers[pin_number / 10];
+                unsigned int shift = (pin_number % 10) * 3;
+                select = (select & ~(7u << shift)) | (1u << shift);
+            }
+        }
+    }
+
+    gpio_outputs::gpio_outputs(type output_type,
+            std::shared_ptr<context> wiring_pi_context,
+            const std::string& device)
+        :   m_type(output_type),
+            m_context(std::move(wiring_pi_context)),
+            m_memory(),
+            m_shadow(0){
+        if(m_type == type::mmio){
+            m_memory = std::make_unique<gpio_memory>(device);
+        }
+    }
+}
@@ -0,0 +1,186 @@
+#ifndef GPIO_BACKEND_HPP
+#define GPIO_BACKEND_HPP
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "wiringPiContext.hpp"
+
+namespace plotter{
+
+    /**
+     * Backends are small value types with an inline write(mask, values)
+     * member that drive a set of pins. They are passed to the templated
+     * coils and steppers as policies so that the whole chain from a tick to
+     * the pin write can be inlined.
+     */
+
+    /**
+     * Backend that writes through a plotter::context. Holds a plain pointer
+     * so that there is no reference counting on the write path; the context
+     * must outlive the backend.
+     */
+    class context_backend{
+        private:
+            context* m_context;
+
+        public:
+            explicit context_backend(context& target) :m_context(&target){}
+
+            void write(pin_mask mask, pin_mask values){
+                m_context->write_mask(mask, values);
+            }
+    };
+
+    /**
+     * Backend that only records pin levels into a shared word. Useful for
+     * compiling jobs and for measuring the cost of the stepping logic itself.
+     */
+    class shadow_backend{
+        private:
+            pin_mask* m_state;
+
+        public:
+            explicit shadow_backend(pin_mask& state) :m_state(&state){}
+
+            void write(pin_mask mask, pin_mask values){
+                *m_state = (*m_state & ~mask) | (values & mask);
+            }
+    };
+
+    /**
+     * Backend that writes the BCM283x GPIO set/clear registers directly
+     * through a gpio_memory mapping. Every pin in a write changes in a single
+     * register store.
+     */
+    class mmio_backend{
+        private:
+            volatile std::uint32_t* m_registers;
+
+            static constexpr std::size_t set_register = 0x1C / 4;
+            static constexpr std::size_t clear_register = 0x28 / 4;
+
+        public:
+            explicit mmio_backend(volatile std::uint32_t* registers) :m_registers(registers){}
+
+            void write(pin_mask mask, pin_mask values){
+                pin_mask set = mask & values;
+                pin_mask clear = mask & ~values;
+                if(set & 0xFFFFFFFFu){
+                    m_registers[set_register] = static_cast<std::uint32_t>(set);
+                }
+                if(set >> 32){
+                    m_registers[set_register + 1] = static_cast<std::uint32_t>(set >> 32);
+                }
+                if(clear & 0xFFFFFFFFu){
+                    m_registers[clear_register] = static_cast<std::uint32_t>(clear);
+                }
+                if(clear >> 32){
+                    m_registers[clear_register + 1] = static_cast<std::uint32_t>(clear >> 32);
+                }
+            }
+    };
+
+    /**
+     * Owns the memory mapping of the GPIO register block used by
+     * mmio_backend
+     */
+    class gpio_memory{
+        private:
+            volatile std::uint32_t* m_registers;
+
+        public:
+            /**
+             * Map the GPIO registers
+             *
+             * @param device: device exposing the registers, /dev/gpiomem
+             *                does not require root
+             */
+            explicit gpio_memory(const std::string& device="/dev/gpiomem");
+            ~gpio_memory();
+
+            gpio_memory(const gpio_memory&) = delete;
+            gpio_memory& operator=(const gpio_memory&) = delete;
+
+            /**
+             * Set the function of each pin in the mask to output
+             *
+             * @param pins: pins to configure
+             */
+            void configure_outputs(pin_mask pins);
+
+            /**
+             * @return: backend writing through this mapping
+             */
+            mmio_backend backend() const{return mmio_backend(m_registers);}
+    };
+
+    /**
+     * Output pins of one controller, written through the backend a machine
+     * description selects. Owns whatever that backend writes through, so
+     * the coils built on it keep it alive.
+     */
+    class gpio_outputs{
+        public:
+            enum class type{
+                context,    // Through the wiringPi context, simulated when offline
+                mmio,       // Straight to the GPIO registers
+                shadow      // Nowhere, the levels are only recorded
+            };
+
+        private:
+            type m_type;
+            std::shared_ptr<context> m_context;
+            std::unique_ptr<gpio_memory> m_memory;
+            pin_mask m_shadow;
+
+        public:
+            /**
+             * @param output_type: backend to write through
+             * @param wiring_pi_context: context written by the context
+             *                           backend
+             * @param device: device mapped by the mmio backend
+             * @throw: system_error if the mmio backend can't map the device
+             */
+            gpio_outputs(type output_type,
+                    std::shared_ptr<context> wiring_pi_context,
+                    const std::string& device="/dev/gpiomem");
+
+            gpio_outputs(const gpio_outputs&) = delete;
+            gpio_outputs& operator=(const gpio_outputs&) = delete;
+
+            /**
+             * Call the visitor with the backend for a set of pins, setting
+             * the pins up as outputs first if the backend needs it
+             *
+             * @param pins: pins the backend will write
+             * @param visitor: callable taking any backend and returning the
+             *                 same type for each
+             * @return: result of the visitor
+             */
+            template<class Visitor>
+            decltype(auto) visit_backend(pin_mask pins, Visitor&& visitor){
+                switch(m_type){
+                    case type::mmio:
+                        m_memory->configure_outputs(pins);
+                        return std::forward<Visitor>(visitor)(m_memory->backend());
+                    case type::shadow:
+                        return std::forward<Visitor>(visitor)(shadow_backend(m_shadow));
+                    default:
+                        return std::forward<Visitor>(visitor)(context_backend(*m_context));
+                }
+            }
+
+            /**
+             * @return: levels written through the shadow backend
+             */
+            pin_mask shadow_state() const{return m_shadow;}
+
+            type get_type() const{return m_type;}
+    };
+}
+
+#endif
@@ -0,0 +1,263 @@
+#include "gpio_edge.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace plotter{
+    namespace{
+        std::system_error os_error(const std::string& what){
+            return std::system_error(errno, std::generic_category(), what);
+        }
+
+        std::uint64_t now_ns(){
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+    }
+
+/******************************************************************************/
+/*                              GPIO Line Source                              */
+/******************************************************************************/
+    gpio_line_source::gpio_line_source(const std::string& chip,
+            std::vector<pin> lines,
+            bool active_low,
+            unsigned int debounce_us)
+        :   m_lines(std::move(lines)),
+            m_fd(-1){
+        if(m_lines.empty() || m_lines.size() > GPIO_V2_LINES_MAX){
+            throw std::invalid_argument("Invalid number of GPIO lines requested");
+        }
+
+        int chip_fd = ::open(chip.c_str(), O_RDONLY | O_CLOEXEC);
+        if(chip_fd < 0){
+            throw os_error("Unable to open " + chip);
+        }
+
+        gpio_v2_line_request request;
+        std::memset(&request, 0, sizeof(request));
+        for(std::size_t i = 0; i < m_lines.size(); i++){
+            request.offsets[i] = m_lines[i];
+        }
+        request.num_lines = static_cast<std::uint32_t>(m_lines.size());
+        std::strncpy(request.consumer, "plotter", sizeof(request.consumer) - 1);
+        request.config.flags = GPIO_V2_LINE_FLAG_INPUT
+            | GPIO_V2_LINE_FLAG_EDGE_RISING
+            | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+        if(active_low){
+            request.config.flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+        }
+        if(debounce_us > 0){
+            request.config.num_attrs = 1;
+            request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+            request.config.attrs[0].attr.debounce_period_us = debounce_us;
+            request.config.attrs[0].mask = (std::uint64_t{1} << m_lines.size()) - 1;
+        }
+
+        int result = ::ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+        int request_errno = errno;
+        ::close(chip_fd);
+        if(result < 0){
+            errno = request_errno;
+            throw os_error("Unable to request GPIO lines on " + chip);
+        }
+
+        m_fd = request.fd;
+        ::fcntl(m_fd, F_SETFL, ::fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    gpio_line_source::~gpio_line_source(){
+        if(m_fd >= 0){
+            ::close(m_fd);
+        }
+    }
+
+    std::size_t gpio_line_source::read_events(const edge_handler& handler){
+        gpio_v2_line_event events[16];
+        std::size_t count = 0;
+        for(;;){
+            ssize_t bytes = ::read(m_fd, events, sizeof(events));
+            if(bytes <= 0){
+                return count;
+            }
+            std::size_t read_count = static_cast<std::size_t>(bytes) / sizeof(gpio_v2_line_event);
+            for(std::size_t i = 0; i < read_count; i++){
+                handler(edge_event{
+                        events[i].offset,
+                        events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE,
+                        events[i].timestamp_ns});
+            }
+            count += read_count;
+        }
+    }
+
+    bool gpio_line_source::level(pin line) const{
+        gpio_v2_line_values values;
+        std::memset(&values, 0, sizeof(values));
+        for(std::size_t i = 0; i < m_lines.size(); i++){
+            if(m_lines[i] == line){
+                values.mask = std::uint64_t{1} << i;
+                if(::ioctl(m_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0){
+                    throw os_error("Unable to read GPIO line");
+                }
+                return (values.bits & values.mask) != 0;
+            }
+        }
+        throw std::invalid_argument("GPIO line was not requested by this source");
+    }
+
+/******************************************************************************/
+/*                              Pipe Edge Source                              */
+/******************************************************************************/
+    pipe_edge_source::pipe_edge_source(pin_mask initial_levels)
+        :   m_read_fd(-1),
+            m_write_fd(-1),
+            m_levels(initial_levels){
+        int fds[2];
+        if(::pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0){
+            throw os_error("Unable to create edge pipe");
+        }
+        m_read_fd = fds[0];
+        m_write_fd = fds[1];
+    }
+
+    pipe_edge_source::~pipe_edge_source(){
+        ::close(m_read_fd);
+        ::close(m_write_fd);
+    }
+
+    void pipe_edge_source::inject(pin line, bool rising){
+        if(rising){
+            m_levels.fetch_or(to_mask(line));
+        }
+        else{
+            m_levels.fetch_and(~to_mask(line));
+        }
+        edge_event event{line, rising, now_ns()};
+        if(::write(m_write_fd, &event, sizeof(event)) != static_cast<ssize_t>(sizeof(event))){
+            throw os_error("Unable to inject edge");
+        }
+    }
+
+    std::size_t pipe_edge_source::read_events(const edge_handler& handler){
+        edge_event events[16];
+        std::size_t count = 0;
+        for(;;){
+            ssize_t bytes = ::read(m_read_fd, events, sizeof(events));
+            if(bytes <= 0){
+                return count;
+            }
+            std::size_t read_count = static_cast<std::size_t>(bytes) / sizeof(edge_event);
+            for(std::size_t i = 0; i < read_count; i++){
+                handler(events[i]);
+            }
+            count += read_count;
+        }
+    }
+
+    bool pipe_edge_source::level(pin line) const{
+        return (m_levels.load() & to_mask(line)) != 0;
+    }
+
+/******************************************************************************/
+/*                                Edge Monitor                                */
+/******************************************************************************/
+    edge_monitor::edge_monitor()
+        :   m_epoll_fd(::epoll_create1(EPOLL_CLOEXEC)),
+            m_wake_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+            m_registrations_mutex(),
+            m_registrations(),
+            m_thread(){
+        // The destructor doesn't run if construction throws, so close
+        // whichever descriptors were opened before throwing
+        auto close_fds = [this](){
+            if(m_wake_fd >= 0){
+                ::close(m_wake_fd);
+            }
+            if(m_epoll_fd >= 0){
+                ::close(m_epoll_fd);
+            }
+        };
+        if(m_epoll_fd < 0 || m_wake_fd < 0){
+            std::system_error error = os_error("Unable to create edge monitor");
+            close_fds();
+            throw error;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if(::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event) < 0){
+            std::system_error error = os_error("Unable to register edge monitor wake fd");
+            close_fds();
+            throw error;
+        }
+    }
+
+    edge_monitor::~edge_monitor(){
+        stop();
+        ::close(m_wake_fd);
+        ::close(m_epoll_fd);
+    }
+
+    void edge_monitor::add(std::shared_ptr<edge_source> source, edge_handler handler){
+        std::lock_guard<std::mutex> lock(m_registrations_mutex);
+        m_registrations.push_back(std::make_unique<registration>(
+                    registration{std::move(source), std::move(handler)}));
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = m_registrations.back().get();
+        if(::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_registrations.back()->source->fd(), &event) < 0){
+            m_registrations.pop_back();
+            throw os_error("Unable to register edge source");
+        }
+    }
+
+    void edge_monitor::start(){
+        if(!m_thread.joinable()){
+            m_thread = std::thread(&edge_monitor::run, this);
+        }
+    }
+
+    void edge_monitor::stop(){
+        if(m_thread.joinable()){
+            // The write only fails if the counter is already nonzero, and
+            // then the thread is being woken anyway. Skipping the join would
+            // destroy a joinable thread.
+            std::uint64_t wake = 1;
+            (void)::write(m_wake_fd, &wake, sizeof(wake));
+            m_thread.join();
+            while(::read(m_wake_fd, &wake, sizeof(wake)) > 0){
+            }
+        }
+    }
+
+    void edge_monitor::run(){
+        epoll_event events[8];
+        for(;;){
+            int count = ::epoll_wait(m_epoll_fd, events, 8, -1);
+            if(count < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                return;
+            }
+            for(int i = 0; i < count; i++){
+                registration* ready = static_cast<registration*>(events[i].data.ptr);
+                if(ready == nullptr){
+                    return;
+                }
+                ready->source->read_events(ready->handler);
+            }
+        }
+    }
+}
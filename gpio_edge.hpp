@@ -0,0 +1,194 @@
+#ifndef GPIO_EDGE_HPP
+#define GPIO_EDGE_HPP
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wiringPiContext.hpp"
+
+namespace plotter{
+
+    /**
+     * A single level change on an input line
+     */
+    struct edge_event{
+        /**
+         * GPIO line the edge occurred on
+         */
+        pin line;
+
+        /**
+         * True for an inactive to active transition
+         */
+        bool rising;
+
+        /**
+         * Time the edge was detected, in nanoseconds
+         */
+        std::uint64_t timestamp_ns;
+    };
+
+    using edge_handler = std::function<void(const edge_event&)>;
+
+    /**
+     * A pollable file descriptor that delivers edge events. Reading the events
+     * only happens on the edge_monitor thread so this is kept off the
+     * stepping path entirely.
+     */
+    class edge_source{
+        public:
+            virtual ~edge_source() = default;
+
+            /**
+             * @return: file descriptor that becomes readable when edges are
+             *          pending
+             */
+            virtual int fd() const = 0;
+
+            /**
+             * Drain the pending edges and pass each one to the handler
+             *
+             * @param handler: called once per edge
+             * @return: number of edges read
+             */
+            virtual std::size_t read_events(const edge_handler& handler) = 0;
+
+            /**
+             * Sample the current level of a line, used to seed state before
+             * any edges arrive
+             *
+             * @param line: line to sample
+             * @return: true if the line is active
+             */
+            virtual bool level(pin line) const = 0;
+    };
+
+    /**
+     * Edge source backed by a GPIO character device line request. Edges are
+     * detected by the kernel and timestamped at interrupt time.
+     */
+    class gpio_line_source : public edge_source{
+        private:
+            std::vector<pin> m_lines;
+            int m_fd;
+
+        public:
+            /**
+             * Request the given lines as inputs with edge detection
+             *
+             * @param chip: path to the GPIO chip, i.e. /dev/gpiochip0
+             * @param lines: line offsets on that chip to watch
+             * @param active_low: treat a low level as active
+             * @param debounce_us: optional hardware debounce period
+             */
+            gpio_line_source(const std::string& chip,
+                    std::vector<pin> lines,
+                    bool active_low=false,
+                    unsigned int debounce_us=0);
+            ~gpio_line_source() override;
+
+            gpio_line_source(const gpio_line_source&) = delete;
+            gpio_line_source& operator=(const gpio_line_source&) = delete;
+
+            int fd() const override{return m_fd;}
+            std::size_t read_events(const edge_handler& handler) override;
+            bool level(pin line) const override;
+    };
+
+    /**
+     * Edge source backed by a pipe so that switch and encoder logic can be
+     * exercised without hardware. Edges are injected from any thread.
+     */
+    class pipe_edge_source : public edge_source{
+        private:
+            int m_read_fd;
+            int m_write_fd;
+
+            /**
+             * Level of each line as of the last injected edge
+             */
+            std::atomic<pin_mask> m_levels;
+
+        public:
+            /**
+             * @param initial_levels: active lines before any edges are injected
+             */
+            explicit pipe_edge_source(pin_mask initial_levels=0);
+            ~pipe_edge_source() override;
+
+            pipe_edge_source(const pipe_edge_source&) = delete;
+            pipe_edge_source& operator=(const pipe_edge_source&) = delete;
+
+            /**
+             * Queue an edge as if it was detected on the given line
+             *
+             * @param line: line the edge occurs on
+             * @param rising: direction of the edge
+             */
+            void inject(pin line, bool rising);
+
+            int fd() const override{return m_read_fd;}
+            std::size_t read_events(const edge_handler& handler) override;
+            bool level(pin line) const override;
+    };
+
+    /**
+     * Waits on any number of edge sources with epoll and dispatches their
+     * edges from a single background thread
+     */
+    class edge_monitor{
+        private:
+            struct registration{
+                std::shared_ptr<edge_source> source;
+                edge_handler handler;
+            };
+
+            int m_epoll_fd;
+
+            /**
+             * eventfd used to wake the monitor thread when stopping
+             */
+            int m_wake_fd;
+
+            std::mutex m_registrations_mutex;
+            std::vector<std::unique_ptr<registration>> m_registrations;
+            std::thread m_thread;
+
+            void run();
+
+        public:
+            edge_monitor();
+            ~edge_monitor();
+
+            edge_monitor(const edge_monitor&) = delete;
+            edge_monitor& operator=(const edge_monitor&) = delete;
+
+            /**
+             * Start dispatching edges from the source to the handler. May be
+             * called while the monitor is running.
+             *
+             * @param source: source to wait on
+             * @param handler: called on the monitor thread for each edge
+             */
+            void add(std::shared_ptr<edge_source> source, edge_handler handler);
+
+            /**
+             * Start the monitor thread
+             */
+            void start();
+
+            /**
+             * Stop and join the monitor thread
+             */
+            void stop();
+    };
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "homing.hpp"
+
+namespace plotter{
+
+    std::shared_ptr<limit_switch> connect_limit_switch(edge_monitor& monitor,
+            std::shared_ptr<edge_source> source,
+            pin line){
+        auto limit = std::make_shared<limit_switch>(source->level(line));
+        monitor.add(source, [limit, line](const edge_event& event){
+            if(event.line == line){
+                limit->on_edge(event);
+            }
+        });
+        return limit;
+    }
+
+/******************************************************************************/
+/*                          Private Member Functions                          */
+/******************************************************************************/
+    void homing_cycle::enter(phase next){
+        m_phase = next;
+        m_wait = 0;
+        m_steps = 0;
+    }
+
+    bool homing_cycle::is_step_due(unsigned int ticks_per_step){
+        m_wait++;
+        if(m_wait < ticks_per_step){
+            return false;
+        }
+        m_wait = 0;
+        m_steps++;
+        if(m_steps > m_profile.max_steps){
+            enter(phase::failed);
+            return false;
+        }
+        return true;
+    }
+
+/******************************************************************************/
+/*                               Public Interface                             */
+/******************************************************************************/
+    void homing_cycle::start(){
+        enter(phase::seeking);
+    }
+
+    void homing_cycle::cancel(){
+        enter(phase::idle);
+    }
+
+    int homing_cycle::tick(bool triggered){
+        switch(m_phase){
+            case phase::seeking:
+                if(triggered){
+                    enter(phase::backing_off);
+                    return 0;
+                }
+                return is_step_due(m_profile.seek_ticks_per_step) ? m_profile.direction : 0;
+
+            case phase::backing_off:
+                if(m_steps >= m_profile.backoff_steps && !triggered){
+                    enter(phase::reseeking);
+                    return 0;
+                }
+                return is_step_due(m_profile.seek_ticks_per_step) ? -m_profile.direction : 0;
+
+            case phase::reseeking:
+                if(triggered){
+                    enter(phase::homed);
+                    return 0;
+                }
+                return is_step_due(m_profile.reseek_ticks_per_step) ? m_profile.direction : 0;
+
+            default:
+                return 0;
+        }
+    }
+}
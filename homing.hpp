@@ -0,0 +1,248 @@
+#ifndef HOMING_HPP
+#define HOMING_HPP
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gpio_edge.hpp"
+#include "units.hpp"
+
+namespace plotter{
+
+    /**
+     * A limit switch whose state is maintained from edge events rather than
+     * by sampling the pin. Checking the switch is a single atomic load so it
+     * can be done on every tick without any I/O.
+     */
+    class limit_switch{
+        private:
+            std::atomic<bool> m_triggered;
+
+            /**
+             * Number of times the switch has become active
+             */
+            std::atomic<std::uint32_t> m_trigger_count;
+
+        public:
+            explicit limit_switch(bool initially_triggered=false)
+                :   m_triggered(initially_triggered),
+                    m_trigger_count(0){}
+
+            /**
+             * Update the switch from an edge on its line
+             *
+             * @param event: edge that occurred
+             */
+            void on_edge(const edge_event& event){
+                if(event.rising){
+                    m_trigger_count.fetch_add(1, std::memory_order_relaxed);
+                }
+                m_triggered.store(event.rising, std::memory_order_release);
+            }
+
+            /**
+             * @return: true while the switch is active
+             */
+            bool is_triggered() const{
+                return m_triggered.load(std::memory_order_acquire);
+            }
+
+            /**
+             * @return: number of times the switch has become active
+             */
+            std::uint32_t trigger_count() const{
+                return m_trigger_count.load(std::memory_order_relaxed);
+            }
+    };
+
+    /**
+     * Create a limit switch that follows the edges of a line
+     *
+     * @param monitor: monitor to dispatch the edges from
+     * @param source: source that reports edges for the line
+     * @param line: line the switch is wired to
+     * @return: switch that stays in sync with the line
+     */
+    std::shared_ptr<limit_switch> connect_limit_switch(edge_monitor& monitor,
+            std::shared_ptr<edge_source> source,
+            pin line);
+
+    /**
+     * Speeds and distances used when homing against a limit switch. Speeds
+     * are given as the number of ticks between steps.
+     */
+    struct homing_profile{
+        /**
+         * Step direction towards the switch, -1 or 1
+         */
+        int direction = -1;
+
+        /**
+         * Ticks per step while seeking the switch
+         */
+        unsigned int seek_ticks_per_step = 1;
+
+        /**
+         * Steps to back away from the switch after the first contact
+         */
+        int backoff_steps = 40;
+
+        /**
+         * Ticks per step while re-seeking the switch for the precise position
+         */
+        unsigned int reseek_ticks_per_step = 8;
+
+        /**
+         * Steps after which homing is abandoned if the switch never triggers
+         */
+        int max_steps = 1 << 20;
+    };
+
+    /**
+     * State machine for a fast seek, back-off and slow re-seek homing cycle.
+     * The owning stepper feeds it the switch state every tick and makes the
+     * step it returns.
+     */
+    class homing_cycle{
+        public:
+            enum class phase{
+                idle,
+                seeking,
+                backing_off,
+                reseeking,
+                homed,
+                failed
+            };
+
+        private:
+            homing_profile m_profile;
+            phase m_phase;
+
+            /**
+             * Ticks since the last step, used to slow the step rate
+             */
+            unsigned int m_wait;
+
+            /**
+             * Steps taken in the current phase
+             */
+            int m_steps;
+
+            void enter(phase next);
+
+            /**
+             * @return: true if a step should be taken this tick at the given
+             *          rate
+             */
+            bool is_step_due(unsigned int ticks_per_step);
+
+        public:
+            explicit homing_cycle(homing_profile profile={})
+                :   m_profile(profile),
+                    m_phase(phase::idle),
+                    m_wait(0),
+                    m_steps(0){}
+
+            /**
+             * Begin the cycle with a fast seek towards the switch
+             */
+            void start();
+
+            /**
+             * Abandon the cycle
+             */
+            void cancel();
+
+            /**
+             * Advance the cycle by one tick
+             *
+             * @param triggered: current state of the limit switch
+             * @return: direction to step this tick, 0 to stay in place
+             */
+            int tick(bool triggered);
+
+            /**
+             * @return: current phase of the cycle
+             */
+            phase get_phase() const{return m_phase;}
+
+            /**
+             * @return: true while the cycle is still moving the axis
+             */
+            bool is_active() const{
+                return m_phase == phase::seeking
+                    || m_phase == phase::backing_off
+                    || m_phase == phase::reseeking;
+            }
+
+            void set_profile(homing_profile profile){m_profile = profile;}
+    };
+
+    /**
+     * Home several axes at once, each against its own switch, making the
+     * step of every active cycle once a tick until each has homed or
+     * failed. Homed axes are teleported to step 0.
+     *
+     * @param steppers: indexable set of pointers to steppers
+     * @param switches: switch of each stepper, nullptr for an axis that
+     *                  doesn't home
+     * @param profiles: profile of each stepper
+     * @param axis_count: number of steppers
+     * @param tick: time between ticks
+     * @return: true if every axis with a switch homed
+     */
+    template<class Steppers>
+    bool home_steppers(Steppers& steppers,
+            const std::vector<std::shared_ptr<limit_switch>>& switches,
+            const std::vector<homing_profile>& profiles,
+            std::size_t axis_count,
+            std::chrono::microseconds tick){
+        std::vector<homing_cycle> cycles;
+        for(std::size_t axis = 0; axis < axis_count; axis++){
+            cycles.emplace_back(profiles[axis]);
+            if(switches[axis]){
+                cycles.back().start();
+            }
+        }
+
+        auto deadline = std::chrono::steady_clock::now();
+        bool active = true;
+        while(active){
+            active = false;
+            for(std::size_t axis = 0; axis < axis_count; axis++){
+                if(!cycles[axis].is_active()){
+                    continue;
+                }
+                int direction = cycles[axis].tick(switches[axis]->is_triggered());
+                if(direction != 0){
+                    steppers[axis]->step(direction);
+                }
+                active = active || cycles[axis].is_active();
+            }
+            deadline += tick;
+            std::this_thread::sleep_until(deadline);
+        }
+
+        bool homed = true;
+        for(std::size_t axis = 0; axis < axis_count; axis++){
+            if(!switches[axis]){
+                continue;
+            }
+            if(cycles[axis].get_phase() == homing_cycle::phase::homed){
+                steppers[axis]->teleport(step(0));
+            }
+            else{
+                homed = false;
+            }
+        }
+        return homed;
+    }
+}
+
+#endif
@@ -4,8 +4,7 @@
  * https://www.wiringpi.com/reference/setup/
  */
 
-#include <iostream>
-#include <bitset>
+#include "logging.hpp"
 
 /********************************/
 /*        Setup Functions       */
@@ -13,25 +12,25 @@
 
 int wiringPiSetup(void)
 {
-    std::cout << "{wiringPiSetup} Called wiringPiSetup" << std::endl;
+    plotter::log_info("{wiringPiSetup} Called wiringPiSetup");
     return 0;
 }
 
 int wiringPiSetupGpio(void)
 {
-    std::cout << "{wiringPiSetupGpio} Called wiringPiSetupGpio" << std::endl;
+    plotter::log_info("{wiringPiSetupGpio} Called wiringPiSetupGpio");
     return 0;
 }
 
 int wiringPiSetupPhys(void)
 {
-    std::cout << "{wiringPiSetupPhys} Called wiringPiSetupPhys" << std::endl;
+    plotter::log_info("{wiringPiSetupPhys} Called wiringPiSetupPhys");
     return 0;
 }
 
 int wiringPiSetupSys(void)
 {
-    std::cout << "{wiringPiSetupSys} Called wiringPiSetupSys" << std::endl;
+    plotter::log_info("{wiringPiSetupSys} Called wiringPiSetupSys");
     return 0;
 }
 
@@ -45,54 +44,53 @@ int wiringPiSetupSys(void)
 //Only pin 7 (BCM_GPIO 4) supports GPIO_CLOCK
 void pinMode(int pin, int mode)
 {
-    std::cout << "{pinMode} Set mode on pin [" << pin << "] to " << mode << std::endl;
+    plotter::log_debug("{pinMode} Set mode on pin [{}] to {}", pin, mode);
 }
 
 //Sets pin to pull-up (PUD_UP), pull-down (PUD_DOWN), or neither (PUD_OFF) resistor mode
 void pullUpDnControl(int pin, int pud)
 {
-    std::cout << "{pullUpDnControl} Set PUD on pin [" << pin << "] to " << pud << std::endl;
+    plotter::log_debug("{pullUpDnControl} Set PUD on pin [{}] to {}", pin, pud);
 }
 
 //Write HIGH or LOW (1 or 0) to the given pin
 void digitalWrite(int pin, int value)
 {
-    std::cout << "{digitalWrite} Set pin [" << pin << "] = " << value << std::endl;
+    plotter::log_debug("{digitalWrite} Set pin [{}] = {}", pin, value);
 }
 
 //Write value to PWM register for given pin
 //only supported on a Raspberry Pi by pin 1, range 0-1024
 void pwmWrite(int pin, int value)
 {
-    std::cout << "{pwmWrite}";
     if(pin == 1)
     {
-        std::cout << "Set pwm on pin [" << pin << "] to " << value << std::endl;
+        plotter::log_debug("{pwmWrite}Set pwm on pin [{}] to {}", pin, value);
     }
     else
     {
-        std::cout << "Invalid PWM pin[" << pin << "]. Only pin 1 supports a PWM register." << std::endl;
+        plotter::log_warning("{pwmWrite}Invalid PWM pin[{}]. Only pin 1 supports a PWM register.", pin);
     }
 }
 
 //Returns value read at given pin. HIGH or LOW
 int digitalRead(int pin)
 {
-    std::cout << "{digitalRead} Read pin [" << pin << "]" << std::endl;
+    plotter::log_debug("{digitalRead} Read pin [{}]", pin);
     return 0;
 }
 
 //Returns value read on supplied analog input pin.
 int analogRead(int pin)
 {
-    std::cout << "{analogRead} Read pin [" << pin << "]" << std::endl;
+    plotter::log_debug("{analogRead} Read pin [{}]", pin);
     return 0;
 }
 
 //Writes given value to the supplied analog pin
 void analogWrite(int pin, int value)
 {
-    std::cout << "{analogWrite} Set pin [" << pin << "] = " << value << std::endl;
+    plotter::log_debug("{analogWrite} Set pin [{}] = {}", pin, value);
 }
 
 /********************************/
@@ -103,31 +101,31 @@ void analogWrite(int pin, int value)
 //Fastest way to set all 8 bits at once
 void digitalWriteByte(int value)
 {
-    std::cout << "{digitalWriteByte} Write pins [8-1] to value [" << std::bitset<8>(value) << ']' << std::endl;
+    plotter::log_debug("{digitalWriteByte} Write pins [8-1] to value [{}]", value);
 }
 
 //Set PWM generator mode to balance (PWM_MODE_BAL) or mark:space (PWM_MODE_MS)
 void pwmSetMode(int mode)
 {
-    std::cout << "{pwmSetMode} PWM set to [" << mode << ']' << std::endl;
+    plotter::log_debug("{pwmSetMode} PWM set to [{}]", mode);
 }
 
 //Sets range register on PWM generator. Default: 1024
 void pwmSetRange(unsigned int range)
 {
-    std::cout << "{pwmSetRange} PWM range set to [" << range << ']' << std::endl;
+    plotter::log_debug("{pwmSetRange} PWM range set to [{}]", range);
 }
 
 //Sets divisor for the PWM clock
 void pwmSetClock(int divisor)
 {
-    std::cout << "{pwmSetClock} PWM divisor set to [" << divisor << ']' << std::endl;
+    plotter::log_debug("{pwmSetClock} PWM divisor set to [{}]", divisor);
 }
 
 //Get's the board revision number. Either 1 or 2
 int piBoardRev(void)
 {
-    std::cout << "{piBoardRev} Default pi board revision is 2" << std::endl;
+    plotter::log_info("{piBoardRev} Default pi board revision is 2");
     return 2;
 }
 
@@ -135,7 +133,7 @@ int piBoardRev(void)
 //Accounts for board revision
 int wpiPinToGpio(int wPiPin)
 {
-    std::cout << "{wpiPinToPgio} Asked to convert wiringPi pin [" << wPiPin << "] to BCM_GPIO" << std::endl;
+    plotter::log_debug("{wpiPinToPgio} Asked to convert wiringPi pin [{}] to BCM_GPIO", wPiPin);
     return wPiPin;
 }
 
@@ -143,7 +141,7 @@ int wpiPinToGpio(int wPiPin)
 //on P1 connector
 int physPinToGpio(int physPin)
 {
-    std::cout << "{physPinToGPio} Asked to convert physical pin [" << physPin << "] to BCM_GPIO" << std::endl;
+    plotter::log_debug("{physPinToGPio} Asked to convert physical pin [{}] to BCM_GPIO", physPin);
     return physPin;
 }
 
@@ -152,7 +150,7 @@ int physPinToGpio(int physPin)
 // Probably shouldn't use until it's fully understood
 void setPadDrive(int group, int value)
 {
-    std::cout << "{setPadDrive} Setting pad drive of group [" << group << "] to [" << value << ']' << std::endl;
+    plotter::log_debug("{setPadDrive} Setting pad drive of group [{}] to [{}]", group, value);
 }
 
 /********************************/
@@ -162,25 +160,25 @@ void setPadDrive(int group, int value)
 //Milliseconds since program called Setup functions
 unsigned int millis(void)
 {
-    std::cout << "{millis} Seconds since Setup functions called" << std::endl;
+    plotter::log_debug("{millis} Seconds since Setup functions called");
     return 100;
 }
 
 //Returns number of micro seconds since Setup functions called
 unsigned int micros(void)
 {
-    std::cout << "{micros} Micro seconds since Setup functions called" << std::endl;
+    plotter::log_debug("{micros} Micro seconds since Setup functions called");
     return 100000;
 }
 
 //Pause for the given number of milliseconds
 void delay(unsigned int howLong)
 {
-    std::cout << "{delay} Delay for [" << howLong << "] milliseconds." << std::endl;
+    plotter::log_debug("{delay} Delay for [{}] milliseconds.", howLong);
 }
 
 // Pause for the given number of microseconds
 void delayMicroseconds(unsigned int howLong)
 {
-    std::cout << "{delayMicroseconds} Delay for [" << howLong << "] microseconds." << std::endl;
+    plotter::log_debug("{delayMicroseconds} Delay for [{}] microseconds.", howLong);
 }
@@ -0,0 +1,344 @@
+#include "input_shaper.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace plotter{
+    namespace{
+        constexpr std::int64_t unit = 1 << 16;
+        constexpr double pi = 3.14159265358979323846;
+    }
+
+    shaper_impulses design_shaper(const shaper_config& config){
+        shaper_impulses impulses{};
+        if(config.type == shaper_type::none){
+            impulses.delay_us[0] = 0;
+            impulses.weight[0] = static_cast<std::int32_t>(unit);
+            impulses.count = 1;
+            return impulses;
+        }
+        if(!(config.frequency > 0) || config.damping < 0 || config.damping >= 1){
+            throw std::invalid_argument("Shaper needs a positive frequency and a damping ratio below 1");
+        }
+
+        double root = std::sqrt(1 - config.damping * config.damping);
+        double period = 1 / (config.frequency * root);
+        std::array<double, shaper_impulses::max_impulses> amplitude{};
+        std::array<double, shaper_impulses::max_impulses> time{};
+        switch(config.type){
+            case shaper_type::zv:{
+                double k = std::exp(-config.damping * pi / root);
+                amplitude = {{1, k, 0}};
+                time = {{0, 0.5 * period, 0}};
+                impulses.count = 2;
+                break;
+            }
+            case shaper_type::mzv:{
+                double k = std::exp(-0.75 * config.damping * pi / root);
+                double first = 1 - 1 / std::sqrt(2.0);
+                amplitude = {{first, (std::sqrt(2.0) - 1) * k, first * k * k}};
+                time = {{0, 0.375 * period, 0.75 * period}};
+                impulses.count = 3;
+                break;
+            }
+            default:{
+                // Extra insensitive with a 5% vibration tolerance
+                double tolerance = 0.05;
+                double k = std::exp(-config.damping * pi / root);
+                double first = 0.25 * (1 + tolerance);
+                amplitude = {{first, 0.5 * (1 - tolerance) * k, first * k * k}};
+                time = {{0, 0.5 * period, period}};
+                impulses.count = 3;
+                break;
+            }
+        }
+
+        double total = 0;
+        for(std::size_t i = 0; i < impulses.count; i++){
+            total += amplitude[i];
+        }
+        std::int64_t assigned = 0;
+        for(std::size_t i = 0; i < impulses.count; i++){
+            impulses.delay_us[i] = static_cast<std::uint32_t>(std::llround(time[i] * 1e6));
+            impulses.weight[i] = static_cast<std::int32_t>(std::llround(amplitude[i] / total * unit));
+            assigned += impulses.weight[i];
+        }
+        // Any rounding goes to the first impulse so the weights add up to 1
+        impulses.weight[0] += static_cast<std::int32_t>(unit - assigned);
+        return impulses;
+    }
+
+    bool is_shaped(const std::array<shaper_config, max_axes>& shapers, std::size_t axis_count){
+        for(std::size_t axis = 0; axis < axis_count; axis++){
+            if(shapers[axis].type != shaper_type::none){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::size_t shaper_capacity(const std::array<shaper_config, max_axes>& shapers, const motion_config& motion){
+        std::uint64_t longest_us = 0;
+        std::uint64_t event_rate = 0;
+        for(std::size_t axis = 0; axis < motion.axis_count; axis++){
+            shaper_impulses impulses = design_shaper(shapers[axis]);
+            longest_us = std::max<std::uint64_t>(longest_us, impulses.delay_us[impulses.count - 1]);
+            // An event steps at least one axis, so no more events than the
+            // steps of every axis at full speed
+            event_rate += static_cast<std::uint64_t>(
+                    motion.axes[axis].scale.to_steps(position(motion.axes[axis].max_velocity * 1000), rounding::up));
+        }
+        event_rate = event_rate * motion_executor::max_override / 100;
+        // Twice what the delay holds, for the ticks without steps the
+        // executor adds around pen moves
+        return static_cast<std::size_t>(std::max<std::uint64_t>(256, 2 * event_rate * longest_us / 1000000 + 64));
+    }
+
+/******************************************************************************/
+/*                                Input Shaper                                */
+/******************************************************************************/
+    input_shaper::input_shaper(step_tick_source source,
+            const std::array<shaper_config, max_axes>& shapers,
+            std::size_t axis_count,
+            std::size_t capacity)
+        :   m_source(std::move(source)),
+            m_axis_count(axis_count),
+            m_events(),
+            m_first(0),
+            m_head(0),
+            m_cursors(),
+            m_cursor_count(0),
+            m_pen_cursor(),
+            m_exhausted(false),
+            m_input_time(0),
+            m_time_offset(0),
+            m_output_time(0),
+            m_shaped(),
+            m_output(),
+            m_pen(pen_action::none),
+            m_direction_bits(0){
+        if(axis_count > max_axes || capacity < 2){
+            throw std::invalid_argument("Input shaper needs at most max_axes axes and room for two events");
+        }
+        m_events.resize(capacity);
+
+        std::uint32_t longest = 0;
+        for(std::size_t axis = 0; axis < axis_count; axis++){
+            shaper_impulses impulses = design_shaper(shapers[axis]);
+            for(std::size_t i = 0; i < impulses.count; i++){
+                m_cursors[m_cursor_count++] = cursor{0, impulses.delay_us[i], impulses.weight[i], 1u << axis};
+                longest = std::max(longest, impulses.delay_us[i]);
+            }
+        }
+        m_pen_cursor = cursor{0, longest, 0, 0};
+    }
+
+    bool input_shaper::is_relevant(const cursor& position){
+        const input_event& event = event_at(position.index);
+        if(position.axis_bit == 0){
+            return event.pen != pen_action::none;
+        }
+        return (event.step_bits & position.axis_bit) != 0;
+    }
+
+    bool input_shaper::read_input(){
+        if(m_head - m_first == m_events.size()){
+            // Drop the events every cursor has passed
+            std::uint64_t oldest = m_pen_cursor.index;
+            for(std::size_t i = 0; i < m_cursor_count; i++){
+                oldest = std::min(oldest, m_cursors[i].index);
+            }
+            m_first = oldest;
+            if(m_head - m_first == m_events.size()){
+                throw std::runtime_error("Input shaper buffer is too small for the shaper delays");
+            }
+        }
+
+        step_tick tick;
+        if(!m_source(tick)){
+            m_exhausted = true;
+            return false;
+        }
+        m_input_time += tick.interval;
+        if(m_input_time + m_time_offset < m_output_time){
+            // The source ran dry and the delayed steps were output in the
+            // meantime, carry on after them
+            m_time_offset = m_output_time - m_input_time;
+        }
+        event_at(m_head) = input_event{m_input_time + m_time_offset, tick.step_bits, tick.direction_bits, tick.pen};
+        m_head++;
+        if(tick.pen != pen_action::none){
+            m_time_offset += m_pen_cursor.delay;
+        }
+        return true;
+    }
+
+    bool input_shaper::emit(step_tick& tick, std::uint64_t time){
+        std::uint32_t step_bits = 0;
+        for(std::size_t axis = 0; axis < m_axis_count; axis++){
+            std::int64_t target = divide(m_shaped[axis] + unit / 2, unit, rounding::down);
+            std::int64_t difference = target - m_output[axis];
+            if(difference == 0){
+                continue;
+            }
+            step_bits |= 1u << axis;
+            if(difference < 0){
+                m_direction_bits |= 1u << axis;
+                m_output[axis]--;
+            }
+            else{
+                m_direction_bits &= ~(1u << axis);
+                m_output[axis]++;
+            }
+        }
+        if(step_bits == 0 && m_pen == pen_action::none){
+            return false;
+        }
+        tick.interval = static_cast<std::uint32_t>(time - m_output_time);
+        tick.step_bits = step_bits;
+        tick.direction_bits = m_direction_bits;
+        tick.pen = m_pen;
+        m_output_time = time;
+        m_pen = pen_action::none;
+        return true;
+    }
+
+    bool input_shaper::next(step_tick& tick){
+        m_exhausted = false;
+
+        // Several copies landing together can leave more than one step
+        // per axis to output at the same time
+        if(emit(tick, m_output_time)){
+            return true;
+        }
+
+        constexpr std::uint64_t none = std::numeric_limits<std::uint64_t>::max();
+        while(true){
+            std::uint64_t earliest = none;
+            std::uint64_t bound = none;
+            std::uint64_t input_time = m_input_time + m_time_offset;
+            for(std::size_t i = 0; i <= m_cursor_count; i++){
+                cursor& position = i < m_cursor_count ? m_cursors[i] : m_pen_cursor;
+                while(position.index < m_head && !is_relevant(position)){
+                    position.index++;
+                }
+                if(position.index < m_head){
+                    earliest = std::min(earliest, event_at(position.index).time + position.delay);
+                }
+                else{
+                    bound = std::min(bound, input_time + position.delay);
+                }
+            }
+
+            // An event not read yet could still come first
+            if(!m_exhausted && bound <= earliest){
+                read_input();
+                continue;
+            }
+            if(earliest == none){
+                return false;
+            }
+
+            for(std::size_t i = 0; i <= m_cursor_count; i++){
+                cursor& position = i < m_cursor_count ? m_cursors[i] : m_pen_cursor;
+                while(position.index < m_head && is_relevant(position)
+                        && event_at(position.index).time + position.delay == earliest){
+                    const input_event& event = event_at(position.index);
+                    if(position.axis_bit == 0){
+                        m_pen = event.pen;
+                    }
+                    else{
+                        std::size_t axis = static_cast<std::size_t>(__builtin_ctz(position.axis_bit));
+                        m_shaped[axis] += (event.direction_bits & position.axis_bit) ? -position.weight : position.weight;
+                    }
+                    position.index++;
+                    while(position.index < m_head && !is_relevant(position)){
+                        position.index++;
+                    }
+                }
+            }
+
+            if(emit(tick, earliest)){
+                return true;
+            }
+        }
+    }
+
+/******************************************************************************/
+/*                              Resonance Sweep                               */
+/******************************************************************************/
+    resonance_sweep::resonance_sweep(std::size_t axis, std::size_t advance_axis,
+            std::int64_t amplitude_steps,
+            double start_frequency, double end_frequency,
+            double duration_s, std::int64_t advance_steps)
+        :   m_axis(axis),
+            m_advance_axis(advance_axis),
+            m_amplitude(static_cast<double>(amplitude_steps)),
+            m_start_frequency(start_frequency),
+            m_end_frequency(end_frequency),
+            m_duration(duration_s),
+            m_advance_steps(advance_steps),
+            m_period(50),
+            m_time(0),
+            m_waiting(0),
+            m_position(),
+            m_target(){
+        if(axis >= max_axes || advance_axis >= max_axes || axis == advance_axis){
+            throw std::invalid_argument("Resonance sweep needs two different axes");
+        }
+        if(!(start_frequency > 0) || !(end_frequency > 0) || !(duration_s > 0)){
+            throw std::invalid_argument("Resonance sweep needs positive frequencies and duration");
+        }
+    }
+
+    bool resonance_sweep::next(step_tick& tick){
+        std::uint64_t duration = static_cast<std::uint64_t>(m_duration * 1e6);
+        while(true){
+            std::uint32_t step_bits = 0;
+            std::uint32_t direction_bits = 0;
+            std::array<std::size_t, 2> axes{{m_axis, m_advance_axis}};
+            for(std::size_t i = 0; i < 2; i++){
+                if(m_target[i] == m_position[i]){
+                    continue;
+                }
+                step_bits |= 1u << axes[i];
+                if(m_target[i] < m_position[i]){
+                    direction_bits |= 1u << axes[i];
+                    m_position[i]--;
+                }
+                else{
+                    m_position[i]++;
+                }
+            }
+            if(step_bits != 0){
+                tick.interval = m_waiting;
+                tick.step_bits = step_bits;
+                tick.direction_bits = direction_bits;
+                tick.pen = pen_action::none;
+                m_waiting = 0;
+                return true;
+            }
+            if(m_time >= duration){
+                return false;
+            }
+
+            m_time = std::min(duration, m_time + m_period);
+            m_waiting += m_period;
+            double seconds = static_cast<double>(m_time) / 1e6;
+            double phase = m_start_frequency * seconds
+                + (m_end_frequency - m_start_frequency) * seconds * seconds / (2 * m_duration);
+            m_target[0] = std::llround(m_amplitude * std::sin(2 * pi * phase));
+            m_target[1] = std::llround(static_cast<double>(m_advance_steps) * seconds / m_duration);
+            if(m_time == duration){
+                m_target[0] = 0;
+            }
+        }
+    }
+
+    double resonance_sweep::frequency_at(std::int64_t advance_steps) const{
+        double fraction = static_cast<double>(advance_steps) / static_cast<double>(m_advance_steps);
+        return m_start_frequency + (m_end_frequency - m_start_frequency) * fraction;
+    }
+}
@@ -0,0 +1,242 @@
+#ifndef INPUT_SHAPER_HPP
+#define INPUT_SHAPER_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "motion.hpp"
+
+namespace plotter{
+
+    enum class shaper_type{
+        none,
+        zv,         // Zero vibration, two impulses
+        mzv,        // Modified ZV, three impulses, more robust to error
+        ei          // Extra insensitive, three impulses, most robust
+    };
+
+    /**
+     * Shaper for a single axis, tuned to the frame's resonance
+     */
+    struct shaper_config{
+        shaper_type type = shaper_type::none;
+
+        /**
+         * Resonance frequency in hertz
+         */
+        double frequency = 40;
+
+        /**
+         * Damping ratio of the resonance
+         */
+        double damping = 0.1;
+    };
+
+    /**
+     * Impulses of a shaper. Weights are Q16 and add up to exactly 1, so a
+     * shaped axis always ends on the same step as the unshaped one.
+     */
+    struct shaper_impulses{
+        static constexpr std::size_t max_impulses = 3;
+
+        std::array<std::uint32_t, max_impulses> delay_us;
+        std::array<std::int32_t, max_impulses> weight;
+        std::size_t count;
+    };
+
+    /**
+     * Compute the impulses of a shaper
+     *
+     * @param config: shaper type and the resonance it cancels
+     * @return: impulses, a single unit impulse for shaper_type::none
+     */
+    shaper_impulses design_shaper(const shaper_config& config);
+
+    /**
+     * @param shapers: shaper of each axis
+     * @param axis_count: number of axes in use
+     * @return: true if any axis in use is shaped
+     */
+    bool is_shaped(const std::array<shaper_config, max_axes>& shapers, std::size_t axis_count);
+
+    /**
+     * Input events an input_shaper needs to hold for a machine
+     *
+     * @param shapers: shaper of each axis
+     * @param motion: axes in use and their fastest speeds
+     * @return: capacity covering the longest shaper at the highest step
+     *          rate the executor produces, feed override included
+     */
+    std::size_t shaper_capacity(const std::array<shaper_config, max_axes>& shapers, const motion_config& motion);
+
+    /**
+     * Supplies step events, returns false when there are none left
+     */
+    using step_tick_source = std::function<bool(step_tick&)>;
+
+    /**
+     * Convolves the step stream of each axis with that axis' shaper. Every
+     * input step is split into weighted copies at the shaper's delays; the
+     * weights are added up per axis in fixed point and a step is output
+     * whenever the rounded position changes. The copies of all axes are
+     * merged back into one stream in time order.
+     *
+     * Pen commands are delayed by the longest shaper so the shaped move
+     * has finished before the pen moves. Everything after a pen command
+     * is delayed with it, so the pen timing set by the executor is kept.
+     *
+     * A source that runs dry, like the executor of an idle controller, is
+     * polled again on the next call; what it produces then follows the
+     * output so far.
+     */
+    class input_shaper{
+        private:
+            struct input_event{
+                std::uint64_t time;
+                std::uint32_t step_bits;
+                std::uint32_t direction_bits;
+                pen_action pen;
+            };
+
+            /**
+             * Position in the input of one impulse of one axis
+             */
+            struct cursor{
+                std::uint64_t index;
+                std::uint32_t delay;
+                std::int32_t weight;
+                std::uint32_t axis_bit;
+            };
+
+            step_tick_source m_source;
+            std::size_t m_axis_count;
+
+            /**
+             * Input events waiting for their last delayed copy, addressed
+             * by an ever increasing index
+             */
+            std::vector<input_event> m_events;
+            std::uint64_t m_first;
+            std::uint64_t m_head;
+
+            std::array<cursor, max_axes * shaper_impulses::max_impulses> m_cursors;
+            std::size_t m_cursor_count;
+            cursor m_pen_cursor;
+
+            bool m_exhausted;
+            std::uint64_t m_input_time;
+            std::uint64_t m_time_offset;
+            std::uint64_t m_output_time;
+
+            /**
+             * Shaped position of each axis in Q16 steps, and the steps
+             * output so far
+             */
+            std::array<std::int64_t, max_axes> m_shaped;
+            std::array<std::int64_t, max_axes> m_output;
+
+            /**
+             * Pen command waiting to be output
+             */
+            pen_action m_pen;
+
+            std::uint32_t m_direction_bits;
+
+            input_event& event_at(std::uint64_t index){return m_events[index % m_events.size()];}
+            bool read_input();
+            bool is_relevant(const cursor& position);
+            bool emit(step_tick& tick, std::uint64_t time);
+
+        public:
+            /**
+             * @param source: unshaped step events, i.e. from a motion_executor
+             * @param shapers: shaper of each axis
+             * @param axis_count: number of axes in use
+             * @param capacity: input events that can be held, must cover the
+             *                  longest shaper at the highest step rate
+             */
+            input_shaper(step_tick_source source,
+                    const std::array<shaper_config, max_axes>& shapers,
+                    std::size_t axis_count,
+                    std::size_t capacity=4096);
+
+            /**
+             * Produce the next shaped step event
+             *
+             * @param tick: receives the event
+             * @return: false once the input is exhausted and every delayed
+             *          step has been output
+             */
+            bool next(step_tick& tick);
+
+            /**
+             * @param axis: axis to query
+             * @return: steps output on the axis since the shaper was built,
+             *          which trail the source's by up to the longest delay
+             */
+            std::int64_t output_steps(std::size_t axis) const{return m_output[axis];}
+    };
+
+    /**
+     * Test pattern for finding a resonance. One axis oscillates with a
+     * fixed amplitude while its frequency sweeps linearly, and a second
+     * axis advances steadily so that, drawn with the pen down, distance
+     * along the second axis maps to frequency. The frame resonates where
+     * the drawn amplitude peaks; frequency_at() turns that distance back
+     * into hertz.
+     */
+    class resonance_sweep{
+        private:
+            std::size_t m_axis;
+            std::size_t m_advance_axis;
+            double m_amplitude;
+            double m_start_frequency;
+            double m_end_frequency;
+            double m_duration;
+            std::int64_t m_advance_steps;
+
+            /**
+             * Sample period of the generator in microseconds
+             */
+            std::uint32_t m_period;
+            std::uint64_t m_time;
+            std::uint32_t m_waiting;
+            std::array<std::int64_t, 2> m_position;
+            std::array<std::int64_t, 2> m_target;
+
+        public:
+            /**
+             * @param axis: axis that oscillates
+             * @param advance_axis: axis that advances with frequency
+             * @param amplitude_steps: peak offset of the oscillation
+             * @param start_frequency: frequency at the start in hertz
+             * @param end_frequency: frequency at the end in hertz
+             * @param duration_s: length of the sweep in seconds
+             * @param advance_steps: distance the advance axis covers
+             */
+            resonance_sweep(std::size_t axis, std::size_t advance_axis,
+                    std::int64_t amplitude_steps,
+                    double start_frequency, double end_frequency,
+                    double duration_s, std::int64_t advance_steps);
+
+            /**
+             * Produce the next step event of the pattern
+             *
+             * @param tick: receives the event
+             * @return: false once the sweep is complete
+             */
+            bool next(step_tick& tick);
+
+            /**
+             * @param advance_steps: steps along the advance axis
+             * @return: oscillation frequency at that point of the pattern
+             */
+            double frequency_at(std::int64_t advance_steps) const;
+    };
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef JOB_ARENA_HPP
+#define JOB_ARENA_HPP
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+namespace plotter{
+
+    /**
+     * Memory for the bookkeeping of one job, taken from the heap in a
+     * single allocation before the job starts and handed out by bumping a
+     * pointer. Nothing is returned to the arena until it is gone, so the
+     * stages of a running job never touch the allocator.
+     */
+    class job_arena{
+        private:
+            std::unique_ptr<unsigned char[]> m_memory;
+            std::size_t m_capacity;
+            std::size_t m_used;
+
+        public:
+            /**
+             * @param capacity: bytes the job may use
+             */
+            explicit job_arena(std::size_t capacity)
+                :   m_memory(new unsigned char[capacity]),
+                    m_capacity(capacity),
+                    m_used(0){}
+
+            job_arena(const job_arena&) = delete;
+            job_arena& operator=(const job_arena&) = delete;
+
+            /**
+             * Bytes needed for count items of T, including alignment
+             */
+            template<class T>
+            static constexpr std::size_t size_of(std::size_t count){
+                return count * sizeof(T) + alignof(T) - 1;
+            }
+
+            /**
+             * Default construct count items of T
+             *
+             * @param count: number of items
+             * @return: the first item, valid as long as the arena
+             * @throw: bad_alloc if the arena is too small
+             */
+            template<class T>
+            T* allocate(std::size_t count){
+                static_assert(std::is_trivially_destructible<T>::value, "Arena items are never destroyed");
+                std::size_t start = (m_used + alignof(T) - 1) / alignof(T) * alignof(T);
+                if(start > m_capacity || count > (m_capacity - start) / sizeof(T)){
+                    throw std::bad_alloc();
+                }
+                m_used = start + count * sizeof(T);
+                T* items = reinterpret_cast<T*>(m_memory.get() + start);
+                for(std::size_t i = 0; i < count; i++){
+                    new(items + i) T();
+                }
+                return items;
+            }
+
+            std::size_t capacity() const{return m_capacity;}
+            std::size_t used() const{return m_used;}
+    };
+
+    /**
+     * First in, first out ring of a fixed number of items kept in a
+     * job_arena. Not synchronized.
+     */
+    template<class T>
+    class arena_ring{
+        private:
+            T* m_items;
+            std::size_t m_capacity;
+            std::size_t m_first;
+            std::size_t m_count;
+
+        public:
+            /**
+             * @param arena: arena to take the items from
+             * @param capacity: most items held at once
+             */
+            arena_ring(job_arena& arena, std::size_t capacity)
+                :   m_items(arena.allocate<T>(capacity)),
+                    m_capacity(capacity),
+                    m_first(0),
+                    m_count(0){
+                if(capacity == 0){
+                    throw std::invalid_argument("Ring capacity must be positive");
+                }
+            }
+
+            /**
+             * @param item: item to add
+             * @return: false if the ring is full and the item was dropped
+             */
+            bool push(const T& item){
+                if(m_count == m_capacity){
+                    return false;
+                }
+                m_items[(m_first + m_count) % m_capacity] = item;
+                m_count++;
+                return true;
+            }
+
+            /**
+             * @param item: receives the oldest item
+             * @return: false if the ring is empty
+             */
+            bool pop(T& item){
+                if(m_count == 0){
+                    return false;
+                }
+                item = m_items[m_first];
+                m_first = (m_first + 1) % m_capacity;
+                m_count--;
+                return true;
+            }
+
+            std::size_t size() const{return m_count;}
+            bool empty() const{return m_count == 0;}
+    };
+}
+
+#endif
@@ -0,0 +1,381 @@
+#include "job_batch.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+namespace plotter{
+    namespace{
+        /**
+         * Commands from a pen lower to the next lift
+         */
+        struct stroke{
+            std::size_t first;      // Index of the first command in the job's command list
+            std::size_t count;
+            std::array<position::rep, max_axes> start;
+            std::array<position::rep, max_axes> end;
+            std::uint32_t lower_line;
+            std::uint32_t lift_line;
+        };
+
+        /**
+         * One end of a stroke, as filed in the grid
+         */
+        struct stroke_end{
+            std::size_t stroke;
+            bool reversed;      // The end, drawing the stroke backwards
+        };
+
+        /**
+         * Uniform grid over the ends of the strokes of one group, searched
+         * in rings of cells outward from a point. Strokes that are taken
+         * stay filed until a search comes across them, and the grid is
+         * rebuilt over the strokes left once most of them are gone.
+         */
+        class stroke_grid{
+            private:
+                const std::vector<stroke>& m_strokes;
+                std::vector<bool>& m_taken;
+                bool m_reverse;
+
+                std::vector<std::size_t> m_group;
+                std::size_t m_left;
+                std::size_t m_filed;
+
+                double m_min_x;
+                double m_min_y;
+                double m_cell_size;
+                std::size_t m_side;
+                std::vector<std::vector<stroke_end>> m_cells;
+
+                std::size_t cell_of(double value, double min) const{
+                    double cell = std::floor((value - min) / m_cell_size);
+                    return static_cast<std::size_t>(std::min<double>(std::max(0.0, cell), static_cast<double>(m_side - 1)));
+                }
+
+                void file(std::size_t index, bool reversed){
+                    const auto& point = reversed ? m_strokes[index].end : m_strokes[index].start;
+                    std::size_t x = cell_of(static_cast<double>(point[0]), m_min_x);
+                    std::size_t y = cell_of(static_cast<double>(point[1]), m_min_y);
+                    m_cells[y * m_side + x].push_back(stroke_end{index, reversed});
+                }
+
+                void rebuild(){
+                    m_group.erase(std::remove_if(m_group.begin(), m_group.end(),
+                                [this](std::size_t index){return m_taken[index];}), m_group.end());
+                    m_filed = m_group.size();
+
+                    double max_x = -std::numeric_limits<double>::infinity();
+                    double max_y = max_x;
+                    m_min_x = std::numeric_limits<double>::infinity();
+                    m_min_y = m_min_x;
+                    for(std::size_t index : m_group){
+                        for(const auto* point : {&m_strokes[index].start, &m_strokes[index].end}){
+                            m_min_x = std::min(m_min_x, static_cast<double>((*point)[0]));
+                            m_min_y = std::min(m_min_y, static_cast<double>((*point)[1]));
+                            max_x = std::max(max_x, static_cast<double>((*point)[0]));
+                            max_y = std::max(max_y, static_cast<double>((*point)[1]));
+                        }
+                    }
+                    // About one stroke per cell
+                    m_side = std::max<std::size_t>(1, std::min<std::size_t>(1024,
+                                static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(m_group.size()))))));
+                    m_cell_size = std::max(1.0, std::max(max_x - m_min_x, max_y - m_min_y) / static_cast<double>(m_side));
+                    m_cells.assign(m_side * m_side, {});
+                    for(std::size_t index : m_group){
+                        file(index, false);
+                        if(m_reverse){
+                            file(index, true);
+                        }
+                    }
+                }
+
+            public:
+                stroke_grid(const std::vector<stroke>& strokes, std::vector<bool>& taken, std::vector<std::size_t> group, bool reverse)
+                    :   m_strokes(strokes),
+                        m_taken(taken),
+                        m_reverse(reverse),
+                        m_group(std::move(group)),
+                        m_left(m_group.size()),
+                        m_filed(0),
+                        m_min_x(0),
+                        m_min_y(0),
+                        m_cell_size(1),
+                        m_side(1),
+                        m_cells(){
+                    rebuild();
+                }
+
+                bool empty() const{return m_left == 0;}
+
+                /**
+                 * Take the stroke with an end nearest to a point
+                 *
+                 * @param x, y: the point
+                 * @return: the stroke and which end to start from
+                 */
+                stroke_end take_nearest(position::rep x, position::rep y){
+                    if(m_left * 4 < m_filed){
+                        rebuild();
+                    }
+                    double point_x = static_cast<double>(x);
+                    double point_y = static_cast<double>(y);
+                    std::size_t cell_x = cell_of(point_x, m_min_x);
+                    std::size_t cell_y = cell_of(point_y, m_min_y);
+
+                    stroke_end best{0, false};
+                    double best_distance = std::numeric_limits<double>::infinity();
+                    for(std::size_t ring = 0; ring < m_side; ring++){
+                        // Anything in this ring or beyond is at least this far
+                        double bound = ring == 0 ? 0 : (static_cast<double>(ring) - 1) * m_cell_size;
+                        if(bound * bound > best_distance){
+                            break;
+                        }
+                        std::size_t low_x = cell_x >= ring ? cell_x - ring : 0;
+                        std::size_t low_y = cell_y >= ring ? cell_y - ring : 0;
+                        std::size_t high_x = std::min(m_side - 1, cell_x + ring);
+                        std::size_t high_y = std::min(m_side - 1, cell_y + ring);
+                        for(std::size_t row = low_y; row <= high_y; row++){
+                            bool edge_row = row + ring == cell_y || row == cell_y + ring;
+                            std::size_t step = edge_row ? 1 : std::max<std::size_t>(1, high_x - low_x);
+                            for(std::size_t column = low_x; column <= high_x; column += step){
+                                if(!edge_row && column + ring != cell_x && column != cell_x + ring){
+                                    continue;
+                                }
+                                std::vector<stroke_end>& cell = m_cells[row * m_side + column];
+                                for(std::size_t i = 0; i < cell.size();){
+                                    if(m_taken[cell[i].stroke]){
+                                        cell[i] = cell.back();
+                                        cell.pop_back();
+                                        continue;
+                                    }
+                                    const stroke& candidate = m_strokes[cell[i].stroke];
+                                    const auto& end = cell[i].reversed ? candidate.end : candidate.start;
+                                    double dx = static_cast<double>(end[0]) - point_x;
+                                    double dy = static_cast<double>(end[1]) - point_y;
+                                    double distance = dx * dx + dy * dy;
+                                    if(distance < best_distance){
+                                        best_distance = distance;
+                                        best = cell[i];
+                                    }
+                                    i++;
+                                }
+                            }
+                        }
+                    }
+                    m_taken[best.stroke] = true;
+                    m_left--;
+                    return best;
+                }
+        };
+
+        /**
+         * The job split into strokes, handed out again group by group
+         */
+        class batch_state{
+            private:
+                command_source m_source;
+                batch_config m_config;
+                bool m_loaded;
+
+                std::vector<move_command> m_commands;
+                std::vector<stroke> m_strokes;
+                std::vector<std::uint8_t> m_tools;
+
+                /**
+                 * Strokes in drawing order and the tool command, if any,
+                 * before each
+                 */
+                std::vector<stroke_end> m_order;
+                std::vector<bool> m_swap_before;
+
+                std::size_t m_next;
+                std::vector<move_command> m_pending;
+                std::size_t m_pending_next;
+
+                void load();
+                void order();
+                void expand(std::size_t position);
+
+            public:
+                batch_state(command_source source, const batch_config& config)
+                    :   m_source(std::move(source)),
+                        m_config(config),
+                        m_loaded(false),
+                        m_commands(),
+                        m_strokes(),
+                        m_tools(),
+                        m_order(),
+                        m_swap_before(),
+                        m_next(0),
+                        m_pending(),
+                        m_pending_next(0){}
+
+                bool next(move_command& command){
+                    if(!m_loaded){
+                        load();
+                        order();
+                        m_loaded = true;
+                    }
+                    while(m_pending_next == m_pending.size()){
+                        if(m_next == m_order.size()){
+                            return false;
+                        }
+                        expand(m_next++);
+                    }
+                    command = m_pending[m_pending_next++];
+                    return true;
+                }
+        };
+
+        void batch_state::load(){
+            std::array<position::rep, max_axes> at{};
+            std::uint8_t tool = 0;
+            bool pen_down = false;
+
+            auto end_stroke = [&](std::uint32_t line){
+                if(pen_down && !m_strokes.empty()){
+                    m_strokes.back().end = at;
+                    m_strokes.back().lift_line = line;
+                    if(m_strokes.back().count == 0){
+                        // Lowered and lifted in place, nothing to draw
+                        m_strokes.pop_back();
+                        m_tools.pop_back();
+                    }
+                }
+                pen_down = false;
+            };
+
+            move_command command;
+            while(m_source(command)){
+                switch(command.type){
+                    case move_command::kind::tool:{
+                        // A pen swapped while down splits the stroke, the
+                        // rest of it is drawn with the new pen
+                        bool was_down = pen_down;
+                        end_stroke(command.line);
+                        tool = command.tool;
+                        if(was_down){
+                            pen_down = true;
+                            m_strokes.push_back(stroke{m_commands.size(), 0, at, at, command.line, command.line});
+                            m_tools.push_back(tool);
+                        }
+                        break;
+                    }
+                    case move_command::kind::pen:
+                        if(!command.pen_down){
+                            end_stroke(command.line);
+                        }
+                        else if(!pen_down){
+                            pen_down = true;
+                            m_strokes.push_back(stroke{m_commands.size(), 0, at, at, command.line, command.line});
+                            m_tools.push_back(tool);
+                        }
+                        break;
+                    case move_command::kind::move:
+                    case move_command::kind::arc:
+                        if(pen_down){
+                            m_commands.push_back(command);
+                            m_strokes.back().count++;
+                        }
+                        at = command.target;
+                        break;
+                }
+            }
+            end_stroke(m_strokes.empty() ? 0 : m_strokes.back().lift_line);
+        }
+
+        void batch_state::order(){
+            // Pens in the order their groups are drawn
+            std::vector<std::uint8_t> pens = m_config.group_order;
+            pens.push_back(0);
+            for(std::uint8_t tool : m_tools){
+                pens.push_back(tool);
+            }
+            std::vector<bool> seen(256, false);
+            std::vector<std::vector<std::size_t>> groups(256);
+            for(std::size_t index = 0; index < m_strokes.size(); index++){
+                groups[m_tools[index]].push_back(index);
+            }
+
+            std::vector<bool> taken(m_strokes.size(), false);
+            m_order.reserve(m_strokes.size());
+            m_swap_before.reserve(m_strokes.size());
+            std::uint8_t fitted = 0;
+            std::array<position::rep, max_axes> at{};
+            for(std::uint8_t pen : pens){
+                if(seen[pen] || groups[pen].empty()){
+                    continue;
+                }
+                seen[pen] = true;
+                stroke_grid grid(m_strokes, taken, std::move(groups[pen]), m_config.reverse_strokes);
+                bool swap = pen != fitted;
+                fitted = pen;
+                while(!grid.empty()){
+                    stroke_end next = grid.take_nearest(at[0], at[1]);
+                    m_order.push_back(next);
+                    m_swap_before.push_back(swap);
+                    swap = false;
+                    const stroke& taken_stroke = m_strokes[next.stroke];
+                    at = next.reversed ? taken_stroke.start : taken_stroke.end;
+                }
+            }
+        }
+
+        void batch_state::expand(std::size_t position){
+            m_pending.clear();
+            m_pending_next = 0;
+            stroke_end next = m_order[position];
+            const stroke& drawn = m_strokes[next.stroke];
+
+            if(m_swap_before[position]){
+                move_command swap{};
+                swap.type = move_command::kind::tool;
+                swap.tool = m_tools[next.stroke];
+                swap.line = drawn.lower_line;
+                m_pending.push_back(swap);
+            }
+
+            move_command travel{};
+            travel.type = move_command::kind::move;
+            travel.line = next.reversed ? drawn.lift_line : drawn.lower_line;
+            travel.target = next.reversed ? drawn.end : drawn.start;
+            travel.feed_rate = m_config.travel_feed;
+            m_pending.push_back(travel);
+
+            move_command pen{};
+            pen.type = move_command::kind::pen;
+            pen.pen_down = true;
+            pen.line = travel.line;
+            m_pending.push_back(pen);
+
+            if(!next.reversed){
+                m_pending.insert(m_pending.end(), m_commands.begin() + static_cast<std::ptrdiff_t>(drawn.first),
+                        m_commands.begin() + static_cast<std::ptrdiff_t>(drawn.first + drawn.count));
+            }
+            else{
+                // Each move goes back to where the one before it started,
+                // arcs the other way around the same center
+                for(std::size_t i = drawn.count; i-- > 0;){
+                    move_command command = m_commands[drawn.first + i];
+                    command.target = i == 0 ? drawn.start : m_commands[drawn.first + i - 1].target;
+                    command.clockwise = !command.clockwise;
+                    m_pending.push_back(command);
+                }
+            }
+
+            pen.pen_down = false;
+            pen.line = next.reversed ? drawn.lower_line : drawn.lift_line;
+            m_pending.push_back(pen);
+        }
+    }
+
+    command_source batch_by_tool(command_source source, const batch_config& config){
+        auto state = std::make_shared<batch_state>(std::move(source), config);
+        return [state](move_command& command){
+            return state->next(command);
+        };
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef JOB_BATCH_HPP
+#define JOB_BATCH_HPP
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "job_import.hpp"
+
+namespace plotter{
+
+    struct batch_config{
+        /**
+         * Speed of the travel moves between strokes, in micrometers per
+         * second
+         */
+        std::int64_t travel_feed = 60000;
+
+        /**
+         * Pens to draw first, in order. The pen fitted at the start, pen 0,
+         * follows and then the other pens in the order the job first uses
+         * them.
+         */
+        std::vector<std::uint8_t> group_order;
+
+        /**
+         * Whether a stroke may be drawn from its end back to its start when
+         * that end is closer
+         */
+        bool reverse_strokes = true;
+    };
+
+    /**
+     * Reorders a job so each pen draws all of its strokes in one go, with
+     * one tool command before each group. Within a group the next stroke is
+     * always the one whose start, or end if it can be reversed, is nearest
+     * to where the last stroke finished, found through a uniform grid over
+     * the stroke ends.
+     *
+     * A stroke runs from a pen lower to the next lift. The travel moves of
+     * the job are dropped and a travel is made to the start of every
+     * stroke. The whole job is read, and held, on the first call.
+     *
+     * @param source: job commands
+     * @param config: pen order and travel speed
+     * @return: the reordered commands
+     */
+    command_source batch_by_tool(command_source source, const batch_config& config=batch_config());
+}
+
+#endif
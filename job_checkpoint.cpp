@@ -0,0 +1,190 @@
+#include "job_checkpoint.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "logging.hpp"
+
+namespace plotter{
+    namespace{
+        const char checkpoint_magic[4] = {'P', 'L', 'C', 'K'};
+
+        constexpr std::size_t checkpoint_size = sizeof(checkpoint_magic) + 4 + 8 + 8 + 4 + (8 + 8 + 4) * max_axes;
+
+        std::system_error os_error(const std::string& what){
+            return std::system_error(errno, std::generic_category(), what);
+        }
+
+        void put(std::string& out, std::uint64_t value, int bytes){
+            for(int i = 0; i < bytes; i++){
+                out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        std::uint64_t get(const std::string& in, std::size_t& at, int bytes){
+            std::uint64_t value = 0;
+            for(int i = 0; i < bytes; i++){
+                value |= static_cast<std::uint64_t>(static_cast<unsigned char>(in[at++])) << (8 * i);
+            }
+            return value;
+        }
+    }
+
+/******************************************************************************/
+/*                                    File                                    */
+/******************************************************************************/
+    void save_checkpoint(const std::string& path, const job_checkpoint& checkpoint){
+        std::string data(checkpoint_magic, sizeof(checkpoint_magic));
+        data.reserve(checkpoint_size);
+        put(data, job_checkpoint::version, 4);
+        put(data, checkpoint.offset, 8);
+        put(data, checkpoint.time_us, 8);
+        put(data, checkpoint.tool, 4);
+        for(position value : checkpoint.target){
+            put(data, static_cast<std::uint64_t>(value.count()), 8);
+        }
+        for(std::int64_t value : checkpoint.position){
+            put(data, static_cast<std::uint64_t>(value), 8);
+        }
+        for(std::uint32_t value : checkpoint.coil_phase){
+            put(data, value, 4);
+        }
+
+        std::string temporary = path + ".tmp";
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0){
+            throw os_error("Unable to open checkpoint " + temporary);
+        }
+        std::size_t written = 0;
+        while(written < data.size()){
+            ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+            if(result < 0 && errno == EINTR){
+                continue;
+            }
+            if(result < 0){
+                std::system_error error = os_error("Unable to write checkpoint " + temporary);
+                ::close(fd);
+                throw error;
+            }
+            written += static_cast<std::size_t>(result);
+        }
+        // On disk before it replaces the last one, or a power cut could
+        // leave neither
+        if(::fsync(fd) != 0){
+            std::system_error error = os_error("Unable to sync checkpoint " + temporary);
+            ::close(fd);
+            throw error;
+        }
+        ::close(fd);
+        if(::rename(temporary.c_str(), path.c_str()) != 0){
+            throw os_error("Unable to replace checkpoint " + path);
+        }
+    }
+
+    bool load_checkpoint(const std::string& path, job_checkpoint& checkpoint){
+        std::ifstream in(path, std::ios::binary);
+        if(!in){
+            return false;
+        }
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if(data.size() != checkpoint_size || data.compare(0, sizeof(checkpoint_magic), checkpoint_magic, sizeof(checkpoint_magic)) != 0){
+            throw std::runtime_error("Not a job checkpoint: " + path);
+        }
+        std::size_t at = sizeof(checkpoint_magic);
+        if(get(data, at, 4) != job_checkpoint::version){
+            throw std::runtime_error("Unsupported checkpoint version: " + path);
+        }
+        checkpoint.offset = get(data, at, 8);
+        checkpoint.time_us = get(data, at, 8);
+        checkpoint.tool = static_cast<std::uint8_t>(get(data, at, 4));
+        for(position& value : checkpoint.target){
+            value = position(static_cast<position::rep>(get(data, at, 8)));
+        }
+        for(std::int64_t& value : checkpoint.position){
+            value = static_cast<std::int64_t>(get(data, at, 8));
+        }
+        for(std::uint32_t& value : checkpoint.coil_phase){
+            value = static_cast<std::uint32_t>(get(data, at, 4));
+        }
+        return true;
+    }
+
+/******************************************************************************/
+/*                                   Writer                                   */
+/******************************************************************************/
+    checkpoint_writer::checkpoint_writer(std::string path)
+        :   m_path(std::move(path)),
+            m_mutex(),
+            m_wake(),
+            m_pending(),
+            m_has_pending(false),
+            m_remove(false),
+            m_stop(false),
+            m_thread(){
+        m_thread = std::thread(&checkpoint_writer::run, this);
+    }
+
+    checkpoint_writer::~checkpoint_writer(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+
+    void checkpoint_writer::post(const job_checkpoint& checkpoint){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending = checkpoint;
+            m_has_pending = true;
+            m_remove = false;
+        }
+        m_wake.notify_one();
+    }
+
+    void checkpoint_writer::remove(){
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_has_pending = false;
+            m_remove = true;
+        }
+        m_wake.notify_one();
+    }
+
+    void checkpoint_writer::run(){
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(true){
+            m_wake.wait(lock, [this]{return m_has_pending || m_remove || m_stop;});
+            if(m_has_pending){
+                job_checkpoint checkpoint = m_pending;
+                m_has_pending = false;
+                lock.unlock();
+                try{
+                    save_checkpoint(m_path, checkpoint);
+                }
+                catch(const std::system_error& error){
+                    log_warning("Unable to save a checkpoint, error {}", error.code().value());
+                }
+                lock.lock();
+            }
+            else if(m_remove){
+                m_remove = false;
+                lock.unlock();
+                std::remove(m_path.c_str());
+                lock.lock();
+            }
+            else{
+                return;
+            }
+        }
+    }
+}
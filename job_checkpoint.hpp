@@ -0,0 +1,163 @@
+#ifndef JOB_CHECKPOINT_HPP
+#define JOB_CHECKPOINT_HPP
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "motion.hpp"
+
+namespace plotter{
+
+    /**
+     * Where a job stood when the machine last stopped with the pen up, for
+     * carrying on from there after an interruption
+     */
+    struct job_checkpoint{
+        static constexpr std::uint32_t version = 1;
+
+        /**
+         * Commands of the optimized job executed, up to and including the
+         * lift the machine stopped at
+         */
+        std::uint64_t offset;
+
+        /**
+         * Microseconds of the job executed
+         */
+        std::uint64_t time_us;
+
+        /**
+         * Pen fitted
+         */
+        std::uint8_t tool;
+
+        /**
+         * End of the last move, before the kinematics, see
+         * motion_planner::target()
+         */
+        axis_positions target;
+
+        /**
+         * Steps executed on each axis
+         */
+        axis_steps position;
+
+        /**
+         * Index of the coil state of each axis, see stepper_coil::state_index()
+         */
+        std::array<std::uint32_t, max_axes> coil_phase;
+    };
+
+    /**
+     * Write a checkpoint so that it survives a power cut. The file is
+     * written and synced under a temporary name, then renamed over the last
+     * one, so there is always one whole checkpoint on disk.
+     *
+     * File layout, little endian:
+     *      "PLCK" | version (u32) | offset (u64) | time (u64) | tool (u32) |
+     *      target (u64 per axis) | position (u64 per axis) | coil phase
+     *      (u32 per axis)
+     *
+     * @param path: file to write
+     * @param checkpoint: checkpoint to save
+     * @throw: system_error if the file can't be written
+     */
+    void save_checkpoint(const std::string& path, const job_checkpoint& checkpoint);
+
+    /**
+     * @param path: file to read
+     * @param checkpoint: receives the checkpoint
+     * @return: false if there is no checkpoint
+     * @throw: runtime_error if the file isn't a checkpoint
+     */
+    bool load_checkpoint(const std::string& path, job_checkpoint& checkpoint);
+
+    /**
+     * Saves checkpoints on its own thread, so the thread that steps the
+     * machine only ever copies one. Only the latest checkpoint posted is
+     * written; a failed write is logged and the job carries on.
+     */
+    class checkpoint_writer{
+        private:
+            std::string m_path;
+
+            std::mutex m_mutex;
+            std::condition_variable m_wake;
+            job_checkpoint m_pending;
+            bool m_has_pending;
+            bool m_remove;
+            bool m_stop;
+
+            std::thread m_thread;
+
+            void run();
+
+        public:
+            /**
+             * @param path: file the checkpoints are saved to
+             */
+            explicit checkpoint_writer(std::string path);
+
+            checkpoint_writer(const checkpoint_writer&) = delete;
+            checkpoint_writer& operator=(const checkpoint_writer&) = delete;
+
+            /**
+             * Writes the last checkpoint posted before returning
+             */
+            ~checkpoint_writer();
+
+            /**
+             * Save a checkpoint, replacing any not yet written
+             *
+             * @param checkpoint: checkpoint to save
+             */
+            void post(const job_checkpoint& checkpoint);
+
+            /**
+             * Delete the checkpoint once the job is done, dropping any not
+             * yet written
+             */
+            void remove();
+    };
+
+    /**
+     * Add the coil phase of each axis to a checkpoint
+     *
+     * @param checkpoint: checkpoint to fill in
+     * @param steppers: indexable set of pointers to steppers, one per axis
+     * @param axis_count: number of steppers
+     */
+    template<class Steppers>
+    void save_coil_phases(job_checkpoint& checkpoint, const Steppers& steppers, std::size_t axis_count){
+        for(std::size_t axis = 0; axis < axis_count; axis++){
+            checkpoint.coil_phase[axis] = static_cast<std::uint32_t>(steppers[axis]->coil().state_index());
+        }
+    }
+
+    /**
+     * Put the steppers back where a checkpoint left them without moving,
+     * for a machine that held its position through the interruption. The
+     * coils are set to the saved phase so energizing them doesn't pull the
+     * rotors to another step. A machine that may have moved is homed
+     * instead, see job_pipeline::resume().
+     *
+     * @param checkpoint: checkpoint to restore
+     * @param steppers: indexable set of pointers to steppers, one per axis
+     * @param axis_count: number of steppers
+     */
+    template<class Steppers>
+    void teleport_steppers(const job_checkpoint& checkpoint, Steppers& steppers, std::size_t axis_count){
+        for(std::size_t axis = 0; axis < axis_count; axis++){
+            steppers[axis]->coil().set_state(checkpoint.coil_phase[axis]);
+            steppers[axis]->teleport(step(static_cast<int>(checkpoint.position[axis])));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,96 @@
+#include "job_client.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "local_socket.hpp"
+
+namespace plotter{
+    namespace{
+        /**
+         * Connect to the controller and receive the descriptors of its ring
+         */
+        job_ring receive_ring(const std::string& path){
+            int fd = connect_local(path, SOCK_STREAM);
+
+            job_hello hello{};
+            iovec data{&hello, sizeof(hello)};
+            int fds[3] = {-1, -1, -1};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+            msghdr message{};
+            message.msg_iov = &data;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            ssize_t received = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+            ::close(fd);
+
+            cmsghdr* rights = CMSG_FIRSTHDR(&message);
+            if(received == static_cast<ssize_t>(sizeof(hello)) && rights != nullptr
+                    && rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS
+                    && rights->cmsg_len == CMSG_LEN(sizeof(fds))){
+                std::memcpy(fds, CMSG_DATA(rights), sizeof(fds));
+            }
+            if(fds[0] < 0 || hello.magic != job_ring::magic || hello.version != job_ring::version
+                    || hello.command_size != sizeof(move_command)){
+                for(int descriptor : fds){
+                    if(descriptor >= 0){
+                        ::close(descriptor);
+                    }
+                }
+                throw std::runtime_error("Controller at " + path + " did not send a compatible job ring");
+            }
+            return job_ring::attach(fds[0], fds[1], fds[2]);
+        }
+    }
+
+    job_client::job_client(const std::string& socket_path)
+        :   m_ring(receive_ring(socket_path)),
+            m_line(0){}
+
+    void job_client::move(const axis_positions& target, std::int64_t feed_rate){
+        move_command command{};
+        command.type = move_command::kind::move;
+        command.line = m_line;
+        for(std::size_t axis = 0; axis < max_axes; axis++){
+            command.target[axis] = target[axis].count();
+        }
+        command.feed_rate = feed_rate;
+        m_ring.push(command);
+    }
+
+    void job_client::arc(const axis_positions& target,
+            const std::array<position, 2>& center,
+            bool clockwise,
+            std::int64_t feed_rate){
+        move_command command{};
+        command.type = move_command::kind::arc;
+        command.clockwise = clockwise;
+        command.line = m_line;
+        for(std::size_t axis = 0; axis < max_axes; axis++){
+            command.target[axis] = target[axis].count();
+        }
+        command.center = {{center[0].count(), center[1].count()}};
+        command.feed_rate = feed_rate;
+        m_ring.push(command);
+    }
+
+    void job_client::pen(bool down){
+        move_command command{};
+        command.type = move_command::kind::pen;
+        command.pen_down = down;
+        command.line = m_line;
+        m_ring.push(command);
+    }
+
+    void job_client::tool(std::uint8_t tool){
+        move_command command{};
+        command.type = move_command::kind::tool;
+        command.tool = tool;
+        command.line = m_line;
+        m_ring.push(command);
+    }
+}
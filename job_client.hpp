@@ -0,0 +1,143 @@
+#ifndef JOB_CLIENT_HPP
+#define JOB_CLIENT_HPP
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "job_ring.hpp"
+
+namespace plotter{
+
+    /**
+     * Submits moves to a running controller from another process. The
+     * connection only fetches the controller's job ring; every command is
+     * then written straight into shared memory.
+     */
+    class job_client{
+        private:
+            job_ring m_ring;
+
+            /**
+             * Tag given to the following commands
+             */
+            std::uint32_t m_line;
+
+        public:
+            /**
+             * Connect to a controller
+             *
+             * @param socket_path: path the controller listens on
+             */
+            explicit job_client(const std::string& socket_path);
+
+            /**
+             * Tag the following commands, i.e. with the line of the job file
+             * they come from
+             *
+             * @param line: tag to use
+             */
+            void set_line(std::uint32_t line){m_line = line;}
+
+            /**
+             * Queue a straight move, waiting while the controller is full
+             *
+             * @param target: absolute position of every axis
+             * @param feed_rate: micrometers per second
+             */
+            void move(const axis_positions& target, std::int64_t feed_rate);
+
+            /**
+             * Queue an arc in the plane of axes 0 and 1, waiting while the
+             * controller is full
+             *
+             * @param target: absolute position of every axis at the end
+             * @param center: center of the arc on axes 0 and 1
+             * @param clockwise: direction around the center
+             * @param feed_rate: micrometers per second
+             */
+            void arc(const axis_positions& target,
+                    const std::array<position, 2>& center,
+                    bool clockwise,
+                    std::int64_t feed_rate);
+
+            /**
+             * Queue a pen lift or lower, waiting while the controller is full
+             *
+             * @param down: true to lower the pen
+             */
+            void pen(bool down);
+
+            /**
+             * Queue a pen swap, the controller stops until the pen is fitted
+             * and the swap confirmed, see confirm_swap()
+             *
+             * @param tool: pen to swap to
+             */
+            void tool(std::uint8_t tool);
+
+            /**
+             * Change the feed of the controller at once, ahead of anything
+             * queued
+             *
+             * @param percent: feed relative to the plan, clamped to
+             *                 motion_executor::min_override..max_override
+             */
+            void set_feed_override(std::uint32_t percent){m_ring.set_feed_override(percent);}
+
+            /**
+             * Decelerate the controller to a stop and hold, ahead of
+             * anything queued
+             */
+            void pause(){m_ring.set_paused(true);}
+
+            /**
+             * Carry on after pause(). A pen swap still waits for
+             * confirm_swap().
+             */
+            void resume(){m_ring.set_paused(false);}
+
+            /**
+             * @return: true while the controller holds for a pen swap
+             */
+            bool is_swapping() const{return m_ring.swap() != 0;}
+
+            /**
+             * @return: pen the controller waits for while is_swapping()
+             */
+            std::uint8_t swap_tool() const{return m_ring.swap_tool();}
+
+            /**
+             * Tell the controller the pen of the swap it holds for is
+             * fitted, so it carries on unless paused
+             *
+             * @return: false if the controller wasn't swapping
+             */
+            bool confirm_swap(){
+                std::uint32_t swap = m_ring.swap();
+                if(swap == 0){
+                    return false;
+                }
+                m_ring.confirm_swap(swap);
+                return true;
+            }
+
+            /**
+             * Queue a prepared command without waiting
+             *
+             * @param command: command to queue
+             * @return: false if the controller is full
+             */
+            bool try_submit(const move_command& command){return m_ring.try_push(command);}
+
+            /**
+             * Queue a prepared command, waiting while the controller is full
+             *
+             * @param command: command to queue
+             */
+            void submit(const move_command& command){m_ring.push(command);}
+    };
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include "job_estimate.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace plotter{
+    namespace{
+        /**
+         * Time of a ramp that starts at a rate and changes by the
+         * acceleration over a number of events, taken as the integral of
+         * 1/v over the events with each event at its midpoint
+         *
+         * @return: time in seconds
+         */
+        double ramp_time(double rate, double acceleration, double events){
+            if(events <= 0){
+                return 0;
+            }
+            double squared = rate * rate;
+            return (std::sqrt(squared + 2 * acceleration * (events + 0.5))
+                    - std::sqrt(squared + acceleration)) / acceleration;
+        }
+
+        /**
+         * Time of the first events of a block
+         *
+         * @return: time in seconds
+         */
+        double elapsed_time(const planned_block& block, std::uint32_t events){
+            double nominal = std::max<double>(1, block.nominal_rate);
+            double acceleration = block.acceleration;
+            if(acceleration <= 0){
+                return events / nominal;
+            }
+            double seconds = ramp_time(block.entry_rate, acceleration, std::min(events, block.accelerate_until));
+            if(events > block.accelerate_until){
+                seconds += (static_cast<double>(std::min(events, block.decelerate_after)) - block.accelerate_until) / nominal;
+            }
+            if(events > block.decelerate_after){
+                seconds += ramp_time(block.exit_rate, acceleration, static_cast<double>(block.event_count) - block.decelerate_after)
+                    - ramp_time(block.exit_rate, acceleration, static_cast<double>(block.event_count) - events);
+            }
+            return seconds;
+        }
+
+        /**
+         * What the executor takes to be left of a block after a number of
+         * events, mirroring motion_executor::remaining_time()
+         *
+         * @return: time in microseconds
+         */
+        double executor_remaining_us(const planned_block& block, std::uint32_t event){
+            if(event >= block.event_count){
+                return 0;
+            }
+            double acceleration = std::max<double>(1, block.acceleration);
+            double nominal = block.nominal_rate;
+            double rate = nominal;
+            if(event < block.accelerate_until){
+                rate = std::floor(std::sqrt(static_cast<double>(block.entry_rate) * block.entry_rate + 2 * acceleration * (event + 1)));
+            }
+            else if(event >= block.decelerate_after){
+                rate = std::floor(std::sqrt(static_cast<double>(block.exit_rate) * block.exit_rate
+                            + 2 * acceleration * (block.event_count - event)));
+            }
+            rate = std::max(1.0, std::min(rate, nominal));
+            double exit = block.exit_rate;
+            if(event >= block.decelerate_after){
+                return rate > exit ? (rate - exit) * 1e6 / acceleration : 0;
+            }
+            return (block.decelerate_after - event) * 1e6 / rate + (nominal > exit ? (nominal - exit) * 1e6 / acceleration : 0);
+        }
+
+        /**
+         * Time a pen command overlaps the end of the move before it. The
+         * executor issues it after the first step that leaves no more than
+         * the lead of the move by its own reckoning, which is found here
+         * by bisection rather than by walking the steps.
+         *
+         * @return: overlap in microseconds
+         */
+        std::uint64_t pen_overlap_us(const planned_block& move, std::uint64_t duration, std::uint64_t lead){
+            std::uint32_t low = 1;
+            std::uint32_t high = move.event_count;
+            while(low < high){
+                std::uint32_t middle = low + (high - low) / 2;
+                if(executor_remaining_us(move, middle) <= static_cast<double>(lead)){
+                    high = middle;
+                }
+                else{
+                    low = middle + 1;
+                }
+            }
+            double overlap = static_cast<double>(duration) - elapsed_time(move, low) * 1e6;
+            return static_cast<std::uint64_t>(std::max(0.0, overlap));
+        }
+    }
+
+    std::uint64_t block_duration_us(const planned_block& block){
+        if(block.kind == block_kind::pen || block.event_count == 0){
+            return 0;
+        }
+        double nominal = std::max<double>(1, block.nominal_rate);
+        double acceleration = block.acceleration;
+        double accelerating = block.accelerate_until;
+        double cruising = static_cast<double>(block.decelerate_after) - block.accelerate_until;
+        double decelerating = static_cast<double>(block.event_count) - block.decelerate_after;
+
+        double seconds = cruising / nominal;
+        if(acceleration > 0){
+            seconds += ramp_time(block.entry_rate, acceleration, accelerating)
+                + ramp_time(block.exit_rate, acceleration, decelerating);
+        }
+        else{
+            seconds += (accelerating + decelerating) / nominal;
+        }
+        return static_cast<std::uint64_t>(std::llround(seconds * 1e6));
+    }
+
+    job_estimator::job_estimator(const motion_config& config, const pen_timing& timing)
+        :   m_config(config),
+            m_timing(timing),
+            m_estimate(),
+            m_pen_down(false),
+            m_last_move(),
+            m_last_move_us(0){}
+
+    void job_estimator::add(const planned_block& block){
+        m_estimate.blocks++;
+        if(block.kind == block_kind::tool){
+            m_estimate.tool_changes++;
+            m_last_move_us = 0;
+            return;
+        }
+        if(block.kind == block_kind::pen){
+            // The executor issues the pen before the move ahead of it ends
+            // and only waits for the rest of the dwell
+            std::uint64_t lead = block.pen_down ? m_timing.touch_us : m_timing.release_us;
+            std::uint64_t dwell = block.pen_down ? m_timing.settle_us : m_timing.clear_us;
+            std::uint64_t overlap = m_last_move_us == 0 ? 0 : pen_overlap_us(m_last_move, m_last_move_us, lead);
+            m_estimate.pen_us += dwell - std::min(dwell, overlap);
+            if(!block.pen_down){
+                m_estimate.pen_lifts++;
+            }
+            m_pen_down = block.pen_down;
+            m_last_move_us = 0;
+            return;
+        }
+
+        std::uint64_t duration = block_duration_us(block);
+        if(m_pen_down){
+            m_estimate.drawing_us += duration;
+            m_estimate.drawing_length += block.length;
+        }
+        else{
+            m_estimate.travel_us += duration;
+            m_estimate.travel_length += block.length;
+        }
+        m_estimate.step_events += block.event_count;
+        for(std::size_t axis = 0; axis < m_config.axis_count; axis++){
+            m_estimate.axis_travel[axis] += m_config.axes[axis].scale.to_position(block.steps[axis]);
+        }
+        m_last_move = block;
+        m_last_move_us = duration;
+    }
+
+    job_estimate estimate_job(command_source source, const pipeline_config& config){
+        // The stages of the pipeline run inline, so a dry run pays nothing
+        // for threads and queues
+        command_transform transform(config);
+        command_optimizer optimizer;
+        command_planner planner(config);
+        job_estimator estimator(config.motion, config.timing);
+
+        block_sink to_estimator = [&estimator](const planned_block& block){
+            estimator.add(block);
+            return true;
+        };
+        command_sink to_planner = [&](const move_command& command){
+            return planner.process(command, to_estimator);
+        };
+        command_sink to_optimizer = [&](const move_command& command){
+            return optimizer.process(command, to_planner);
+        };
+
+        move_command command;
+        while(source(command)){
+            transform.process(command, to_optimizer);
+        }
+        optimizer.finish(to_planner);
+        planner.flush(to_estimator);
+        return estimator.estimate();
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef JOB_ESTIMATE_HPP
+#define JOB_ESTIMATE_HPP
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "job_pipeline.hpp"
+#include "motion.hpp"
+#include "pen.hpp"
+
+namespace plotter{
+
+    /**
+     * How long a job takes and how far it moves, from its planned blocks
+     */
+    struct job_estimate{
+        /**
+         * Time spent moving with the pen down and with it up, and waiting
+         * for the pen between moves, in microseconds
+         */
+        std::uint64_t drawing_us = 0;
+        std::uint64_t travel_us = 0;
+        std::uint64_t pen_us = 0;
+
+        /**
+         * Path length with the pen down and with it up, in micrometers
+         */
+        std::int64_t drawing_length = 0;
+        std::int64_t travel_length = 0;
+
+        /**
+         * Distance each axis moves, in either direction
+         */
+        axis_positions axis_travel{};
+
+        std::uint64_t blocks = 0;
+        std::uint64_t pen_lifts = 0;
+
+        /**
+         * Pen swaps, each a stop for the operator that isn't in the times
+         */
+        std::uint64_t tool_changes = 0;
+
+        std::uint64_t step_events = 0;
+
+        std::uint64_t total_us() const{return drawing_us + travel_us + pen_us;}
+    };
+
+    /**
+     * Adds up the time of planned blocks without stepping them. The
+     * trapezoid of each block is integrated in closed form, and pen blocks
+     * are charged what the executor waits for them once it has overlapped
+     * the pen with the end of the move before. Runs at full feed override
+     * and assumes the pen starts lifted.
+     */
+    class job_estimator{
+        private:
+            motion_config m_config;
+            pen_timing m_timing;
+            job_estimate m_estimate;
+            bool m_pen_down;
+
+            /**
+             * Last block and its duration if it was a move, which a pen
+             * block after it overlaps
+             */
+            planned_block m_last_move;
+            std::uint64_t m_last_move_us;
+
+        public:
+            /**
+             * @param config: machine the blocks were planned for
+             * @param timing: pen mechanism timing
+             */
+            job_estimator(const motion_config& config, const pen_timing& timing);
+
+            /**
+             * Account for the next planned block
+             *
+             * @param block: block in execution order
+             */
+            void add(const planned_block& block);
+
+            const job_estimate& estimate() const{return m_estimate;}
+    };
+
+    /**
+     * Time a block takes at full feed override
+     *
+     * @param block: planned move
+     * @return: duration in microseconds
+     */
+    std::uint64_t block_duration_us(const planned_block& block);
+
+    /**
+     * Dry run a job through the stages of the pipeline on the calling
+     * thread, planning it for the configured machine without generating a
+     * single step
+     *
+     * @param source: job commands
+     * @param config: machine settings, as for a real run
+     * @return: the estimate
+     * @throw: whatever a pipeline stage threw
+     */
+    job_estimate estimate_job(command_source source, const pipeline_config& config);
+}
+
+#endif
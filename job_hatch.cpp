@@ -0,0 +1,227 @@
+#include "job_hatch.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+namespace plotter{
+    namespace{
+        constexpr double pi = 3.14159265358979323846;
+        constexpr std::size_t no_path = std::numeric_limits<std::size_t>::max();
+
+        /**
+         * Edge of a ring, in the frame where the hatch lines run along x
+         */
+        struct edge{
+            double low_y;
+            double high_y;
+            double low_x;       // x at low_y
+            double slope;       // Change of x per unit of y
+            int winding;        // +1 going up, -1 going down
+        };
+
+        /**
+         * Inside part of one scanline
+         */
+        struct span{
+            double left;
+            double right;
+            std::size_t path;   // Stroke the span was drawn into
+            bool ends_right;    // The stroke left off at the right end
+        };
+
+        /**
+         * Whether the straight link between the ends of spans on
+         * neighbouring scanlines stays in the shape: no edge may cross it
+         * and its middle must be inside. Edges the ends lie on touch it
+         * within the tolerance and don't count as crossing, and the middle
+         * is taken the tolerance in from the ends, off an outline the link
+         * runs along.
+         *
+         * @param edges: every edge of the shape
+         * @param band: edges that overlap the lines of from and to
+         * @param from: end of the span on the lower line
+         * @param to: end of the span on the upper line
+         * @param right: the link joins the right ends of the spans
+         */
+        bool link_inside(const std::vector<edge>& edges, const std::vector<std::size_t>& band, fill_rule rule,
+                const hatch_point& from, const hatch_point& to, bool right, double tolerance){
+            double slope = (to[0] - from[0]) / (to[1] - from[1]);
+            auto link_x = [&from, slope](double y){return from[0] + (y - from[1]) * slope;};
+            double middle_y = (from[1] + to[1]) / 2;
+            double middle_x = link_x(middle_y) + (right ? -tolerance : tolerance);
+            int winding = 0;
+            int count = 0;
+            for(std::size_t index : band){
+                const edge& crossed = edges[index];
+                double low = std::max(crossed.low_y, from[1]);
+                double high = std::min(crossed.high_y, to[1]);
+                if(low < high){
+                    double below = crossed.low_x + (low - crossed.low_y) * crossed.slope - link_x(low);
+                    double above = crossed.low_x + (high - crossed.low_y) * crossed.slope - link_x(high);
+                    if((below < -tolerance && above > tolerance) || (below > tolerance && above < -tolerance)){
+                        return false;
+                    }
+                }
+                if(crossed.low_y <= middle_y && middle_y < crossed.high_y
+                        && crossed.low_x + (middle_y - crossed.low_y) * crossed.slope < middle_x){
+                    winding += crossed.winding;
+                    count++;
+                }
+            }
+            return rule == fill_rule::even_odd ? (count & 1) != 0 : winding != 0;
+        }
+    }
+
+    std::vector<hatch_path> hatch_polygon(const std::vector<hatch_path>& rings, fill_rule rule, double angle, double spacing){
+        std::vector<hatch_path> paths;
+        if(!(spacing > 0)){
+            return paths;
+        }
+        // Rotate the rings back by the angle so the hatch lines run along x
+        double cosine = std::cos(angle * pi / 180);
+        double sine = std::sin(angle * pi / 180);
+        auto rotate = [cosine, sine](const hatch_point& point){
+            return hatch_point{{point[0] * cosine + point[1] * sine, point[1] * cosine - point[0] * sine}};
+        };
+
+        std::vector<edge> edges;
+        for(const hatch_path& ring : rings){
+            if(ring.size() < 3){
+                continue;
+            }
+            hatch_point from = rotate(ring.back());
+            for(const hatch_point& point : ring){
+                hatch_point to = rotate(point);
+                if(from[1] != to[1]){
+                    const hatch_point& low = from[1] < to[1] ? from : to;
+                    const hatch_point& high = from[1] < to[1] ? to : from;
+                    edges.push_back(edge{low[1], high[1], low[0], (high[0] - low[0]) / (high[1] - low[1]), from[1] < to[1] ? 1 : -1});
+                }
+                from = to;
+            }
+        }
+        if(edges.empty()){
+            return paths;
+        }
+        std::sort(edges.begin(), edges.end(), [](const edge& a, const edge& b){return a.low_y < b.low_y;});
+
+        std::vector<std::size_t> active;
+        std::vector<std::size_t> band;
+        std::vector<std::pair<double, int>> crossings;
+        std::vector<span> previous;
+        std::vector<span> current;
+        std::vector<std::uint32_t> previous_overlaps;
+        std::vector<std::uint32_t> current_overlaps;
+        std::vector<std::size_t> partner;
+        std::size_t next_edge = 0;
+
+        // Scanlines sit halfway between multiples of the spacing, which
+        // keeps them off the vertices of shapes drawn on a grid
+        double line = std::ceil(edges.front().low_y / spacing - 0.5);
+        while(next_edge < edges.size() || !active.empty()){
+            double y = (line + 0.5) * spacing;
+            while(next_edge < edges.size() && edges[next_edge].low_y <= y){
+                active.push_back(next_edge++);
+            }
+            // Every edge between the last line and this one, for the links
+            band.assign(active.begin(), active.end());
+            // Edges cover [low_y, high_y), so a vertex is counted once
+            for(std::size_t i = 0; i < active.size();){
+                if(edges[active[i]].high_y <= y){
+                    active[i] = active.back();
+                    active.pop_back();
+                }
+                else{
+                    i++;
+                }
+            }
+            if(active.empty()){
+                previous.clear();
+                if(next_edge < edges.size()){
+                    // Skip the gap to the next part of the shape
+                    line = std::max(line + 1, std::ceil(edges[next_edge].low_y / spacing - 0.5));
+                }
+                continue;
+            }
+
+            crossings.clear();
+            for(std::size_t index : active){
+                const edge& crossed = edges[index];
+                crossings.emplace_back(crossed.low_x + (y - crossed.low_y) * crossed.slope, crossed.winding);
+            }
+            std::sort(crossings.begin(), crossings.end());
+
+            current.clear();
+            int winding = 0;
+            int count = 0;
+            double left = 0;
+            for(const auto& crossing : crossings){
+                bool was_inside = rule == fill_rule::even_odd ? (count & 1) != 0 : winding != 0;
+                winding += crossing.second;
+                count++;
+                bool inside = rule == fill_rule::even_odd ? (count & 1) != 0 : winding != 0;
+                if(inside && !was_inside){
+                    left = crossing.first;
+                }
+                else if(!inside && was_inside && crossing.first > left){
+                    current.push_back(span{left, crossing.first, no_path, true});
+                }
+            }
+
+            // Pair off the spans that overlap only each other with the
+            // spans of the line before
+            previous_overlaps.assign(previous.size(), 0);
+            current_overlaps.assign(current.size(), 0);
+            partner.assign(current.size(), no_path);
+            for(std::size_t i = 0, j = 0; i < previous.size() && j < current.size();){
+                if(previous[i].left <= current[j].right && current[j].left <= previous[i].right){
+                    previous_overlaps[i]++;
+                    current_overlaps[j]++;
+                    partner[j] = i;
+                }
+                if(previous[i].right < current[j].right){
+                    i++;
+                }
+                else{
+                    j++;
+                }
+            }
+
+            for(std::size_t j = 0; j < current.size(); j++){
+                span& drawn = current[j];
+                std::size_t i = partner[j];
+                if(current_overlaps[j] == 1 && previous_overlaps[i] == 1
+                        && link_inside(edges, band, rule, paths[previous[i].path].back(),
+                                hatch_point{{previous[i].ends_right ? drawn.right : drawn.left, y}},
+                                previous[i].ends_right, spacing * 1e-6)){
+                    // Carry on the stroke from the same end, then back
+                    // along this line
+                    drawn.path = previous[i].path;
+                    drawn.ends_right = !previous[i].ends_right;
+                }
+                else{
+                    drawn.path = paths.size();
+                    paths.emplace_back();
+                    drawn.ends_right = true;
+                }
+                hatch_path& path = paths[drawn.path];
+                double start = drawn.ends_right ? drawn.left : drawn.right;
+                double end = drawn.ends_right ? drawn.right : drawn.left;
+                path.push_back(hatch_point{{start, y}});
+                path.push_back(hatch_point{{end, y}});
+            }
+            previous.swap(current);
+            line++;
+        }
+
+        for(hatch_path& path : paths){
+            for(hatch_point& point : path){
+                point = hatch_point{{point[0] * cosine - point[1] * sine, point[0] * sine + point[1] * cosine}};
+            }
+        }
+        return paths;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef JOB_HATCH_HPP
+#define JOB_HATCH_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace plotter{
+
+    using hatch_point = std::array<double, 2>;
+
+    /**
+     * Open polyline, or a closed ring of a polygon whose last point joins
+     * back to the first
+     */
+    using hatch_path = std::vector<hatch_point>;
+
+    enum class fill_rule{
+        nonzero,    // Inside where the rings wind around the point any number of times
+        even_odd    // Inside where a ray from the point crosses the rings an odd number of times
+    };
+
+    struct hatch_config{
+        /**
+         * Distance between hatch lines in nanometers, 0 to leave shapes
+         * unfilled
+         */
+        double spacing = 0;
+
+        /**
+         * Direction of the hatch lines, counterclockwise from the x axis
+         */
+        double angle = 45;
+
+        /**
+         * Shapes hatched at once on their own threads while the job is read
+         */
+        std::size_t threads = 4;
+    };
+
+    /**
+     * Fill a polygon with parallel hatch lines. The rings are clipped one
+     * scanline at a time against an active edge table, so holes and self
+     * intersections follow the fill rule. Spans on neighbouring scanlines
+     * that only touch each other are joined end to end into one serpentine
+     * stroke by a straight link, unless the outline cuts in between the two
+     * lines and the link would leave the shape; the pen lifts there and a
+     * new stroke starts. Scanlines lie on a grid fixed by the spacing, so the hatching of
+     * neighbouring shapes lines up.
+     *
+     * @param rings: closed rings of the polygon, in any units
+     * @param rule: which parts the rings enclose
+     * @param angle: direction of the hatch lines in degrees
+     * @param spacing: distance between lines, in the units of the rings
+     * @return: strokes to draw
+     */
+    std::vector<hatch_path> hatch_polygon(const std::vector<hatch_path>& rings, fill_rule rule, double angle, double spacing);
+}
+
+#endif
@@ -0,0 +1,897 @@
+#include "job_import.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace plotter{
+    namespace{
+        constexpr double pi = 3.14159265358979323846;
+
+        /**
+         * Parse a number at the cursor, advancing it past the number
+         *
+         * @return: false if there is no number at the cursor
+         */
+        bool parse_number(const char*& cursor, double& value){
+            while(*cursor == ' ' || *cursor == ',' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'){
+                cursor++;
+            }
+            char* end;
+            value = std::strtod(cursor, &end);
+            if(end == cursor){
+                return false;
+            }
+            cursor = end;
+            return true;
+        }
+
+        /**
+         * Find an attribute of a tag
+         *
+         * @return: false if the tag doesn't have the attribute
+         */
+        bool attribute(const std::string& tag, const char* name, std::string& value){
+            std::size_t length = std::strlen(name);
+            std::size_t at = 0;
+            while((at = tag.find(name, at)) != std::string::npos){
+                std::size_t after = at + length;
+                bool starts_word = at > 0 && std::isspace(static_cast<unsigned char>(tag[at - 1]));
+                at = after;
+                while(after < tag.size() && std::isspace(static_cast<unsigned char>(tag[after]))){
+                    after++;
+                }
+                if(!starts_word || after >= tag.size() || tag[after] != '='){
+                    continue;
+                }
+                after++;
+                while(after < tag.size() && std::isspace(static_cast<unsigned char>(tag[after]))){
+                    after++;
+                }
+                if(after >= tag.size() || (tag[after] != '"' && tag[after] != '\'')){
+                    continue;
+                }
+                std::size_t close = tag.find(tag[after], after + 1);
+                if(close == std::string::npos){
+                    return false;
+                }
+                value.assign(tag, after + 1, close - after - 1);
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * Presentation property of a tag, i.e. its stroke colour, from its
+         * style or else its attribute of the same name
+         *
+         * @return: false if the tag doesn't set the property
+         */
+        bool style_attribute(const std::string& tag, const char* name, std::string& value){
+            std::string style;
+            std::size_t length = std::strlen(name);
+            bool found = false;
+            if(attribute(tag, "style", style)){
+                std::size_t at = 0;
+                while((at = style.find(name, at)) != std::string::npos){
+                    std::size_t after = at + length;
+                    bool starts_word = at == 0 || style[at - 1] == ';' || std::isspace(static_cast<unsigned char>(style[at - 1]));
+                    at = after;
+                    while(after < style.size() && std::isspace(static_cast<unsigned char>(style[after]))){
+                        after++;
+                    }
+                    if(!starts_word || after >= style.size() || style[after] != ':'){
+                        continue;
+                    }
+                    std::size_t end = style.find(';', after);
+                    value = style.substr(after + 1, end == std::string::npos ? std::string::npos : end - after - 1);
+                    found = true;
+                    break;
+                }
+            }
+            if(!found && !attribute(tag, name, value)){
+                return false;
+            }
+            // Compare values without case or surrounding space
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t") + 1);
+            std::transform(value.begin(), value.end(), value.begin(),
+                    [](unsigned char c){return static_cast<char>(std::tolower(c));});
+            return true;
+        }
+
+        double number_attribute(const std::string& tag, const char* name, std::string& scratch){
+            if(!attribute(tag, name, scratch)){
+                return 0;
+            }
+            return std::strtod(scratch.c_str(), nullptr);
+        }
+
+        /**
+         * Segments needed for a curve whose second derivative is at most
+         * bend, so no chord strays more than the tolerance
+         */
+        int curve_segments(double bend, double tolerance){
+            double segments = std::ceil(std::sqrt(bend / (8 * tolerance)));
+            return static_cast<int>(std::min(1000.0, std::max(1.0, segments)));
+        }
+    }
+
+/******************************************************************************/
+/*                                   G-code                                   */
+/******************************************************************************/
+    gcode_importer::gcode_importer(std::istream& in, const import_config& config)
+        :   m_in(in),
+            m_config(config),
+            m_line(),
+            m_line_number(0),
+            m_position(),
+            m_unit(1),
+            m_relative(false),
+            m_pen_down(false),
+            m_feed(config.draw_feed),
+            m_motion(0),
+            m_tool(0),
+            m_pending(),
+            m_pending_count(0),
+            m_pending_next(0){}
+
+    bool gcode_importer::next(move_command& command){
+        while(m_pending_next == m_pending_count){
+            if(!std::getline(m_in, m_line)){
+                return false;
+            }
+            m_line_number++;
+            parse_line();
+        }
+        command = m_pending[m_pending_next++];
+        return true;
+    }
+
+    void gcode_importer::parse_line(){
+        m_pending_count = 0;
+        m_pending_next = 0;
+
+        bool has_x = false, has_y = false, has_z = false, has_i = false, has_j = false;
+        double x = 0, y = 0, z = 0, i = 0, j = 0;
+        int pen = -1;
+        int tool = -1;
+        bool moves = false;
+
+        const char* cursor = m_line.c_str();
+        while(*cursor != '\0'){
+            char letter = static_cast<char>(std::toupper(static_cast<unsigned char>(*cursor)));
+            if(letter == ';'){
+                break;
+            }
+            if(letter == '('){
+                while(*cursor != '\0' && *cursor != ')'){
+                    cursor++;
+                }
+                if(*cursor == ')'){
+                    cursor++;
+                }
+                continue;
+            }
+            if(letter < 'A' || letter > 'Z'){
+                cursor++;
+                continue;
+            }
+            cursor++;
+            double value;
+            if(!parse_number(cursor, value)){
+                continue;
+            }
+            switch(letter){
+                case 'G':{
+                    int code = static_cast<int>(value);
+                    if(code >= 0 && code <= 3){
+                        m_motion = code;
+                        moves = true;
+                    }
+                    else if(code == 20){
+                        m_unit = 25.4;
+                    }
+                    else if(code == 21){
+                        m_unit = 1;
+                    }
+                    else if(code == 90){
+                        m_relative = false;
+                    }
+                    else if(code == 91){
+                        m_relative = true;
+                    }
+                    break;
+                }
+                case 'M':
+                    if(value == 3 || value == 4){
+                        pen = 1;
+                    }
+                    else if(value == 5){
+                        pen = 0;
+                    }
+                    break;
+                case 'X': has_x = true; x = value; break;
+                case 'Y': has_y = true; y = value; break;
+                case 'Z': has_z = true; z = value; break;
+                case 'I': has_i = true; i = value; break;
+                case 'J': has_j = true; j = value; break;
+                case 'T':
+                    tool = static_cast<int>(value);
+                    break;
+                case 'F':
+                    // Units per minute to micrometers per second
+                    m_feed = std::max<std::int64_t>(1, std::llround(value * m_unit * 1000 / 60));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        if(tool >= 0 && tool <= 255 && tool != m_tool){
+            m_tool = static_cast<std::uint8_t>(tool);
+            move_command& swap = m_pending[m_pending_count++];
+            swap = move_command{};
+            swap.type = move_command::kind::tool;
+            swap.tool = m_tool;
+            swap.line = m_line_number;
+        }
+        if(has_z){
+            pen = z <= 0 ? 1 : 0;
+        }
+        if(pen >= 0 && (pen == 1) != m_pen_down){
+            m_pen_down = pen == 1;
+            move_command& lift = m_pending[m_pending_count++];
+            lift = move_command{};
+            lift.type = move_command::kind::pen;
+            lift.pen_down = m_pen_down;
+            lift.line = m_line_number;
+        }
+
+        bool is_arc = m_motion == 2 || m_motion == 3;
+        if(!has_x && !has_y && !(is_arc && (has_i || has_j) && moves)){
+            return;
+        }
+        auto to_nm = [this](double value){return static_cast<position::rep>(std::llround(value * m_unit * 1e6));};
+        std::array<position::rep, 2> start = m_position;
+        if(has_x){
+            m_position[0] = m_relative ? m_position[0] + to_nm(x) : to_nm(x);
+        }
+        if(has_y){
+            m_position[1] = m_relative ? m_position[1] + to_nm(y) : to_nm(y);
+        }
+
+        move_command& move = m_pending[m_pending_count++];
+        move = move_command{};
+        move.type = is_arc ? move_command::kind::arc : move_command::kind::move;
+        move.clockwise = m_motion == 2;
+        move.line = m_line_number;
+        move.target[0] = m_position[0];
+        move.target[1] = m_position[1];
+        move.center = {{start[0] + to_nm(i), start[1] + to_nm(j)}};
+        move.feed_rate = m_motion == 0 ? m_config.travel_feed : m_feed;
+    }
+
+/******************************************************************************/
+/*                                     SVG                                    */
+/******************************************************************************/
+    svg_importer::svg_importer(std::istream& in, const import_config& config)
+        :   m_in(in),
+            m_config(config),
+            m_tag(),
+            m_element(0),
+            m_pending(),
+            m_pending_next(0),
+            m_converted(),
+            m_ahead(),
+            m_hatching(0),
+            m_end(false),
+            m_pen_down(false),
+            m_groups(),
+            m_colours(),
+            m_tool(0),
+            m_outline(true),
+            m_filling(false),
+            m_rings(),
+            m_hatch(){}
+
+    bool svg_importer::next(move_command& command){
+        while(m_pending_next == m_pending.size()){
+            m_pending.clear();
+            m_pending_next = 0;
+            read_ahead();
+            if(m_ahead.empty()){
+                return false;
+            }
+            converted_element& front = m_ahead.front();
+            if(!front.commands.empty()){
+                m_pending.swap(front.commands);
+                front.commands.clear();
+                if(!front.hatch.valid()){
+                    m_ahead.pop_front();
+                }
+            }
+            else{
+                m_pending = front.hatch.get();
+                m_hatching--;
+                m_ahead.pop_front();
+            }
+        }
+        command = m_pending[m_pending_next++];
+        return true;
+    }
+
+    void svg_importer::read_ahead(){
+        // While shapes are being hatched, read on so several hatch at once
+        std::size_t threads = std::max<std::size_t>(1, m_config.hatch.threads);
+        while(!m_end && (m_ahead.empty() || (m_hatching > 0 && m_hatching < threads && m_ahead.size() < 64 * threads))){
+            if(!read_tag()){
+                m_end = true;
+                break;
+            }
+            convert_tag();
+            if(!m_converted.empty() || m_hatch.valid()){
+                m_ahead.push_back(converted_element{std::move(m_converted), std::move(m_hatch)});
+                m_converted.clear();
+            }
+        }
+    }
+
+    bool svg_importer::read_tag(){
+        std::istream::int_type c;
+        while((c = m_in.get()) != std::istream::traits_type::eof() && c != '<'){
+        }
+        if(c == std::istream::traits_type::eof()){
+            return false;
+        }
+        m_tag.clear();
+        char quote = 0;
+        while((c = m_in.get()) != std::istream::traits_type::eof()){
+            char character = static_cast<char>(c);
+            if(quote != 0){
+                if(character == quote){
+                    quote = 0;
+                }
+            }
+            else if(character == '"' || character == '\''){
+                quote = character;
+            }
+            else if(character == '>'){
+                break;
+            }
+            m_tag += character;
+            if(m_tag.size() == 3 && m_tag == "!--"){
+                // Skip the comment whole, it may contain anything
+                std::string tail;
+                while((c = m_in.get()) != std::istream::traits_type::eof()){
+                    tail += static_cast<char>(c);
+                    if(tail.size() >= 3 && tail.compare(tail.size() - 3, 3, "-->") == 0){
+                        break;
+                    }
+                    if(tail.size() > 3){
+                        tail.erase(0, tail.size() - 3);
+                    }
+                }
+                m_tag.clear();
+                return true;
+            }
+        }
+        return true;
+    }
+
+    void svg_importer::emit(move_command command){
+        command.line = m_element;
+        m_converted.push_back(command);
+    }
+
+    void svg_importer::lift(){
+        if(m_pen_down){
+            move_command command{};
+            command.type = move_command::kind::pen;
+            command.pen_down = false;
+            emit(command);
+            m_pen_down = false;
+        }
+    }
+
+    void svg_importer::select_tool(const std::string& colour){
+        std::size_t index = static_cast<std::size_t>(std::find(m_colours.begin(), m_colours.end(), colour) - m_colours.begin());
+        if(index == m_colours.size()){
+            m_colours.push_back(colour);
+        }
+        // Colours past the last pen number share it
+        std::uint8_t tool = static_cast<std::uint8_t>(std::min<std::size_t>(index, 255));
+        if(tool != m_tool){
+            lift();
+            move_command command{};
+            command.type = move_command::kind::tool;
+            command.tool = tool;
+            emit(command);
+            m_tool = tool;
+        }
+    }
+
+    void svg_importer::travel(double x, double y){
+        if(m_filling){
+            m_rings.push_back(hatch_path{hatch_point{{x, y}}});
+        }
+        if(!m_outline){
+            return;
+        }
+        lift();
+        move_command command{};
+        command.type = move_command::kind::move;
+        command.target[0] = std::llround(x * m_config.svg_unit);
+        command.target[1] = std::llround(y * m_config.svg_unit);
+        command.feed_rate = m_config.travel_feed;
+        emit(command);
+    }
+
+    void svg_importer::draw(double x, double y){
+        if(m_filling && !m_rings.empty()){
+            m_rings.back().push_back(hatch_point{{x, y}});
+        }
+        if(!m_outline){
+            return;
+        }
+        if(!m_pen_down){
+            move_command command{};
+            command.type = move_command::kind::pen;
+            command.pen_down = true;
+            emit(command);
+            m_pen_down = true;
+        }
+        move_command command{};
+        command.type = move_command::kind::move;
+        command.target[0] = std::llround(x * m_config.svg_unit);
+        command.target[1] = std::llround(y * m_config.svg_unit);
+        command.feed_rate = m_config.draw_feed;
+        emit(command);
+    }
+
+    void svg_importer::draw_arc(double x, double y, double center_x, double center_y, bool clockwise){
+        if(m_filling && !m_rings.empty()){
+            // The outline of the fill only needs the arc within the curve
+            // tolerance
+            const hatch_point& from = m_rings.back().back();
+            double radius = std::hypot(from[0] - center_x, from[1] - center_y);
+            double start = std::atan2(from[1] - center_y, from[0] - center_x);
+            double sweep = std::atan2(y - center_y, x - center_x) - start;
+            if(clockwise){
+                while(sweep >= 0){
+                    sweep -= 2 * pi;
+                }
+            }
+            else{
+                while(sweep <= 0){
+                    sweep += 2 * pi;
+                }
+            }
+            int segments = curve_segments(radius * sweep * sweep, m_config.curve_tolerance / m_config.svg_unit);
+            for(int i = 1; i < segments; i++){
+                double angle = start + sweep * i / segments;
+                m_rings.back().push_back(hatch_point{{center_x + radius * std::cos(angle), center_y + radius * std::sin(angle)}});
+            }
+        }
+        draw(x, y);
+        if(!m_outline){
+            return;
+        }
+        move_command& command = m_converted.back();
+        command.type = move_command::kind::arc;
+        command.clockwise = clockwise;
+        command.center = {{std::llround(center_x * m_config.svg_unit), std::llround(center_y * m_config.svg_unit)}};
+    }
+
+    void svg_importer::convert_tag(){
+        if(m_tag.empty() || m_tag[0] == '?' || m_tag[0] == '!'){
+            return;
+        }
+        if(m_tag[0] == '/'){
+            if(m_tag.compare(1, 1, "g") == 0 && (m_tag.size() == 2 || std::isspace(static_cast<unsigned char>(m_tag[2])))
+                    && !m_groups.empty()){
+                m_groups.pop_back();
+            }
+            return;
+        }
+        std::size_t name_end = 0;
+        while(name_end < m_tag.size() && !std::isspace(static_cast<unsigned char>(m_tag[name_end])) && m_tag[name_end] != '/'){
+            name_end++;
+        }
+        std::string name = m_tag.substr(0, name_end);
+        std::string value;
+        element_style style = m_groups.empty() ? element_style() : m_groups.back();
+        style_attribute(m_tag, "stroke", style.stroke);
+        style_attribute(m_tag, "fill", style.fill);
+        if(style_attribute(m_tag, "fill-rule", value)){
+            style.even_odd = value == "evenodd";
+        }
+        if(name == "g"){
+            if(m_tag.back() != '/'){
+                m_groups.push_back(style);
+            }
+            return;
+        }
+        m_element++;
+        m_filling = false;
+        m_outline = true;
+        if(name == "path" || name == "line" || name == "polyline" || name == "polygon"
+                || name == "rect" || name == "circle" || name == "ellipse"){
+            m_filling = m_config.hatch.spacing > 0 && name != "line"
+                && !style.fill.empty() && style.fill != "none" && style.fill != "transparent";
+            m_outline = !m_filling || style.stroke != "none";
+            m_rings.clear();
+            if(m_outline){
+                select_tool(style.stroke);
+            }
+        }
+
+        if(name == "path"){
+            if(attribute(m_tag, "d", value)){
+                convert_path(value);
+            }
+        }
+        else if(name == "line"){
+            travel(number_attribute(m_tag, "x1", value), number_attribute(m_tag, "y1", value));
+            draw(number_attribute(m_tag, "x2", value), number_attribute(m_tag, "y2", value));
+        }
+        else if(name == "polyline" || name == "polygon"){
+            if(!attribute(m_tag, "points", value)){
+                return;
+            }
+            const char* cursor = value.c_str();
+            double x, y, first_x = 0, first_y = 0;
+            bool first = true;
+            while(parse_number(cursor, x) && parse_number(cursor, y)){
+                if(first){
+                    travel(x, y);
+                    first_x = x;
+                    first_y = y;
+                    first = false;
+                }
+                else{
+                    draw(x, y);
+                }
+            }
+            if(name == "polygon" && !first){
+                draw(first_x, first_y);
+            }
+        }
+        else if(name == "rect"){
+            double x = number_attribute(m_tag, "x", value);
+            double y = number_attribute(m_tag, "y", value);
+            double width = number_attribute(m_tag, "width", value);
+            double height = number_attribute(m_tag, "height", value);
+            travel(x, y);
+            draw(x + width, y);
+            draw(x + width, y + height);
+            draw(x, y + height);
+            draw(x, y);
+        }
+        else if(name == "circle"){
+            double x = number_attribute(m_tag, "cx", value);
+            double y = number_attribute(m_tag, "cy", value);
+            double r = number_attribute(m_tag, "r", value);
+            if(r > 0){
+                travel(x + r, y);
+                draw_arc(x - r, y, x, y, false);
+                draw_arc(x + r, y, x, y, false);
+            }
+        }
+        else if(name == "ellipse"){
+            double x = number_attribute(m_tag, "cx", value);
+            double y = number_attribute(m_tag, "cy", value);
+            double rx = number_attribute(m_tag, "rx", value);
+            double ry = number_attribute(m_tag, "ry", value);
+            if(rx > 0 && ry > 0){
+                double tolerance = m_config.curve_tolerance / m_config.svg_unit;
+                int segments = 4 * curve_segments(std::max(rx, ry) * pi * pi / 4, tolerance);
+                travel(x + rx, y);
+                for(int i = 1; i <= segments; i++){
+                    double angle = 2 * pi * i / segments;
+                    draw(x + rx * std::cos(angle), y + ry * std::sin(angle));
+                }
+            }
+        }
+        else{
+            m_element--;
+            return;
+        }
+        lift();
+        if(m_filling){
+            select_tool(style.fill);
+            hatch(style.even_odd ? fill_rule::even_odd : fill_rule::nonzero);
+        }
+    }
+
+    void svg_importer::hatch(fill_rule rule){
+        import_config config = m_config;
+        std::uint32_t element = m_element;
+        auto task = [rings = std::move(m_rings), rule, config, element](){
+            double unit = config.svg_unit;
+            std::vector<move_command> commands;
+            for(const hatch_path& path : hatch_polygon(rings, rule, config.hatch.angle, config.hatch.spacing / unit)){
+                move_command command{};
+                command.line = element;
+                command.type = move_command::kind::move;
+                command.feed_rate = config.travel_feed;
+                command.target[0] = std::llround(path.front()[0] * unit);
+                command.target[1] = std::llround(path.front()[1] * unit);
+                commands.push_back(command);
+
+                move_command pen{};
+                pen.line = element;
+                pen.type = move_command::kind::pen;
+                pen.pen_down = true;
+                commands.push_back(pen);
+
+                command.feed_rate = config.draw_feed;
+                for(std::size_t i = 1; i < path.size(); i++){
+                    command.target[0] = std::llround(path[i][0] * unit);
+                    command.target[1] = std::llround(path[i][1] * unit);
+                    commands.push_back(command);
+                }
+                pen.pen_down = false;
+                commands.push_back(pen);
+            }
+            return commands;
+        };
+        m_rings.clear();
+        m_hatch = std::async(m_config.hatch.threads == 0 ? std::launch::deferred : std::launch::async, std::move(task));
+        m_hatching++;
+    }
+
+    void svg_importer::convert_path(const std::string& data){
+        double tolerance = m_config.curve_tolerance / m_config.svg_unit;
+        const char* cursor = data.c_str();
+        double x = 0, y = 0;
+        double start_x = 0, start_y = 0;
+        double control_x = 0, control_y = 0;
+        char command = 0;
+        char previous = 0;
+
+        while(true){
+            while(*cursor == ' ' || *cursor == ',' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'){
+                cursor++;
+            }
+            if(*cursor == '\0'){
+                break;
+            }
+            if(std::isalpha(static_cast<unsigned char>(*cursor))){
+                command = *cursor++;
+            }
+            else if(command == 0){
+                break;
+            }
+            bool relative = std::islower(static_cast<unsigned char>(command)) != 0;
+            double base_x = relative ? x : 0;
+            double base_y = relative ? y : 0;
+            char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(command)));
+
+            if(upper == 'Z'){
+                draw(start_x, start_y);
+                x = start_x;
+                y = start_y;
+                previous = upper;
+                command = 0;
+                continue;
+            }
+
+            double a[7];
+            int count = upper == 'H' || upper == 'V' ? 1
+                : upper == 'C' ? 6
+                : upper == 'S' || upper == 'Q' ? 4
+                : upper == 'A' ? 7
+                : 2;
+            bool complete = true;
+            for(int i = 0; i < count && complete; i++){
+                if(upper == 'A' && (i == 3 || i == 4)){
+                    // Flags may be written without separators
+                    while(*cursor == ' ' || *cursor == ','){
+                        cursor++;
+                    }
+                    if(*cursor != '0' && *cursor != '1'){
+                        complete = false;
+                        break;
+                    }
+                    a[i] = *cursor++ == '1' ? 1 : 0;
+                    continue;
+                }
+                complete = parse_number(cursor, a[i]);
+            }
+            if(!complete){
+                break;
+            }
+
+            switch(upper){
+                case 'M':
+                    x = base_x + a[0];
+                    y = base_y + a[1];
+                    travel(x, y);
+                    start_x = x;
+                    start_y = y;
+                    // Further pairs are lines
+                    command = relative ? 'l' : 'L';
+                    break;
+                case 'L':
+                    x = base_x + a[0];
+                    y = base_y + a[1];
+                    draw(x, y);
+                    break;
+                case 'H':
+                    x = base_x + a[0];
+                    draw(x, y);
+                    break;
+                case 'V':
+                    y = (relative ? y : 0) + a[0];
+                    draw(x, y);
+                    break;
+                case 'C':
+                case 'S':{
+                    double x1, y1;
+                    int offset = 0;
+                    if(upper == 'C'){
+                        x1 = base_x + a[0];
+                        y1 = base_y + a[1];
+                        offset = 2;
+                    }
+                    else if(previous == 'C' || previous == 'S'){
+                        x1 = 2 * x - control_x;
+                        y1 = 2 * y - control_y;
+                    }
+                    else{
+                        x1 = x;
+                        y1 = y;
+                    }
+                    double x2 = base_x + a[offset];
+                    double y2 = base_y + a[offset + 1];
+                    double x3 = base_x + a[offset + 2];
+                    double y3 = base_y + a[offset + 3];
+                    double bend = 6 * std::max(std::hypot(x - 2 * x1 + x2, y - 2 * y1 + y2),
+                            std::hypot(x1 - 2 * x2 + x3, y1 - 2 * y2 + y3));
+                    int segments = curve_segments(bend, tolerance);
+                    for(int i = 1; i <= segments; i++){
+                        double t = static_cast<double>(i) / segments;
+                        double u = 1 - t;
+                        draw(u * u * u * x + 3 * u * u * t * x1 + 3 * u * t * t * x2 + t * t * t * x3,
+                                u * u * u * y + 3 * u * u * t * y1 + 3 * u * t * t * y2 + t * t * t * y3);
+                    }
+                    control_x = x2;
+                    control_y = y2;
+                    x = x3;
+                    y = y3;
+                    break;
+                }
+                case 'Q':
+                case 'T':{
+                    double x1, y1;
+                    int offset = 0;
+                    if(upper == 'Q'){
+                        x1 = base_x + a[0];
+                        y1 = base_y + a[1];
+                        offset = 2;
+                    }
+                    else if(previous == 'Q' || previous == 'T'){
+                        x1 = 2 * x - control_x;
+                        y1 = 2 * y - control_y;
+                    }
+                    else{
+                        x1 = x;
+                        y1 = y;
+                    }
+                    double x2 = base_x + a[offset];
+                    double y2 = base_y + a[offset + 1];
+                    int segments = curve_segments(2 * std::hypot(x - 2 * x1 + x2, y - 2 * y1 + y2), tolerance);
+                    for(int i = 1; i <= segments; i++){
+                        double t = static_cast<double>(i) / segments;
+                        double u = 1 - t;
+                        draw(u * u * x + 2 * u * t * x1 + t * t * x2, u * u * y + 2 * u * t * y1 + t * t * y2);
+                    }
+                    control_x = x1;
+                    control_y = y1;
+                    x = x2;
+                    y = y2;
+                    break;
+                }
+                default:{
+                    // Elliptical arc, converted to center form as in the SVG
+                    // specification's implementation notes
+                    double rx = std::fabs(a[0]);
+                    double ry = std::fabs(a[1]);
+                    double rotation = a[2] * pi / 180;
+                    double end_x = base_x + a[5];
+                    double end_y = base_y + a[6];
+                    if(rx == 0 || ry == 0){
+                        draw(end_x, end_y);
+                        x = end_x;
+                        y = end_y;
+                        break;
+                    }
+                    double cos_r = std::cos(rotation);
+                    double sin_r = std::sin(rotation);
+                    double dx = (x - end_x) / 2;
+                    double dy = (y - end_y) / 2;
+                    double px = cos_r * dx + sin_r * dy;
+                    double py = -sin_r * dx + cos_r * dy;
+                    double lambda = (px * px) / (rx * rx) + (py * py) / (ry * ry);
+                    if(lambda > 1){
+                        rx *= std::sqrt(lambda);
+                        ry *= std::sqrt(lambda);
+                    }
+                    double numerator = rx * rx * ry * ry - rx * rx * py * py - ry * ry * px * px;
+                    double denominator = rx * rx * py * py + ry * ry * px * px;
+                    double factor = std::sqrt(std::max(0.0, numerator / denominator));
+                    if((a[3] != 0) == (a[4] != 0)){
+                        factor = -factor;
+                    }
+                    double cx_p = factor * rx * py / ry;
+                    double cy_p = -factor * ry * px / rx;
+                    double center_x = cos_r * cx_p - sin_r * cy_p + (x + end_x) / 2;
+                    double center_y = sin_r * cx_p + cos_r * cy_p + (y + end_y) / 2;
+                    double start_angle = std::atan2((py - cy_p) / ry, (px - cx_p) / rx);
+                    double end_angle = std::atan2((-py - cy_p) / ry, (-px - cx_p) / rx);
+                    double sweep = end_angle - start_angle;
+                    if(a[4] != 0 && sweep < 0){
+                        sweep += 2 * pi;
+                    }
+                    else if(a[4] == 0 && sweep > 0){
+                        sweep -= 2 * pi;
+                    }
+                    double radius = std::max(rx, ry);
+                    int segments = curve_segments(radius * sweep * sweep, tolerance);
+                    for(int i = 1; i < segments; i++){
+                        double angle = start_angle + sweep * i / segments;
+                        double ex = rx * std::cos(angle);
+                        double ey = ry * std::sin(angle);
+                        draw(center_x + cos_r * ex - sin_r * ey, center_y + sin_r * ex + cos_r * ey);
+                    }
+                    draw(end_x, end_y);
+                    x = end_x;
+                    y = end_y;
+                    break;
+                }
+            }
+            previous = upper;
+        }
+    }
+
+/******************************************************************************/
+/*                                    Files                                   */
+/******************************************************************************/
+    namespace{
+        template<class Importer>
+        command_source open_with(const std::string& path, const import_config& config){
+            struct reader{
+                std::ifstream in;
+                Importer importer;
+
+                reader(const std::string& path, const import_config& config)
+                    :   in(path),
+                        importer(in, config){}
+            };
+            auto state = std::make_shared<reader>(path, config);
+            if(!state->in){
+                throw std::runtime_error("Unable to open " + path);
+            }
+            return [state](move_command& command){
+                return state->importer.next(command);
+            };
+        }
+    }
+
+    command_source open_job(const std::string& path, const import_config& config){
+        std::size_t dot = path.find_last_of('.');
+        std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                [](unsigned char c){return static_cast<char>(std::tolower(c));});
+        if(extension == "svg"){
+            return open_with<svg_importer>(path, config);
+        }
+        return open_with<gcode_importer>(path, config);
+    }
+}
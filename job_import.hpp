@@ -0,0 +1,197 @@
+#ifndef JOB_IMPORT_HPP
+#define JOB_IMPORT_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "job_hatch.hpp"
+#include "job_ring.hpp"
+
+namespace plotter{
+
+    /**
+     * Supplies job commands in order, returns false at the end of the job
+     */
+    using command_source = std::function<bool(move_command&)>;
+
+    struct import_config{
+        /**
+         * Speeds in micrometers per second, for moves that don't give one
+         */
+        std::int64_t draw_feed = 20000;
+        std::int64_t travel_feed = 60000;
+
+        /**
+         * Size of an SVG user unit in nanometers, 96 per inch by default
+         */
+        double svg_unit = 25.4e6 / 96;
+
+        /**
+         * Largest deviation of a flattened SVG curve from the true curve,
+         * in nanometers
+         */
+        double curve_tolerance = 20000;
+
+        /**
+         * Hatching of filled SVG shapes, off unless given a spacing
+         */
+        hatch_config hatch;
+    };
+
+    /**
+     * Reads G-code a line at a time, so only the current line is ever held.
+     * Understood: G0 G1 G2 G3 (X Y Z I J F), G20 G21, G90 G91, M3 and M5 to
+     * lower and lift the pen, Z, where zero or below lowers the pen, and T
+     * to swap pens. Other words are ignored. Each command is tagged with
+     * its line.
+     */
+    class gcode_importer{
+        private:
+            std::istream& m_in;
+            import_config m_config;
+            std::string m_line;
+            std::uint32_t m_line_number;
+
+            std::array<position::rep, 2> m_position;
+            double m_unit;
+            bool m_relative;
+            bool m_pen_down;
+            std::int64_t m_feed;
+            int m_motion;       // Modal G0 to G3
+            std::uint8_t m_tool;
+
+            /**
+             * Commands of the current line not yet handed out
+             */
+            std::array<move_command, 3> m_pending;
+            std::size_t m_pending_count;
+            std::size_t m_pending_next;
+
+            void parse_line();
+
+        public:
+            /**
+             * @param in: G-code text, read as the commands are taken
+             * @param config: speeds to use
+             */
+            gcode_importer(std::istream& in, const import_config& config=import_config());
+
+            bool next(move_command& command);
+    };
+
+    /**
+     * Reads SVG one tag at a time and turns each path, line, polyline,
+     * polygon, rect and circle into pen strokes. Curves are flattened into
+     * straight moves within the curve tolerance and circles become arcs.
+     * Each stroke colour, from the stroke attribute or style of the element
+     * or its groups, is a pen, numbered in the order the colours first
+     * appear.
+     *
+     * With a hatch spacing set, shapes given a fill are hatched with the
+     * pen of the fill colour after their outline, following fill-rule, and
+     * drawn without an outline when the stroke is none. Hatching runs on
+     * other threads while the importer reads on, up to the configured
+     * number of shapes at a time.
+     *
+     * Transforms and other styles are ignored. Memory use is bounded by the
+     * largest single element times the shapes read ahead.
+     */
+    class svg_importer{
+        private:
+            std::istream& m_in;
+            import_config m_config;
+            std::string m_tag;
+            std::uint32_t m_element;
+
+            struct element_style{
+                std::string stroke;
+                std::string fill;
+                bool even_odd = false;
+            };
+
+            /**
+             * Element read but not yet handed out, with the hatching of its
+             * fill still in progress
+             */
+            struct converted_element{
+                std::vector<move_command> commands;
+                std::future<std::vector<move_command>> hatch;
+            };
+
+            /**
+             * Commands of the current element not yet handed out
+             */
+            std::vector<move_command> m_pending;
+            std::size_t m_pending_next;
+
+            /**
+             * Commands of the element being converted, and the elements
+             * read ahead of the one being handed out
+             */
+            std::vector<move_command> m_converted;
+            std::deque<converted_element> m_ahead;
+            std::size_t m_hatching;
+            bool m_end;
+
+            bool m_pen_down;
+
+            /**
+             * Style of each open group, colours in order of first use and
+             * the pen of the last element
+             */
+            std::vector<element_style> m_groups;
+            std::vector<std::string> m_colours;
+            std::uint8_t m_tool;
+
+            /**
+             * Whether the element's outline is drawn and its fill hatched,
+             * and the rings of the fill
+             */
+            bool m_outline;
+            bool m_filling;
+            std::vector<hatch_path> m_rings;
+            std::future<std::vector<move_command>> m_hatch;
+
+            void read_ahead();
+            bool read_tag();
+            void select_tool(const std::string& colour);
+            void hatch(fill_rule rule);
+            void convert_tag();
+            void convert_path(const std::string& data);
+            void travel(double x, double y);
+            void draw(double x, double y);
+            void draw_arc(double x, double y, double center_x, double center_y, bool clockwise);
+            void lift();
+            void emit(move_command command);
+
+        public:
+            /**
+             * @param in: SVG text, read as the commands are taken
+             * @param config: speeds, unit size and curve tolerance
+             */
+            svg_importer(std::istream& in, const import_config& config=import_config());
+
+            bool next(move_command& command);
+    };
+
+    /**
+     * Open a job file, choosing the importer by extension: .svg for SVG and
+     * anything else for G-code
+     *
+     * @param path: file to read
+     * @param config: import settings
+     * @return: source that reads the file as commands are taken
+     */
+    command_source open_job(const std::string& path, const import_config& config=import_config());
+}
+
+#endif
@@ -0,0 +1,732 @@
+#include "job_pipeline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+#include "logging.hpp"
+
+namespace plotter{
+    namespace{
+        constexpr double pi = 3.14159265358979323846;
+
+        axis_positions command_target(const move_command& command){
+            axis_positions target;
+            for(std::size_t axis = 0; axis < max_axes; axis++){
+                target[axis] = position(command.target[axis]);
+            }
+            return target;
+        }
+
+        bool same_target(const move_command& command, const std::array<position::rep, max_axes>& at){
+            return command.target == at;
+        }
+    }
+
+/******************************************************************************/
+/*                                  Transform                                 */
+/******************************************************************************/
+    affine_transform affine_transform::place(double scale, double degrees, position offset_x, position offset_y){
+        double radians = degrees * pi / 180;
+        affine_transform transform;
+        transform.xx = scale * std::cos(radians);
+        transform.xy = -scale * std::sin(radians);
+        transform.yx = scale * std::sin(radians);
+        transform.yy = scale * std::cos(radians);
+        transform.offset_x = static_cast<double>(offset_x.count());
+        transform.offset_y = static_cast<double>(offset_y.count());
+        return transform;
+    }
+
+    bool affine_transform::is_similarity() const{
+        constexpr double epsilon = 1e-9;
+        bool rotation = std::fabs(xx - yy) < epsilon && std::fabs(xy + yx) < epsilon;
+        bool reflection = std::fabs(xx + yy) < epsilon && std::fabs(xy - yx) < epsilon;
+        return rotation || reflection;
+    }
+
+    void affine_transform::apply(position::rep& x, position::rep& y) const{
+        double in_x = static_cast<double>(x);
+        double in_y = static_cast<double>(y);
+        x = std::llround(xx * in_x + xy * in_y + offset_x);
+        y = std::llround(yx * in_x + yy * in_y + offset_y);
+    }
+
+/******************************************************************************/
+/*                                   Stages                                   */
+/******************************************************************************/
+    command_transform::command_transform(const pipeline_config& config)
+        :   m_transform(config.transform),
+            m_keep_arcs(config.transform.is_similarity() && config.machine.get_type() == kinematics::type::cartesian),
+            m_mirrored(config.transform.determinant() < 0),
+            m_tolerance(config.arc_tolerance / std::max(1e-9, std::max(
+                            std::hypot(config.transform.xx, config.transform.yx),
+                            std::hypot(config.transform.xy, config.transform.yy)))),
+            m_last(){}
+
+    bool command_transform::process(move_command command, const command_sink& emit){
+        if(command.type == move_command::kind::pen || command.type == move_command::kind::tool){
+            return emit(command);
+        }
+
+        std::array<position::rep, 2> start = m_last;
+        m_last = {{command.target[0], command.target[1]}};
+
+        if(command.type == move_command::kind::arc && !m_keep_arcs){
+            double center_x = static_cast<double>(command.center[0]);
+            double center_y = static_cast<double>(command.center[1]);
+            double radius = std::hypot(start[0] - center_x, start[1] - center_y);
+            double from = std::atan2(start[1] - center_y, start[0] - center_x);
+            double sweep = std::atan2(command.target[1] - center_y, command.target[0] - center_x) - from;
+            if(command.clockwise && sweep >= 0){
+                sweep -= 2 * pi;
+            }
+            else if(!command.clockwise && sweep <= 0){
+                sweep += 2 * pi;
+            }
+            double step = m_tolerance < radius ? 2 * std::acos(1 - m_tolerance / radius) : pi / 2;
+            std::size_t pieces = static_cast<std::size_t>(std::min(10000.0, std::max(1.0, std::ceil(std::fabs(sweep) / step))));
+
+            move_command piece = command;
+            piece.type = move_command::kind::move;
+            for(std::size_t i = 1; i <= pieces; i++){
+                if(i < pieces){
+                    double angle = from + sweep * static_cast<double>(i) / static_cast<double>(pieces);
+                    piece.target[0] = std::llround(center_x + radius * std::cos(angle));
+                    piece.target[1] = std::llround(center_y + radius * std::sin(angle));
+                }
+                else{
+                    piece.target[0] = command.target[0];
+                    piece.target[1] = command.target[1];
+                }
+                m_transform.apply(piece.target[0], piece.target[1]);
+                if(!emit(piece)){
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        m_transform.apply(command.target[0], command.target[1]);
+        if(command.type == move_command::kind::arc){
+            m_transform.apply(command.center[0], command.center[1]);
+            command.clockwise = command.clockwise != m_mirrored;
+        }
+        return emit(command);
+    }
+
+    command_optimizer::command_optimizer()
+        :   m_pen(pen_state::unknown),
+            m_at(),
+            m_sent_at(),
+            m_held_lift(false),
+            m_held_travel(false),
+            m_lift(),
+            m_travel(),
+            m_tool(0){}
+
+    bool command_optimizer::release(const command_sink& emit){
+        if(m_held_lift && !emit(m_lift)){
+            return false;
+        }
+        if(m_held_travel && !emit(m_travel)){
+            return false;
+        }
+        m_held_lift = false;
+        m_held_travel = false;
+        m_sent_at = m_at;
+        return true;
+    }
+
+    bool command_optimizer::process(move_command command, const command_sink& emit){
+        if(command.type == move_command::kind::tool){
+            if(command.tool == m_tool){
+                return true;
+            }
+            m_tool = command.tool;
+            // The pen comes off the paper for the swap, and the travel after
+            // a lift waits until after it. A pen that was drawing goes back
+            // down where it was.
+            bool was_down = m_pen == pen_state::down;
+            if(was_down){
+                m_lift = move_command{};
+                m_lift.type = move_command::kind::pen;
+                m_lift.line = command.line;
+                m_held_lift = true;
+            }
+            if(m_held_lift){
+                if(!emit(m_lift)){
+                    return false;
+                }
+                m_held_lift = false;
+            }
+            if(!emit(command)){
+                return false;
+            }
+            if(was_down){
+                move_command lower = m_lift;
+                lower.pen_down = true;
+                return emit(lower);
+            }
+            return true;
+        }
+        if(command.type == move_command::kind::pen){
+            if(!command.pen_down){
+                if(m_pen != pen_state::up){
+                    m_pen = pen_state::up;
+                    m_held_lift = true;
+                    m_lift = command;
+                }
+                return true;
+            }
+            if(m_pen == pen_state::down){
+                return true;
+            }
+            m_pen = pen_state::down;
+            if(m_held_lift && !m_held_travel){
+                // Lifted and lowered on the spot
+                m_held_lift = false;
+                return true;
+            }
+            return release(emit) && emit(command);
+        }
+
+        if(m_pen == pen_state::up){
+            // The path of a travel doesn't matter, only where it ends, so
+            // arcs and chains of travels become a single straight move
+            command.type = move_command::kind::move;
+            m_travel = command;
+            m_held_travel = !same_target(command, m_sent_at);
+            m_at = command.target;
+            return true;
+        }
+        if(command.type == move_command::kind::move && same_target(command, m_at)){
+            return true;
+        }
+        if(!release(emit) || !emit(command)){
+            return false;
+        }
+        m_at = command.target;
+        m_sent_at = m_at;
+        return true;
+    }
+
+    bool command_optimizer::finish(const command_sink& emit){
+        return release(emit);
+    }
+
+    command_planner::command_planner(const pipeline_config& config)
+        :   m_planner(config.motion),
+            m_kinematic(),
+            m_block(),
+            m_rejected(0),
+            m_cache(config.machine.get_type() != kinematics::type::polargraph ? config.cache : nullptr),
+            m_machine_hash(),
+            m_stroke_hash(),
+            m_piece(),
+            m_plan(),
+            m_uncached(false){
+        if(config.machine.get_type() != kinematics::type::cartesian){
+            m_kinematic = std::make_unique<kinematic_planner>(m_planner, config.machine);
+        }
+        m_machine_hash.add(plan_cache::version);
+        m_machine_hash.add(static_cast<std::uint64_t>(config.machine.get_type()));
+        m_machine_hash.add(config.motion);
+    }
+
+    bool command_planner::drain(const block_sink& emit){
+        while(m_planner.pop(m_block)){
+            if(!emit(m_block)){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool command_planner::add(const move_command& command){
+        switch(command.type){
+            case move_command::kind::move:
+                return m_kinematic ? m_kinematic->add_move(command_target(command), command.feed_rate)
+                    : m_planner.add_move(command_target(command), command.feed_rate);
+            case move_command::kind::arc:
+                return m_planner.add_arc(command_target(command),
+                        {{position(command.center[0]), position(command.center[1])}},
+                        command.clockwise,
+                        command.feed_rate);
+            case move_command::kind::tool:
+                return m_kinematic ? m_kinematic->add_tool(command.tool) : m_planner.add_tool(command.tool);
+            default:
+                return m_kinematic ? m_kinematic->add_pen(command.pen_down) : m_planner.add_pen(command.pen_down);
+        }
+    }
+
+    bool command_planner::plan(const move_command& command, std::uint32_t line, const block_sink& emit){
+        if(m_kinematic){
+            m_kinematic->set_line(line);
+        }
+        else{
+            m_planner.set_line(line);
+        }
+
+        try{
+            while(!add(command)){
+                if(m_kinematic){
+                    m_kinematic->pump();
+                }
+                if(!drain(emit)){
+                    return false;
+                }
+            }
+        }
+        catch(const std::invalid_argument&){
+            m_rejected++;
+            log_warning("Rejected the move from line {}", command.line);
+        }
+        return true;
+    }
+
+    bool command_planner::finish(const block_sink& emit){
+        while(m_kinematic && !m_kinematic->pump()){
+            if(!drain(emit)){
+                return false;
+            }
+        }
+        while(!m_planner.flush()){
+            if(!drain(emit)){
+                return false;
+            }
+        }
+        return drain(emit);
+    }
+
+    plan_state command_planner::state() const{
+        return plan_state{m_kinematic ? m_kinematic->target() : m_planner.target(), m_planner.target(), m_planner.steps()};
+    }
+
+    void command_planner::restore(const plan_state& state){
+        if(m_kinematic){
+            m_kinematic->set_position(state.cartesian);
+        }
+        m_planner.set_position(state.target, state.steps);
+    }
+
+    bool command_planner::plan_piece(const block_sink& emit){
+        plan_hasher hash = m_machine_hash;
+        plan_state start = state();
+        for(std::size_t axis = 0; axis < max_axes; axis++){
+            hash.add(static_cast<std::uint64_t>(start.cartesian[axis].count()));
+            hash.add(static_cast<std::uint64_t>(start.target[axis].count()));
+            hash.add(static_cast<std::uint64_t>(start.steps[axis]));
+        }
+        for(const move_command& command : m_piece){
+            hash.add(command);
+        }
+        plan_key key = hash.key();
+
+        // Cached blocks are tagged with the index of their command in the
+        // piece, which is swapped for the command's own line on the way out
+        if(m_cache->load(key, m_plan)){
+            for(planned_block block : m_plan.blocks){
+                block.line = block.line < m_piece.size() ? m_piece[block.line].line : 0;
+                if(!emit(block)){
+                    return false;
+                }
+            }
+            m_rejected += m_plan.rejected;
+            restore(m_plan.end);
+            m_piece.clear();
+            return true;
+        }
+
+        m_plan.blocks.clear();
+        std::uint64_t rejected = m_rejected;
+        block_sink record = [this, &emit](const planned_block& block){
+            m_plan.blocks.push_back(block);
+            planned_block tagged = block;
+            tagged.line = m_piece[block.line].line;
+            return emit(tagged);
+        };
+        for(std::size_t index = 0; index < m_piece.size(); index++){
+            if(!plan(m_piece[index], static_cast<std::uint32_t>(index), record)){
+                return false;
+            }
+        }
+        if(!finish(record)){
+            return false;
+        }
+        m_plan.end = state();
+        m_plan.rejected = m_rejected - rejected;
+        m_piece.clear();
+        try{
+            m_cache->store(key, m_plan);
+        }
+        catch(const std::runtime_error&){
+            log_warning("Unable to store a plan in the cache");
+        }
+        return true;
+    }
+
+    bool command_planner::process(const move_command& command, const block_sink& emit){
+        if(!m_cache){
+            return plan(command, command.line, emit);
+        }
+
+        bool lift = command.type == move_command::kind::tool
+            || (command.type == move_command::kind::pen && !command.pen_down);
+        if(m_uncached){
+            if(!plan(command, command.line, emit)){
+                return false;
+            }
+            if(lift){
+                m_uncached = false;
+                return finish(emit);
+            }
+            return true;
+        }
+
+        m_piece.push_back(command);
+        m_stroke_hash.add(command);
+        if(lift){
+            bool end = (m_stroke_hash.key().low & 15) == 0 || m_piece.size() >= piece_commands;
+            m_stroke_hash = plan_hasher();
+            return !end || plan_piece(emit);
+        }
+        if(m_piece.size() >= max_piece_commands){
+            for(const move_command& held : m_piece){
+                if(!plan(held, held.line, emit)){
+                    return false;
+                }
+            }
+            m_piece.clear();
+            m_uncached = true;
+        }
+        return true;
+    }
+
+    void command_planner::set_position(const axis_positions& target, const axis_steps& steps){
+        if(m_kinematic){
+            m_kinematic->set_position(target);
+        }
+        else{
+            m_planner.set_position(target);
+        }
+        m_planner.set_position(m_planner.target(), steps);
+    }
+
+    bool command_planner::flush(const block_sink& emit){
+        m_uncached = false;
+        if(!m_piece.empty() && !plan_piece(emit)){
+            return false;
+        }
+        return finish(emit);
+    }
+
+/******************************************************************************/
+/*                                  Pipeline                                  */
+/******************************************************************************/
+    job_pipeline::job_pipeline(command_source source, const pipeline_config& config, tick_handler on_tick)
+        :   m_source(std::move(source)),
+            m_config(config),
+            m_on_tick(std::move(on_tick)),
+            m_imported(config.queue_capacity),
+            m_transformed(config.queue_capacity),
+            m_optimized(config.queue_capacity),
+            m_planned(config.queue_capacity),
+            m_lift_mutex(),
+            m_arena(job_arena::size_of<lift_mark>(lifts_in_flight(config))),
+            m_lifts(m_arena, lifts_in_flight(config)),
+            m_resuming(false),
+            m_rehomed(false),
+            m_resume(),
+            m_ticks(0),
+            m_rejected(0),
+            m_cancelled(false),
+            m_error_mutex(),
+            m_error(),
+            m_threads(){}
+
+    job_pipeline::~job_pipeline(){
+        cancel();
+        for(std::thread& thread : m_threads){
+            if(thread.joinable()){
+                thread.join();
+            }
+        }
+    }
+
+    std::size_t job_pipeline::lifts_in_flight(const pipeline_config& config){
+        // Every lift planned and not yet executed is the command being
+        // planned, a pen block in the planner, the queue to the execute
+        // stage or the current and next block of the executor, or a command
+        // of the piece the cache is holding back
+        std::size_t blocks = 1 + motion_planner::lookahead + motion_planner::output_capacity
+            + config.queue_capacity + 2;
+        return config.cache ? blocks + command_planner::piece_commands + 1 : blocks;
+    }
+
+    void job_pipeline::resume(const job_checkpoint& checkpoint, bool rehomed){
+        if(!m_threads.empty()){
+            throw std::runtime_error("Pipeline already started");
+        }
+        m_resuming = true;
+        m_rehomed = rehomed;
+        m_resume = checkpoint;
+    }
+
+    void job_pipeline::start(){
+        if(!m_threads.empty()){
+            throw std::runtime_error("Pipeline already started");
+        }
+        m_threads.emplace_back(&job_pipeline::run_stage, this, &job_pipeline::import_stage);
+        m_threads.emplace_back(&job_pipeline::run_stage, this, &job_pipeline::transform_stage);
+        m_threads.emplace_back(&job_pipeline::run_stage, this, &job_pipeline::optimize_stage);
+        m_threads.emplace_back(&job_pipeline::run_stage, this, &job_pipeline::plan_stage);
+        m_threads.emplace_back(&job_pipeline::run_stage, this, &job_pipeline::execute_stage);
+    }
+
+    void job_pipeline::wait(){
+        for(std::thread& thread : m_threads){
+            if(thread.joinable()){
+                thread.join();
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_error_mutex);
+        if(m_error){
+            std::rethrow_exception(m_error);
+        }
+    }
+
+    void job_pipeline::cancel(){
+        m_cancelled.store(true, std::memory_order_relaxed);
+        close_all();
+    }
+
+    void job_pipeline::close_all(){
+        m_imported.close();
+        m_transformed.close();
+        m_optimized.close();
+        m_planned.close();
+    }
+
+    std::array<stage_stats, job_pipeline::stage_count> job_pipeline::stats() const{
+        return {{
+            {"import", m_imported.pushed(), 0, m_imported.push_wait_ns()},
+            {"transform", m_transformed.pushed(), m_imported.pop_wait_ns(), m_transformed.push_wait_ns()},
+            {"optimize", m_optimized.pushed(), m_transformed.pop_wait_ns(), m_optimized.push_wait_ns()},
+            {"plan", m_planned.pushed(), m_optimized.pop_wait_ns(), m_planned.push_wait_ns()},
+            {"execute", m_ticks.load(std::memory_order_relaxed), m_planned.pop_wait_ns(), 0}
+        }};
+    }
+
+    void job_pipeline::started(const char* stage){
+        if(m_config.on_stage_start){
+            m_config.on_stage_start(stage);
+        }
+    }
+
+    void job_pipeline::run_stage(void (job_pipeline::*stage)()){
+        try{
+            (this->*stage)();
+        }
+        catch(...){
+            {
+                std::lock_guard<std::mutex> lock(m_error_mutex);
+                if(!m_error){
+                    m_error = std::current_exception();
+                }
+            }
+            log_error("Job pipeline stage failed, cancelling the job");
+            cancel();
+        }
+    }
+
+    void job_pipeline::import_stage(){
+        started("import");
+        move_command command;
+        while(!m_cancelled.load(std::memory_order_relaxed) && m_source(command)){
+            if(!m_imported.push(command)){
+                break;
+            }
+        }
+        m_imported.close();
+    }
+
+    void job_pipeline::transform_stage(){
+        command_transform transform(m_config);
+        command_sink emit = [this](const move_command& command){
+            return m_transformed.push(command);
+        };
+        started("transform");
+        move_command command;
+        while(m_imported.pop(command)){
+            if(!transform.process(command, emit)){
+                break;
+            }
+        }
+        m_transformed.close();
+    }
+
+    void job_pipeline::optimize_stage(){
+        command_optimizer optimizer;
+        // Commands already executed before the checkpoint
+        std::uint64_t skip = m_resuming ? m_resume.offset : 0;
+        command_sink emit = [this, &skip](const move_command& command){
+            if(skip > 0){
+                skip--;
+                return true;
+            }
+            return m_optimized.push(command);
+        };
+        started("optimize");
+        move_command command;
+        bool running = true;
+        while(running && m_transformed.pop(command)){
+            running = optimizer.process(command, emit);
+        }
+        if(running){
+            optimizer.finish(emit);
+        }
+        m_optimized.close();
+    }
+
+    void job_pipeline::plan_stage(){
+        command_planner planner(m_config);
+        block_sink emit = [this](const planned_block& block){
+            return m_planned.push(block);
+        };
+        bool checkpoints = !m_config.checkpoint_path.empty();
+        std::uint64_t offset = 0;
+        axis_positions target{};
+        if(m_resuming){
+            offset = m_resume.offset;
+            if(!m_rehomed){
+                target = m_resume.target;
+                planner.set_position(m_resume.target, m_resume.position);
+            }
+        }
+        started("plan");
+        move_command command;
+        while(!m_cancelled.load(std::memory_order_relaxed)){
+            if(!m_optimized.try_pop(command)){
+                // Nothing more to look ahead at, so let the executor have
+                // everything rather than starve it
+                if((!m_config.cache && !planner.flush(emit)) || !m_optimized.pop(command)){
+                    break;
+                }
+            }
+            offset++;
+            if(command.type == move_command::kind::move || command.type == move_command::kind::arc){
+                target = command_target(command);
+            }
+            else if(checkpoints && command.type == move_command::kind::pen && !command.pen_down){
+                std::lock_guard<std::mutex> lock(m_lift_mutex);
+                lift_mark mark{offset, target};
+                if(!m_lifts.push(mark)){
+                    // Dropping a mark would pair every later lift with the
+                    // offset of another, so checkpoints would resume at the
+                    // wrong command
+                    throw std::runtime_error("More lifts in flight than the pipeline holds");
+                }
+            }
+            bool running = planner.process(command, emit);
+            m_rejected.store(planner.rejected(), std::memory_order_relaxed);
+            if(!running){
+                break;
+            }
+        }
+        if(!m_cancelled.load(std::memory_order_relaxed)){
+            planner.flush(emit);
+        }
+        m_planned.close();
+    }
+
+    void job_pipeline::execute_stage(){
+        motion_executor executor([this](planned_block& block){
+            return m_planned.pop(block);
+        }, m_config.timing);
+
+        std::unique_ptr<checkpoint_writer> writer;
+        if(!m_config.checkpoint_path.empty()){
+            writer = std::make_unique<checkpoint_writer>(m_config.checkpoint_path);
+        }
+        std::uint64_t job_us = 0;
+        std::uint8_t tool = 0;
+        if(m_resuming){
+            job_us = m_resume.time_us;
+            tool = m_resume.tool;
+            if(!m_rehomed){
+                executor.set_position(m_resume.position);
+            }
+        }
+        std::uint64_t last_checkpoint_us = job_us;
+        bool checkpoint_due = false;
+        lift_mark lift{};
+        for(stall_monitor& monitor : m_config.stall_monitors){
+            monitor.rebase(executor.position()[monitor.axis()]);
+        }
+
+        // Shaped steps trail the executor, the steppers are where the
+        // shaper's output has taken them
+        std::unique_ptr<input_shaper> shaper;
+        axis_steps origin = executor.position();
+        if(is_shaped(m_config.shapers, m_config.motion.axis_count)){
+            shaper = std::make_unique<input_shaper>([&executor](step_tick& unshaped){
+                        return executor.next(unshaped);
+                    }, m_config.shapers, m_config.motion.axis_count,
+                    shaper_capacity(m_config.shapers, m_config.motion));
+        }
+        auto stepped = [&](std::size_t axis){
+            return shaper ? origin[axis] + shaper->output_steps(axis) : executor.position()[axis];
+        };
+
+        started("execute");
+        step_tick tick;
+        // A halt stops the shaper's delayed steps as well
+        while(!m_cancelled.load(std::memory_order_relaxed) && !executor.is_halted()
+                && (shaper ? shaper->next(tick) : executor.next(tick))){
+            m_on_tick(tick, executor);
+            m_ticks.fetch_add(1, std::memory_order_relaxed);
+            for(stall_monitor& monitor : m_config.stall_monitors){
+                monitor.check(executor, stepped(monitor.axis()));
+            }
+            if(!writer){
+                continue;
+            }
+
+            job_us += tick.interval;
+            if(tick.pen == pen_action::swap){
+                tool = executor.tool();
+            }
+            else if(tick.pen == pen_action::lift){
+                std::lock_guard<std::mutex> lock(m_lift_mutex);
+                if(m_lifts.pop(lift)){
+                    checkpoint_due = job_us - last_checkpoint_us >= m_config.checkpoint_interval_us;
+                }
+            }
+            // The lift is issued ahead of the end of the move, the machine
+            // is only where the checkpoint says once the move is done
+            if(checkpoint_due && !executor.is_moving()){
+                axis_steps position = executor.position();
+                for(std::size_t axis = 0; axis < m_config.motion.axis_count; axis++){
+                    position[axis] = stepped(axis);
+                }
+                job_checkpoint checkpoint{lift.offset, job_us, tool, lift.target, position, {}};
+                if(m_config.on_checkpoint){
+                    m_config.on_checkpoint(checkpoint);
+                }
+                writer->post(checkpoint);
+                last_checkpoint_us = job_us;
+                checkpoint_due = false;
+            }
+        }
+        if(executor.is_halted() && !m_cancelled.load(std::memory_order_relaxed)){
+            // The stages feeding the executor would wait on full queues
+            // forever, failing the job cancels them. The checkpoint stays.
+            throw std::runtime_error("Machine halted during the job");
+        }
+        if(writer && !m_cancelled.load(std::memory_order_relaxed)){
+            writer->remove();
+        }
+    }
+}
@@ -0,0 +1,485 @@
+#ifndef JOB_PIPELINE_HPP
+#define JOB_PIPELINE_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "encoder.hpp"
+#include "input_shaper.hpp"
+#include "job_arena.hpp"
+#include "job_checkpoint.hpp"
+#include "job_import.hpp"
+#include "kinematics.hpp"
+#include "motion.hpp"
+#include "plan_cache.hpp"
+
+namespace plotter{
+
+    /**
+     * Affine map applied to the X and Y of a job, in nanometers:
+     * x' = xx * x + xy * y + offset_x, y' = yx * x + yy * y + offset_y
+     */
+    struct affine_transform{
+        double xx = 1;
+        double xy = 0;
+        double yx = 0;
+        double yy = 1;
+        double offset_x = 0;
+        double offset_y = 0;
+
+        /**
+         * Scale uniformly, then rotate counterclockwise, then shift
+         *
+         * @param scale: scale factor
+         * @param degrees: rotation
+         * @param offset_x: shift along x
+         * @param offset_y: shift along y
+         * @return: the transform
+         */
+        static affine_transform place(double scale, double degrees, position offset_x, position offset_y);
+
+        /**
+         * @return: true if circles stay circles, so arcs can be mapped
+         *          exactly by their end points and center
+         */
+        bool is_similarity() const;
+
+        /**
+         * @return: negative if the transform mirrors, which reverses arcs
+         */
+        double determinant() const{return xx * yy - xy * yx;}
+
+        void apply(position::rep& x, position::rep& y) const;
+    };
+
+    struct pipeline_config{
+        motion_config motion;
+        kinematics machine;
+        affine_transform transform;
+        pen_timing timing;
+
+        /**
+         * Items each queue between two stages holds, which bounds the
+         * memory of the whole pipeline whatever the size of the job
+         */
+        std::size_t queue_capacity = 256;
+
+        /**
+         * Largest deviation of an arc that has to be split into straight
+         * moves, in nanometers
+         */
+        double arc_tolerance = 10000;
+
+        /**
+         * Where to keep planned blocks for reuse, none to plan every job
+         * afresh. See command_planner.
+         */
+        std::shared_ptr<plan_cache> cache;
+
+        /**
+         * File to keep a checkpoint of the job in, empty to take none. See
+         * job_pipeline::resume().
+         */
+        std::string checkpoint_path;
+
+        /**
+         * Microseconds of the job between checkpoints
+         */
+        std::uint64_t checkpoint_interval_us = 30000000;
+
+        /**
+         * Called on the execute thread with each checkpoint before it is
+         * saved, to add what only the owner of the steppers knows, i.e. with
+         * save_coil_phases()
+         */
+        std::function<void(job_checkpoint&)> on_checkpoint;
+
+        /**
+         * Called on each stage's thread with the name of the stage, once it
+         * is set up and before it takes its first item, i.e. to pin the
+         * thread or to watch it for allocations
+         */
+        std::function<void(const char*)> on_stage_start;
+
+        /**
+         * Checked on every tick, a stall halts the executor and fails the
+         * job. Lined up with the executor when the job starts.
+         */
+        std::vector<stall_monitor> stall_monitors;
+
+        /**
+         * Shaper of each axis. If any is set the executor's steps pass
+         * through an input_shaper before they reach the tick handler.
+         */
+        std::array<shaper_config, max_axes> shapers{};
+    };
+
+    /**
+     * Takes the output of a stage, returns false to stop the stage
+     */
+    using command_sink = std::function<bool(const move_command&)>;
+    using block_sink = std::function<bool(const planned_block&)>;
+
+    /**
+     * Applies the affine transform to commands, splitting arcs that the
+     * transform or the kinematics can't keep circular into straight moves
+     */
+    class command_transform{
+        private:
+            affine_transform m_transform;
+            bool m_keep_arcs;
+            bool m_mirrored;
+
+            /**
+             * Arc tolerance before the transform scales it
+             */
+            double m_tolerance;
+
+            /**
+             * End of the last move, before transforming
+             */
+            std::array<position::rep, 2> m_last;
+
+        public:
+            explicit command_transform(const pipeline_config& config);
+
+            /**
+             * @param command: next command of the job
+             * @param emit: receives the transformed commands
+             * @return: false if the sink stopped the stage
+             */
+            bool process(move_command command, const command_sink& emit);
+    };
+
+    /**
+     * Drops redundant pen and tool commands and zero length moves, joins
+     * consecutive travel moves and cancels a lift that is followed by a
+     * lower without any travel in between. The pen is lifted before every
+     * pen swap. It only sees the commands passing through it, so it never
+     * reorders strokes; see batch_by_tool() for that.
+     */
+    class command_optimizer{
+        private:
+            enum class pen_state{
+                unknown,    // Until the first pen command
+                up,
+                down
+            };
+
+            pen_state m_pen;
+
+            /**
+             * Where the machine will be, and where the commands sent on so
+             * far take it
+             */
+            std::array<position::rep, max_axes> m_at;
+            std::array<position::rep, max_axes> m_sent_at;
+
+            /**
+             * A lift and the travel after it are held back until the next
+             * pen command or drawing move shows whether they are needed
+             */
+            bool m_held_lift;
+            bool m_held_travel;
+            move_command m_lift;
+            move_command m_travel;
+
+            /**
+             * Pen fitted, 0 until the first tool command
+             */
+            std::uint8_t m_tool;
+
+            bool release(const command_sink& emit);
+
+        public:
+            command_optimizer();
+
+            /**
+             * @param command: next command of the job
+             * @param emit: receives the commands that are kept
+             * @return: false if the sink stopped the stage
+             */
+            bool process(move_command command, const command_sink& emit);
+
+            /**
+             * Send on whatever is held back at the end of the job
+             *
+             * @param emit: receives the commands
+             * @return: false if the sink stopped the stage
+             */
+            bool finish(const command_sink& emit);
+    };
+
+    /**
+     * Feeds commands to the motion planner, through the kinematics when the
+     * machine isn't Cartesian, and hands on the blocks as they are
+     * finalized
+     *
+     * With a plan cache the job is planned in pieces that end at a pen lift
+     * or swap, where the machine stops anyway. Each piece is keyed by the
+     * machine configuration, where the planner starts and the commands of
+     * the piece, and streamed from the cache when the same piece has been
+     * planned before. Where a piece ends depends only on the stroke before
+     * the lift, so a change to one part of a job leaves the pieces of the
+     * rest as they were and they are still found in the cache. Polargraph
+     * machines are always planned afresh, their geometry isn't part of the
+     * key.
+     */
+    class command_planner{
+        public:
+            /**
+             * Commands after which a piece ends at the next lift whatever
+             * the stroke before it
+             */
+            static constexpr std::size_t piece_commands = 4096;
+
+            /**
+             * Commands after which a piece still without a lift is given up
+             * on and planned uncached until the next lift
+             */
+            static constexpr std::size_t max_piece_commands = 65536;
+
+        private:
+            motion_planner m_planner;
+            std::unique_ptr<kinematic_planner> m_kinematic;
+            planned_block m_block;
+            std::uint64_t m_rejected;
+
+            std::shared_ptr<plan_cache> m_cache;
+            plan_hasher m_machine_hash;
+            plan_hasher m_stroke_hash;
+            std::vector<move_command> m_piece;
+            cached_plan m_plan;
+            bool m_uncached;
+
+            bool drain(const block_sink& emit);
+            bool add(const move_command& command);
+            bool plan(const move_command& command, std::uint32_t line, const block_sink& emit);
+            bool finish(const block_sink& emit);
+            bool plan_piece(const block_sink& emit);
+            plan_state state() const;
+            void restore(const plan_state& state);
+
+        public:
+            explicit command_planner(const pipeline_config& config);
+
+            command_planner(const command_planner&) = delete;
+            command_planner& operator=(const command_planner&) = delete;
+
+            /**
+             * Plan a command. A command the planner refuses is counted and
+             * skipped, one bad move doesn't stop the job.
+             *
+             * @param command: next command of the job
+             * @param emit: receives finalized blocks
+             * @return: false if the sink stopped the stage
+             */
+            bool process(const move_command& command, const block_sink& emit);
+
+            /**
+             * Finalize everything planned so far, coming to a stop
+             *
+             * @param emit: receives the blocks
+             * @return: false if the sink stopped the stage
+             */
+            bool flush(const block_sink& emit);
+
+            /**
+             * Plan on from a position without moving. Must only be called
+             * while nothing is planned.
+             *
+             * @param target: end of the last move, before the kinematics
+             * @param steps: step position of every axis
+             */
+            void set_position(const axis_positions& target, const axis_steps& steps);
+
+            std::uint64_t rejected() const{return m_rejected;}
+    };
+
+    /**
+     * Receives each step event as the execute stage produces it, and may
+     * steer the executor, i.e. resume it once a pen swap is done
+     */
+    using tick_handler = std::function<void(const step_tick&, motion_executor&)>;
+
+    /**
+     * Throughput of a pipeline stage
+     */
+    struct stage_stats{
+        const char* name;
+
+        /**
+         * Items the stage has produced: commands, blocks, or ticks for the
+         * execute stage
+         */
+        std::uint64_t items;
+
+        /**
+         * Time spent waiting for input, high in stages that are fed too
+         * slowly
+         */
+        std::uint64_t starved_ns;
+
+        /**
+         * Time spent waiting for room in the next queue, high in stages
+         * that run ahead of the machine
+         */
+        std::uint64_t blocked_ns;
+    };
+
+    /**
+     * Runs a job as a chain of stages, each on its own thread and joined
+     * by bounded queues:
+     *
+     *  import    reads commands from the source
+     *  transform see command_transform
+     *  optimize  see command_optimizer
+     *  plan      see command_planner
+     *  execute   turns planned blocks into step events for the handler
+     *
+     * A full queue stops the stage feeding it, so the whole pipeline runs
+     * at the pace of the machine and only the queues' worth of the job is
+     * ever in memory.
+     *
+     * Past the import stage, which parses the job, nothing is allocated
+     * once the stages have started unless a plan cache is in use: the
+     * queues and planners have fixed capacity and what the stages share
+     * about the job is kept in a job_arena sized when the pipeline is
+     * built.
+     *
+     * With a checkpoint path set, the execute stage saves a job_checkpoint
+     * every so often, the first time the machine stops at a pen lift once
+     * the interval is up. The plan stage tells it which command each lift
+     * came from. The checkpoint is deleted once the job is done.
+     *
+     * The planner is flushed, bringing the machine to a stop, only when
+     * its input runs dry, as drain_planner() does. With a plan cache it
+     * waits for input instead, so the pieces of a job don't depend on how
+     * fast it arrives.
+     */
+    class job_pipeline{
+        public:
+            static constexpr std::size_t stage_count = 5;
+
+        private:
+            command_source m_source;
+            pipeline_config m_config;
+            tick_handler m_on_tick;
+
+            bounded_queue<move_command> m_imported;
+            bounded_queue<move_command> m_transformed;
+            bounded_queue<move_command> m_optimized;
+            bounded_queue<planned_block> m_planned;
+
+            /**
+             * Offset of each lift planned but not yet executed, and the end
+             * of the move before it
+             */
+            struct lift_mark{
+                std::uint64_t offset;
+                axis_positions target;
+            };
+            std::mutex m_lift_mutex;
+            job_arena m_arena;
+            arena_ring<lift_mark> m_lifts;
+
+            bool m_resuming;
+            bool m_rehomed;
+            job_checkpoint m_resume;
+
+            std::atomic<std::uint64_t> m_ticks;
+            std::atomic<std::uint64_t> m_rejected;
+            std::atomic<bool> m_cancelled;
+
+            std::mutex m_error_mutex;
+            std::exception_ptr m_error;
+
+            std::vector<std::thread> m_threads;
+
+            static std::size_t lifts_in_flight(const pipeline_config& config);
+
+            void run_stage(void (job_pipeline::*stage)());
+            void started(const char* stage);
+            void close_all();
+
+            void import_stage();
+            void transform_stage();
+            void optimize_stage();
+            void plan_stage();
+            void execute_stage();
+
+        public:
+            /**
+             * @param source: job commands
+             * @param config: machine and pipeline settings
+             * @param on_tick: called from the execute thread with every step
+             *                 event, may block to pace the machine
+             */
+            job_pipeline(command_source source, const pipeline_config& config, tick_handler on_tick);
+
+            job_pipeline(const job_pipeline&) = delete;
+            job_pipeline& operator=(const job_pipeline&) = delete;
+
+            /**
+             * Cancels the job if it is still running
+             */
+            ~job_pipeline();
+
+            /**
+             * Carry on from a checkpoint rather than from the start of the
+             * job. The commands before it are read and optimized again, so
+             * every stage is in the state it was, but not planned or
+             * executed. Call before start().
+             *
+             * @param checkpoint: where to carry on from
+             * @param rehomed: true if the machine has been homed since and
+             *                 is at the origin, false if it held the
+             *                 checkpoint's position, see teleport_steppers()
+             */
+            void resume(const job_checkpoint& checkpoint, bool rehomed);
+
+            /**
+             * Start the stage threads
+             */
+            void start();
+
+            /**
+             * Wait for the job to finish
+             *
+             * @throw: the first exception thrown by any stage, runtime_error
+             *         if the executor was halted
+             */
+            void wait();
+
+            /**
+             * Stop every stage as soon as possible, dropping the rest of the
+             * job
+             */
+            void cancel();
+
+            /**
+             * @return: commands that the planner refused, such as moves that
+             *          don't fit in a block
+             */
+            std::uint64_t rejected() const{return m_rejected.load(std::memory_order_relaxed);}
+
+            /**
+             * @return: counters of each stage in pipeline order, safe to read
+             *          while the job runs
+             */
+            std::array<stage_stats, stage_count> stats() const;
+    };
+}
+
+#endif
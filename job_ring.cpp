@@ -0,0 +1,264 @@
+#include "job_ring.hpp"
+
+#include <cerrno>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace plotter{
+    namespace{
+        void close_fd(int fd){
+            if(fd >= 0){
+                ::close(fd);
+            }
+        }
+
+        void signal_fd(int fd){
+            std::uint64_t one = 1;
+            // A full counter still wakes the reader, so the result is of no
+            // interest
+            ssize_t written = ::write(fd, &one, sizeof(one));
+            static_cast<void>(written);
+        }
+
+        void clear_fd(int fd){
+            std::uint64_t count;
+            ssize_t result = ::read(fd, &count, sizeof(count));
+            static_cast<void>(result);
+        }
+
+        std::system_error os_error(const std::string& what){
+            return std::system_error(errno, std::generic_category(), what);
+        }
+    }
+
+    std::size_t job_ring::mapping_size(std::size_t capacity){
+        return sizeof(header) + capacity * sizeof(slot);
+    }
+
+    job_ring::job_ring(int memory_fd, int data_fd, int space_fd, bool initialize, std::size_t capacity)
+        :   m_memory_fd(memory_fd),
+            m_data_fd(data_fd),
+            m_space_fd(space_fd),
+            m_size(0),
+            m_header(nullptr),
+            m_slots(nullptr),
+            m_mask(0){
+        try{
+            if(initialize){
+                m_size = mapping_size(capacity);
+                if(::ftruncate(m_memory_fd, static_cast<off_t>(m_size)) != 0){
+                    throw os_error("Unable to size the job ring");
+                }
+            }
+            else{
+                struct stat info;
+                if(::fstat(m_memory_fd, &info) != 0){
+                    throw os_error("Unable to inspect the job ring");
+                }
+                m_size = static_cast<std::size_t>(info.st_size);
+                if(m_size < sizeof(header)){
+                    throw std::runtime_error("Job ring is too small");
+                }
+            }
+
+            void* memory = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_memory_fd, 0);
+            if(memory == MAP_FAILED){
+                throw os_error("Unable to map the job ring");
+            }
+            m_header = static_cast<header*>(memory);
+            m_slots = reinterpret_cast<slot*>(static_cast<char*>(memory) + sizeof(header));
+
+            if(initialize){
+                new (m_header) header{magic, version, static_cast<std::uint32_t>(capacity),
+                        static_cast<std::uint32_t>(sizeof(move_command)), {0}, {0}, {0}, {0}, {100}, {0}, {0}, {0}, {0}};
+                for(std::size_t i = 0; i < capacity; i++){
+                    new (&m_slots[i].sequence) std::atomic<std::uint64_t>(i);
+                }
+            }
+            else{
+                capacity = m_header->capacity;
+                if(m_header->magic != magic || m_header->version != version
+                        || m_header->command_size != sizeof(move_command)
+                        || capacity == 0 || (capacity & (capacity - 1)) != 0
+                        || mapping_size(capacity) > m_size){
+                    throw std::runtime_error("Job ring was created by an incompatible controller");
+                }
+            }
+            m_mask = capacity - 1;
+        }
+        catch(...){
+            release();
+            throw;
+        }
+    }
+
+    job_ring job_ring::create(std::size_t capacity){
+        if(capacity == 0 || capacity > (1u << 24)){
+            throw std::invalid_argument("Job ring capacity must be between 1 and 2^24");
+        }
+        std::size_t rounded = 1;
+        while(rounded < capacity){
+            rounded <<= 1;
+        }
+
+        int memory_fd = ::memfd_create("plotter-job-ring", MFD_CLOEXEC);
+        int data_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        int space_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if(memory_fd < 0 || data_fd < 0 || space_fd < 0){
+            std::system_error error = os_error("Unable to create the job ring");
+            close_fd(memory_fd);
+            close_fd(data_fd);
+            close_fd(space_fd);
+            throw error;
+        }
+        return job_ring(memory_fd, data_fd, space_fd, true, rounded);
+    }
+
+    job_ring job_ring::attach(int memory_fd, int data_fd, int space_fd){
+        return job_ring(memory_fd, data_fd, space_fd, false, 0);
+    }
+
+    job_ring::job_ring(job_ring&& other) noexcept
+        :   m_memory_fd(other.m_memory_fd),
+            m_data_fd(other.m_data_fd),
+            m_space_fd(other.m_space_fd),
+            m_size(other.m_size),
+            m_header(other.m_header),
+            m_slots(other.m_slots),
+            m_mask(other.m_mask){
+        other.m_memory_fd = other.m_data_fd = other.m_space_fd = -1;
+        other.m_header = nullptr;
+        other.m_slots = nullptr;
+    }
+
+    job_ring& job_ring::operator=(job_ring&& other) noexcept{
+        if(this != &other){
+            release();
+            m_memory_fd = other.m_memory_fd;
+            m_data_fd = other.m_data_fd;
+            m_space_fd = other.m_space_fd;
+            m_size = other.m_size;
+            m_header = other.m_header;
+            m_slots = other.m_slots;
+            m_mask = other.m_mask;
+            other.m_memory_fd = other.m_data_fd = other.m_space_fd = -1;
+            other.m_header = nullptr;
+            other.m_slots = nullptr;
+        }
+        return *this;
+    }
+
+    job_ring::~job_ring(){
+        release();
+    }
+
+    void job_ring::release(){
+        if(m_header != nullptr){
+            ::munmap(m_header, m_size);
+            m_header = nullptr;
+            m_slots = nullptr;
+        }
+        close_fd(m_memory_fd);
+        close_fd(m_data_fd);
+        close_fd(m_space_fd);
+        m_memory_fd = m_data_fd = m_space_fd = -1;
+    }
+
+/******************************************************************************/
+/*                                  Producer                                  */
+/******************************************************************************/
+    bool job_ring::try_push(const move_command& command){
+        std::uint64_t position = m_header->enqueue.load(std::memory_order_relaxed);
+        slot* target;
+        while(true){
+            target = &m_slots[position & m_mask];
+            std::uint64_t sequence = target->sequence.load(std::memory_order_acquire);
+            std::int64_t lag = static_cast<std::int64_t>(sequence - position);
+            if(lag == 0){
+                if(m_header->enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }
+            else if(lag < 0){
+                // The consumer hasn't handed this slot back yet
+                return false;
+            }
+            else{
+                position = m_header->enqueue.load(std::memory_order_relaxed);
+            }
+        }
+
+        target->command = command;
+        target->sequence.store(position + 1, std::memory_order_release);
+
+        // Pairs with the fence in wait() so either the consumer sees the
+        // command or we see that it is asleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_header->consumer_waiting.load(std::memory_order_relaxed) != 0){
+            signal_fd(m_data_fd);
+        }
+        return true;
+    }
+
+    void job_ring::push(const move_command& command){
+        if(try_push(command)){
+            return;
+        }
+        m_header->producers_waiting.fetch_add(1, std::memory_order_seq_cst);
+        while(!try_push(command)){
+            // Another producer may take the wake-up, so the sleep is bounded
+            pollfd space{m_space_fd, POLLIN, 0};
+            if(::poll(&space, 1, 100) > 0){
+                clear_fd(m_space_fd);
+            }
+        }
+        m_header->producers_waiting.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+/******************************************************************************/
+/*                                  Consumer                                  */
+/******************************************************************************/
+    const move_command* job_ring::front() const{
+        std::uint64_t position = m_header->dequeue.load(std::memory_order_relaxed);
+        const slot& source = m_slots[position & m_mask];
+        if(source.sequence.load(std::memory_order_acquire) != position + 1){
+            return nullptr;
+        }
+        return &source.command;
+    }
+
+    void job_ring::pop(){
+        std::uint64_t position = m_header->dequeue.load(std::memory_order_relaxed);
+        m_slots[position & m_mask].sequence.store(position + m_mask + 1, std::memory_order_release);
+        m_header->dequeue.store(position + 1, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_header->producers_waiting.load(std::memory_order_relaxed) != 0){
+            signal_fd(m_space_fd);
+        }
+    }
+
+    bool job_ring::wait(int timeout_ms, int other_fd){
+        if(front() != nullptr){
+            return true;
+        }
+        m_header->consumer_waiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(front() == nullptr){
+            pollfd fds[2] = {{m_data_fd, POLLIN, 0}, {other_fd, POLLIN, 0}};
+            if(::poll(fds, other_fd >= 0 ? 2 : 1, timeout_ms) > 0 && (fds[0].revents & POLLIN)){
+                clear_fd(m_data_fd);
+            }
+        }
+        m_header->consumer_waiting.store(0, std::memory_order_relaxed);
+        return front() != nullptr;
+    }
+}
@@ -0,0 +1,270 @@
+#ifndef JOB_RING_HPP
+#define JOB_RING_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "motion.hpp"
+#include "units.hpp"
+
+namespace plotter{
+
+    /**
+     * One command submitted to the controller. The layout is fixed so it can
+     * be written straight into shared memory by another process.
+     */
+    struct move_command{
+        enum class kind : std::uint8_t{
+            move,       // Straight move to target
+            arc,        // Arc to target around center, see motion_planner::add_arc()
+            pen,        // Lift or lower the pen
+            tool        // Stop for the operator to swap to pen tool
+        };
+
+        kind type;
+        bool clockwise;
+        bool pen_down;
+        std::uint8_t tool;
+
+        /**
+         * Reference chosen by the client, i.e. the line of the job file the
+         * command came from
+         */
+        std::uint32_t line;
+
+        /**
+         * Absolute position of every axis in nanometers
+         */
+        std::array<position::rep, max_axes> target;
+
+        /**
+         * Arc center of axes 0 and 1 in nanometers
+         */
+        std::array<position::rep, 2> center;
+
+        /**
+         * Micrometers per second
+         */
+        std::int64_t feed_rate;
+    };
+
+    /**
+     * First and only message on the handshake socket. The descriptors of
+     * the ring travel alongside it as SCM_RIGHTS ancillary data, in the
+     * order shared memory, data eventfd, space eventfd.
+     */
+    struct job_hello{
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t capacity;
+        std::uint32_t command_size;
+    };
+
+    /**
+     * Bounded queue of move commands in memory shared between processes.
+     * Any number of client processes push and the controller alone pops.
+     *
+     * Every slot carries a sequence number: a producer claims the next
+     * position with a compare-and-swap on the enqueue counter, writes the
+     * command into the slot in place and then publishes it by advancing the
+     * slot's sequence. The consumer reads the command where it lies and
+     * hands the slot back by advancing the sequence a lap. Nothing is
+     * serialized and no system call is made while the queue is neither
+     * empty nor full.
+     *
+     * Two eventfds wake the other side when it has gone to sleep: one
+     * signals data to the consumer and one signals space to the producers.
+     * Each side only writes its eventfd when the other has announced that
+     * it is waiting.
+     *
+     * A producer that dies between claiming and publishing a slot stalls
+     * the queue at that slot.
+     *
+     * The header also carries the feed override and pause any client may
+     * set. They bypass the queue, so they act on the move in progress
+     * rather than after everything already queued. The controller reports
+     * a pen swap in progress there too, numbered so that a confirmation
+     * only ever ends the swap it was given for.
+     */
+    class job_ring{
+        public:
+            static constexpr std::uint32_t magic = 0x504C4A52;    // "PLJR"
+            static constexpr std::uint32_t version = 4;       // 2 added tool commands, 3 controls, 4 swaps
+
+        private:
+            struct slot{
+                std::atomic<std::uint64_t> sequence;
+                move_command command;
+            };
+
+            struct header{
+                std::uint32_t magic;
+                std::uint32_t version;
+                std::uint32_t capacity;
+                std::uint32_t command_size;
+
+                alignas(64) std::atomic<std::uint64_t> enqueue;
+                alignas(64) std::atomic<std::uint64_t> dequeue;
+                alignas(64) std::atomic<std::uint32_t> consumer_waiting;
+                std::atomic<std::uint32_t> producers_waiting;
+
+                alignas(64) std::atomic<std::uint32_t> feed_override;
+                std::atomic<std::uint32_t> paused;
+
+                alignas(64) std::atomic<std::uint32_t> swap;
+                std::atomic<std::uint32_t> swap_tool;
+                std::atomic<std::uint32_t> swap_confirmed;
+            };
+
+            static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+                    "Shared memory atomics must be lock free");
+
+            int m_memory_fd;
+            int m_data_fd;
+            int m_space_fd;
+            std::size_t m_size;
+            header* m_header;
+            slot* m_slots;
+            std::uint64_t m_mask;
+
+            job_ring(int memory_fd, int data_fd, int space_fd, bool initialize, std::size_t capacity);
+
+            static std::size_t mapping_size(std::size_t capacity);
+            void release();
+
+        public:
+            /**
+             * Create a new ring in anonymous shared memory
+             *
+             * @param capacity: number of commands, rounded up to a power of 2
+             * @return: ring owned by the consumer
+             */
+            static job_ring create(std::size_t capacity);
+
+            /**
+             * Map a ring created by another process. Takes ownership of the
+             * descriptors.
+             *
+             * @param memory_fd: shared memory holding the ring
+             * @param data_fd: eventfd signalling new commands
+             * @param space_fd: eventfd signalling free slots
+             * @return: ring for a producer
+             */
+            static job_ring attach(int memory_fd, int data_fd, int space_fd);
+
+            job_ring(const job_ring&) = delete;
+            job_ring& operator=(const job_ring&) = delete;
+            job_ring(job_ring&& other) noexcept;
+            job_ring& operator=(job_ring&& other) noexcept;
+            ~job_ring();
+
+            /**
+             * Queue a command without blocking
+             *
+             * @param command: command to copy into the ring
+             * @return: false if the ring is full
+             */
+            bool try_push(const move_command& command);
+
+            /**
+             * Queue a command, sleeping while the ring is full
+             *
+             * @param command: command to copy into the ring
+             */
+            void push(const move_command& command);
+
+            /**
+             * Consumer only
+             *
+             * @return: oldest command, in place in the ring, or nullptr if
+             *          the ring is empty
+             */
+            const move_command* front() const;
+
+            /**
+             * Consumer only. Hand the slot of front() back to the producers.
+             */
+            void pop();
+
+            /**
+             * Consumer only. Sleep until a command is available.
+             *
+             * @param timeout_ms: longest time to sleep, negative to wait
+             *                    indefinitely
+             * @param other_fd: descriptor that also ends the wait when it
+             *                  becomes readable, or -1
+             * @return: true if a command is available
+             */
+            bool wait(int timeout_ms, int other_fd=-1);
+
+            /**
+             * Ask the controller for a feed override
+             *
+             * @param percent: feed relative to the plan, see
+             *                 motion_executor::set_feed_override()
+             */
+            void set_feed_override(std::uint32_t percent){
+                m_header->feed_override.store(percent, std::memory_order_relaxed);
+            }
+
+            std::uint32_t feed_override() const{return m_header->feed_override.load(std::memory_order_relaxed);}
+
+            /**
+             * Ask the controller to pause or resume
+             *
+             * @param paused: true to decelerate to a stop and hold
+             */
+            void set_paused(bool paused){m_header->paused.store(paused ? 1 : 0, std::memory_order_relaxed);}
+
+            bool paused() const{return m_header->paused.load(std::memory_order_relaxed) != 0;}
+
+            /**
+             * Consumer only. Report a pen swap the controller is holding for.
+             *
+             * @param swap: number of the swap, counting from 1
+             * @param tool: pen to fit
+             */
+            void begin_swap(std::uint32_t swap, std::uint8_t tool){
+                m_header->swap_tool.store(tool, std::memory_order_relaxed);
+                m_header->swap.store(swap, std::memory_order_release);
+            }
+
+            /**
+             * Consumer only. Report that the controller carried on.
+             */
+            void end_swap(){m_header->swap.store(0, std::memory_order_release);}
+
+            /**
+             * @return: number of the swap the controller holds for, 0 if
+             *          it isn't swapping
+             */
+            std::uint32_t swap() const{return m_header->swap.load(std::memory_order_acquire);}
+
+            /**
+             * @return: pen the controller waits for, see swap()
+             */
+            std::uint8_t swap_tool() const{
+                return static_cast<std::uint8_t>(m_header->swap_tool.load(std::memory_order_relaxed));
+            }
+
+            /**
+             * Tell the controller the pen is fitted
+             *
+             * @param swap: number of the swap that is done, see swap()
+             */
+            void confirm_swap(std::uint32_t swap){m_header->swap_confirmed.store(swap, std::memory_order_relaxed);}
+
+            std::uint32_t swap_confirmed() const{return m_header->swap_confirmed.load(std::memory_order_relaxed);}
+
+            std::size_t capacity() const{return static_cast<std::size_t>(m_mask + 1);}
+
+            int memory_fd() const{return m_memory_fd;}
+            int data_fd() const{return m_data_fd;}
+            int space_fd() const{return m_space_fd;}
+    };
+}
+
+#endif
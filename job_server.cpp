@@ -0,0 +1,166 @@
+#include "job_server.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "local_socket.hpp"
+
+namespace plotter{
+    namespace{
+        void send_ring(int fd, const job_ring& ring){
+            job_hello hello{job_ring::magic, job_ring::version,
+                    static_cast<std::uint32_t>(ring.capacity()),
+                    static_cast<std::uint32_t>(sizeof(move_command))};
+            int fds[3] = {ring.memory_fd(), ring.data_fd(), ring.space_fd()};
+
+            iovec data{&hello, sizeof(hello)};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+            msghdr message{};
+            message.msg_iov = &data;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            cmsghdr* rights = CMSG_FIRSTHDR(&message);
+            rights->cmsg_level = SOL_SOCKET;
+            rights->cmsg_type = SCM_RIGHTS;
+            rights->cmsg_len = CMSG_LEN(sizeof(fds));
+            std::memcpy(CMSG_DATA(rights), fds, sizeof(fds));
+
+            // A client that went away before reading is simply dropped
+            ssize_t sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+            static_cast<void>(sent);
+        }
+
+        axis_positions command_target(const move_command& command){
+            axis_positions target;
+            for(std::size_t axis = 0; axis < max_axes; axis++){
+                target[axis] = position(command.target[axis]);
+            }
+            return target;
+        }
+
+        bool plan(motion_planner& planner, const move_command& command, std::uint64_t&){
+            switch(command.type){
+                case move_command::kind::move:
+                    return planner.add_move(command_target(command), command.feed_rate);
+                case move_command::kind::arc:
+                    return planner.add_arc(command_target(command),
+                            {{position(command.center[0]), position(command.center[1])}},
+                            command.clockwise,
+                            command.feed_rate);
+                case move_command::kind::tool:
+                    return planner.add_tool(command.tool);
+                default:
+                    return planner.add_pen(command.pen_down);
+            }
+        }
+
+        bool plan(kinematic_planner& planner, const move_command& command, std::uint64_t& rejected){
+            switch(command.type){
+                case move_command::kind::move:
+                    return planner.add_move(command_target(command), command.feed_rate);
+                case move_command::kind::arc:
+                    // Dropped, but consumed so the queue keeps moving
+                    rejected++;
+                    return true;
+                case move_command::kind::tool:
+                    return planner.add_tool(command.tool);
+                default:
+                    return planner.add_pen(command.pen_down);
+            }
+        }
+
+        template<class Planner>
+        std::size_t feed_planner(job_ring& ring, Planner& planner, std::uint64_t& rejected){
+            std::size_t planned = 0;
+            while(const move_command* command = ring.front()){
+                planner.set_line(command->line);
+                try{
+                    if(!plan(planner, *command, rejected)){
+                        break;
+                    }
+                }
+                catch(const std::invalid_argument&){
+                    // A bad command from a client must not stop the controller
+                    rejected++;
+                }
+                ring.pop();
+                planned++;
+            }
+            return planned;
+        }
+    }
+
+    job_server::job_server(const std::string& socket_path, std::size_t capacity)
+        :   m_path(socket_path),
+            m_listen_fd(-1),
+            m_ring(job_ring::create(capacity)),
+            m_rejected(0),
+            m_feed_override(100),
+            m_paused(false),
+            m_swaps(0),
+            m_swapping(false){
+        m_listen_fd = listen_local(socket_path, SOCK_STREAM);
+    }
+
+    job_server::~job_server(){
+        ::close(m_listen_fd);
+        ::unlink(m_path.c_str());
+    }
+
+    std::size_t job_server::accept_clients(){
+        std::size_t accepted = 0;
+        while(true){
+            int client = ::accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if(client < 0){
+                return accepted;
+            }
+            send_ring(client, m_ring);
+            ::close(client);
+            accepted++;
+        }
+    }
+
+    std::size_t job_server::feed(motion_planner& planner){
+        return feed_planner(m_ring, planner, m_rejected);
+    }
+
+    std::size_t job_server::feed(kinematic_planner& planner){
+        return feed_planner(m_ring, planner, m_rejected);
+    }
+
+    void job_server::apply_controls(motion_executor& executor){
+        std::uint32_t percent = m_ring.feed_override();
+        if(percent != m_feed_override){
+            m_feed_override = percent;
+            executor.set_feed_override(percent);
+        }
+        bool paused = m_ring.paused();
+        if(paused != m_paused){
+            m_paused = paused;
+            if(paused){
+                executor.pause();
+            }
+            else if(!executor.is_swapping()){
+                executor.resume();
+            }
+        }
+
+        // The swap may also have been ended by the executor's owner
+        bool swapping = executor.is_swapping();
+        if(swapping && !m_swapping){
+            m_ring.begin_swap(++m_swaps, executor.tool());
+        }
+        else if(!swapping && m_swapping){
+            m_ring.end_swap();
+        }
+        m_swapping = swapping;
+        if(swapping && !m_paused && m_ring.swap_confirmed() == m_swaps){
+            executor.resume();
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef JOB_SERVER_HPP
+#define JOB_SERVER_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "job_ring.hpp"
+#include "kinematics.hpp"
+#include "motion.hpp"
+
+namespace plotter{
+
+    /**
+     * Controller side of job submission. Owns the shared job ring and a
+     * UNIX socket that hands the ring's descriptors to every client that
+     * connects, after which the socket plays no further part: commands
+     * travel through the shared memory only.
+     */
+    class job_server{
+        private:
+            std::string m_path;
+            int m_listen_fd;
+            job_ring m_ring;
+
+            /**
+             * Commands that were dropped, either invalid or arcs on a
+             * machine with non-linear kinematics
+             */
+            std::uint64_t m_rejected;
+
+            /**
+             * Controls last passed to the executor
+             */
+            std::uint32_t m_feed_override;
+            bool m_paused;
+
+            /**
+             * Pen swaps seen so far, the one in progress included while
+             * m_swapping
+             */
+            std::uint32_t m_swaps;
+            bool m_swapping;
+
+        public:
+            /**
+             * @param socket_path: path to listen on, replaced if it exists
+             * @param capacity: commands the ring holds
+             */
+            job_server(const std::string& socket_path, std::size_t capacity=1024);
+
+            job_server(const job_server&) = delete;
+            job_server& operator=(const job_server&) = delete;
+            ~job_server();
+
+            /**
+             * Hand the ring to every client waiting to connect, without
+             * blocking
+             *
+             * @return: number of clients connected
+             */
+            std::size_t accept_clients();
+
+            /**
+             * Pass queued commands to a planner until it is full or the
+             * ring is empty
+             *
+             * @param planner: planner to feed
+             * @return: number of commands planned
+             */
+            std::size_t feed(motion_planner& planner);
+
+            /**
+             * Pass queued commands to a kinematic planner until it is full
+             * or the ring is empty. Arcs are rejected since their motor
+             * paths aren't arcs.
+             *
+             * @param planner: planner to feed
+             * @return: number of commands planned
+             */
+            std::size_t feed(kinematic_planner& planner);
+
+            /**
+             * Pass the feed override and pause set by clients on to an
+             * executor when they change, and report its pen swaps to them.
+             * A resume doesn't end a pen swap, a client confirming it does
+             * once the executor isn't paused.
+             *
+             * @param executor: executor to steer
+             */
+            void apply_controls(motion_executor& executor);
+
+            /**
+             * Sleep until a command arrives or a client connects
+             *
+             * @param timeout_ms: longest time to sleep, negative to wait
+             *                    indefinitely
+             * @return: true if a command is available
+             */
+            bool wait(int timeout_ms){return m_ring.wait(timeout_ms, m_listen_fd);}
+
+            std::uint64_t rejected() const{return m_rejected;}
+
+            const job_ring& ring() const{return m_ring;}
+    };
+}
+
+#endif
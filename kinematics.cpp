@@ -0,0 +1,272 @@
+#include "kinematics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace plotter{
+    namespace{
+        constexpr std::int64_t nanometers_per_micrometer = 1000;
+
+        position::rep round_to_rep(double value){
+            return static_cast<position::rep>(std::floor(value + 0.5));
+        }
+
+        /**
+         * Distance from a point to a line segment
+         */
+        double distance_to_segment(double px, double py,
+                double from_x, double from_y,
+                double to_x, double to_y){
+            double dx = to_x - from_x;
+            double dy = to_y - from_y;
+            double length_squared = dx * dx + dy * dy;
+            double t = length_squared > 0 ? ((px - from_x) * dx + (py - from_y) * dy) / length_squared : 0;
+            t = std::max(0.0, std::min(1.0, t));
+            return std::hypot(from_x + t * dx - px, from_y + t * dy - py);
+        }
+    }
+
+/******************************************************************************/
+/*                                 Kinematics                                 */
+/******************************************************************************/
+    kinematics::kinematics()
+        :kinematics(type::cartesian){}
+
+    kinematics::kinematics(type machine)
+        :   m_type(machine),
+            m_separation(0),
+            m_home_x(0),
+            m_home_y(0),
+            m_home_left(0),
+            m_home_right(0),
+            m_tolerance(0){
+        if(machine == type::polargraph){
+            throw std::invalid_argument("Polargraph kinematics need their geometry, use kinematics::polargraph()");
+        }
+    }
+
+    kinematics kinematics::polargraph(position anchor_separation,
+            position home_x,
+            position home_y,
+            position tolerance){
+        if(anchor_separation.count() <= 0 || home_y.count() <= 0 || tolerance.count() <= 0){
+            throw std::invalid_argument("Polargraph needs a positive anchor separation, home depth and tolerance");
+        }
+        kinematics machine;
+        machine.m_type = type::polargraph;
+        machine.m_separation = static_cast<double>(anchor_separation.count());
+        machine.m_home_x = static_cast<double>(home_x.count());
+        machine.m_home_y = static_cast<double>(home_y.count());
+        machine.m_home_left = std::hypot(machine.m_home_x, machine.m_home_y);
+        machine.m_home_right = std::hypot(machine.m_separation - machine.m_home_x, machine.m_home_y);
+        machine.m_tolerance = static_cast<double>(tolerance.count());
+        return machine;
+    }
+
+    void kinematics::to_motors(const position::rep* x, const position::rep* y,
+            position::rep* a, position::rep* b, std::size_t count) const{
+        switch(m_type){
+            case type::cartesian:
+                std::copy(x, x + count, a);
+                std::copy(y, y + count, b);
+                break;
+            case type::corexy:
+            case type::hbot:
+                for(std::size_t i = 0; i < count; i++){
+                    a[i] = x[i] + y[i];
+                    b[i] = x[i] - y[i];
+                }
+                break;
+            case type::polargraph:
+                for(std::size_t i = 0; i < count; i++){
+                    double px = m_home_x + static_cast<double>(x[i]);
+                    double py = m_home_y + static_cast<double>(y[i]);
+                    double rx = m_separation - px;
+                    a[i] = round_to_rep(std::sqrt(px * px + py * py) - m_home_left);
+                    b[i] = round_to_rep(std::sqrt(rx * rx + py * py) - m_home_right);
+                }
+                break;
+        }
+    }
+
+    void kinematics::to_cartesian(const position::rep* a, const position::rep* b,
+            position::rep* x, position::rep* y, std::size_t count) const{
+        switch(m_type){
+            case type::cartesian:
+                std::copy(a, a + count, x);
+                std::copy(b, b + count, y);
+                break;
+            case type::corexy:
+            case type::hbot:
+                for(std::size_t i = 0; i < count; i++){
+                    x[i] = (a[i] + b[i]) / 2;
+                    y[i] = (a[i] - b[i]) / 2;
+                }
+                break;
+            case type::polargraph:
+                // Intersection of the two cord circles below the anchors
+                for(std::size_t i = 0; i < count; i++){
+                    double left = static_cast<double>(a[i]) + m_home_left;
+                    double right = static_cast<double>(b[i]) + m_home_right;
+                    double px = (left * left - right * right + m_separation * m_separation) / (2 * m_separation);
+                    double py = std::sqrt(std::max(0.0, left * left - px * px));
+                    x[i] = round_to_rep(px - m_home_x);
+                    y[i] = round_to_rep(py - m_home_y);
+                }
+                break;
+        }
+    }
+
+    std::size_t kinematics::segment_count(position from_x, position from_y,
+            position to_x, position to_y) const{
+        if(is_linear()){
+            return 1;
+        }
+        double start_x = m_home_x + static_cast<double>(from_x.count());
+        double start_y = m_home_y + static_cast<double>(from_y.count());
+        double end_x = m_home_x + static_cast<double>(to_x.count());
+        double end_y = m_home_y + static_cast<double>(to_y.count());
+        double length = std::hypot(end_x - start_x, end_y - start_y);
+        if(length == 0){
+            return 1;
+        }
+
+        // A cord length along a line bends by at most 1 / distance to its
+        // anchor, so a chord of length s strays at most s^2 / (8 * distance)
+        double nearest = std::min(distance_to_segment(0, 0, start_x, start_y, end_x, end_y),
+                distance_to_segment(m_separation, 0, start_x, start_y, end_x, end_y));
+        nearest = std::max(nearest, m_tolerance);
+        double piece = std::sqrt(8 * nearest * m_tolerance);
+        return std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(length / piece)));
+    }
+
+/******************************************************************************/
+/*                              Kinematic Planner                             */
+/******************************************************************************/
+    kinematic_planner::kinematic_planner(motion_planner& planner, const kinematics& machine)
+        :   m_planner(planner),
+            m_kinematics(machine),
+            m_x(),
+            m_y(),
+            m_a(),
+            m_b(),
+            m_feed(),
+            m_pending_start(0),
+            m_pending_count(0),
+            m_move_from(),
+            m_pending_target(),
+            m_move_feed(0),
+            m_move_pieces(0),
+            m_move_batched(0),
+            m_pending_line(0),
+            m_line(0),
+            m_position(){}
+
+    bool kinematic_planner::add_move(const axis_positions& target, std::int64_t feed_rate){
+        if(!pump()){
+            return false;
+        }
+
+        m_move_from = m_position;
+        m_pending_target = target;
+        m_move_feed = feed_rate;
+        m_move_pieces = m_kinematics.segment_count(m_position[0], m_position[1], target[0], target[1]);
+        m_move_batched = 0;
+        m_pending_line = m_line;
+        m_position = target;
+        pump();
+        return true;
+    }
+
+    void kinematic_planner::transform_batch(){
+        std::size_t first = m_move_batched;
+        std::size_t pieces = std::min(max_segments, m_move_pieces - first);
+        const axis_positions& from = m_move_from;
+        const axis_positions& target = m_pending_target;
+        std::int64_t whole = static_cast<std::int64_t>(m_move_pieces);
+        auto along = [&](std::size_t axis, std::size_t part){
+            return from[axis].count() + divide((target[axis] - from[axis]).count() * static_cast<std::int64_t>(part),
+                    whole, rounding::nearest);
+        };
+        for(std::size_t i = 0; i < pieces; i++){
+            m_x[i] = along(0, first + i + 1);
+            m_y[i] = along(1, first + i + 1);
+        }
+        m_kinematics.to_motors(m_x.data(), m_y.data(), m_a.data(), m_b.data(), pieces);
+
+        // Scale the feed of every piece by how much longer it is for the
+        // motors than for the pen
+        position::rep start_x = along(0, first);
+        position::rep start_y = along(1, first);
+        position::rep start_a;
+        position::rep start_b;
+        m_kinematics.to_motors(&start_x, &start_y, &start_a, &start_b, 1);
+        for(std::size_t i = 0; i < pieces; i++){
+            std::int64_t dx = (m_x[i] - start_x) / nanometers_per_micrometer;
+            std::int64_t dy = (m_y[i] - start_y) / nanometers_per_micrometer;
+            std::int64_t da = (m_a[i] - start_a) / nanometers_per_micrometer;
+            std::int64_t db = (m_b[i] - start_b) / nanometers_per_micrometer;
+            std::int64_t pen = static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(dx * dx + dy * dy)));
+            std::int64_t motor = static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(da * da + db * db)));
+            m_feed[i] = pen > 0 ? std::max<std::int64_t>(1, m_move_feed * motor / pen) : m_move_feed;
+            start_x = m_x[i];
+            start_y = m_y[i];
+            start_a = m_a[i];
+            start_b = m_b[i];
+        }
+
+        m_pending_start = 0;
+        m_pending_count = pieces;
+        m_move_batched = first + pieces;
+    }
+
+    bool kinematic_planner::pump(){
+        while(m_planner.can_accept()){
+            if(m_pending_count == 0){
+                if(m_move_batched == m_move_pieces){
+                    return true;
+                }
+                transform_batch();
+            }
+            std::size_t index = m_pending_start;
+            std::size_t remaining = m_move_pieces - m_move_batched + m_pending_count;
+            axis_positions piece = m_planner.target();
+            piece[0] = position(m_a[index]);
+            piece[1] = position(m_b[index]);
+            if(remaining == 1){
+                for(std::size_t axis = 2; axis < max_axes; axis++){
+                    piece[axis] = m_pending_target[axis];
+                }
+            }
+            else{
+                // Other axes move evenly across the pieces
+                for(std::size_t axis = 2; axis < max_axes; axis++){
+                    piece[axis] += position(divide((m_pending_target[axis] - piece[axis]).count(),
+                                static_cast<std::int64_t>(remaining), rounding::nearest));
+                }
+            }
+            m_planner.set_line(m_pending_line);
+            m_planner.add_move(piece, m_feed[index]);
+            m_pending_start++;
+            m_pending_count--;
+        }
+        return m_pending_count == 0 && m_move_batched == m_move_pieces;
+    }
+
+    void kinematic_planner::set_position(const axis_positions& current){
+        m_position = current;
+        m_pending_count = 0;
+        m_move_pieces = 0;
+        m_move_batched = 0;
+        axis_positions motors = current;
+        position::rep x = current[0].count();
+        position::rep y = current[1].count();
+        position::rep a;
+        position::rep b;
+        m_kinematics.to_motors(&x, &y, &a, &b, 1);
+        motors[0] = position(a);
+        motors[1] = position(b);
+        m_planner.set_position(motors);
+    }
+}
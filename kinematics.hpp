@@ -0,0 +1,258 @@
+#ifndef KINEMATICS_HPP
+#define KINEMATICS_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "motion.hpp"
+#include "units.hpp"
+
+namespace plotter{
+
+    /**
+     * Maps Cartesian X/Y to the positions of the two motors that move the
+     * pen. Transforms work on whole arrays of points in structure-of-arrays
+     * form with the machine type switched once per batch, so the inner
+     * loops are plain arithmetic the compiler can vectorize.
+     *
+     * Axes beyond the first two are not affected by kinematics.
+     */
+    class kinematics{
+        public:
+            enum class type{
+                cartesian,      // One motor per axis
+                corexy,         // a = x + y, b = x - y
+                hbot,           // Same mapping as CoreXY, single long belt
+                polargraph      // Two cords hanging from fixed anchors
+            };
+
+        private:
+            type m_type;
+
+            /**
+             * Polargraph geometry in nanometers. The left anchor is at the
+             * origin, the right anchor is m_separation to its right and y
+             * grows downward. Cartesian (0, 0) and motor (0, 0) are both
+             * the home point.
+             */
+            double m_separation;
+            double m_home_x;
+            double m_home_y;
+            double m_home_left;
+            double m_home_right;
+
+            /**
+             * Largest allowed deviation of a segmented polargraph move from
+             * the straight line, in nanometers
+             */
+            double m_tolerance;
+
+        public:
+            /**
+             * Cartesian kinematics
+             */
+            kinematics();
+
+            /**
+             * @param machine: a linear machine type, i.e. not polargraph
+             */
+            explicit kinematics(type machine);
+
+            /**
+             * Build polargraph kinematics
+             *
+             * @param anchor_separation: distance between the cord anchors
+             * @param home_x: home point, measured right from the left anchor
+             * @param home_y: home point, measured down from the anchors
+             * @param tolerance: largest allowed deviation from a straight
+             *                   line when a move is segmented
+             * @return: polargraph kinematics
+             */
+            static kinematics polargraph(position anchor_separation,
+                    position home_x,
+                    position home_y,
+                    position tolerance=position::from<std::micro>(10));
+
+            /**
+             * Convert Cartesian points to motor positions
+             *
+             * @param x: x of each point in nanometers
+             * @param y: y of each point in nanometers
+             * @param a: receives the first motor position of each point
+             * @param b: receives the second motor position of each point
+             * @param count: number of points
+             */
+            void to_motors(const position::rep* x, const position::rep* y,
+                    position::rep* a, position::rep* b, std::size_t count) const;
+
+            /**
+             * Convert motor positions back to Cartesian points
+             *
+             * @param a: first motor position of each point in nanometers
+             * @param b: second motor position of each point in nanometers
+             * @param x: receives x of each point
+             * @param y: receives y of each point
+             * @param count: number of points
+             */
+            void to_cartesian(const position::rep* a, const position::rep* b,
+                    position::rep* x, position::rep* y, std::size_t count) const;
+
+            /**
+             * Number of equal pieces a straight Cartesian move must be split
+             * into so that none strays more than the tolerance from the line
+             * once mapped to the motors. Linear machines never split. For a
+             * polargraph the cord length bends most close to an anchor, so
+             * the pieces get shorter there.
+             *
+             * @param from_x: start of the move
+             * @param from_y: start of the move
+             * @param to_x: end of the move
+             * @param to_y: end of the move
+             * @return: number of pieces, at least 1
+             */
+            std::size_t segment_count(position from_x, position from_y,
+                    position to_x, position to_y) const;
+
+            /**
+             * @return: true if straight moves stay straight for the motors
+             */
+            bool is_linear() const{return m_type != type::polargraph;}
+
+            type get_type() const{return m_type;}
+    };
+
+    /**
+     * Takes Cartesian moves, segments them as the kinematics require,
+     * transforms the pieces of a move in batches and feeds them to a
+     * motion_planner in motor space. The requested feed is scaled per
+     * piece so the pen keeps its Cartesian speed.
+     */
+    class kinematic_planner{
+        public:
+            /**
+             * Most pieces transformed in one batch. A move split into more
+             * is transformed a batch at a time as the planner takes them.
+             */
+            static constexpr std::size_t max_segments = 128;
+
+        private:
+            motion_planner& m_planner;
+            kinematics m_kinematics;
+
+            /**
+             * Batch buffers, in nanometers
+             */
+            std::array<position::rep, max_segments> m_x;
+            std::array<position::rep, max_segments> m_y;
+            std::array<position::rep, max_segments> m_a;
+            std::array<position::rep, max_segments> m_b;
+
+            /**
+             * Pieces of the current batch not yet taken by the planner
+             */
+            std::array<std::int64_t, max_segments> m_feed;
+            std::size_t m_pending_start;
+            std::size_t m_pending_count;
+
+            /**
+             * Last move accepted, split into m_move_pieces of which the
+             * first m_move_batched have been transformed
+             */
+            axis_positions m_move_from;
+            axis_positions m_pending_target;
+            std::int64_t m_move_feed;
+            std::size_t m_move_pieces;
+            std::size_t m_move_batched;
+            std::uint32_t m_pending_line;
+
+            /**
+             * Tag given to the following moves
+             */
+            std::uint32_t m_line;
+
+            /**
+             * Cartesian end of the last accepted move
+             */
+            axis_positions m_position;
+
+            void transform_batch();
+
+        public:
+            /**
+             * @param planner: planner working in motor space
+             * @param machine: kinematics between Cartesian and motor space
+             */
+            kinematic_planner(motion_planner& planner, const kinematics& machine);
+
+            /**
+             * Plan a straight Cartesian move
+             *
+             * @param target: absolute Cartesian position of every axis
+             * @param feed_rate: requested pen speed in micrometers per second
+             * @return: false if the pieces of the previous move haven't all
+             *          been planned yet and the move was not accepted
+             */
+            bool add_move(const axis_positions& target, std::int64_t feed_rate);
+
+            /**
+             * Lift or lower the pen after the last accepted move
+             *
+             * @param down: true to lower the pen, false to lift it
+             * @return: false if the pen block was not accepted
+             */
+            bool add_pen(bool down){
+                if(!pump()){
+                    return false;
+                }
+                m_planner.set_line(m_line);
+                return m_planner.add_pen(down);
+            }
+
+            /**
+             * Stop for a pen swap after the last accepted move
+             *
+             * @param tool: pen to swap to
+             * @return: false if the block was not accepted
+             */
+            bool add_tool(std::uint8_t tool){
+                if(!pump()){
+                    return false;
+                }
+                m_planner.set_line(m_line);
+                return m_planner.add_tool(tool);
+            }
+
+            /**
+             * Tag the following moves, see motion_planner::set_line()
+             *
+             * @param line: tag to use
+             */
+            void set_line(std::uint32_t line){m_line = line;}
+
+            /**
+             * Pass pending pieces to the planner as it makes room
+             *
+             * @return: true once every piece has been planned
+             */
+            bool pump();
+
+            /**
+             * Move the origin without moving. Must only be called while the
+             * planner is empty.
+             *
+             * @param current: Cartesian position of every axis
+             */
+            void set_position(const axis_positions& current);
+
+            /**
+             * @return: Cartesian end of the last accepted move
+             */
+            const axis_positions& target() const{return m_position;}
+
+            const kinematics& machine() const{return m_kinematics;}
+    };
+}
+
+#endif
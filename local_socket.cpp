@@ -0,0 +1,53 @@
+#include "local_socket.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace plotter{
+    namespace{
+        sockaddr_un socket_address(const std::string& path){
+            sockaddr_un address{};
+            if(path.empty() || path.size() >= sizeof(address.sun_path)){
+                throw std::invalid_argument("Socket path is empty or too long");
+            }
+            address.sun_family = AF_UNIX;
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            return address;
+        }
+    }
+
+    int listen_local(const std::string& path, int type){
+        sockaddr_un address = socket_address(path);
+        int fd = ::socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(fd < 0){
+            throw std::system_error(errno, std::generic_category(), "Unable to create a socket for " + path);
+        }
+        ::unlink(path.c_str());
+        if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || ::listen(fd, 8) != 0){
+            std::system_error error(errno, std::generic_category(), "Unable to listen on " + path);
+            ::close(fd);
+            throw error;
+        }
+        return fd;
+    }
+
+    int connect_local(const std::string& path, int type){
+        sockaddr_un address = socket_address(path);
+        int fd = ::socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+        if(fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+            std::system_error error(errno, std::generic_category(), "Unable to connect to " + path);
+            if(fd >= 0){
+                ::close(fd);
+            }
+            throw error;
+        }
+        return fd;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef LOCAL_SOCKET_HPP
+#define LOCAL_SOCKET_HPP
+#pragma once
+
+#include <string>
+
+namespace plotter{
+
+    /**
+     * Listen on a UNIX socket, replacing any socket file left at the path.
+     * The socket is non-blocking so accepting never stalls the caller.
+     *
+     * @param path: path to listen on
+     * @param type: SOCK_STREAM or SOCK_SEQPACKET
+     * @return: listening descriptor
+     */
+    int listen_local(const std::string& path, int type);
+
+    /**
+     * Connect to a UNIX socket
+     *
+     * @param path: path to connect to
+     * @param type: SOCK_STREAM or SOCK_SEQPACKET
+     * @return: connected, blocking descriptor
+     */
+    int connect_local(const std::string& path, int type);
+}
+
+#endif
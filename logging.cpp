@@ -0,0 +1,265 @@
+#include "logging.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace plotter{
+    namespace{
+        static_assert((logger::buffer_capacity & (logger::buffer_capacity - 1)) == 0,
+                "Log buffer capacity must be a power of 2");
+
+        /**
+         * Single producer, single consumer ring of records. The owning
+         * thread advances head and the drain thread advances tail.
+         */
+        struct thread_buffer{
+            std::array<log_record, logger::buffer_capacity> records;
+            std::atomic<std::uint64_t> head{0};
+            std::atomic<std::uint64_t> tail{0};
+
+            /**
+             * Set when the owning thread exits, the drain thread frees the
+             * buffer once it is empty
+             */
+            std::atomic<bool> retired{false};
+        };
+
+        /**
+         * Set once the drain has been destroyed at exit, after which
+         * messages are dropped
+         */
+        std::atomic<bool> drain_destroyed{false};
+
+        const char* level_name(log_level level){
+            switch(level){
+                case log_level::trace: return "trace";
+                case log_level::debug: return "debug";
+                case log_level::info: return "info";
+                case log_level::warning: return "warning";
+                default: return "error";
+            }
+        }
+
+        void append_arg(std::string& out, const log_arg& arg){
+            switch(arg.type){
+                case log_arg::kind::signed_integer:
+                    out += std::to_string(arg.i);
+                    break;
+                case log_arg::kind::unsigned_integer:
+                    out += std::to_string(arg.u);
+                    break;
+                case log_arg::kind::floating:
+                    out += std::to_string(arg.d);
+                    break;
+                default:
+                    out += arg.s != nullptr ? arg.s : "(null)";
+                    break;
+            }
+        }
+
+        void format_record(std::string& out, const log_record& record){
+            out += '[';
+            out += level_name(record.level);
+            out += "] ";
+            std::size_t next = 0;
+            for(const char* c = record.format; *c != '\0'; c++){
+                if(c[0] == '{' && c[1] == '}' && next < record.arg_count){
+                    append_arg(out, record.args[next++]);
+                    c++;
+                }
+                else{
+                    out += *c;
+                }
+            }
+            out += '\n';
+        }
+
+        class log_drain{
+            private:
+                std::mutex m_buffers_mutex;
+                std::vector<std::unique_ptr<thread_buffer>> m_buffers;
+
+                std::atomic<std::uint64_t> m_dropped;
+
+                /**
+                 * Drain passes completed, for flush()
+                 */
+                std::mutex m_pass_mutex;
+                std::condition_variable m_pass_done;
+                std::uint64_t m_passes;
+
+                std::atomic<bool> m_running;
+                std::thread m_thread;
+
+                /**
+                 * Reused between passes so that draining settles into not
+                 * allocating
+                 */
+                std::vector<log_record> m_batch;
+                std::string m_text;
+
+                void drain_once(){
+                    m_batch.clear();
+                    {
+                        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+                        for(auto& buffer : m_buffers){
+                            bool retired = buffer->retired.load(std::memory_order_acquire);
+                            std::uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+                            std::uint64_t head = buffer->head.load(std::memory_order_acquire);
+                            for(; tail != head; tail++){
+                                m_batch.push_back(buffer->records[tail & (logger::buffer_capacity - 1)]);
+                            }
+                            buffer->tail.store(tail, std::memory_order_release);
+                            if(retired){
+                                buffer.reset();
+                            }
+                        }
+                        m_buffers.erase(std::remove(m_buffers.begin(), m_buffers.end(), nullptr), m_buffers.end());
+                    }
+
+                    if(!m_batch.empty()){
+                        // Threads are drained one after another, so put their
+                        // messages back in time order
+                        std::stable_sort(m_batch.begin(), m_batch.end(),
+                                [](const log_record& a, const log_record& b){return a.time_ns < b.time_ns;});
+                        m_text.clear();
+                        for(const log_record& record : m_batch){
+                            format_record(m_text, record);
+                        }
+                        std::cout.write(m_text.data(), static_cast<std::streamsize>(m_text.size()));
+                        std::cout.flush();
+                    }
+
+                    std::lock_guard<std::mutex> lock(m_pass_mutex);
+                    m_passes++;
+                    m_pass_done.notify_all();
+                }
+
+                void run(){
+                    while(m_running.load(std::memory_order_acquire)){
+                        drain_once();
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    }
+                    drain_once();
+                }
+
+            public:
+                log_drain()
+                    :   m_buffers_mutex(),
+                        m_buffers(),
+                        m_dropped(0),
+                        m_pass_mutex(),
+                        m_pass_done(),
+                        m_passes(0),
+                        m_running(true),
+                        m_thread(),
+                        m_batch(),
+                        m_text(){
+                    m_batch.reserve(logger::buffer_capacity);
+                    m_thread = std::thread(&log_drain::run, this);
+                }
+
+                ~log_drain(){
+                    drain_destroyed.store(true, std::memory_order_release);
+                    m_running.store(false, std::memory_order_release);
+                    m_thread.join();
+                }
+
+                thread_buffer* add_buffer(){
+                    auto buffer = std::make_unique<thread_buffer>();
+                    thread_buffer* raw = buffer.get();
+                    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+                    m_buffers.push_back(std::move(buffer));
+                    return raw;
+                }
+
+                void count_drop(){m_dropped.fetch_add(1, std::memory_order_relaxed);}
+
+                std::uint64_t dropped() const{return m_dropped.load(std::memory_order_relaxed);}
+
+                void flush(){
+                    // The pass running now may have missed recent messages,
+                    // the one after it will not
+                    std::unique_lock<std::mutex> lock(m_pass_mutex);
+                    std::uint64_t target = m_passes + 2;
+                    m_pass_done.wait(lock, [&]{return m_passes >= target;});
+                }
+        };
+
+        log_drain& drain(){
+            static log_drain instance;
+            return instance;
+        }
+
+        struct thread_registration{
+            thread_buffer* buffer = nullptr;
+
+            ~thread_registration(){
+                if(buffer != nullptr && !drain_destroyed.load(std::memory_order_acquire)){
+                    buffer->retired.store(true, std::memory_order_release);
+                }
+                buffer = nullptr;
+            }
+        };
+
+        thread_local thread_registration registration;
+
+        thread_buffer* thread_log_buffer(){
+            if(registration.buffer == nullptr){
+                registration.buffer = drain().add_buffer();
+            }
+            return registration.buffer;
+        }
+    }
+
+    namespace detail{
+        log_record* begin_record(){
+            if(drain_destroyed.load(std::memory_order_relaxed)){
+                return nullptr;
+            }
+            thread_buffer* buffer = registration.buffer;
+            if(buffer == nullptr){
+                buffer = thread_log_buffer();
+            }
+            std::uint64_t head = buffer->head.load(std::memory_order_relaxed);
+            if(head - buffer->tail.load(std::memory_order_acquire) == logger::buffer_capacity){
+                drain().count_drop();
+                return nullptr;
+            }
+            return &buffer->records[head & (logger::buffer_capacity - 1)];
+        }
+
+        void commit_record(){
+            thread_buffer* buffer = registration.buffer;
+            buffer->head.store(buffer->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        std::uint64_t log_clock_ns(){
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+    }
+
+    namespace logger{
+        void prepare_thread(){
+            thread_log_buffer();
+        }
+
+        void flush(){
+            if(!drain_destroyed.load(std::memory_order_acquire)){
+                drain().flush();
+            }
+        }
+
+        std::uint64_t dropped(){
+            return drain().dropped();
+        }
+    }
+}
@@ -0,0 +1,178 @@
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * Least severe level that is compiled in, see plotter::log_level. Messages
+ * below it cost nothing at all.
+ */
+#ifndef PLOTTER_LOG_LEVEL
+#define PLOTTER_LOG_LEVEL 2
+#endif
+
+namespace plotter{
+
+    enum class log_level : std::uint8_t{
+        trace = 0,
+        debug = 1,      // Every pin write and other per step detail
+        info = 2,
+        warning = 3,
+        error = 4
+    };
+
+    /**
+     * One argument of a log message, kept in binary until the drain thread
+     * formats it
+     */
+    struct log_arg{
+        enum class kind : std::uint8_t{
+            signed_integer,
+            unsigned_integer,
+            floating,
+            text            // Must point to a string that is never freed
+        };
+
+        kind type;
+        union{
+            std::int64_t i;
+            std::uint64_t u;
+            double d;
+            const char* s;
+        };
+    };
+
+    /**
+     * A log message as recorded by the logging thread. The format is a
+     * string literal in which each {} is replaced by the next argument.
+     */
+    struct log_record{
+        static constexpr std::size_t max_args = 6;
+
+        std::uint64_t time_ns;
+        const char* format;
+        log_level level;
+        std::uint8_t arg_count;
+        std::array<log_arg, max_args> args;
+    };
+
+    namespace detail{
+        /**
+         * @return: free record in the calling thread's buffer, or nullptr
+         *          if the buffer is full and the message must be dropped
+         */
+        log_record* begin_record();
+
+        /**
+         * Hand the record from begin_record() to the drain thread
+         */
+        void commit_record();
+
+        std::uint64_t log_clock_ns();
+
+        template<class T>
+        log_arg make_log_arg(T value){
+            log_arg arg;
+            if constexpr(std::is_same<T, const char*>::value || std::is_same<T, char*>::value){
+                arg.type = log_arg::kind::text;
+                arg.s = value;
+            }
+            else if constexpr(std::is_floating_point<T>::value){
+                arg.type = log_arg::kind::floating;
+                arg.d = static_cast<double>(value);
+            }
+            else if constexpr(std::is_enum<T>::value){
+                arg.type = log_arg::kind::signed_integer;
+                arg.i = static_cast<std::int64_t>(value);
+            }
+            else if constexpr(std::is_signed<T>::value){
+                arg.type = log_arg::kind::signed_integer;
+                arg.i = static_cast<std::int64_t>(value);
+            }
+            else{
+                static_assert(std::is_unsigned<T>::value, "Log arguments must be numbers or string literals");
+                arg.type = log_arg::kind::unsigned_integer;
+                arg.u = static_cast<std::uint64_t>(value);
+            }
+            return arg;
+        }
+    }
+
+    /**
+     * Record a message without formatting it or making a system call. The
+     * arguments are stored in binary in a lock-free buffer owned by the
+     * calling thread and a background thread formats and writes them. A
+     * full buffer drops the message rather than waiting, see
+     * logger::dropped().
+     *
+     * @param format: string literal, {} marks each argument
+     * @param args: numbers, or string literals
+     */
+    template<log_level Level, class... Args>
+    void log_message(const char* format, Args... args){
+        if constexpr(static_cast<int>(Level) >= PLOTTER_LOG_LEVEL){
+            static_assert(sizeof...(Args) <= log_record::max_args, "Too many log arguments");
+            log_record* record = detail::begin_record();
+            if(record == nullptr){
+                return;
+            }
+            record->time_ns = detail::log_clock_ns();
+            record->format = format;
+            record->level = Level;
+            record->arg_count = static_cast<std::uint8_t>(sizeof...(Args));
+            std::size_t index = 0;
+            static_cast<void>(index);
+            ((record->args[index++] = detail::make_log_arg(args)), ...);
+            detail::commit_record();
+        }
+    }
+
+    template<class... Args>
+    void log_trace(const char* format, Args... args){log_message<log_level::trace>(format, args...);}
+
+    template<class... Args>
+    void log_debug(const char* format, Args... args){log_message<log_level::debug>(format, args...);}
+
+    template<class... Args>
+    void log_info(const char* format, Args... args){log_message<log_level::info>(format, args...);}
+
+    template<class... Args>
+    void log_warning(const char* format, Args... args){log_message<log_level::warning>(format, args...);}
+
+    template<class... Args>
+    void log_error(const char* format, Args... args){log_message<log_level::error>(format, args...);}
+
+    /**
+     * Control of the background thread that drains the per-thread buffers
+     */
+    namespace logger{
+        /**
+         * Records each thread can buffer before messages are dropped
+         */
+        constexpr std::size_t buffer_capacity = 1024;
+
+        /**
+         * Set up the calling thread's buffer ahead of time, so that its
+         * first message doesn't allocate. Real-time threads should call
+         * this before they start stepping.
+         */
+        void prepare_thread();
+
+        /**
+         * Wait until every message recorded so far has been written
+         */
+        void flush();
+
+        /**
+         * @return: messages dropped because a buffer was full
+         */
+        std::uint64_t dropped();
+    }
+}
+
+#endif
@@ -0,0 +1,813 @@
+#include "machine_config.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace plotter{
+    namespace{
+        /**
+         * Sequences every description can name, one word per state and one
+         * digit per coil
+         */
+        struct builtin_sequence{
+            const char* name;
+            const char* states;
+        };
+
+        constexpr builtin_sequence builtin_sequences[] = {
+            {"wave", "1000 0100 0010 0001"},
+            {"full", "1100 0110 0011 1001"},
+            {"half", "1000 1100 0100 0110 0010 0011 0001 1001"}
+        };
+
+        /**
+         * Largest pin a pin_mask can hold
+         */
+        constexpr pin max_pin = 63;
+
+        const char* const default_description =
+            "[machine]\n"
+            "kinematics = cartesian\n"
+            "[pen]\n"
+            "type = servo\n"
+            "pin = 1\n"
+            "[sequence plotter]\n"
+            "states = 1010 0110 0101 1001\n"
+            "[axis x]\n"
+            "pins = 0 2 3 12\n"
+            "sequence = plotter\n"
+            "steps_per_mm = 120\n"
+            "[axis y]\n"
+            "pins = 13 14 21 22\n"
+            "sequence = plotter\n"
+            "steps_per_mm = 120\n";
+
+        std::string trim(const std::string& text){
+            std::size_t first = text.find_first_not_of(" \t\r");
+            if(first == std::string::npos){
+                return std::string();
+            }
+            std::size_t last = text.find_last_not_of(" \t\r");
+            return text.substr(first, last - first + 1);
+        }
+
+        std::vector<std::string> words(const std::string& text){
+            std::vector<std::string> result;
+            std::istringstream in(text);
+            std::string word;
+            while(in >> word){
+                result.push_back(word);
+            }
+            return result;
+        }
+
+        /**
+         * Settings of one [axis] section as written
+         */
+        struct axis_entry{
+            std::string name;
+            std::size_t line;
+            std::vector<pin> pins;
+            std::string sequence;
+            double steps_per_mm = 0;
+            axis_limits limits;
+            std::size_t shard = 0;
+            bool homes = false;
+            pin limit_line = 0;
+            homing_profile homing = {};
+            bool has_encoder = false;
+            pin encoder_a = 0;
+            pin encoder_b = 0;
+            std::int64_t encoder_counts = 0;
+            std::int64_t encoder_steps = 0;
+            std::int64_t stall_tolerance = 8;
+            bool adaptive = false;
+            step_mode_profile step_modes = {};
+            shaper_config shaper = {};
+        };
+
+        /**
+         * States of one [sequence] section as written
+         */
+        struct sequence_entry{
+            std::string name;
+            std::size_t line;
+            std::vector<std::string> states;
+        };
+
+        /**
+         * Reads a description line by line, then checks it as a whole and
+         * compiles it
+         */
+        class description_parser{
+            private:
+                std::string m_source;
+                std::size_t m_line;
+
+                std::string m_section;
+                std::string m_kinematics;
+                double m_anchor_separation;
+                double m_home_x;
+                double m_home_y;
+                double m_tolerance;
+                std::string m_pen_type;
+
+                std::vector<axis_entry> m_axes;
+                std::vector<sequence_entry> m_sequences;
+                machine_config m_config;
+
+                [[noreturn]] void fail(const std::string& message) const{
+                    throw std::runtime_error(m_source + ":" + std::to_string(m_line) + ": " + message);
+                }
+
+                [[noreturn]] void fail_at(std::size_t line, const std::string& message) const{
+                    throw std::runtime_error(m_source + ":" + std::to_string(line) + ": " + message);
+                }
+
+                double number(const std::string& value) const{
+                    std::size_t used = 0;
+                    double result = 0;
+                    try{
+                        result = std::stod(value, &used);
+                    }
+                    catch(const std::exception&){
+                        used = 0;
+                    }
+                    if(used == 0 || used != value.size() || !std::isfinite(result)){
+                        fail("'" + value + "' is not a number");
+                    }
+                    return result;
+                }
+
+                double positive(const std::string& value) const{
+                    double result = number(value);
+                    if(!(result > 0)){
+                        fail("'" + value + "' must be greater than 0");
+                    }
+                    return result;
+                }
+
+                unsigned int whole(const std::string& value) const{
+                    double result = number(value);
+                    if(result < 0 || result > 4294967295.0 || std::floor(result) != result){
+                        fail("'" + value + "' must be a whole number");
+                    }
+                    return static_cast<unsigned int>(result);
+                }
+
+                bool flag(const std::string& value) const{
+                    if(value == "true" || value == "yes" || value == "1"){
+                        return true;
+                    }
+                    if(value == "false" || value == "no" || value == "0"){
+                        return false;
+                    }
+                    fail("'" + value + "' is not true or false");
+                }
+
+                std::size_t shard(const std::string& value) const{
+                    unsigned int result = whole(value);
+                    if(result >= max_axes){
+                        fail("Shard " + value + " is out of range, shards are numbered from 0 to " + std::to_string(max_axes - 1));
+                    }
+                    return result;
+                }
+
+                /**
+                 * Micrometers from millimeters, the planner's unit for speeds
+                 */
+                static std::int64_t micrometers(double millimeters){
+                    return static_cast<std::int64_t>(std::llround(millimeters * 1000));
+                }
+
+                void section(const std::string& header);
+                void setting(const std::string& key, const std::string& value);
+                void machine_setting(const std::string& key, const std::string& value);
+                void pen_setting(const std::string& key, const std::string& value);
+                void axis_setting(axis_entry& axis, const std::string& key, const std::string& value);
+
+                const sequence_entry* find_sequence(const std::string& name) const;
+                void compile_axes();
+                void compile_kinematics();
+
+            public:
+                explicit description_parser(std::string source)
+                    :   m_source(std::move(source)),
+                        m_line(0),
+                        m_section(),
+                        m_kinematics("cartesian"),
+                        m_anchor_separation(0),
+                        m_home_x(0),
+                        m_home_y(0),
+                        m_tolerance(0.01),
+                        m_pen_type("servo"),
+                        m_axes(),
+                        m_sequences(),
+                        m_config(){}
+
+                machine_config parse(std::istream& in);
+        };
+
+        void description_parser::section(const std::string& header){
+            std::vector<std::string> parts = words(header.substr(1, header.size() - 2));
+            if(parts.empty()){
+                fail("Empty section name");
+            }
+            m_section = parts[0];
+            if(m_section == "machine" || m_section == "pen"){
+                if(parts.size() != 1){
+                    fail("[" + m_section + "] takes no name");
+                }
+                return;
+            }
+            if(m_section != "axis" && m_section != "sequence"){
+                fail("Unknown section [" + m_section + "]");
+            }
+            if(parts.size() != 2){
+                fail("[" + m_section + "] needs a single word name");
+            }
+            if(m_section == "axis"){
+                for(const axis_entry& axis : m_axes){
+                    if(axis.name == parts[1]){
+                        fail("Axis " + parts[1] + " is described twice");
+                    }
+                }
+                m_axes.push_back(axis_entry{parts[1], m_line, {}, std::string(), 0, axis_limits(), 0});
+            }
+            else{
+                for(const sequence_entry& sequence : m_sequences){
+                    if(sequence.name == parts[1]){
+                        fail("Sequence " + parts[1] + " is described twice");
+                    }
+                }
+                m_sequences.push_back(sequence_entry{parts[1], m_line, {}});
+            }
+        }
+
+        void description_parser::setting(const std::string& key, const std::string& value){
+            if(m_section.empty()){
+                fail("Setting outside of any section");
+            }
+            if(value.empty()){
+                fail(key + " has no value");
+            }
+            if(m_section == "machine"){
+                machine_setting(key, value);
+            }
+            else if(m_section == "pen"){
+                pen_setting(key, value);
+            }
+            else if(m_section == "axis"){
+                axis_setting(m_axes.back(), key, value);
+            }
+            else if(key == "states"){
+                m_sequences.back().states = words(value);
+            }
+            else{
+                fail("Unknown sequence setting " + key);
+            }
+        }
+
+        void description_parser::machine_setting(const std::string& key, const std::string& value){
+            if(key == "kinematics"){
+                m_kinematics = value;
+            }
+            else if(key == "gpio"){
+                if(value == "wiringpi"){
+                    m_config.gpio = gpio_outputs::type::context;
+                }
+                else if(value == "mmio"){
+                    m_config.gpio = gpio_outputs::type::mmio;
+                }
+                else if(value == "shadow"){
+                    m_config.gpio = gpio_outputs::type::shadow;
+                }
+                else{
+                    fail("gpio must be wiringpi, mmio or shadow, not " + value);
+                }
+            }
+            else if(key == "gpio_device"){
+                m_config.gpio_device = value;
+            }
+            else if(key == "acceleration"){
+                m_config.motion.acceleration = micrometers(positive(value));
+            }
+            else if(key == "junction_deviation"){
+                m_config.motion.junction_deviation = micrometers(positive(value));
+            }
+            else if(key == "anchor_separation"){
+                m_anchor_separation = positive(value);
+            }
+            else if(key == "home_x"){
+                m_home_x = number(value);
+            }
+            else if(key == "home_y"){
+                m_home_y = positive(value);
+            }
+            else if(key == "tolerance"){
+                m_tolerance = positive(value);
+            }
+            else if(key == "input_chip"){
+                m_config.input_chip = value;
+            }
+            else if(key == "input_active_low"){
+                m_config.input_active_low = flag(value);
+            }
+            else if(key == "input_debounce_us"){
+                m_config.input_debounce_us = whole(value);
+            }
+            else if(key == "homing_tick_us"){
+                m_config.homing_tick_us = whole(value);
+                if(m_config.homing_tick_us == 0){
+                    fail("homing_tick_us must be greater than 0");
+                }
+            }
+            else{
+                fail("Unknown machine setting " + key);
+            }
+        }
+
+        void description_parser::pen_setting(const std::string& key, const std::string& value){
+            if(key == "type"){
+                if(value != "servo" && value != "solenoid"){
+                    fail("Pen type must be servo or solenoid, not " + value);
+                }
+                m_pen_type = value;
+            }
+            else if(key == "pin"){
+                m_config.pen_pin = whole(value);
+            }
+            else if(key == "up_pulse_us"){
+                m_config.up_pulse_us = whole(value);
+            }
+            else if(key == "down_pulse_us"){
+                m_config.down_pulse_us = whole(value);
+            }
+            else if(key == "lift_when_high"){
+                m_config.lift_when_high = flag(value);
+            }
+            else if(key == "release_us"){
+                m_config.timing.release_us = whole(value);
+            }
+            else if(key == "clear_us"){
+                m_config.timing.clear_us = whole(value);
+            }
+            else if(key == "touch_us"){
+                m_config.timing.touch_us = whole(value);
+            }
+            else if(key == "settle_us"){
+                m_config.timing.settle_us = whole(value);
+            }
+            else if(key == "shard"){
+                m_config.pen_shard = shard(value);
+            }
+            else{
+                fail("Unknown pen setting " + key);
+            }
+        }
+
+        void description_parser::axis_setting(axis_entry& axis, const std::string& key, const std::string& value){
+            if(key == "pins"){
+                axis.pins.clear();
+                for(const std::string& word : words(value)){
+                    axis.pins.push_back(whole(word));
+                }
+            }
+            else if(key == "sequence"){
+                axis.sequence = value;
+            }
+            else if(key == "steps_per_mm"){
+                axis.steps_per_mm = positive(value);
+            }
+            else if(key == "max_velocity"){
+                axis.limits.max_velocity = micrometers(positive(value));
+            }
+            else if(key == "max_acceleration"){
+                axis.limits.max_acceleration = micrometers(positive(value));
+            }
+            else if(key == "shard"){
+                axis.shard = shard(value);
+            }
+            else if(key == "step_mode"){
+                if(value != "fixed" && value != "adaptive"){
+                    fail("step_mode must be fixed or adaptive, not " + value);
+                }
+                axis.adaptive = value == "adaptive";
+            }
+            else if(key == "full_step_above"){
+                axis.step_modes.full_step_above = whole(value);
+            }
+            else if(key == "half_step_below"){
+                axis.step_modes.half_step_below = whole(value);
+            }
+            else if(key == "shaper"){
+                if(value == "none"){
+                    axis.shaper.type = shaper_type::none;
+                }
+                else if(value == "zv"){
+                    axis.shaper.type = shaper_type::zv;
+                }
+                else if(value == "mzv"){
+                    axis.shaper.type = shaper_type::mzv;
+                }
+                else if(value == "ei"){
+                    axis.shaper.type = shaper_type::ei;
+                }
+                else{
+                    fail("shaper must be none, zv, mzv or ei, not " + value);
+                }
+            }
+            else if(key == "shaper_frequency"){
+                axis.shaper.frequency = positive(value);
+            }
+            else if(key == "shaper_damping"){
+                axis.shaper.damping = number(value);
+                if(axis.shaper.damping < 0 || axis.shaper.damping >= 1){
+                    fail("shaper_damping must be at least 0 and below 1");
+                }
+            }
+            else if(key == "limit_pin"){
+                axis.homes = true;
+                axis.limit_line = whole(value);
+            }
+            else if(key == "home_direction"){
+                if(value != "-1" && value != "1"){
+                    fail("home_direction must be -1 or 1, not " + value);
+                }
+                axis.homing.direction = value == "1" ? 1 : -1;
+            }
+            else if(key == "home_backoff"){
+                axis.homing.backoff_steps = static_cast<int>(std::min(whole(value), 1u << 30));
+            }
+            else if(key == "home_seek_ticks"){
+                axis.homing.seek_ticks_per_step = std::max(1u, whole(value));
+            }
+            else if(key == "home_reseek_ticks"){
+                axis.homing.reseek_ticks_per_step = std::max(1u, whole(value));
+            }
+            else if(key == "home_max_steps"){
+                axis.homing.max_steps = static_cast<int>(std::min(whole(value), 1u << 30));
+            }
+            else if(key == "encoder_pins"){
+                std::vector<std::string> lines = words(value);
+                if(lines.size() != 2){
+                    fail("encoder_pins needs the lines of channels A and B");
+                }
+                axis.has_encoder = true;
+                axis.encoder_a = whole(lines[0]);
+                axis.encoder_b = whole(lines[1]);
+            }
+            else if(key == "encoder_counts"){
+                double counts = number(value);
+                if(counts == 0 || std::floor(counts) != counts || std::fabs(counts) > 1e9){
+                    fail("encoder_counts must be a whole number other than 0");
+                }
+                axis.encoder_counts = static_cast<std::int64_t>(counts);
+            }
+            else if(key == "encoder_steps"){
+                axis.encoder_steps = std::min(whole(value), 1000000000u);
+            }
+            else if(key == "stall_tolerance"){
+                axis.stall_tolerance = whole(value);
+            }
+            else{
+                fail("Unknown axis setting " + key);
+            }
+        }
+
+        const sequence_entry* description_parser::find_sequence(const std::string& name) const{
+            for(const sequence_entry& sequence : m_sequences){
+                if(sequence.name == name){
+                    return &sequence;
+                }
+            }
+            return nullptr;
+        }
+
+        void description_parser::compile_axes(){
+            if(m_axes.empty()){
+                throw std::runtime_error(m_source + ": No axes described");
+            }
+            if(m_axes.size() > max_axes){
+                fail_at(m_axes[max_axes].line, "More than " + std::to_string(max_axes) + " axes");
+            }
+
+            if(m_config.pen_pin > max_pin){
+                throw std::runtime_error(m_source + ": Pen pin " + std::to_string(m_config.pen_pin) + " is out of range");
+            }
+            m_config.shard_count = m_config.pen_shard + 1;
+            for(const axis_entry& axis : m_axes){
+                m_config.shard_count = std::max(m_config.shard_count, axis.shard + 1);
+            }
+            // Every pin of a controller drives one thing only, and every
+            // input line belongs to one switch or encoder
+            std::vector<pin_mask> used(m_config.shard_count, 0);
+            std::vector<pin> input_lines;
+            std::vector<std::size_t> shard_axes(m_config.shard_count, 0);
+            used[m_config.pen_shard] = to_mask(m_config.pen_pin);
+            std::vector<sequence_entry> builtins;
+            for(const builtin_sequence& builtin : builtin_sequences){
+                builtins.push_back(sequence_entry{builtin.name, 0, words(builtin.states)});
+            }
+
+            m_config.motion.axis_count = m_axes.size();
+            for(std::size_t index = 0; index < m_axes.size(); index++){
+                const axis_entry& axis = m_axes[index];
+                if(axis.pins.empty()){
+                    fail_at(axis.line, "Axis " + axis.name + " has no pins");
+                }
+                if(axis.steps_per_mm == 0){
+                    fail_at(axis.line, "Axis " + axis.name + " has no steps_per_mm");
+                }
+                pin_mask pins = 0;
+                for(pin coil_pin : axis.pins){
+                    if(coil_pin > max_pin){
+                        fail_at(axis.line, "Pin " + std::to_string(coil_pin) + " of axis " + axis.name + " is out of range");
+                    }
+                    if((used[axis.shard] & to_mask(coil_pin)) != 0){
+                        fail_at(axis.line, "Pin " + std::to_string(coil_pin) + " of axis " + axis.name + " is already in use");
+                    }
+                    used[axis.shard] |= to_mask(coil_pin);
+                    pins |= to_mask(coil_pin);
+                }
+
+                std::string name = axis.sequence.empty() ? "full" : axis.sequence;
+                const sequence_entry* sequence = find_sequence(name);
+                for(const sequence_entry& builtin : builtins){
+                    if(sequence == nullptr && builtin.name == name){
+                        sequence = &builtin;
+                    }
+                }
+                if(sequence == nullptr){
+                    fail_at(axis.line, "Axis " + axis.name + " uses unknown sequence " + name);
+                }
+                if(sequence->states.size() < 2){
+                    fail_at(sequence->line != 0 ? sequence->line : axis.line, "Sequence " + name + " needs at least two states");
+                }
+
+                if(axis.adaptive){
+                    if(sequence->states.size() % 2 != 0){
+                        fail_at(axis.line, "Adaptive axis " + axis.name + " needs a half-step sequence with an even number of states");
+                    }
+                    if(axis.step_modes.half_step_below > axis.step_modes.full_step_above){
+                        fail_at(axis.line, "half_step_below of axis " + axis.name + " is above its full_step_above");
+                    }
+                }
+
+                // Packed once here so a step is a table lookup and a write
+                std::vector<pin_mask> states;
+                states.reserve(sequence->states.size());
+                for(const std::string& state : sequence->states){
+                    if(state.size() != axis.pins.size() || state.find_first_not_of("01") != std::string::npos){
+                        fail_at(axis.line, "State " + state + " of sequence " + name + " doesn't give one 0 or 1 per pin of axis " + axis.name);
+                    }
+                    pin_mask levels = 0;
+                    for(std::size_t coil = 0; coil < state.size(); coil++){
+                        if(state[coil] == '1'){
+                            levels |= to_mask(axis.pins[coil]);
+                        }
+                    }
+                    states.push_back(levels);
+                }
+
+                std::vector<pin> inputs;
+                if(axis.homes){
+                    inputs.push_back(axis.limit_line);
+                }
+                if(axis.has_encoder){
+                    if(axis.encoder_counts == 0 || axis.encoder_steps == 0){
+                        fail_at(axis.line, "The encoder of axis " + axis.name + " needs encoder_counts and encoder_steps");
+                    }
+                    inputs.push_back(axis.encoder_a);
+                    inputs.push_back(axis.encoder_b);
+                }
+                for(pin line : inputs){
+                    if(std::find(input_lines.begin(), input_lines.end(), line) != input_lines.end()){
+                        fail_at(axis.line, "Input line " + std::to_string(line) + " of axis " + axis.name + " is already in use");
+                    }
+                    input_lines.push_back(line);
+                }
+
+                step_scale scale = step_scale::from_steps_per_millimeter(axis.steps_per_mm);
+                m_config.axes.push_back(machine_axis{axis.name, runtime_sequence(std::move(states), pins), scale,
+                        axis.shard, shard_axes[axis.shard]++, axis.homes, axis.limit_line, axis.homing,
+                        axis.has_encoder, axis.encoder_a, axis.encoder_b, axis.encoder_counts, axis.encoder_steps,
+                        axis.stall_tolerance, axis.adaptive, axis.step_modes, axis.shaper});
+                m_config.motion.axes[index] = axis.limits;
+                m_config.motion.axes[index].scale = scale;
+            }
+
+            for(std::size_t shard = 0; shard < m_config.shard_count; shard++){
+                if(shard_axes[shard] == 0 && shard != m_config.pen_shard){
+                    throw std::runtime_error(m_source + ": Shard " + std::to_string(shard) + " drives nothing");
+                }
+            }
+
+            // Arcs and the mixed axes of CoreXY both step the two in one
+            // resolution
+            if(m_axes.size() >= 2 && (m_config.motion.axes[0].scale.steps() != m_config.motion.axes[1].scale.steps()
+                        || m_config.motion.axes[0].scale.length() != m_config.motion.axes[1].scale.length())){
+                fail_at(m_axes[1].line, "Axes " + m_axes[0].name + " and " + m_axes[1].name + " must have the same steps_per_mm");
+            }
+        }
+
+        void description_parser::compile_kinematics(){
+            if(m_kinematics == "cartesian"){
+                m_config.machine = kinematics(kinematics::type::cartesian);
+                return;
+            }
+            if(m_axes.size() < 2){
+                throw std::runtime_error(m_source + ": " + m_kinematics + " kinematics need two axes");
+            }
+            if(m_kinematics == "corexy"){
+                m_config.machine = kinematics(kinematics::type::corexy);
+            }
+            else if(m_kinematics == "hbot"){
+                m_config.machine = kinematics(kinematics::type::hbot);
+            }
+            else if(m_kinematics == "polargraph"){
+                if(m_anchor_separation == 0 || m_home_y == 0){
+                    throw std::runtime_error(m_source + ": A polargraph needs anchor_separation and home_y");
+                }
+                try{
+                    m_config.machine = kinematics::polargraph(position::from(millimeters(m_anchor_separation)),
+                            position::from(millimeters(m_home_x)),
+                            position::from(millimeters(m_home_y)),
+                            position::from(millimeters(m_tolerance)));
+                }
+                catch(const std::invalid_argument& error){
+                    throw std::runtime_error(m_source + ": " + error.what());
+                }
+            }
+            else{
+                throw std::runtime_error(m_source + ": Unknown kinematics " + m_kinematics);
+            }
+        }
+
+        machine_config description_parser::parse(std::istream& in){
+            std::string text;
+            while(std::getline(in, text)){
+                m_line++;
+                std::string line = trim(text.substr(0, text.find('#')));
+                if(line.empty()){
+                    continue;
+                }
+                if(line.front() == '['){
+                    if(line.back() != ']'){
+                        fail("Section header without a closing ]");
+                    }
+                    section(line);
+                    continue;
+                }
+                std::size_t equals = line.find('=');
+                if(equals == std::string::npos){
+                    fail("Expected key = value");
+                }
+                setting(trim(line.substr(0, equals)), trim(line.substr(equals + 1)));
+            }
+            if(in.bad()){
+                throw std::runtime_error("Unable to read machine description " + m_source);
+            }
+
+            m_config.pen = m_pen_type == "servo" ? machine_config::pen_type::servo : machine_config::pen_type::solenoid;
+            compile_axes();
+            compile_kinematics();
+            return std::move(m_config);
+        }
+    }
+
+/******************************************************************************/
+/*                                   Loading                                  */
+/******************************************************************************/
+    machine_config parse_machine_config(std::istream& in, const std::string& source){
+        return description_parser(source).parse(in);
+    }
+
+    machine_config load_machine_config(const std::string& path){
+        std::ifstream in(path);
+        if(!in){
+            throw std::runtime_error("Unable to open machine description " + path);
+        }
+        return parse_machine_config(in, path);
+    }
+
+    machine_config default_machine_config(){
+        std::istringstream in(default_description);
+        return parse_machine_config(in, "default machine");
+    }
+
+/******************************************************************************/
+/*                                  Hardware                                  */
+/******************************************************************************/
+    std::shared_ptr<gpio_outputs> machine_config::make_outputs(std::shared_ptr<context> wiring_pi_context) const{
+        return std::make_shared<gpio_outputs>(gpio, std::move(wiring_pi_context), gpio_device);
+    }
+
+    std::unique_ptr<stepper> machine_config::make_stepper(const std::shared_ptr<gpio_outputs>& outputs, std::size_t axis) const{
+        const machine_axis& described = axes.at(axis);
+        std::unique_ptr<stepper_coil> coil = described.adaptive
+            ? std::make_unique<stepper_coil>(outputs, described.sequence, described.step_modes)
+            : std::make_unique<stepper_coil>(outputs, described.sequence);
+        return std::make_unique<stepper>(std::move(coil), described.scale);
+    }
+
+    bool machine_config::homes() const{
+        for(const machine_axis& axis : axes){
+            if(axis.homes){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool machine_config::has_inputs() const{
+        for(const machine_axis& axis : axes){
+            if(axis.homes || axis.has_encoder){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::shared_ptr<edge_source> machine_config::make_input_source() const{
+        std::vector<pin> lines;
+        for(const machine_axis& axis : axes){
+            if(axis.homes){
+                lines.push_back(axis.limit_line);
+            }
+            if(axis.has_encoder){
+                lines.push_back(axis.encoder_a);
+                lines.push_back(axis.encoder_b);
+            }
+        }
+        return std::make_shared<gpio_line_source>(input_chip, std::move(lines), input_active_low, input_debounce_us);
+    }
+
+    machine_inputs machine_config::connect_inputs(edge_monitor& monitor, std::shared_ptr<edge_source> source) const{
+        machine_inputs inputs;
+        for(const machine_axis& axis : axes){
+            inputs.switches.push_back(axis.homes
+                    ? std::make_shared<limit_switch>(source->level(axis.limit_line))
+                    : nullptr);
+            inputs.encoders.push_back(axis.has_encoder
+                    ? std::make_shared<quadrature_encoder>(axis.encoder_a, axis.encoder_b,
+                        source->level(axis.encoder_a), source->level(axis.encoder_b))
+                    : nullptr);
+        }
+        std::vector<pin> limit_lines;
+        for(const machine_axis& axis : axes){
+            limit_lines.push_back(axis.limit_line);
+        }
+        monitor.add(source, [inputs, limit_lines](const edge_event& event){
+            for(std::size_t axis = 0; axis < limit_lines.size(); axis++){
+                if(inputs.switches[axis] && event.line == limit_lines[axis]){
+                    inputs.switches[axis]->on_edge(event);
+                }
+                if(inputs.encoders[axis]){
+                    // Ignores the lines of other encoders
+                    inputs.encoders[axis]->on_edge(event);
+                }
+            }
+        });
+        return inputs;
+    }
+
+    std::vector<stall_monitor> machine_config::make_stall_monitors(const machine_inputs& inputs,
+            const stall_handler& handler) const{
+        std::vector<stall_monitor> monitors;
+        for(std::size_t axis = 0; axis < axes.size(); axis++){
+            if(inputs.encoders[axis]){
+                monitors.emplace_back(inputs.encoders[axis], axis, axes[axis].encoder_counts,
+                        axes[axis].encoder_steps, axes[axis].stall_tolerance, handler);
+            }
+        }
+        return monitors;
+    }
+
+    std::array<shaper_config, max_axes> machine_config::shapers() const{
+        std::array<shaper_config, max_axes> result{};
+        for(std::size_t axis = 0; axis < axes.size(); axis++){
+            result[axis] = axes[axis].shaper;
+        }
+        return result;
+    }
+
+    std::vector<homing_profile> machine_config::homing_profiles() const{
+        std::vector<homing_profile> profiles;
+        for(const machine_axis& axis : axes){
+            profiles.push_back(axis.homing);
+        }
+        return profiles;
+    }
+
+    pen_actuator machine_config::make_pen(std::shared_ptr<context> wiring_pi_context) const{
+        if(pen == pen_type::servo){
+            return pen_actuator::servo(std::move(wiring_pi_context), pen_pin, up_pulse_us, down_pulse_us);
+        }
+        return pen_actuator::solenoid(std::move(wiring_pi_context), pen_pin, lift_when_high);
+    }
+}
@@ -0,0 +1,289 @@
+#ifndef MACHINE_CONFIG_HPP
+#define MACHINE_CONFIG_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "adaptive_coil.hpp"
+#include "coil_sequence.hpp"
+#include "encoder.hpp"
+#include "gpio_backend.hpp"
+#include "gpio_edge.hpp"
+#include "homing.hpp"
+#include "input_shaper.hpp"
+#include "kinematics.hpp"
+#include "motion.hpp"
+#include "pen.hpp"
+#include "stepper.hpp"
+#include "units.hpp"
+#include "wiringPiContext.hpp"
+
+namespace plotter{
+
+    /**
+     * One motor of a machine, ready to build a stepper from
+     */
+    struct machine_axis{
+        std::string name;
+
+        /**
+         * Coil states packed into pin levels, see runtime_sequence
+         */
+        runtime_sequence sequence;
+        step_scale scale;
+
+        /**
+         * Controller driving the axis, and its index among that
+         * controller's axes
+         */
+        std::size_t shard;
+        std::size_t shard_axis;
+
+        /**
+         * Whether the axis is homed at startup, and the line of its limit
+         * switch on machine_config::input_chip
+         */
+        bool homes;
+        pin limit_line;
+        homing_profile homing;
+
+        /**
+         * Whether a quadrature encoder watches the axis for stalls, its
+         * lines on machine_config::input_chip and the ratio and tolerance
+         * of its stall_monitor
+         */
+        bool has_encoder;
+        pin encoder_a;
+        pin encoder_b;
+        std::int64_t encoder_counts;
+        std::int64_t encoder_steps;
+        std::int64_t stall_tolerance;
+
+        /**
+         * Whether the coil full steps its half-step sequence when driven
+         * fast, and the rates at which it changes mode
+         */
+        bool adaptive;
+        step_mode_profile step_modes;
+
+        /**
+         * Shaper cancelling the frame's resonance along the axis
+         */
+        shaper_config shaper;
+    };
+
+    /**
+     * Inputs of a machine connected to an edge_monitor, one entry per
+     * axis, nullptr where the axis has none
+     */
+    struct machine_inputs{
+        std::vector<std::shared_ptr<limit_switch>> switches;
+        std::vector<std::shared_ptr<quadrature_encoder>> encoders;
+    };
+
+    /**
+     * A machine description compiled for use: the planner's limits, the
+     * kinematics, the pen and the packed coil table of every axis. Nothing
+     * here is looked up while stepping; the steppers and pen are built from
+     * it once and the description itself is gone after loading.
+     *
+     * Descriptions are text, one setting per line in sections, with # to
+     * the end of a line a comment. Lengths are in millimeters and times in
+     * microseconds:
+     *
+     *      [machine]
+     *      kinematics = cartesian      # corexy, hbot or polargraph
+     *      gpio = wiringpi             # Coil outputs, mmio writes the
+     *      gpio_device = /dev/gpiomem  # registers of gpio_device and
+     *                                  # shadow only records the levels
+     *      acceleration = 1000         # mm/s^2 along the path
+     *      junction_deviation = 0.02
+     *      anchor_separation = 800     # Polargraph only, as are home_x,
+     *                                  # home_y and tolerance
+     *      input_chip = /dev/gpiochip0 # GPIO chip of the limit switches
+     *      input_active_low = false    # and encoders
+     *      input_debounce_us = 0
+     *      homing_tick_us = 500        # Time between homing ticks
+     *
+     *      [pen]
+     *      type = servo                # or solenoid
+     *      pin = 1
+     *      up_pulse_us = 1000          # Servo only
+     *      down_pulse_us = 2000
+     *      lift_when_high = true       # Solenoid only
+     *      release_us = 40000          # See pen_timing, as are clear_us,
+     *                                  # touch_us and settle_us
+     *      shard = 0                   # Controller driving the pen
+     *
+     *      [sequence wide]             # Named coil sequence, one state per
+     *      states = 1100 0110 0011 1001  # word and one digit per coil pin
+     *
+     *      [axis x]                    # In the planner's axis order
+     *      pins = 0 2 3 12
+     *      sequence = full             # wave, full and half are built in
+     *      steps_per_mm = 120
+     *      max_velocity = 100          # mm/s
+     *      max_acceleration = 2000     # mm/s^2
+     *      shard = 0                   # Controller driving the axis
+     *      limit_pin = 5               # Homes the axis at startup, see
+     *      home_direction = -1         # homing_profile for these
+     *      home_backoff = 40           # Steps
+     *      home_seek_ticks = 1         # Homing ticks per step
+     *      home_reseek_ticks = 8
+     *      home_max_steps = 1048576
+     *      encoder_pins = 7 8          # Quadrature A and B, halts the job
+     *      encoder_counts = 400        # on a stall; counts per
+     *      encoder_steps = 200         # encoder_steps motor steps,
+     *      stall_tolerance = 8         # negative if counting backwards
+     *      step_mode = fixed           # adaptive full steps a half-step
+     *      full_step_above = 1600      # sequence at or above this many
+     *      half_step_below = 1200      # steps per second, and half steps
+     *                                  # again below half_step_below
+     *      shaper = none               # zv, mzv or ei cancel a resonance
+     *      shaper_frequency = 40       # at this many hertz, see
+     *      shaper_damping = 0.1        # input_shaper
+     *
+     * A machine with more motors than one controller has pins is split
+     * into shards numbered from 0, each with its own pins; see
+     * shard_distributor. Anything left out keeps the default of its config
+     * struct.
+     */
+    struct machine_config{
+        enum class pen_type{
+            servo,
+            solenoid
+        };
+
+        motion_config motion;
+        kinematics machine;
+
+        pen_type pen = pen_type::servo;
+        pin pen_pin = 1;
+        unsigned int up_pulse_us = 1000;
+        unsigned int down_pulse_us = 2000;
+        bool lift_when_high = true;
+        pen_timing timing;
+        std::size_t pen_shard = 0;
+
+        std::vector<machine_axis> axes;
+
+        /**
+         * Controllers the machine is spread over
+         */
+        std::size_t shard_count = 1;
+
+        /**
+         * Backend the coils are written through, see gpio_outputs
+         */
+        gpio_outputs::type gpio = gpio_outputs::type::context;
+        std::string gpio_device = "/dev/gpiomem";
+
+        /**
+         * Limit switches and encoders
+         */
+        std::string input_chip = "/dev/gpiochip0";
+        bool input_active_low = false;
+        unsigned int input_debounce_us = 0;
+        unsigned int homing_tick_us = 500;
+
+        /**
+         * @return: true if any axis homes at startup
+         */
+        bool homes() const;
+
+        /**
+         * @return: true if any axis has a limit switch or an encoder
+         */
+        bool has_inputs() const;
+
+        /**
+         * @return: edge source for the limit switch and encoder lines of
+         *          every axis
+         * @throw: system_error if the lines can't be requested
+         */
+        std::shared_ptr<edge_source> make_input_source() const;
+
+        /**
+         * The lines share one source, which the monitor takes once and
+         * dispatches to every switch and encoder
+         *
+         * @param monitor: monitor to dispatch the edges from
+         * @param source: source of the input lines, i.e. from
+         *                make_input_source()
+         * @return: switches and encoders of the axes
+         */
+        machine_inputs connect_inputs(edge_monitor& monitor, std::shared_ptr<edge_source> source) const;
+
+        /**
+         * @param inputs: connected inputs
+         * @param handler: called when an axis stalls
+         * @return: stall monitor of every axis with an encoder
+         */
+        std::vector<stall_monitor> make_stall_monitors(const machine_inputs& inputs,
+                const stall_handler& handler=stall_handler()) const;
+
+        /**
+         * @return: shaper of each axis, for pipeline_config::shapers
+         */
+        std::array<shaper_config, max_axes> shapers() const;
+
+        /**
+         * @return: homing profile of each axis
+         */
+        std::vector<homing_profile> homing_profiles() const;
+
+        /**
+         * @param wiring_pi_context: hardware interface, written by the
+         *                           context backend and the pen
+         * @return: coil outputs of one controller
+         * @throw: system_error if the mmio backend can't map gpio_device
+         */
+        std::shared_ptr<gpio_outputs> make_outputs(std::shared_ptr<context> wiring_pi_context) const;
+
+        /**
+         * @param outputs: outputs of the controller driving the axis, from
+         *                 make_outputs()
+         * @param axis: index of the axis
+         * @return: stepper driving the axis
+         */
+        std::unique_ptr<stepper> make_stepper(const std::shared_ptr<gpio_outputs>& outputs, std::size_t axis) const;
+
+        /**
+         * @param wiring_pi_context: hardware interface
+         * @return: pen lift, starting with the pen up
+         */
+        pen_actuator make_pen(std::shared_ptr<context> wiring_pi_context) const;
+    };
+
+    /**
+     * Read, check and compile a machine description
+     *
+     * @param in: description text
+     * @param source: name of the description for error messages
+     * @return: compiled machine
+     * @throw: runtime_error naming the line or section at fault if the
+     *         description is malformed or describes an impossible machine,
+     *         i.e. one pin of a controller driving two things
+     */
+    machine_config parse_machine_config(std::istream& in, const std::string& source);
+
+    /**
+     * @param path: description file
+     * @return: compiled machine
+     * @throw: runtime_error if the file can't be read or is invalid
+     */
+    machine_config load_machine_config(const std::string& path);
+
+    /**
+     * @return: the two axis Cartesian plotter on one Raspberry Pi this
+     *          controller was built for
+     */
+    machine_config default_machine_config();
+}
+
+#endif
@@ -0,0 +1,648 @@
+#include "motion.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace plotter{
+    namespace{
+        constexpr std::int64_t nanometers_per_micrometer = 1000;
+
+        /**
+         * Fixed-point one for the junction angle math
+         */
+        constexpr std::int64_t unit = 1 << 16;
+
+        std::int64_t abs64(std::int64_t value){
+            return value < 0 ? -value : value;
+        }
+
+        std::uint32_t to_rate(std::int64_t speed, std::uint32_t event_count, std::int64_t length){
+            return static_cast<std::uint32_t>(scale(speed, event_count, length, rounding::nearest));
+        }
+    }
+
+/******************************************************************************/
+/*                                   Planner                                  */
+/******************************************************************************/
+    motion_planner::motion_planner(const motion_config& config)
+        :   m_config(config),
+            m_window(),
+            m_window_start(0),
+            m_window_count(0),
+            m_locked_entry(0),
+            m_output(),
+            m_output_start(0),
+            m_output_count(0),
+            m_target(),
+            m_position(),
+            m_last_delta(),
+            m_last_length(0),
+            m_last_nominal(0),
+            m_line(0){}
+
+    std::int64_t motion_planner::junction_speed(const std::array<std::int64_t, max_axes>& delta,
+            std::int64_t length,
+            std::int64_t acceleration) const{
+        if(m_last_length == 0){
+            return 0;
+        }
+
+        std::int64_t dot = 0;
+        for(std::size_t axis = 0; axis < m_config.axis_count; axis++){
+            dot += m_last_delta[axis] * delta[axis];
+        }
+        std::int64_t cosine = divide(dot * unit, m_last_length * length, rounding::nearest);
+        std::int64_t limit = m_last_nominal;
+        if(cosine >= unit - 1){
+            return limit;
+        }
+        if(cosine <= -unit + 1){
+            return 0;
+        }
+
+        // sin(theta / 2) = sqrt((1 - cos(theta)) / 2), where theta is the
+        // change in direction
+        std::int64_t sine = static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>((unit - cosine) / 2) * unit));
+        if(sine >= unit){
+            return 0;
+        }
+        std::int64_t speed_squared = acceleration * m_config.junction_deviation * sine / (unit - sine);
+        return std::min(limit, static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(speed_squared))));
+    }
+
+    bool motion_planner::make_room(){
+        if(m_window_count == lookahead){
+            if(m_output_count == output_capacity){
+                return false;
+            }
+            finalize_oldest();
+        }
+        return true;
+    }
+
+    bool motion_planner::add_move(const axis_positions& target, std::int64_t feed_rate){
+        if(!make_room()){
+            return false;
+        }
+
+        pending_block pending{};
+        planned_block& block = pending.block;
+        block.kind = block_kind::line;
+        block.line = m_line;
+        std::int64_t length_squared = 0;
+        for(std::size_t axis = 0; axis < m_config.axis_count; axis++){
+            std::int64_t steps = m_config.axes[axis].scale.to_steps(target[axis]);
+            std::int64_t step_delta = steps - m_position[axis];
+            block.steps[axis] = static_cast<std::uint32_t>(abs64(step_delta));
+            if(step_delta < 0){
+                block.direction_bits |= 1u << axis;
+            }
+            block.event_count = std::max(block.event_count, block.steps[axis]);
+
+            pending.delta[axis] = divide((target[axis] - m_target[axis]).count(), nanometers_per_micrometer, rounding::nearest);
+            length_squared += pending.delta[axis] * pending.delta[axis];
+        }
+        m_target = target;
+        if(block.event_count == 0){
+            return true;
+        }
+        for(std::size_t axis = 0; axis < m_config.axis_count; axis++){
+            m_position[axis] += (block.direction_bits >> axis) & 1 ? -static_cast<std::int64_t>(block.steps[axis]) : block.steps[axis];
+        }
+
+        block.length = std::max<std::int64_t>(1, static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(length_squared))));
+        pending.nominal_speed = std::max<std::int64_t>(1, feed_rate);
+        pending.acceleration = m_config.acceleration;
+        for(std::size_t axis = 0; axis < m_config.axis_count; axis++){
+            std::int64_t travel = abs64(pending.delta[axis]);
+            if(travel == 0){
+                continue;
+            }
+            const axis_limits& limits = m_config.axes[axis];
+            pending.nominal_speed = std::min(pending.nominal_speed, limits.max_velocity * block.length / travel);
+            pending.acceleration = std::min(pending.acceleration, limits.max_acceleration * block.length / travel);
+        }
+
+        enqueue(pending, block.length, pending.delta, block.length);
+        return true;
+    }
+
+    bool motion_planner::add_arc(const axis_positions& target,
+            const std::array<position, 2>& center,
+            bool clockwise,
+            std::int64_t feed_rate){
+        const step_scale& scale = m_config.axes[0].scale;
+        if(scale.steps() != m_config.axes[1].scale.steps() || scale.length() != m_config.axes[1].scale.length()){
+            throw std::invalid_argument("Arc axes must share a step resolution");
+        }
+
+        std::int64_t center_x = scale.to_steps(center[0]);
+        std::int64_t center_y = scale.to_steps(center[1]);
+        arc_walk walk{m_position[0] - center_x, m_position[1] - center_y, 0, clockwise ? -1 : 1};
+        walk.radius_squared = walk.x * walk.x + walk.y * walk.y;
+        if(walk.radius_squared == 0){
+            return add_move(target, feed_rate);
+        }
+        if(!make_room()){
+            return false;
+        }
+
+        // Walk the arc once to find its exact step count. The walk ends on
+        // the first step that reaches or passes the end angle; for a full
+        // circle the end is only armed once the walk has left the start.
+        std::int64_t end_x = scale.to_steps(target[0]) - center_x;
+        std::int64_t end_y = scale.to_steps(target[1]) - center_y;
+        std::int64_t radius = static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(walk.radius_squared)));
+        std::int64_t limit = 8 * radius + 16;
+        std::int64_t events = 0;
+        std::int64_t diagonal_events = 0;
+        std::array<std::int64_t, 2> axis_steps{};
+        bool ahead = (walk.x * end_y - walk.y * end_x) * walk.direction > 0;
+        arc_walk cursor = walk;
+        while(events < limit){
+            std::int32_t step_x;
+            std::int32_t step_y;
+            cursor.advance(step_x, step_y);
+            events++;
+            axis_steps[0] += step_x != 0;
+            axis_steps[1] += step_y != 0;
+            diagonal_events += step_x != 0 && step_y != 0;
+
+            std::int64_t cross = (cursor.x * end_y - cursor.y * end_x) * walk.direction;
+            if(cross > 0){
+                ahead = true;
+            }
+            else if(ahead && cursor.x * end_x + cursor.y * end_y > 0){
+                break;
+            }
+        }
+
+        pending_block pending{};
+        planned_block& block = pending.block;
+        block.kind = block_kind::arc;
+        block.line = m_line;
+        block.arc = walk;
+        block.event_count = static_cast<std::uint32_t>(events);
+        block.steps[0] = static_cast<std::uint32_t>(axis_steps[0]);
+        block.steps[1] = static_cast<std::uint32_t>(axis_steps[1]);
+        m_position[0] = center_x + cursor.x;
+        m_position[1] = center_y + cursor.y;
+        m_target[0] = target[0];
+        m_target[1] = target[1];
+
+        // Axial events cover one step and diagonal ones the square root of
+        // two, added up in Q16
+        std::int64_t path_steps = (events - diagonal_events) * unit + diagonal_events * 92682;
+        block.length = std::max<std::int64_t>(1,
+                divide(scale.to_position(path_steps).count(), unit * nanometers_per_micrometer, rounding::nearest));
+        std::int64_t radius_length = std::max<std::int64_t>(1,
+                divide(scale.to_position(radius).count(), nanometers_per_micrometer, rounding::nearest));
+
+        // Both axes reach their full share of the speed somewhere on a
+        // circle, and the centripetal acceleration is speed squared over
+        // the radius
+        pending.acceleration = std::min({m_config.acceleration,
+                m_config.axes[0].max_acceleration,
+                m_config.axes[1].max_acceleration});
+        pending.nominal_speed = std::min({std::max<std::int64_t>(1, feed_rate),
+                m_config.axes[0].max_velocity,
+                m_config.axes[1].max_velocity,
+                static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(pending.acceleration * radius_length)))});
+
+        // Junctions use the tangents at either end of the arc
+        pending.delta[0] = walk.direction > 0 ? -walk.y : walk.y;
+        pending.delta[1] = walk.direction > 0 ? walk.x : -walk.x;
+        std::array<std::int64_t, max_axes> exit_delta{};
+        exit_delta[0] = walk.direction > 0 ? -cursor.y : cursor.y;
+        exit_delta[1] = walk.direction > 0 ? cursor.x : -cursor.x;
+        std::int64_t entry_length = std::max<std::int64_t>(1, static_cast<std::int64_t>(
+                    isqrt(static_cast<std::uint64_t>(pending.delta[0] * pending.delta[0] + pending.delta[1] * pending.delta[1]))));
+        std::int64_t exit_length = std::max<std::int64_t>(1, static_cast<std::int64_t>(
+                    isqrt(static_cast<std::uint64_t>(exit_delta[0] * exit_delta[0] + exit_delta[1] * exit_delta[1]))));
+
+        enqueue(pending, entry_length, exit_delta, exit_length);
+        return true;
+    }
+
+    void motion_planner::enqueue(pending_block& pending,
+            std::int64_t entry_length,
+            const std::array<std::int64_t, max_axes>& exit_delta,
+            std::int64_t exit_length){
+        pending.nominal_speed = std::max<std::int64_t>(1, pending.nominal_speed);
+        pending.acceleration = std::max<std::int64_t>(1, pending.acceleration);
+        pending.max_entry_speed = std::min(pending.nominal_speed,
+                junction_speed(pending.delta, entry_length, pending.acceleration));
+        pending.entry_speed = pending.max_entry_speed;
+
+        m_last_delta = exit_delta;
+        m_last_length = exit_length;
+        m_last_nominal = pending.nominal_speed;
+        insert(pending);
+    }
+
+    bool motion_planner::add_pen(bool down){
+        if(!make_room()){
+            return false;
+        }
+        // A zero length block with no entry speed brings the moves on
+        // either side of it to a stop
+        pending_block pending{};
+        pending.block.kind = block_kind::pen;
+        pending.block.pen_down = down;
+        pending.block.line = m_line;
+        pending.acceleration = 1;
+        m_last_length = 0;
+        insert(pending);
+        return true;
+    }
+
+    bool motion_planner::add_tool(std::uint8_t tool){
+        if(!make_room()){
+            return false;
+        }
+        pending_block pending{};
+        pending.block.kind = block_kind::tool;
+        pending.block.tool = tool;
+        pending.block.line = m_line;
+        pending.acceleration = 1;
+        m_last_length = 0;
+        insert(pending);
+        return true;
+    }
+
+    void motion_planner::insert(const pending_block& pending){
+        if(m_window_count == 0 && m_output_count == 0){
+            m_locked_entry = 0;
+        }
+        window_at(m_window_count) = pending;
+        window_at(m_window_count).backward_entry = -1;
+        window_at(m_window_count).forward_entry = -1;
+        m_window_count++;
+        recalculate();
+    }
+
+    void motion_planner::recalculate(){
+        // Backward pass: every block must be able to slow down to the entry
+        // of the next, with the last block coming to a stop. A new block
+        // behind a block can only raise its result, so once a block comes
+        // out as it did last time, so do all the blocks before it and both
+        // passes can start from there.
+        std::int64_t next_entry = 0;
+        std::size_t first = 0;
+        for(std::size_t i = m_window_count; i-- > 1;){
+            pending_block& current = window_at(i);
+            std::int64_t reachable = static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(
+                            next_entry * next_entry + 2 * current.acceleration * current.block.length)));
+            std::int64_t entry = std::min(current.max_entry_speed, reachable);
+            if(entry == current.backward_entry){
+                first = i;
+                break;
+            }
+            current.backward_entry = entry;
+            current.entry_speed = entry;
+            next_entry = entry;
+        }
+
+        // Forward pass: every block must be able to reach its exit from its
+        // entry. The oldest block's entry is locked by the block before it.
+        if(first == 0){
+            window_at(0).entry_speed = m_locked_entry;
+        }
+        for(std::size_t i = first; i + 1 < m_window_count; i++){
+            pending_block& current = window_at(i);
+            pending_block& next = window_at(i + 1);
+            if(current.entry_speed != current.forward_entry){
+                current.forward_entry = current.entry_speed;
+                current.forward_exit = static_cast<std::int64_t>(isqrt(static_cast<std::uint64_t>(
+                                current.entry_speed * current.entry_speed + 2 * current.acceleration * current.block.length)));
+            }
+            next.entry_speed = std::min(next.entry_speed, current.forward_exit);
+        }
+    }
+
+    void motion_planner::finalize_oldest(){
+        pending_block& oldest = window_at(0);
+        std::int64_t exit_speed = m_window_count > 1 ? window_at(1).entry_speed : 0;
+        planned_block& block = oldest.block;
+        if(block.kind == block_kind::pen || block.kind == block_kind::tool){
+            m_output[(m_output_start + m_output_count) % output_capacity] = block;
+            m_output_count++;
+            m_locked_entry = 0;
+            m_window_start = (m_window_start + 1) % lookahead;
+            m_window_count--;
+            return;
+        }
+
+        std::uint64_t event_count = block.event_count;
+        std::uint64_t acceleration = std::max<std::uint32_t>(1, to_rate(oldest.acceleration, block.event_count, block.length));
+        std::uint64_t nominal = std::max<std::uint32_t>(1, to_rate(oldest.nominal_speed, block.event_count, block.length));
+        std::uint64_t entry = std::min<std::uint64_t>(nominal, to_rate(oldest.entry_speed, block.event_count, block.length));
+        std::uint64_t exit = std::min<std::uint64_t>(nominal, to_rate(exit_speed, block.event_count, block.length));
+
+        std::uint64_t accelerate_events = (nominal * nominal - entry * entry) / (2 * acceleration);
+        std::uint64_t decelerate_events = (nominal * nominal - exit * exit) / (2 * acceleration);
+        if(accelerate_events + decelerate_events > event_count){
+            // No cruise, accelerate and decelerate meet part way
+            std::int64_t meet = (static_cast<std::int64_t>(2 * acceleration * event_count + exit * exit) - static_cast<std::int64_t>(entry * entry))
+                / static_cast<std::int64_t>(4 * acceleration);
+            meet = std::max<std::int64_t>(0, std::min<std::int64_t>(meet, static_cast<std::int64_t>(event_count)));
+            accelerate_events = static_cast<std::uint64_t>(meet);
+            decelerate_events = event_count - accelerate_events;
+            nominal = std::max({entry, exit, isqrt(entry * entry + 2 * acceleration * accelerate_events)});
+        }
+
+        block.entry_rate = static_cast<std::uint32_t>(entry);
+        block.nominal_rate = static_cast<std::uint32_t>(nominal);
+        block.exit_rate = static_cast<std::uint32_t>(exit);
+        block.acceleration = static_cast<std::uint32_t>(acceleration);
+        block.accelerate_until = static_cast<std::uint32_t>(accelerate_events);
+        block.decelerate_after = static_cast<std::uint32_t>(event_count - decelerate_events);
+
+        m_output[(m_output_start + m_output_count) % output_capacity] = block;
+        m_output_count++;
+
+        m_locked_entry = exit_speed;
+        m_window_start = (m_window_start + 1) % lookahead;
+        m_window_count--;
+    }
+
+    bool motion_planner::flush(){
+        while(m_window_count > 0 && m_output_count < output_capacity){
+            finalize_oldest();
+        }
+        return m_window_count == 0;
+    }
+
+    bool motion_planner::pop(planned_block& block){
+        if(m_output_count == 0){
+            return false;
+        }
+        block = m_output[m_output_start];
+        m_output_start = (m_output_start + 1) % output_capacity;
+        m_output_count--;
+        return true;
+    }
+
+    void motion_planner::set_position(const axis_positions& current){
+        m_target = current;
+        for(std::size_t axis = 0; axis < max_axes; axis++){
+            m_position[axis] = m_config.axes[axis].scale.to_steps(current[axis]);
+        }
+        m_last_length = 0;
+    }
+
+    void motion_planner::set_position(const axis_positions& current, const axis_steps& steps){
+        m_target = current;
+        m_position = steps;
+        m_last_length = 0;
+    }
+
+/******************************************************************************/
+/*                                  Executor                                  */
+/******************************************************************************/
+    motion_executor::motion_executor(block_source source, pen_timing timing)
+        :   m_source(std::move(source)),
+            m_block(),
+            m_active(false),
+            m_next(),
+            m_has_next(false),
+            m_timing(timing),
+            m_pen_phase(pen_phase::idle),
+            m_pen_down(false),
+            m_since_pen(0),
+            m_event(0),
+            m_error(),
+            m_arc(),
+            m_remainder(0),
+            m_position(),
+            m_rate(0),
+            m_scale(unit),
+            m_override(100),
+            m_pause(false),
+            m_halt(false),
+            m_tool(0),
+            m_swapping(false){}
+
+    void motion_executor::start_block(){
+        m_active = true;
+        m_event = 0;
+        for(std::size_t axis = 0; axis < max_axes; axis++){
+            m_error[axis] = -static_cast<std::int64_t>(m_block.event_count / 2);
+        }
+        m_arc = m_block.arc;
+
+        // Look for a pen block after this move so it can be started
+        // before the move stops
+        if(!m_has_next){
+            m_has_next = m_source(m_next);
+        }
+        if(m_has_next && m_next.kind == block_kind::pen){
+            m_pen_phase = pen_phase::armed;
+            m_pen_down = m_next.pen_down;
+            m_has_next = false;
+        }
+    }
+
+    bool motion_executor::fetch(planned_block& block){
+        if(m_has_next){
+            block = m_next;
+            m_has_next = false;
+            return true;
+        }
+        return m_source(block);
+    }
+
+    void motion_executor::issue_pen(bool down, step_tick& tick){
+        tick.pen = down ? pen_action::lower : pen_action::lift;
+        m_pen_down = down;
+        m_pen_phase = pen_phase::issued;
+        m_since_pen = 0;
+    }
+
+    std::uint64_t motion_executor::remaining_time() const{
+        if(m_event >= m_block.event_count){
+            return 0;
+        }
+        std::uint64_t rate = rate_at(m_event);
+        std::uint64_t exit = m_block.exit_rate;
+        std::uint64_t deceleration = rate > exit ? (rate - exit) * 1000000u / m_block.acceleration : 0;
+        if(m_event >= m_block.decelerate_after){
+            return deceleration;
+        }
+        std::uint64_t nominal = m_block.nominal_rate;
+        return static_cast<std::uint64_t>(m_block.decelerate_after - m_event) * 1000000u / rate
+            + (nominal > exit ? (nominal - exit) * 1000000u / m_block.acceleration : 0);
+    }
+
+    std::uint64_t motion_executor::rate_at(std::uint32_t event) const{
+        std::uint64_t rate = m_block.nominal_rate;
+        std::uint64_t acceleration = m_block.acceleration;
+        if(event < m_block.accelerate_until){
+            std::uint64_t entry = m_block.entry_rate;
+            rate = isqrt(entry * entry + 2 * acceleration * (event + 1));
+        }
+        else if(event >= m_block.decelerate_after){
+            std::uint64_t exit = m_block.exit_rate;
+            rate = isqrt(exit * exit + 2 * acceleration * (m_block.event_count - event));
+        }
+        return std::max<std::uint64_t>(1, std::min<std::uint64_t>(rate, m_block.nominal_rate));
+    }
+
+    std::uint64_t motion_executor::scaled(std::uint64_t duration) const{
+        if(m_scale == 0){
+            return std::numeric_limits<std::uint64_t>::max();
+        }
+        return static_cast<std::uint64_t>(scale(static_cast<std::int64_t>(duration), unit,
+                    static_cast<std::int64_t>(m_scale), rounding::nearest));
+    }
+
+    void motion_executor::ramp_scale(std::uint64_t interval_ns){
+        std::uint64_t target = m_pause.load(std::memory_order_relaxed) ? 0
+            : m_override.load(std::memory_order_relaxed) * static_cast<std::uint64_t>(unit) / 100;
+        if(m_scale == target){
+            return;
+        }
+        // The extra acceleration from changing the time base is the rate
+        // times the change in scale per second; keep it within the block's
+        std::uint64_t change = static_cast<std::uint64_t>(scale(static_cast<std::int64_t>(m_block.acceleration * interval_ns),
+                    unit, static_cast<std::int64_t>(m_rate * 1000000000u), rounding::up));
+        if(m_scale < target){
+            m_scale = std::min(target, m_scale + change);
+        }
+        else if(m_scale - target > change){
+            m_scale -= change;
+            if(target == 0 && m_scale <= min_scale){
+                m_scale = 0;
+            }
+        }
+        else{
+            m_scale = target;
+        }
+    }
+
+    bool motion_executor::next(step_tick& tick){
+        if(m_halt.load(std::memory_order_acquire)){
+            return false;
+        }
+        tick.step_bits = 0;
+        tick.direction_bits = m_block.direction_bits;
+        tick.pen = pen_action::none;
+        if(m_scale == 0){
+            if(m_pause.load(std::memory_order_relaxed)){
+                tick.interval = pause_tick_us;
+                return true;
+            }
+            m_scale = min_scale;
+            m_swapping = false;
+        }
+        if(!m_active){
+            if(m_pen_phase == pen_phase::issued){
+                // Wait out whatever the pen still needs after the move
+                m_pen_phase = pen_phase::idle;
+                std::uint64_t dwell = m_pen_down ? m_timing.settle_us : m_timing.clear_us;
+                if(dwell > m_since_pen){
+                    tick.interval = static_cast<std::uint32_t>(dwell - m_since_pen);
+                    return true;
+                }
+            }
+            if(m_pause.load(std::memory_order_relaxed) && m_block.exit_rate == 0){
+                // Already stopped between moves
+                m_scale = 0;
+                tick.interval = pause_tick_us;
+                return true;
+            }
+            while(true){
+                if(!fetch(m_block)){
+                    return false;
+                }
+                if(m_block.kind == block_kind::pen){
+                    // No move to overlap with
+                    tick.interval = 0;
+                    issue_pen(m_block.pen_down, tick);
+                    return true;
+                }
+                if(m_block.kind == block_kind::tool){
+                    // Hold until the operator has swapped pens and resumes
+                    m_tool = m_block.tool;
+                    m_swapping = true;
+                    m_pause.store(true, std::memory_order_relaxed);
+                    m_scale = 0;
+                    tick.interval = 0;
+                    tick.pen = pen_action::swap;
+                    return true;
+                }
+                if(m_block.event_count != 0){
+                    break;
+                }
+            }
+            start_block();
+        }
+
+        m_rate = rate_at(m_event);
+        std::uint64_t planned = 1000000000u / m_rate;
+        std::uint64_t interval = m_remainder + (m_scale == static_cast<std::uint64_t>(unit) ? planned : scaled(planned));
+        tick.interval = static_cast<std::uint32_t>(interval / 1000);
+        m_remainder = interval % 1000;
+        ramp_scale(interval);
+
+        if(m_pen_phase == pen_phase::issued){
+            m_since_pen += tick.interval;
+        }
+
+        std::size_t first_axis = 0;
+        if(m_block.kind == block_kind::arc){
+            std::int32_t step_x;
+            std::int32_t step_y;
+            m_arc.advance(step_x, step_y);
+            step_arc_axis(0, step_x, tick);
+            step_arc_axis(1, step_y, tick);
+            first_axis = 2;
+        }
+        tick.direction_bits = m_block.direction_bits;
+        for(std::size_t axis = first_axis; axis < max_axes; axis++){
+            m_error[axis] += m_block.steps[axis];
+            if(m_error[axis] > 0){
+                m_error[axis] -= m_block.event_count;
+                tick.step_bits |= 1u << axis;
+                m_position[axis] += (m_block.direction_bits >> axis) & 1 ? -1 : 1;
+            }
+        }
+
+        m_event++;
+        if(m_pen_phase == pen_phase::armed){
+            std::uint32_t lead = m_pen_down ? m_timing.touch_us : m_timing.release_us;
+            if(scaled(remaining_time()) <= lead){
+                issue_pen(m_pen_down, tick);
+            }
+        }
+        if(m_event == m_block.event_count){
+            m_active = false;
+        }
+        return true;
+    }
+
+    void motion_executor::step_arc_axis(std::size_t axis, std::int32_t step, step_tick& tick){
+        if(step == 0){
+            return;
+        }
+        tick.step_bits |= 1u << axis;
+        if(step < 0){
+            m_block.direction_bits |= 1u << axis;
+        }
+        else{
+            m_block.direction_bits &= ~(1u << axis);
+        }
+        m_position[axis] += step;
+    }
+
+    block_source drain_planner(motion_planner& planner){
+        return [&planner](planned_block& block){
+            if(planner.pop(block)){
+                return true;
+            }
+            planner.flush();
+            return planner.pop(block);
+        };
+    }
+}
@@ -0,0 +1,743 @@
+#ifndef MOTION_HPP
+#define MOTION_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#include "pen.hpp"
+#include "units.hpp"
+
+namespace plotter{
+
+    /**
+     * Most axes a single planner coordinates
+     */
+    constexpr std::size_t max_axes = 8;
+
+    using axis_positions = std::array<position, max_axes>;
+    using axis_steps = std::array<std::int64_t, max_axes>;
+
+    /**
+     * Resolution and dynamic limits of a single axis. Speeds are in
+     * micrometers per second and accelerations in micrometers per second
+     * squared, which keeps the squared terms of the planner well inside
+     * 64 bits.
+     */
+    struct axis_limits{
+        step_scale scale;
+        std::int64_t max_velocity = 100000;
+        std::int64_t max_acceleration = 2000000;
+    };
+
+    /**
+     * Machine description used by the planner
+     */
+    struct motion_config{
+        /**
+         * Number of axes in use, starting from axis 0
+         */
+        std::size_t axis_count = 2;
+
+        std::array<axis_limits, max_axes> axes{};
+
+        /**
+         * Acceleration along the path, micrometers per second squared
+         */
+        std::int64_t acceleration = 1000000;
+
+        /**
+         * Allowed deviation from the corner of a junction when choosing the
+         * speed through it, in micrometers
+         */
+        std::int64_t junction_deviation = 20;
+    };
+
+    /**
+     * Shape of a planned block
+     */
+    enum class block_kind : std::uint8_t{
+        line,
+        arc,        // Circular arc in the plane of axes 0 and 1
+        pen,        // Pen lift or lower between moves
+        tool        // Stop for the operator to swap pens
+    };
+
+    /**
+     * Integer midpoint walk around a circle in step space. Every call to
+     * advance() moves one step along the axis that is travelling fastest
+     * and steps the other axis too when that keeps the point closer to the
+     * circle, so no step is ever more than half a step off the arc.
+     */
+    struct arc_walk{
+        /**
+         * Current point relative to the center, in steps
+         */
+        std::int64_t x;
+        std::int64_t y;
+
+        /**
+         * Square of the radius being followed, in steps
+         */
+        std::int64_t radius_squared;
+
+        /**
+         * 1 for counterclockwise, -1 for clockwise
+         */
+        std::int32_t direction;
+
+        std::int64_t error(std::int64_t at_x, std::int64_t at_y) const{
+            std::int64_t value = at_x * at_x + at_y * at_y - radius_squared;
+            return value < 0 ? -value : value;
+        }
+
+        /**
+         * Move to the next point of the walk
+         *
+         * @param step_x: receives -1, 0 or 1, the step made along x
+         * @param step_y: receives -1, 0 or 1, the step made along y
+         */
+        void advance(std::int32_t& step_x, std::int32_t& step_y){
+            // Tangent of the circle in the direction of travel
+            std::int64_t tangent_x = direction > 0 ? -y : y;
+            std::int64_t tangent_y = direction > 0 ? x : -x;
+            step_x = 0;
+            step_y = 0;
+            if((y < 0 ? -y : y) >= (x < 0 ? -x : x)){
+                step_x = tangent_x > 0 ? 1 : -1;
+                std::int32_t slow = tangent_y != 0 ? (tangent_y > 0 ? 1 : -1) : (y > 0 ? -1 : 1);
+                if(error(x + step_x, y + slow) < error(x + step_x, y)){
+                    step_y = slow;
+                }
+            }
+            else{
+                step_y = tangent_y > 0 ? 1 : -1;
+                std::int32_t slow = tangent_x != 0 ? (tangent_x > 0 ? 1 : -1) : (x > 0 ? -1 : 1);
+                if(error(x + slow, y + step_y) < error(x, y + step_y)){
+                    step_x = slow;
+                }
+            }
+            x += step_x;
+            y += step_y;
+        }
+    };
+
+    /**
+     * A move whose velocity profile is final. The profile is expressed in
+     * step events, where every event steps the dominant axis and the other
+     * axes are interleaved by the DDA.
+     */
+    struct planned_block{
+        /**
+         * Absolute number of steps for each axis
+         */
+        std::array<std::uint32_t, max_axes> steps;
+
+        /**
+         * Bit N is set when axis N moves toward negative
+         */
+        std::uint32_t direction_bits;
+
+        /**
+         * Number of step events, the largest entry of steps
+         */
+        std::uint32_t event_count;
+
+        /**
+         * Step event rates in events per second
+         */
+        std::uint32_t entry_rate;
+        std::uint32_t nominal_rate;
+        std::uint32_t exit_rate;
+
+        /**
+         * Step events per second squared
+         */
+        std::uint32_t acceleration;
+
+        /**
+         * Events before which the block accelerates and from which it
+         * decelerates
+         */
+        std::uint32_t accelerate_until;
+        std::uint32_t decelerate_after;
+
+        /**
+         * Path length in micrometers
+         */
+        std::int64_t length;
+
+        block_kind kind;
+
+        /**
+         * Walk from the start of an arc block, unused for lines. The steps
+         * and direction_bits of axes 0 and 1 only summarize an arc; the
+         * executor takes the actual steps from the walk.
+         */
+        arc_walk arc;
+
+        /**
+         * For pen blocks, true to lower the pen and false to lift it
+         */
+        bool pen_down;
+
+        /**
+         * For tool blocks, the pen to swap to
+         */
+        std::uint8_t tool;
+
+        /**
+         * Tag of the move the block came from, see motion_planner::set_line()
+         */
+        std::uint32_t line;
+    };
+
+    /**
+     * Look-ahead planner. Moves are converted to exact step targets, joined
+     * with junction speeds and given trapezoidal velocity profiles using
+     * fixed-point math only. The oldest move is finalized once the
+     * look-ahead window is full; nothing is allocated after construction.
+     */
+    class motion_planner{
+        public:
+            static constexpr std::size_t lookahead = 16;
+            static constexpr std::size_t output_capacity = 32;
+
+        private:
+            struct pending_block{
+                planned_block block;
+
+                /**
+                 * Per axis travel in micrometers, used for junction angles
+                 */
+                std::array<std::int64_t, max_axes> delta;
+
+                /**
+                 * Speeds in micrometers per second
+                 */
+                std::int64_t nominal_speed;
+                std::int64_t max_entry_speed;
+                std::int64_t entry_speed;
+
+                /**
+                 * Entry speed as the backward pass alone left it, -1 until
+                 * the first pass
+                 */
+                std::int64_t backward_entry;
+
+                /**
+                 * Entry speed the forward pass last started from, -1 until
+                 * the first pass, and the exit speed reachable from it.
+                 * Most passes find the entry unchanged and skip the root.
+                 */
+                std::int64_t forward_entry;
+                std::int64_t forward_exit;
+
+                /**
+                 * Acceleration limited by every moving axis
+                 */
+                std::int64_t acceleration;
+            };
+
+            motion_config m_config;
+
+            std::array<pending_block, lookahead> m_window;
+            std::size_t m_window_start;
+            std::size_t m_window_count;
+
+            /**
+             * Entry speed of the oldest window block, fixed by the exit of
+             * the last finalized block
+             */
+            std::int64_t m_locked_entry;
+
+            std::array<planned_block, output_capacity> m_output;
+            std::size_t m_output_start;
+            std::size_t m_output_count;
+
+            /**
+             * Position of the end of the last accepted move
+             */
+            axis_positions m_target;
+            axis_steps m_position;
+
+            /**
+             * Last accepted move, for the junction with the next one
+             */
+            std::array<std::int64_t, max_axes> m_last_delta;
+            std::int64_t m_last_length;
+            std::int64_t m_last_nominal;
+
+            /**
+             * Tag given to the following blocks
+             */
+            std::uint32_t m_line;
+
+            pending_block& window_at(std::size_t index){
+                return m_window[(m_window_start + index) % lookahead];
+            }
+
+            std::int64_t junction_speed(const std::array<std::int64_t, max_axes>& delta,
+                    std::int64_t length,
+                    std::int64_t acceleration) const;
+            bool make_room();
+            void insert(const pending_block& pending);
+            void enqueue(pending_block& pending,
+                    std::int64_t entry_length,
+                    const std::array<std::int64_t, max_axes>& exit_delta,
+                    std::int64_t exit_length);
+            void recalculate();
+            void finalize_oldest();
+
+        public:
+            explicit motion_planner(const motion_config& config);
+
+            /**
+             * @return: true if add_move() will accept another move
+             */
+            bool can_accept() const{
+                return m_window_count < lookahead || m_output_count < output_capacity;
+            }
+
+            /**
+             * Plan a straight move to the target
+             *
+             * @param target: absolute position of every axis
+             * @param feed_rate: requested speed in micrometers per second
+             * @return: false if the planner is full and the move was not
+             *          accepted
+             */
+            bool add_move(const axis_positions& target, std::int64_t feed_rate);
+
+            /**
+             * Plan a circular arc in the plane of axes 0 and 1. The arc is
+             * walked in step space from the current position around the
+             * center, so it becomes a single block however long it is. The
+             * target is expected to lie on the same circle; the walk stops
+             * at the step nearest the target's angle and the next move picks
+             * up any remainder. Other axes hold still. Axes 0 and 1 must
+             * share a step resolution.
+             *
+             * @param target: absolute end of the arc
+             * @param center: absolute center of the arc on axes 0 and 1
+             * @param clockwise: true for G2, false for G3
+             * @param feed_rate: requested speed in micrometers per second
+             * @return: false if the planner is full and the arc was not
+             *          accepted
+             */
+            bool add_arc(const axis_positions& target,
+                    const std::array<position, 2>& center,
+                    bool clockwise,
+                    std::int64_t feed_rate);
+
+            /**
+             * Lift or lower the pen between moves. The moves on either side
+             * come to a stop at the pen block, and the executor overlaps the
+             * pen move with the end of the previous one.
+             *
+             * @param down: true to lower the pen, false to lift it
+             * @return: false if the planner is full and the pen block was
+             *          not accepted
+             */
+            bool add_pen(bool down);
+
+            /**
+             * Stop for a pen swap between moves, see motion_executor. The
+             * moves on either side come to a stop as for a pen block.
+             *
+             * @param tool: pen to swap to
+             * @return: false if the planner is full and the block was not
+             *          accepted
+             */
+            bool add_tool(std::uint8_t tool);
+
+            /**
+             * Finalize the moves in the look-ahead window, coming to a stop at
+             * the end of the last one
+             *
+             * @return: true once every move has been finalized
+             */
+            bool flush();
+
+            /**
+             * Take the next finalized block
+             *
+             * @param block: receives the block
+             * @return: false if no block is finalized yet
+             */
+            bool pop(planned_block& block);
+
+            /**
+             * @return: true if there are no moves left in the planner
+             */
+            bool is_empty() const{return m_window_count == 0 && m_output_count == 0;}
+
+            /**
+             * @return: number of blocks held, planned or not
+             */
+            std::size_t depth() const{return m_window_count + m_output_count;}
+
+            /**
+             * Tag the following moves, i.e. with the line of the job file
+             * they come from
+             *
+             * @param line: tag to use
+             */
+            void set_line(std::uint32_t line){m_line = line;}
+
+            /**
+             * Move the planner's origin without moving, i.e. after homing.
+             * Must only be called while the planner is empty.
+             *
+             * @param current: the current position of every axis
+             */
+            void set_position(const axis_positions& current);
+
+            /**
+             * Restore the origin to one saved from target() and steps(), so
+             * the moves that follow plan exactly as they did then. Must only
+             * be called while the planner is empty.
+             *
+             * @param current: the current position of every axis
+             * @param steps: the step position of every axis
+             */
+            void set_position(const axis_positions& current, const axis_steps& steps);
+
+            /**
+             * @return: position of the last accepted move
+             */
+            const axis_positions& target() const{return m_target;}
+
+            /**
+             * @return: step position of the last accepted move, which after
+             *          an arc is off target() by the remainder the next move
+             *          picks up
+             */
+            const axis_steps& steps() const{return m_position;}
+
+            const motion_config& config() const{return m_config;}
+    };
+
+    /**
+     * Pen command carried by a step event
+     */
+    enum class pen_action : std::uint8_t{
+        none,
+        lift,
+        lower,
+        swap        // Stopped for the operator to fit pen executor.tool()
+    };
+
+    /**
+     * One step event as produced by an executor
+     */
+    struct step_tick{
+        /**
+         * Microseconds since the previous tick
+         */
+        std::uint32_t interval;
+
+        /**
+         * Bit N is set if axis N steps on this tick
+         */
+        std::uint32_t step_bits;
+
+        /**
+         * Bit N is set if axis N steps toward negative
+         */
+        std::uint32_t direction_bits;
+
+        /**
+         * Pen command to issue at the time of this event
+         */
+        pen_action pen;
+    };
+
+    /**
+     * Supplies finalized blocks to an executor, returns false when none are
+     * available
+     */
+    using block_source = std::function<bool(planned_block&)>;
+
+    /**
+     * Turns planned blocks into timed step events. The axes of a line are
+     * interleaved with a Bresenham DDA, arcs follow their midpoint walk, and
+     * the interval of each event comes
+     * from the block's trapezoid using integer square roots, so the step
+     * times are exact and don't drift.
+     *
+     * Pen blocks are started before the move ahead of them stops: a lift
+     * is issued pen_timing::release_us before the drawing move ends and a
+     * lower pen_timing::touch_us before the travel move ends. The next move
+     * then waits only for whatever is left of the clear or settle time,
+     * using a tick without steps.
+     *
+     * The feed override and pause stretch the time base of the planned
+     * profiles instead of replanning them. The time base ramps toward its
+     * target no faster than the block's acceleration allows at the current
+     * rate, so a pause decelerates and a resume accelerates smoothly from
+     * wherever the move was.
+     */
+    class motion_executor{
+        private:
+            enum class pen_phase{
+                idle,
+                armed,      // A pen block follows the current move
+                issued      // The pen is moving
+            };
+
+            block_source m_source;
+            planned_block m_block;
+            bool m_active;
+
+            /**
+             * Block fetched early to look for a pen block
+             */
+            planned_block m_next;
+            bool m_has_next;
+
+            pen_timing m_timing;
+            pen_phase m_pen_phase;
+            bool m_pen_down;
+
+            /**
+             * Microseconds since the pen command was issued
+             */
+            std::uint64_t m_since_pen;
+
+            /**
+             * Events completed in the current block
+             */
+            std::uint32_t m_event;
+
+            std::array<std::int64_t, max_axes> m_error;
+
+            /**
+             * Walk of the current arc block
+             */
+            arc_walk m_arc;
+
+            /**
+             * Nanoseconds carried between ticks so that intervals round
+             * without drifting
+             */
+            std::uint64_t m_remainder;
+
+            axis_steps m_position;
+
+            /**
+             * Step event rate of the last tick
+             */
+            std::uint64_t m_rate;
+
+            /**
+             * Time base of the planned profiles in Q16, 1 plays them as
+             * planned and 0 holds them paused. m_override and m_pause are
+             * written by other threads.
+             */
+            std::uint64_t m_scale;
+            std::atomic<std::uint32_t> m_override;
+            std::atomic<bool> m_pause;
+
+            /**
+             * Set by a fault such as a stall, stops the executor at once
+             */
+            std::atomic<bool> m_halt;
+
+            /**
+             * Pen asked for by the last tool block, and whether the executor
+             * is still holding for it
+             */
+            std::uint8_t m_tool;
+            bool m_swapping;
+
+            bool fetch(planned_block& block);
+            void start_block();
+            void issue_pen(bool down, step_tick& tick);
+            std::uint64_t remaining_time() const;
+            std::uint64_t scaled(std::uint64_t duration) const;
+            void ramp_scale(std::uint64_t interval_ns);
+            void step_arc_axis(std::size_t axis, std::int32_t step, step_tick& tick);
+            std::uint64_t rate_at(std::uint32_t event) const;
+
+        public:
+            /**
+             * @param source: supplies planned blocks
+             * @param timing: pen mechanism timing
+             */
+            explicit motion_executor(block_source source, pen_timing timing={});
+
+            /**
+             * Produce the next step event
+             *
+             * @param tick: receives the event
+             * @return: false if no block is available
+             */
+            bool next(step_tick& tick);
+
+            /**
+             * Most and least feed override, in percent
+             */
+            static constexpr std::uint32_t min_override = 10;
+            static constexpr std::uint32_t max_override = 200;
+
+            /**
+             * Length of the ticks without steps produced while paused
+             */
+            static constexpr std::uint32_t pause_tick_us = 10000;
+
+            /**
+             * Slowest time base before a pause stops, 1/64 in Q16
+             */
+            static constexpr std::uint64_t min_scale = 1024;
+
+            /**
+             * Change the feed of the planned moves. Safe to call from any
+             * thread.
+             *
+             * @param percent: feed relative to the plan, clamped to
+             *                 min_override..max_override
+             */
+            void set_feed_override(std::uint32_t percent){
+                percent = percent < min_override ? min_override : (percent > max_override ? max_override : percent);
+                m_override.store(percent, std::memory_order_relaxed);
+            }
+
+            std::uint32_t feed_override() const{return m_override.load(std::memory_order_relaxed);}
+
+            /**
+             * Decelerate to a stop and hold. Safe to call from any thread.
+             */
+            void pause(){m_pause.store(true, std::memory_order_relaxed);}
+
+            /**
+             * Accelerate back to the overridden feed. Safe to call from any
+             * thread.
+             */
+            void resume(){m_pause.store(false, std::memory_order_relaxed);}
+
+            /**
+             * Stop producing steps at once, without decelerating, after a
+             * fault such as a stall. next() returns false until the halt is
+             * cleared. Safe to call from any thread.
+             */
+            void halt(){m_halt.store(true, std::memory_order_release);}
+
+            /**
+             * Allow stepping again once the fault has been dealt with, i.e.
+             * after re-homing and set_position()
+             */
+            void clear_halt(){m_halt.store(false, std::memory_order_release);}
+
+            bool is_halted() const{return m_halt.load(std::memory_order_acquire);}
+
+            /**
+             * @return: true once a pause has brought motion to a stop
+             */
+            bool is_paused() const{return m_scale == 0;}
+
+            /**
+             * @return: true if no block is in progress
+             */
+            bool is_idle() const{return !m_active && m_pen_phase == pen_phase::idle;}
+
+            /**
+             * @return: true while a move is stepping, false from its last
+             *          step on even if the pen is still moving
+             */
+            bool is_moving() const{return m_active;}
+
+            /**
+             * @return: true while holding at a tool block. The executor
+             *          pauses itself there and resume() carries on once the
+             *          operator has fitted pen tool().
+             */
+            bool is_swapping() const{return m_swapping;}
+
+            /**
+             * @return: pen asked for by the last tool block
+             */
+            std::uint8_t tool() const{return m_tool;}
+
+            /**
+             * @param axis: axis to query
+             * @return: steps per second of the axis at the last tick
+             */
+            std::uint32_t axis_rate(std::size_t axis) const{
+                if(m_block.event_count == 0){
+                    return 0;
+                }
+                return static_cast<std::uint32_t>(m_rate * m_block.steps[axis] / m_block.event_count);
+            }
+
+            /**
+             * @return: tag of the block in progress
+             */
+            std::uint32_t line() const{return m_block.line;}
+
+            /**
+             * @return: steps executed on each axis
+             */
+            const axis_steps& position() const{return m_position;}
+
+            void set_position(const axis_steps& steps){m_position = steps;}
+    };
+
+    /**
+     * Block source that drains a planner, flushing its look-ahead window
+     * once nothing else is finalized
+     *
+     * @param planner: planner to drain
+     * @return: source for a motion_executor
+     */
+    block_source drain_planner(motion_planner& planner);
+
+    /**
+     * Make the steps of a tick on a set of steppers
+     *
+     * @param tick: event to apply
+     * @param steppers: indexable set of pointers to steppers, one per axis
+     */
+    template<class Steppers>
+    void apply_step_tick(const step_tick& tick, Steppers& steppers){
+        for(std::uint32_t bits = tick.step_bits; bits != 0; bits &= bits - 1){
+            unsigned int axis = static_cast<unsigned int>(__builtin_ctz(bits));
+            steppers[axis]->step(((tick.direction_bits >> axis) & 1) ? -1 : 1);
+        }
+    }
+
+    /**
+     * Issue the pen command of a tick
+     *
+     * @param tick: event to apply
+     * @param pen: pen actuator with lift() and lower()
+     */
+    template<class Pen>
+    void apply_pen_action(const step_tick& tick, Pen& pen){
+        if(tick.pen == pen_action::lift){
+            pen.lift();
+        }
+        else if(tick.pen == pen_action::lower){
+            pen.lower();
+        }
+    }
+
+    /**
+     * Pass the planned step rate of each axis to its stepper, letting
+     * speed-adaptive coils choose their step mode
+     *
+     * @param executor: executor that produced the last tick
+     * @param steppers: indexable set of pointers to steppers, one per axis
+     * @param axis_count: number of steppers
+     */
+    template<class Steppers>
+    void apply_step_rates(const motion_executor& executor, Steppers& steppers, std::size_t axis_count){
+        for(std::size_t axis = 0; axis < axis_count; axis++){
+            steppers[axis]->set_step_rate(executor.axis_rate(axis));
+        }
+    }
+}
+
+#endif
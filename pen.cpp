@@ -0,0 +1,48 @@
+#include "pen.hpp"
+
+namespace plotter{
+    pen_actuator::pen_actuator(std::shared_ptr<context> wiring_pi_context,
+            type actuator, pin pin_number, int up_value, int down_value)
+        :   m_context(std::move(wiring_pi_context)),
+            m_type(actuator),
+            m_pin(pin_number),
+            m_up_value(up_value),
+            m_down_value(down_value),
+            m_is_down(false){
+        if(m_type == type::servo){
+            m_context->configure_pwm(m_pin, servo_range, servo_divisor);
+        }
+        apply(m_up_value);
+    }
+
+    pen_actuator pen_actuator::servo(std::shared_ptr<context> wiring_pi_context,
+            pin pin_number, unsigned int up_pulse_us, unsigned int down_pulse_us){
+        return pen_actuator(std::move(wiring_pi_context), type::servo, pin_number,
+                static_cast<int>(up_pulse_us / 10), static_cast<int>(down_pulse_us / 10));
+    }
+
+    pen_actuator pen_actuator::solenoid(std::shared_ptr<context> wiring_pi_context,
+            pin pin_number, bool lift_when_high){
+        return pen_actuator(std::move(wiring_pi_context), type::solenoid, pin_number,
+                lift_when_high ? 1 : 0, lift_when_high ? 0 : 1);
+    }
+
+    void pen_actuator::lift(){
+        m_is_down = false;
+        apply(m_up_value);
+    }
+
+    void pen_actuator::lower(){
+        m_is_down = true;
+        apply(m_down_value);
+    }
+
+    void pen_actuator::apply(int value){
+        if(m_type == type::servo){
+            m_context->write_pwm(m_pin, value);
+        }
+        else{
+            m_context->write(m_pin, value != 0);
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef PEN_HPP
+#define PEN_HPP
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "wiringPiContext.hpp"
+
+namespace plotter{
+
+    /**
+     * How long the pen mechanism takes to move, measured from the command.
+     * The executor uses these to overlap pen moves with XY deceleration.
+     */
+    struct pen_timing{
+        /**
+         * Lift command until the tip leaves the paper. The lift is issued
+         * this long before a drawing move stops.
+         */
+        std::uint32_t release_us = 40000;
+
+        /**
+         * Lift command until the pen is high enough to travel
+         */
+        std::uint32_t clear_us = 120000;
+
+        /**
+         * Lower command until the tip reaches the paper. The lower is
+         * issued this long before a travel move stops.
+         */
+        std::uint32_t touch_us = 60000;
+
+        /**
+         * Lower command until the tip has settled and drawing can start
+         */
+        std::uint32_t settle_us = 100000;
+    };
+
+    /**
+     * Pen lift driven either by a hobby servo on a PWM pin or by a solenoid
+     * on a plain GPIO pin. Commands return immediately; waiting for the pen
+     * is left to the motion_executor.
+     */
+    class pen_actuator{
+        //Types
+        public:
+            enum class type{
+                servo,
+                solenoid
+            };
+
+        //Members
+        private:
+            std::shared_ptr<context> m_context;
+            type m_type;
+            pin m_pin;
+
+            /**
+             * PWM counts for a servo, or the pin level for a solenoid
+             */
+            int m_up_value;
+            int m_down_value;
+
+            bool m_is_down;
+
+            pen_actuator(std::shared_ptr<context> wiring_pi_context,
+                    type actuator, pin pin_number, int up_value, int down_value);
+
+        //Interface
+        public:
+            /**
+             * PWM period of a servo in 10us counts, giving 50Hz
+             */
+            static constexpr unsigned int servo_range = 2000;
+
+            /**
+             * Divides the 19.2MHz PWM clock down to 10us counts
+             */
+            static constexpr int servo_divisor = 192;
+
+            /**
+             * Servo pen lift on a hardware PWM pin
+             *
+             * @param wiring_pi_context: hardware interface
+             * @param pin_number: PWM capable pin
+             * @param up_pulse_us: servo pulse width with the pen up
+             * @param down_pulse_us: servo pulse width with the pen down
+             * @return: pen actuator, starting with the pen up
+             */
+            static pen_actuator servo(std::shared_ptr<context> wiring_pi_context,
+                    pin pin_number, unsigned int up_pulse_us=1000, unsigned int down_pulse_us=2000);
+
+            /**
+             * Solenoid pen lift on a GPIO pin
+             *
+             * @param wiring_pi_context: hardware interface
+             * @param pin_number: pin driving the solenoid
+             * @param lift_when_high: true if energizing the solenoid lifts
+             *                        the pen, false if it pushes it down
+             * @return: pen actuator, starting with the pen up
+             */
+            static pen_actuator solenoid(std::shared_ptr<context> wiring_pi_context,
+                    pin pin_number, bool lift_when_high=true);
+
+            void lift();
+            void lower();
+
+            /**
+             * @param down: true to lower the pen, false to lift it
+             */
+            void set(bool down){
+                if(down){
+                    lower();
+                }
+                else{
+                    lift();
+                }
+            }
+
+            /**
+             * @return: true if the last command lowered the pen
+             */
+            bool is_down() const{return m_is_down;}
+
+            type get_type() const{return m_type;}
+
+        private:
+            void apply(int value);
+    };
+}
+
+#endif
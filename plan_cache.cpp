@@ -0,0 +1,210 @@
+#include "plan_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace plotter{
+    namespace{
+        const char cache_magic[4] = {'P', 'L', 'P', 'C'};
+
+        /**
+         * Bytes of a cached plan before its blocks
+         */
+        constexpr std::size_t header_size = sizeof(cache_magic) + 4 + 4 + 8 + 8 + 3 * 8 * max_axes;
+
+        std::uint64_t rotate_left(std::uint64_t value, int bits){
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        /**
+         * Finalizer of MurmurHash3, every input bit affects every output bit
+         */
+        std::uint64_t mix(std::uint64_t value){
+            value ^= value >> 33;
+            value *= 0xFF51AFD7ED558CCDULL;
+            value ^= value >> 33;
+            value *= 0xC4CEB9FE1A85EC53ULL;
+            value ^= value >> 33;
+            return value;
+        }
+
+        void put_u32(std::ofstream& out, std::uint32_t value){
+            for(int i = 0; i < 4; i++){
+                out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        void put_u64(std::ofstream& out, std::uint64_t value){
+            for(int i = 0; i < 8; i++){
+                out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        std::uint32_t get_u32(std::ifstream& in){
+            std::uint32_t value = 0;
+            for(int i = 0; i < 4; i++){
+                value |= static_cast<std::uint32_t>(static_cast<unsigned char>(in.get())) << (8 * i);
+            }
+            return value;
+        }
+
+        std::uint64_t get_u64(std::ifstream& in){
+            std::uint64_t value = 0;
+            for(int i = 0; i < 8; i++){
+                value |= static_cast<std::uint64_t>(static_cast<unsigned char>(in.get())) << (8 * i);
+            }
+            return value;
+        }
+    }
+
+/******************************************************************************/
+/*                                    Keys                                    */
+/******************************************************************************/
+    std::string plan_key::name() const{
+        char text[33];
+        std::snprintf(text, sizeof(text), "%016llx%016llx",
+                static_cast<unsigned long long>(high),
+                static_cast<unsigned long long>(low));
+        return text;
+    }
+
+    plan_hasher::plan_hasher()
+        :   m_high(0x6A09E667F3BCC908ULL),
+            m_low(0xBB67AE8584CAA73BULL){}
+
+    void plan_hasher::add(std::uint64_t value){
+        m_low = mix(m_low ^ value);
+        m_high = mix(rotate_left(m_high, 23) ^ (value * 0x9E3779B97F4A7C15ULL));
+    }
+
+    void plan_hasher::add(const motion_config& config){
+        add(config.axis_count);
+        for(std::size_t axis = 0; axis < config.axis_count && axis < max_axes; axis++){
+            const axis_limits& limits = config.axes[axis];
+            add(static_cast<std::uint64_t>(limits.scale.steps()));
+            add(static_cast<std::uint64_t>(limits.scale.length()));
+            add(static_cast<std::uint64_t>(limits.max_velocity));
+            add(static_cast<std::uint64_t>(limits.max_acceleration));
+        }
+        add(static_cast<std::uint64_t>(config.acceleration));
+        add(static_cast<std::uint64_t>(config.junction_deviation));
+    }
+
+    void plan_hasher::add(const move_command& command){
+        add(static_cast<std::uint64_t>(command.type)
+                | static_cast<std::uint64_t>(command.clockwise) << 8
+                | static_cast<std::uint64_t>(command.pen_down) << 16
+                | static_cast<std::uint64_t>(command.tool) << 24);
+        for(position::rep value : command.target){
+            add(static_cast<std::uint64_t>(value));
+        }
+        if(command.type == move_command::kind::arc){
+            add(static_cast<std::uint64_t>(command.center[0]));
+            add(static_cast<std::uint64_t>(command.center[1]));
+        }
+        add(static_cast<std::uint64_t>(command.feed_rate));
+    }
+
+/******************************************************************************/
+/*                                    Cache                                   */
+/******************************************************************************/
+    plan_cache::plan_cache(std::string directory)
+        :   m_directory(std::move(directory)),
+            m_hits(0),
+            m_misses(0),
+            m_written(0){
+        if(::mkdir(m_directory.c_str(), 0755) != 0 && errno != EEXIST){
+            throw std::system_error(errno, std::generic_category(), "Unable to create plan cache " + m_directory);
+        }
+    }
+
+    std::string plan_cache::path(const plan_key& key) const{
+        return m_directory + "/" + key.name() + ".plan";
+    }
+
+    bool plan_cache::load(const plan_key& key, cached_plan& plan){
+        std::ifstream in(path(key), std::ios::binary | std::ios::ate);
+        if(!in){
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::uint64_t size = static_cast<std::uint64_t>(in.tellg());
+        in.seekg(0);
+
+        char magic[sizeof(cache_magic)] = {};
+        in.read(magic, sizeof(magic));
+        bool valid = size >= header_size
+            && std::equal(magic, magic + sizeof(magic), cache_magic)
+            && get_u32(in) == version
+            && get_u32(in) == sizeof(planned_block);
+        std::uint64_t count = valid ? get_u64(in) : 0;
+        valid = valid && count <= size / sizeof(planned_block)
+            && size == header_size + count * sizeof(planned_block);
+        if(valid){
+            plan.rejected = get_u64(in);
+            for(axis_positions* positions : {&plan.end.cartesian, &plan.end.target}){
+                for(position& value : *positions){
+                    value = position(static_cast<position::rep>(get_u64(in)));
+                }
+            }
+            for(std::int64_t& value : plan.end.steps){
+                value = static_cast<std::int64_t>(get_u64(in));
+            }
+            plan.blocks.resize(static_cast<std::size_t>(count));
+            in.read(reinterpret_cast<char*>(plan.blocks.data()), static_cast<std::streamsize>(count * sizeof(planned_block)));
+            valid = static_cast<bool>(in);
+        }
+        if(!valid){
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void plan_cache::store(const plan_key& key, const cached_plan& plan){
+        std::string final_path = path(key);
+        // Unique across the processes and threads sharing the cache
+        std::string temporary = final_path + "." + std::to_string(::getpid()) + "."
+            + std::to_string(m_written.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if(!out){
+                throw std::runtime_error("Unable to open cached plan for writing: " + temporary);
+            }
+            out.write(cache_magic, sizeof(cache_magic));
+            put_u32(out, version);
+            put_u32(out, sizeof(planned_block));
+            put_u64(out, plan.blocks.size());
+            put_u64(out, plan.rejected);
+            for(const axis_positions* positions : {&plan.end.cartesian, &plan.end.target}){
+                for(position value : *positions){
+                    put_u64(out, static_cast<std::uint64_t>(value.count()));
+                }
+            }
+            for(std::int64_t value : plan.end.steps){
+                put_u64(out, static_cast<std::uint64_t>(value));
+            }
+            out.write(reinterpret_cast<const char*>(plan.blocks.data()),
+                    static_cast<std::streamsize>(plan.blocks.size() * sizeof(planned_block)));
+            out.close();
+            if(!out){
+                std::remove(temporary.c_str());
+                throw std::runtime_error("Unable to write cached plan: " + temporary);
+            }
+        }
+        if(std::rename(temporary.c_str(), final_path.c_str()) != 0){
+            std::remove(temporary.c_str());
+            throw std::runtime_error("Unable to store cached plan: " + final_path);
+        }
+    }
+}
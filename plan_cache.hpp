@@ -0,0 +1,147 @@
+#ifndef PLAN_CACHE_HPP
+#define PLAN_CACHE_HPP
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "job_ring.hpp"
+#include "kinematics.hpp"
+#include "motion.hpp"
+
+namespace plotter{
+
+    /**
+     * 128 bit hash naming a cached plan
+     */
+    struct plan_key{
+        std::uint64_t high;
+        std::uint64_t low;
+
+        /**
+         * @return: the key as 32 hex digits
+         */
+        std::string name() const;
+    };
+
+    /**
+     * Builds a plan key from everything the planned blocks depend on, a
+     * word at a time into two independently mixed 64 bit lanes
+     */
+    class plan_hasher{
+        private:
+            std::uint64_t m_high;
+            std::uint64_t m_low;
+
+        public:
+            plan_hasher();
+
+            void add(std::uint64_t value);
+
+            /**
+             * Add the step scales and limits the planner works from
+             */
+            void add(const motion_config& config);
+
+            /**
+             * Add a command, leaving out its line tag
+             */
+            void add(const move_command& command);
+
+            plan_key key() const{return plan_key{m_high, m_low};}
+    };
+
+    /**
+     * Where a plan leaves the planners, for planning on from the same place
+     */
+    struct plan_state{
+        /**
+         * End of the last move before the kinematics, the same as target
+         * on a Cartesian machine
+         */
+        axis_positions cartesian;
+
+        /**
+         * See motion_planner::target() and motion_planner::steps()
+         */
+        axis_positions target;
+        axis_steps steps;
+    };
+
+    /**
+     * Planned blocks of a piece of a job. The line of each block is the
+     * index of the command it came from within the piece, so a plan can be
+     * reused wherever the same commands come up again.
+     */
+    struct cached_plan{
+        std::vector<planned_block> blocks;
+        plan_state end;
+
+        /**
+         * Commands the planner refused
+         */
+        std::uint64_t rejected;
+    };
+
+    /**
+     * Planned blocks on disk, one file per plan named by its key. Files are
+     * written under a temporary name and renamed into place, so a plan is
+     * only ever seen whole and several processes can share a cache. Nothing
+     * is evicted; delete the files to empty it.
+     *
+     * Blocks are stored as they are in memory, so a cache only suits the
+     * build that wrote it; the block size in the header keeps other builds
+     * from reading it.
+     *
+     * File layout, little endian:
+     *      "PLPC" | version (u32) | block size (u32) | block count (u64) |
+     *      rejected (u64) | end cartesian, target and steps (u64 per axis
+     *      each) | blocks
+     */
+    class plan_cache{
+        public:
+            static constexpr std::uint32_t version = 1;
+
+        private:
+            std::string m_directory;
+            std::atomic<std::uint64_t> m_hits;
+            std::atomic<std::uint64_t> m_misses;
+            std::atomic<std::uint64_t> m_written;
+
+            std::string path(const plan_key& key) const;
+
+        public:
+            /**
+             * @param directory: where to keep the plans, created if missing
+             * @throw: system_error if the directory can't be created
+             */
+            explicit plan_cache(std::string directory);
+
+            /**
+             * Read a plan. Missing, truncated and foreign files are all
+             * misses.
+             *
+             * @param key: plan to look up
+             * @param plan: receives the plan, reusing its storage
+             * @return: true if the plan was found
+             */
+            bool load(const plan_key& key, cached_plan& plan);
+
+            /**
+             * Write a plan, replacing any stored under the same key
+             *
+             * @param key: key of the plan
+             * @param plan: plan to store
+             * @throw: runtime_error if the plan can't be written
+             */
+            void store(const plan_key& key, const cached_plan& plan);
+
+            const std::string& directory() const{return m_directory;}
+            std::uint64_t hits() const{return m_hits.load(std::memory_order_relaxed);}
+            std::uint64_t misses() const{return m_misses.load(std::memory_order_relaxed);}
+    };
+}
+
+#endif
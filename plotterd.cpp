@@ -0,0 +1,181 @@
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "wiringPiContext.hpp"
+#include "stepper.hpp"
+#include "step_stream.hpp"
+#include "motion.hpp"
+#include "kinematics.hpp"
+#include "logging.hpp"
+#include "machine_config.hpp"
+#include "pen.hpp"
+#include "job_server.hpp"
+#include "telemetry.hpp"
+#include "input_shaper.hpp"
+
+namespace{
+    volatile std::sig_atomic_t stop_requested = 0;
+    volatile std::sig_atomic_t swap_done = 0;
+
+    void request_stop(int){
+        stop_requested = 1;
+    }
+
+    void confirm_swap(int){
+        swap_done = 1;
+    }
+}
+
+/**
+ * Controller daemon. Plans and executes the moves that other processes
+ * queue through the shared job ring, see job_client. At a pen swap it
+ * holds until a client confirms it, see job_client::confirm_swap(), or the
+ * operator sends SIGUSR1. Clients can change the feed override and pause
+ * at any time.
+ *
+ * The machine is read from a description file, see machine_config, or is
+ * the built in two axis plotter if none is given. Axes the description
+ * gives a limit switch are homed at startup, a stall seen by the encoder
+ * of an axis stops the daemon and axes with a shaper are stepped through
+ * an input_shaper.
+ *
+ * Usage: plotterd [socket path] [telemetry socket path] [machine file]
+ */
+int main(int argc, char** argv){
+    std::string path = argc > 1 ? argv[1] : "/tmp/plotterd.sock";
+    std::string telemetry_path = argc > 2 ? argv[2] : "/tmp/plotterd.telemetry";
+
+    plotter::machine_config machine;
+    try{
+        machine = argc > 3 ? plotter::load_machine_config(argv[3]) : plotter::default_machine_config();
+    }
+    catch(const std::exception& error){
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    if(machine.shard_count > 1){
+        std::cerr << "The machine is spread over " << machine.shard_count
+            << " controllers, plotterd drives one" << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    std::signal(SIGUSR1, confirm_swap);
+
+    std::shared_ptr<plotter::context> context = std::make_shared<plotter::context>();
+    std::shared_ptr<plotter::gpio_outputs> outputs;
+    try{
+        outputs = machine.make_outputs(context);
+    }
+    catch(const std::exception& error){
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    std::vector<std::unique_ptr<plotter::stepper>> steppers;
+    for(std::size_t axis = 0; axis < machine.axes.size(); axis++){
+        steppers.push_back(machine.make_stepper(outputs, axis));
+    }
+    plotter::pen_actuator pen = machine.make_pen(context);
+
+    // Axes with a limit switch are homed before anything is planned, so
+    // every job starts from step 0 at the switches
+    plotter::edge_monitor monitor;
+    std::vector<plotter::stall_monitor> stall_monitors;
+    if(machine.has_inputs()){
+        try{
+            plotter::machine_inputs inputs = machine.connect_inputs(monitor, machine.make_input_source());
+            monitor.start();
+            if(machine.homes()){
+                std::cout << "Homing" << std::endl;
+                if(!plotter::home_steppers(steppers, inputs.switches, machine.homing_profiles(), steppers.size(),
+                            std::chrono::microseconds(machine.homing_tick_us))){
+                    std::cerr << "An axis didn't find its limit switch" << std::endl;
+                    return 1;
+                }
+            }
+            stall_monitors = machine.make_stall_monitors(inputs, [](const plotter::stall_event& stall){
+                plotter::log_error("Axis {} stalled at step {}, commanded {}",
+                        stall.axis, stall.measured_steps, stall.commanded_steps);
+            });
+        }
+        catch(const std::exception& error){
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    }
+
+    plotter::motion_planner planner(machine.motion);
+    plotter::kinematic_planner kinematic(planner, machine.machine);
+    bool cartesian = machine.machine.get_type() == plotter::kinematics::type::cartesian;
+    plotter::motion_executor executor(plotter::drain_planner(planner), machine.timing);
+    std::unique_ptr<plotter::input_shaper> shaper;
+    if(plotter::is_shaped(machine.shapers(), machine.axes.size())){
+        shaper = std::make_unique<plotter::input_shaper>([&executor](plotter::step_tick& unshaped){
+                    return executor.next(unshaped);
+                }, machine.shapers(), machine.axes.size(),
+                plotter::shaper_capacity(machine.shapers(), machine.motion));
+    }
+    plotter::job_server server(path);
+    std::cout << "Listening on " << path << std::endl;
+
+    plotter::telemetry_channel telemetry;
+    plotter::telemetry_publisher publisher(telemetry);
+    plotter::telemetry_server telemetry_server(telemetry, telemetry_path);
+    telemetry_server.start();
+
+    auto deadline = std::chrono::steady_clock::now();
+    plotter::step_tick tick;
+    bool stopped_by_stall = false;
+    while(stop_requested == 0){
+        server.accept_clients();
+        server.apply_controls(executor);
+        if(cartesian){
+            server.feed(planner);
+        }
+        else{
+            server.feed(kinematic);
+        }
+        if(!executor.is_halted() && (shaper ? shaper->next(tick) : executor.next(tick))){
+            deadline += std::chrono::microseconds(tick.interval);
+            plotter::wait_until(deadline);
+            plotter::apply_step_rates(executor, steppers, steppers.size());
+            plotter::apply_step_tick(tick, steppers);
+            plotter::apply_pen_action(tick, pen);
+            for(plotter::stall_monitor& stall : stall_monitors){
+                // The executor and the shaper both start from step 0
+                stall.check(executor, shaper ? shaper->output_steps(stall.axis()) : executor.position()[stall.axis()]);
+            }
+            publisher.on_tick(executor, tick, planner.depth());
+            if(tick.pen == plotter::pen_action::swap){
+                swap_done = 0;
+                std::cout << "Fit pen " << static_cast<unsigned int>(executor.tool())
+                    << " and confirm the swap or send SIGUSR1 to carry on" << std::endl;
+            }
+            else if(swap_done != 0 && executor.is_swapping()){
+                swap_done = 0;
+                executor.resume();
+            }
+            continue;
+        }
+        if(executor.is_halted()){
+            // Where the stalled axis is isn't known any more
+            std::cerr << "An axis stalled, restart plotterd to home it again" << std::endl;
+            stopped_by_stall = true;
+            break;
+        }
+        publisher.publish(executor, planner.depth());
+
+        // Idle until a client connects or queues a move, checking now and
+        // then for a stop request
+        server.wait(100);
+        deadline = std::chrono::steady_clock::now();
+    }
+
+    std::cout << "Stopped, " << server.rejected() << " commands rejected" << std::endl;
+    return stopped_by_stall ? 1 : 0;
+}
@@ -0,0 +1,386 @@
+#include "shard.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace plotter{
+    namespace{
+        std::system_error os_error(const std::string& what){
+            return std::system_error(errno, std::generic_category(), what);
+        }
+    }
+
+/******************************************************************************/
+/*                                    Ring                                    */
+/******************************************************************************/
+    std::size_t shard_ring::mapping_size(std::size_t capacity){
+        return sizeof(header) + capacity * sizeof(shard_event);
+    }
+
+    shard_ring::shard_ring(int memory_fd, bool initialize, std::size_t capacity)
+        :   m_memory_fd(memory_fd),
+            m_size(0),
+            m_header(nullptr),
+            m_events(nullptr),
+            m_mask(0){
+        try{
+            if(initialize){
+                m_size = mapping_size(capacity);
+                if(::ftruncate(m_memory_fd, static_cast<off_t>(m_size)) != 0){
+                    throw os_error("Unable to size the shard ring");
+                }
+            }
+            else{
+                struct stat info;
+                if(::fstat(m_memory_fd, &info) != 0){
+                    throw os_error("Unable to inspect the shard ring");
+                }
+                m_size = static_cast<std::size_t>(info.st_size);
+                if(m_size < sizeof(header)){
+                    throw std::runtime_error("Shard ring is too small");
+                }
+            }
+
+            void* memory = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_memory_fd, 0);
+            if(memory == MAP_FAILED){
+                throw os_error("Unable to map the shard ring");
+            }
+            m_header = static_cast<header*>(memory);
+            m_events = reinterpret_cast<shard_event*>(static_cast<char*>(memory) + sizeof(header));
+
+            if(initialize){
+                new (m_header) header{magic, version, static_cast<std::uint32_t>(capacity),
+                        static_cast<std::uint32_t>(sizeof(shard_event)), {0}, {0}, {0}, {0}, {0}, {}, {0}, {0}, {0}, {0}};
+            }
+            else{
+                capacity = m_header->capacity;
+                if(m_header->magic != magic || m_header->version != version
+                        || m_header->event_size != sizeof(shard_event)
+                        || capacity == 0 || (capacity & (capacity - 1)) != 0
+                        || mapping_size(capacity) > m_size){
+                    throw std::runtime_error("Shard ring was created by an incompatible controller");
+                }
+            }
+            m_mask = capacity - 1;
+        }
+        catch(...){
+            release();
+            throw;
+        }
+    }
+
+    shard_ring shard_ring::create(std::size_t capacity){
+        if(capacity == 0 || capacity > (1u << 24)){
+            throw std::invalid_argument("Shard ring capacity must be between 1 and 2^24");
+        }
+        std::size_t rounded = 1;
+        while(rounded < capacity){
+            rounded <<= 1;
+        }
+
+        int memory_fd = ::memfd_create("plotter-shard-ring", MFD_CLOEXEC);
+        if(memory_fd < 0){
+            throw os_error("Unable to create the shard ring");
+        }
+        return shard_ring(memory_fd, true, rounded);
+    }
+
+    shard_ring shard_ring::attach(int memory_fd){
+        return shard_ring(memory_fd, false, 0);
+    }
+
+    shard_ring::shard_ring(shard_ring&& other) noexcept
+        :   m_memory_fd(other.m_memory_fd),
+            m_size(other.m_size),
+            m_header(other.m_header),
+            m_events(other.m_events),
+            m_mask(other.m_mask){
+        other.m_memory_fd = -1;
+        other.m_header = nullptr;
+        other.m_events = nullptr;
+    }
+
+    shard_ring& shard_ring::operator=(shard_ring&& other) noexcept{
+        if(this != &other){
+            release();
+            m_memory_fd = other.m_memory_fd;
+            m_size = other.m_size;
+            m_header = other.m_header;
+            m_events = other.m_events;
+            m_mask = other.m_mask;
+            other.m_memory_fd = -1;
+            other.m_header = nullptr;
+            other.m_events = nullptr;
+        }
+        return *this;
+    }
+
+    shard_ring::~shard_ring(){
+        release();
+    }
+
+    void shard_ring::release(){
+        if(m_header != nullptr){
+            ::munmap(m_header, m_size);
+            m_header = nullptr;
+            m_events = nullptr;
+        }
+        if(m_memory_fd >= 0){
+            ::close(m_memory_fd);
+            m_memory_fd = -1;
+        }
+    }
+
+    bool shard_ring::try_push(const shard_event& event){
+        std::uint64_t position = m_header->write.load(std::memory_order_relaxed);
+        if(position - m_header->read.load(std::memory_order_acquire) > m_mask){
+            return false;
+        }
+        m_events[position & m_mask] = event;
+        m_header->write.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    const shard_event* shard_ring::front() const{
+        std::uint64_t position = m_header->read.load(std::memory_order_relaxed);
+        if(position == m_header->write.load(std::memory_order_acquire)){
+            return nullptr;
+        }
+        return &m_events[position & m_mask];
+    }
+
+    void shard_ring::pop(){
+        m_header->read.store(m_header->read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+/******************************************************************************/
+/*                                  Handshake                                 */
+/******************************************************************************/
+    void shard_ring::announce_ready(){
+        m_header->ready.store(1, std::memory_order_release);
+    }
+
+    bool shard_ring::start(std::chrono::steady_clock::time_point& start) const{
+        std::int64_t start_ns = m_header->start_ns.load(std::memory_order_acquire);
+        if(start_ns == 0){
+            return false;
+        }
+        start = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::nanoseconds(start_ns)));
+        return true;
+    }
+
+    void shard_ring::finish(const shard_report& report){
+        m_header->report = report;
+        m_header->finished.store(1, std::memory_order_release);
+    }
+
+    std::chrono::nanoseconds shard_ring::shift() const{
+        return std::chrono::nanoseconds(m_header->shift_ns.load(std::memory_order_acquire));
+    }
+
+    void shard_ring::request_shift(std::chrono::nanoseconds shift){
+        m_header->requested_ns.store(shift.count(), std::memory_order_release);
+    }
+
+    void shard_ring::reach_hold(std::uint32_t hold){
+        m_header->held.store(hold, std::memory_order_release);
+    }
+
+    bool shard_ring::is_released(std::uint32_t hold) const{
+        return m_header->released.load(std::memory_order_acquire) >= hold;
+    }
+
+    bool shard_ring::is_ready() const{
+        return m_header->ready.load(std::memory_order_acquire) != 0;
+    }
+
+    void shard_ring::set_start(std::chrono::steady_clock::time_point start){
+        m_header->start_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(),
+                std::memory_order_release);
+    }
+
+    std::chrono::nanoseconds shard_ring::requested_shift() const{
+        return std::chrono::nanoseconds(m_header->requested_ns.load(std::memory_order_acquire));
+    }
+
+    void shard_ring::set_shift(std::chrono::nanoseconds shift){
+        m_header->shift_ns.store(shift.count(), std::memory_order_release);
+    }
+
+    std::uint32_t shard_ring::held() const{
+        return m_header->held.load(std::memory_order_acquire);
+    }
+
+    void shard_ring::release(std::uint32_t hold){
+        m_header->released.store(hold, std::memory_order_release);
+    }
+
+    bool shard_ring::finished(shard_report& report) const{
+        if(m_header->finished.load(std::memory_order_acquire) == 0){
+            return false;
+        }
+        report = m_header->report;
+        return true;
+    }
+
+/******************************************************************************/
+/*                                 Distributor                                */
+/******************************************************************************/
+    shard_distributor::shard_distributor(const machine_config& machine, std::size_t capacity)
+        :   m_rings(),
+            m_routes(),
+            m_axis_count(machine.axes.size()),
+            m_pen_shard(machine.pen_shard),
+            m_time_us(0),
+            m_shift(0),
+            m_start(),
+            m_holds(0),
+            m_holding(false),
+            m_events(machine.shard_count){
+        for(std::size_t shard = 0; shard < machine.shard_count; shard++){
+            m_rings.push_back(shard_ring::create(capacity));
+        }
+        for(std::size_t axis = 0; axis < m_axis_count; axis++){
+            m_routes[axis] = axis_route{static_cast<std::uint32_t>(machine.axes[axis].shard),
+                static_cast<std::uint32_t>(machine.axes[axis].shard_axis)};
+        }
+    }
+
+    void shard_distributor::push(std::size_t shard, const shard_event& event){
+        // A full ring is a whole ring ahead of the shard, which empties it
+        // at the pace of the machine
+        while(!m_rings[shard].try_push(event)){
+            relay();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+    void shard_distributor::relay(){
+        std::chrono::nanoseconds shift = m_shift;
+        for(const shard_ring& ring : m_rings){
+            shift = std::max(shift, ring.requested_shift());
+        }
+        if(shift != m_shift){
+            m_shift = shift;
+            for(shard_ring& ring : m_rings){
+                ring.set_shift(shift);
+            }
+        }
+    }
+
+    void shard_distributor::start(std::chrono::microseconds lead, std::chrono::milliseconds timeout){
+        auto give_up = std::chrono::steady_clock::now() + timeout;
+        for(std::size_t shard = 0; shard < m_rings.size(); shard++){
+            while(!m_rings[shard].is_ready()){
+                if(std::chrono::steady_clock::now() > give_up){
+                    throw std::runtime_error("Shard " + std::to_string(shard) + " didn't get ready");
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        m_start = std::chrono::steady_clock::now() + lead;
+        for(shard_ring& ring : m_rings){
+            ring.set_start(m_start);
+        }
+    }
+
+    void shard_distributor::on_tick(const step_tick& tick){
+        relay();
+        if(m_holding){
+            return;
+        }
+        m_time_us += tick.interval;
+        for(shard_event& event : m_events){
+            event = shard_event{m_time_us, 0, 0, pen_action::none, false, false};
+        }
+        for(std::uint32_t bits = tick.step_bits; bits != 0; bits &= bits - 1){
+            unsigned int axis = static_cast<unsigned int>(__builtin_ctz(bits));
+            const axis_route& route = m_routes[axis];
+            m_events[route.shard].step_bits |= std::uint32_t{1} << route.bit;
+            if(((tick.direction_bits >> axis) & 1) != 0){
+                m_events[route.shard].direction_bits |= std::uint32_t{1} << route.bit;
+            }
+        }
+        if(tick.pen == pen_action::lift || tick.pen == pen_action::lower){
+            m_events[m_pen_shard].pen = tick.pen;
+        }
+        for(std::size_t shard = 0; shard < m_events.size(); shard++){
+            const shard_event& event = m_events[shard];
+            if(event.step_bits != 0 || event.pen != pen_action::none){
+                push(shard, event);
+            }
+        }
+        if(tick.pen == pen_action::swap){
+            hold();
+        }
+    }
+
+    void shard_distributor::hold(){
+        if(m_holding){
+            return;
+        }
+        m_holding = true;
+        m_holds++;
+        for(std::size_t shard = 0; shard < m_rings.size(); shard++){
+            push(shard, shard_event{m_time_us, 0, 0, pen_action::none, false, true});
+        }
+    }
+
+    bool shard_distributor::release(std::chrono::microseconds lead, std::chrono::milliseconds timeout){
+        if(!m_holding){
+            return true;
+        }
+        auto give_up = std::chrono::steady_clock::now() + timeout;
+        for(const shard_ring& ring : m_rings){
+            while(ring.held() < m_holds){
+                if(std::chrono::steady_clock::now() > give_up){
+                    return false;
+                }
+                relay();
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        // Every shard is stopped at the time of the hold, which now comes
+        // the lead from now
+        auto resume = std::chrono::steady_clock::now() + lead;
+        m_shift = std::max(m_shift, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    resume - m_start - std::chrono::microseconds(m_time_us)));
+        for(shard_ring& ring : m_rings){
+            ring.set_shift(m_shift);
+            ring.release(m_holds);
+        }
+        m_holding = false;
+        return true;
+    }
+
+    void shard_distributor::finish(){
+        for(std::size_t shard = 0; shard < m_rings.size(); shard++){
+            push(shard, shard_event{m_time_us, 0, 0, pen_action::none, true, false});
+        }
+    }
+
+    bool shard_distributor::wait_finished(std::vector<shard_report>& reports, std::chrono::milliseconds timeout){
+        auto give_up = std::chrono::steady_clock::now() + timeout;
+        reports.resize(m_rings.size());
+        for(std::size_t shard = 0; shard < m_rings.size(); shard++){
+            while(!m_rings[shard].finished(reports[shard])){
+                if(std::chrono::steady_clock::now() > give_up){
+                    return false;
+                }
+                // The shards still running must follow one that fell behind
+                relay();
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,545 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "machine_config.hpp"
+#include "motion.hpp"
+#include "step_stream.hpp"
+
+namespace plotter{
+
+    /**
+     * A step event as one shard sees it. The time is counted from the
+     * start tick common to every shard, so each shard keeps to the plan on
+     * its own and the shards stay in step with each other without ever
+     * talking, as long as none falls behind; see shard_distributor for
+     * what happens when one does.
+     */
+    struct shard_event{
+        /**
+         * Microseconds from the common start tick
+         */
+        std::uint64_t time_us;
+
+        /**
+         * Bit N is set if the shard's axis N steps, see
+         * machine_axis::shard_axis
+         */
+        std::uint32_t step_bits;
+        std::uint32_t direction_bits;
+
+        pen_action pen;
+
+        /**
+         * Set on the event after the last of the job
+         */
+        bool last;
+
+        /**
+         * Set on an event where every shard stops, for a pen swap or a
+         * pause, until the distributor releases the hold
+         */
+        bool hold;
+    };
+
+    /**
+     * What a shard reports once it has run its part of the job
+     */
+    struct shard_report{
+        /**
+         * Events applied
+         */
+        std::uint64_t events;
+
+        /**
+         * Events found more than shard_ring::late_us behind the time base,
+         * each of which moved the time base of every shard on instead of
+         * being caught up in a burst, and the worst lateness seen
+         */
+        std::uint64_t late;
+        std::uint64_t worst_late_us;
+
+        /**
+         * How far the common time base had been moved on by the end
+         */
+        std::uint64_t shift_us;
+
+        /**
+         * Step position of each of the shard's axes at the end
+         */
+        axis_steps position;
+    };
+
+    /**
+     * Step events for one shard in memory shared with the process driving
+     * it. One producer, the planner's distributor, and one consumer, the
+     * shard. Unlike job_ring nothing sleeps on an eventfd: the shard waits
+     * for the time of the next event anyway, and the distributor only
+     * waits when it is a whole ring ahead of the machine.
+     *
+     * The header also carries the start handshake: the shard announces it
+     * is ready, the distributor publishes the common start tick once every
+     * shard is, and the shard hands its report back at the end. In
+     * between, the shard asks for the time base to be moved on when it has
+     * fallen behind, and the distributor passes the furthest any shard has
+     * asked for to every shard. The shard also reports each hold it has
+     * stopped at, and the distributor releases the hold once it has moved
+     * the time base past it.
+     */
+    class shard_ring{
+        public:
+            static constexpr std::uint32_t magic = 0x504C5352;    // "PLSR"
+            static constexpr std::uint32_t version = 3;       // 2 moved time base, 3 holds
+
+            /**
+             * Lateness up to which an event still counts as on time
+             */
+            static constexpr std::uint64_t late_us = 100;
+
+        private:
+            struct header{
+                std::uint32_t magic;
+                std::uint32_t version;
+                std::uint32_t capacity;
+                std::uint32_t event_size;
+
+                alignas(64) std::atomic<std::uint64_t> write;
+                alignas(64) std::atomic<std::uint64_t> read;
+
+                /**
+                 * Handshake, see the class description. start_ns is the
+                 * common start tick on the steady clock, 0 until published.
+                 */
+                alignas(64) std::atomic<std::uint32_t> ready;
+                std::atomic<std::int64_t> start_ns;
+                std::atomic<std::uint32_t> finished;
+                shard_report report;
+
+                /**
+                 * Time base, see the class description. shift_ns is how far
+                 * the distributor has moved the start tick of every shard
+                 * on, requested_ns how far this shard needs it moved.
+                 */
+                alignas(64) std::atomic<std::int64_t> shift_ns;
+                std::atomic<std::int64_t> requested_ns;
+
+                /**
+                 * Holds this shard has stopped at and holds the distributor
+                 * has released, both counted from 1
+                 */
+                std::atomic<std::uint32_t> held;
+                std::atomic<std::uint32_t> released;
+            };
+
+            static_assert(std::atomic<std::int64_t>::is_always_lock_free,
+                    "Shared memory atomics must be lock free");
+
+            int m_memory_fd;
+            std::size_t m_size;
+            header* m_header;
+            shard_event* m_events;
+            std::uint64_t m_mask;
+
+            shard_ring(int memory_fd, bool initialize, std::size_t capacity);
+
+            static std::size_t mapping_size(std::size_t capacity);
+            void release();
+
+        public:
+            /**
+             * Create a new ring in anonymous shared memory. A child forked
+             * afterwards shares it as is, any other process attaches to the
+             * descriptor.
+             *
+             * @param capacity: number of events, rounded up to a power of 2
+             * @return: ring
+             */
+            static shard_ring create(std::size_t capacity);
+
+            /**
+             * Map a ring created by another process. Takes ownership of the
+             * descriptor.
+             *
+             * @param memory_fd: shared memory holding the ring
+             * @return: ring
+             */
+            static shard_ring attach(int memory_fd);
+
+            shard_ring(const shard_ring&) = delete;
+            shard_ring& operator=(const shard_ring&) = delete;
+            shard_ring(shard_ring&& other) noexcept;
+            shard_ring& operator=(shard_ring&& other) noexcept;
+            ~shard_ring();
+
+            /**
+             * Producer only
+             *
+             * @param event: event to copy into the ring
+             * @return: false if the ring is full
+             */
+            bool try_push(const shard_event& event);
+
+            /**
+             * Consumer only
+             *
+             * @return: oldest event, in place in the ring, or nullptr if the
+             *          ring is empty
+             */
+            const shard_event* front() const;
+
+            /**
+             * Consumer only. Hand the slot of front() back.
+             */
+            void pop();
+
+            /**
+             * Shard side. Tell the distributor the shard is set up.
+             */
+            void announce_ready();
+
+            /**
+             * Shard side
+             *
+             * @param start: receives the common start tick
+             * @return: false if it isn't published yet
+             */
+            bool start(std::chrono::steady_clock::time_point& start) const;
+
+            /**
+             * Shard side. Hand the report back, the shard must not touch
+             * the ring afterwards.
+             *
+             * @param report: what the shard did
+             */
+            void finish(const shard_report& report);
+
+            /**
+             * Shard side
+             *
+             * @return: how far the distributor has moved the common start
+             *          tick on
+             */
+            std::chrono::nanoseconds shift() const;
+
+            /**
+             * Shard side. Ask for the common start tick to be moved on.
+             *
+             * @param shift: how far from the start tick the shard keeps to
+             *               now, never less than asked for before
+             */
+            void request_shift(std::chrono::nanoseconds shift);
+
+            /**
+             * Shard side. Tell the distributor the shard has stopped at a
+             * hold.
+             *
+             * @param hold: number of the hold
+             */
+            void reach_hold(std::uint32_t hold);
+
+            /**
+             * Shard side. The time base is moved past the hold before it
+             * is released.
+             *
+             * @param hold: number of the hold
+             * @return: true once the distributor has released it
+             */
+            bool is_released(std::uint32_t hold) const;
+
+            /**
+             * Distributor side
+             */
+            bool is_ready() const;
+
+            /**
+             * Distributor side. Publish the common start tick.
+             *
+             * @param start: time of the first event's time base
+             */
+            void set_start(std::chrono::steady_clock::time_point start);
+
+            /**
+             * Distributor side
+             *
+             * @return: how far the shard has asked for the start tick to be
+             *          moved on
+             */
+            std::chrono::nanoseconds requested_shift() const;
+
+            /**
+             * Distributor side. Move the common start tick on.
+             *
+             * @param shift: how far from the start tick every shard keeps to
+             */
+            void set_shift(std::chrono::nanoseconds shift);
+
+            /**
+             * Distributor side
+             *
+             * @return: holds the shard has stopped at
+             */
+            std::uint32_t held() const;
+
+            /**
+             * Distributor side. Let the shard carry on past a hold, after
+             * set_shift() has moved the time base past it.
+             *
+             * @param hold: number of the hold
+             */
+            void release(std::uint32_t hold);
+
+            /**
+             * Distributor side
+             *
+             * @param report: receives the shard's report
+             * @return: false if the shard hasn't finished
+             */
+            bool finished(shard_report& report) const;
+
+            std::size_t capacity() const{return static_cast<std::size_t>(m_mask + 1);}
+            int memory_fd() const{return m_memory_fd;}
+    };
+
+    /**
+     * Splits the step events of one planner between the controllers of a
+     * sharded machine, see machine_config. Every tick becomes one event for
+     * each shard that has something to do in it, stamped with the time of
+     * the tick since the job started, so an executor process per controller
+     * can replay its axes on its own clock.
+     *
+     * The shards must share a time base: the steady clock of one host, as
+     * in the local stand-in of separate processes, or clocks disciplined to
+     * each other, i.e. with PTP, across boards.
+     *
+     * A shard that finds itself behind the time base, because its process
+     * wasn't scheduled in time or the planner starved it, doesn't catch up
+     * in a burst of steps at no rate limit. It moves its own time base on
+     * by its lateness and asks for the same, and the distributor moves
+     * every other shard's on with it whenever it hands out ticks or waits.
+     * The shards dwell for that long where they are and carry on in step.
+     *
+     * A pen swap or a pause can't simply run on the time base, since the
+     * executor holds for as long as the operator or a client takes while
+     * the shards are a ring's worth of events behind it. A pen swap in the
+     * ticks, or hold() once the executor is paused, queues a hold for
+     * every shard instead. The shards stop there, and release() moves the
+     * time base on to the moment they are let go, so they carry on together.
+     * Ticks handed over while holding are the executor standing still and
+     * are dropped.
+     */
+    class shard_distributor{
+        private:
+            /**
+             * Where each planner axis goes
+             */
+            struct axis_route{
+                std::uint32_t shard;
+                std::uint32_t bit;
+            };
+
+            std::vector<shard_ring> m_rings;
+            std::array<axis_route, max_axes> m_routes;
+            std::size_t m_axis_count;
+            std::size_t m_pen_shard;
+            std::uint64_t m_time_us;
+
+            /**
+             * How far the common start tick has been moved on
+             */
+            std::chrono::nanoseconds m_shift;
+
+            /**
+             * Common start tick, and the holds queued so far
+             */
+            std::chrono::steady_clock::time_point m_start;
+            std::uint32_t m_holds;
+            bool m_holding;
+
+            /**
+             * Event being built for each shard, kept so that a tick makes
+             * no allocation
+             */
+            std::vector<shard_event> m_events;
+
+            void push(std::size_t shard, const shard_event& event);
+
+            /**
+             * Move every shard's time base as far on as any shard asked
+             */
+            void relay();
+
+        public:
+            /**
+             * @param machine: machine with its axes assigned to shards
+             * @param capacity: events each ring holds, which is how far the
+             *                  planner can run ahead of a shard
+             */
+            shard_distributor(const machine_config& machine, std::size_t capacity);
+
+            /**
+             * @param shard: index of the shard
+             * @return: ring feeding the shard, for handing to its process
+             */
+            shard_ring& ring(std::size_t shard){return m_rings.at(shard);}
+
+            std::size_t shard_count() const{return m_rings.size();}
+
+            /**
+             * Wait for every shard to be ready, then set the common start
+             * tick a little ahead so every shard is waiting for it
+             *
+             * @param lead: time from now to the start tick, long enough for
+             *              the planner to fill the rings
+             * @param timeout: longest wait for the shards
+             * @throw: runtime_error if a shard isn't ready in time
+             */
+            void start(std::chrono::microseconds lead, std::chrono::milliseconds timeout);
+
+            /**
+             * Hand a tick to the shards, waiting while a ring is full
+             *
+             * @param tick: next event of the executor
+             */
+            void on_tick(const step_tick& tick);
+
+            /**
+             * Stop every shard where the ticks handed over so far end, i.e.
+             * once the executor is paused. A pen swap holds by itself.
+             */
+            void hold();
+
+            /**
+             * @return: true from a hold until it is released
+             */
+            bool is_holding() const{return m_holding;}
+
+            /**
+             * Wait for every shard to stop at the hold, then let them all
+             * carry on a little later. The executor should only resume
+             * once this returns, the pen being swapped or the pause over.
+             *
+             * @param lead: time from now until the shards carry on, long
+             *              enough for the planner to refill the rings
+             * @param timeout: longest wait for the shards to stop
+             * @return: false if a shard didn't stop in time, the hold is
+             *          then still in force
+             */
+            bool release(std::chrono::microseconds lead, std::chrono::milliseconds timeout);
+
+            /**
+             * Tell every shard the job is over
+             */
+            void finish();
+
+            /**
+             * Wait for every shard to report
+             *
+             * @param reports: receives the report of each shard
+             * @param timeout: longest wait
+             * @return: false if a shard didn't report in time
+             */
+            bool wait_finished(std::vector<shard_report>& reports, std::chrono::milliseconds timeout);
+    };
+
+    /**
+     * Run the part of a job a shard_distributor sends to one shard: apply
+     * each event at its time after the common start tick and report back.
+     * Returns once the last event has been applied. An event found late
+     * moves the time base on rather than being caught up, and a hold stops
+     * the shard until the distributor releases it, see shard_distributor.
+     *
+     * @param ring: ring from the distributor
+     * @param steppers: indexable set of pointers to the shard's steppers,
+     *                  in the order of machine_axis::shard_axis
+     * @param axis_count: number of steppers
+     * @param pen: pen actuator with lift() and lower() if the shard drives
+     *             the pen, otherwise nullptr
+     * @return: what the shard did, as also handed back through the ring
+     */
+    template<class Steppers, class Pen>
+    shard_report run_shard(shard_ring& ring, Steppers& steppers, std::size_t axis_count, Pen* pen){
+        shard_report report{};
+        ring.announce_ready();
+        std::chrono::steady_clock::time_point start;
+        while(!ring.start(start)){
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        std::chrono::nanoseconds shift(0);
+        std::uint32_t holds = 0;
+
+        while(true){
+            const shard_event* event = ring.front();
+            if(event == nullptr){
+                // The planner has fallen behind, the events that follow
+                // will count as late
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                continue;
+            }
+            if(event->last){
+                ring.pop();
+                break;
+            }
+            shift = std::max(shift, ring.shift());
+            auto deadline = start + shift + std::chrono::microseconds(event->time_us);
+            // As wait_until(), but yielding while spinning, since the shard
+            // processes of the local stand-in may share a core
+            if(deadline - std::chrono::steady_clock::now() > std::chrono::microseconds(200)){
+                std::this_thread::sleep_until(deadline - std::chrono::microseconds(200));
+            }
+            while(std::chrono::steady_clock::now() < deadline){
+                std::this_thread::yield();
+            }
+            std::chrono::nanoseconds behind = std::chrono::steady_clock::now() - deadline;
+            std::uint64_t late = static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::microseconds>(behind).count());
+            if(late > shard_ring::late_us){
+                // Dwell here for as long as the shard was held up, and have
+                // the others do the same, so the steps keep their spacing
+                shift += behind;
+                ring.request_shift(shift);
+                report.late++;
+            }
+            if(event->hold){
+                // Stopped where the plan stops, until the time base has
+                // been moved past the hold
+                ring.pop();
+                ring.reach_hold(++holds);
+                while(!ring.is_released(holds)){
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                continue;
+            }
+            for(std::uint32_t bits = event->step_bits; bits != 0; bits &= bits - 1){
+                unsigned int axis = static_cast<unsigned int>(__builtin_ctz(bits));
+                steppers[axis]->step(((event->direction_bits >> axis) & 1) ? -1 : 1);
+            }
+            if(pen != nullptr){
+                step_tick tick{0, 0, 0, event->pen};
+                apply_pen_action(tick, *pen);
+            }
+            ring.pop();
+
+            report.events++;
+            if(late > report.worst_late_us){
+                report.worst_late_us = late;
+            }
+        }
+        for(std::size_t axis = 0; axis < axis_count; axis++){
+            report.position[axis] = steppers[axis]->get_current_step();
+        }
+        report.shift_us = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(shift).count());
+        ring.finish(report);
+        return report;
+    }
+}
+
+#endif
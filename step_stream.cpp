@@ -0,0 +1,340 @@
+#include "step_stream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+namespace plotter{
+    namespace{
+        const char stream_magic[4] = {'P', 'L', 'S', 'S'};
+
+        std::uint64_t zigzag(std::int64_t value){
+            return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+        }
+
+        std::int64_t unzigzag(std::uint64_t value){
+            return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+        }
+
+        void put_u64(std::ofstream& out, std::uint64_t value){
+            for(int i = 0; i < 8; i++){
+                out.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        std::uint64_t get_u64(std::ifstream& in){
+            std::uint64_t value = 0;
+            for(int i = 0; i < 8; i++){
+                value |= static_cast<std::uint64_t>(static_cast<unsigned char>(in.get())) << (8 * i);
+            }
+            return value;
+        }
+    }
+
+    void wait_until(std::chrono::steady_clock::time_point deadline){
+        constexpr auto spin_window = std::chrono::microseconds(200);
+        auto now = std::chrono::steady_clock::now();
+        if(deadline - now > spin_window){
+            std::this_thread::sleep_until(deadline - spin_window);
+        }
+        while(std::chrono::steady_clock::now() < deadline){
+        }
+    }
+
+/******************************************************************************/
+/*                                   Writer                                   */
+/******************************************************************************/
+    step_stream_writer::step_stream_writer(const std::string& path,
+            pin_mask initial_mask,
+            pin_mask initial_state)
+        :   m_out(path, std::ios::binary | std::ios::trunc),
+            m_run_period(0),
+            m_run_length(0),
+            m_carried_interval(0),
+            m_finished(false){
+        if(!m_out){
+            throw std::runtime_error("Unable to open step stream for writing: " + path);
+        }
+        m_out.write(stream_magic, sizeof(stream_magic));
+        m_out.put(static_cast<char>(version));
+        put_u64(m_out, initial_mask);
+        put_u64(m_out, initial_state & initial_mask);
+    }
+
+    step_stream_writer::~step_stream_writer(){
+        if(!m_finished){
+            finish();
+        }
+    }
+
+    void step_stream_writer::put_varint(std::uint64_t value){
+        while(value >= 0x80){
+            m_out.put(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        m_out.put(static_cast<char>(value));
+    }
+
+    void step_stream_writer::emit(const step_frame& frame, std::uint32_t previous_interval){
+        std::uint8_t op = literal_op;
+        for(std::size_t i = 0; i < m_dictionary.size(); i++){
+            if(m_dictionary[i] == frame.toggles){
+                op = static_cast<std::uint8_t>(i);
+                break;
+            }
+        }
+        if(frame.interval != previous_interval){
+            op |= interval_flag;
+        }
+
+        m_out.put(static_cast<char>(op));
+        if((op & index_bits) == literal_op){
+            put_varint(frame.toggles);
+            if(m_dictionary.size() < max_dictionary_size){
+                m_dictionary.push_back(frame.toggles);
+            }
+        }
+        if(op & interval_flag){
+            put_varint(zigzag(static_cast<std::int64_t>(frame.interval) - previous_interval));
+        }
+    }
+
+    bool step_stream_writer::matches_period(std::size_t period, std::uint64_t length) const{
+        if(period + length > history_size || period + length > m_frame_count){
+            return false;
+        }
+        for(std::size_t i = 1; i <= length; i++){
+            if(history_at(i) != history_at(i + period)){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void step_stream_writer::flush_run(){
+        if(m_run_period == 0){
+            return;
+        }
+
+        std::uint64_t leftover = m_run_length % m_run_period;
+        std::uint64_t repeated = m_run_length - leftover;
+        if(repeated > 0){
+            m_out.put(static_cast<char>(run_op));
+            put_varint(m_run_period);
+            put_varint(repeated);
+        }
+        for(std::uint64_t i = leftover; i > 0; i--){
+            emit(history_at(i), history_at(i + 1).interval);
+        }
+
+        m_run_period = 0;
+        m_run_length = 0;
+    }
+
+    void step_stream_writer::push(const step_frame& frame){
+        if(m_run_period != 0){
+            if(frame == history_at(m_run_period)){
+                push_history(frame);
+                m_run_length++;
+                return;
+            }
+
+            // Before a full period has been seen the pattern may just be a
+            // longer one that started the same way
+            if(m_run_length < m_run_period){
+                for(std::size_t period = m_run_period + 1; period <= max_period; period++){
+                    if(frame == history_at(period) && matches_period(period, m_run_length)){
+                        m_run_period = period;
+                        push_history(frame);
+                        m_run_length++;
+                        return;
+                    }
+                }
+            }
+            flush_run();
+        }
+
+        std::uint64_t searchable = std::min<std::uint64_t>(max_period, m_frame_count);
+        for(std::size_t period = 1; period <= searchable; period++){
+            if(frame == history_at(period)){
+                m_run_period = period;
+                m_run_length = 1;
+                push_history(frame);
+                return;
+            }
+        }
+
+        emit(frame, m_frame_count > 0 ? history_at(1).interval : 0);
+        push_history(frame);
+    }
+
+    void step_stream_writer::append(const step_frame& frame){
+        if(frame.toggles == 0){
+            m_carried_interval += frame.interval;
+            return;
+        }
+
+        constexpr std::uint64_t max_interval = std::numeric_limits<std::uint32_t>::max();
+        std::uint64_t interval = m_carried_interval + frame.interval;
+        m_carried_interval = 0;
+        while(interval > max_interval){
+            push(step_frame{0, static_cast<std::uint32_t>(max_interval)});
+            interval -= max_interval;
+        }
+        push(step_frame{frame.toggles, static_cast<std::uint32_t>(interval)});
+    }
+
+    void step_stream_writer::finish(){
+        if(m_finished){
+            return;
+        }
+        if(m_carried_interval > 0){
+            // Keep the trailing dwell so that the stream's duration is exact
+            constexpr std::uint64_t max_interval = std::numeric_limits<std::uint32_t>::max();
+            while(m_carried_interval > 0){
+                std::uint64_t interval = std::min(m_carried_interval, max_interval);
+                push(step_frame{0, static_cast<std::uint32_t>(interval)});
+                m_carried_interval -= interval;
+            }
+        }
+        flush_run();
+        m_out.put(static_cast<char>(run_op));
+        put_varint(0);
+        m_out.flush();
+        m_finished = true;
+    }
+
+/******************************************************************************/
+/*                                   Reader                                   */
+/******************************************************************************/
+    step_stream_reader::step_stream_reader(const std::string& path)
+        :   m_in(path, std::ios::binary),
+            m_initial_mask(0),
+            m_initial_state(0),
+            m_run_period(0),
+            m_run_remaining(0),
+            m_ended(false){
+        if(!m_in){
+            throw std::runtime_error("Unable to open step stream for reading: " + path);
+        }
+        char magic[sizeof(stream_magic)];
+        m_in.read(magic, sizeof(magic));
+        if(!m_in || !std::equal(std::begin(magic), std::end(magic), std::begin(stream_magic))){
+            throw std::runtime_error("Not a step stream: " + path);
+        }
+        if(get_byte() != version){
+            throw std::runtime_error("Unsupported step stream version: " + path);
+        }
+        m_initial_mask = get_u64(m_in);
+        m_initial_state = get_u64(m_in);
+    }
+
+    std::uint8_t step_stream_reader::get_byte(){
+        int value = m_in.get();
+        if(value == std::char_traits<char>::eof()){
+            throw std::runtime_error("Truncated step stream");
+        }
+        return static_cast<std::uint8_t>(value);
+    }
+
+    std::uint64_t step_stream_reader::get_varint(){
+        std::uint64_t value = 0;
+        for(unsigned int shift = 0; shift < 64; shift += 7){
+            std::uint8_t byte = get_byte();
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if((byte & 0x80) == 0){
+                return value;
+            }
+        }
+        throw std::runtime_error("Malformed varint in step stream");
+    }
+
+    bool step_stream_reader::next(step_frame& frame){
+        while(m_run_remaining == 0){
+            if(m_ended){
+                return false;
+            }
+
+            std::uint8_t op = get_byte();
+            std::uint8_t index = op & index_bits;
+            if(index == run_op){
+                std::uint64_t period = get_varint();
+                if(period == 0){
+                    m_ended = true;
+                    return false;
+                }
+                if(period > max_period || period > m_frame_count){
+                    throw std::runtime_error("Invalid run period in step stream");
+                }
+                m_run_period = period;
+                m_run_remaining = get_varint();
+                continue;
+            }
+
+            if(index == literal_op){
+                frame.toggles = get_varint();
+                if(m_dictionary.size() < max_dictionary_size){
+                    m_dictionary.push_back(frame.toggles);
+                }
+            }
+            else if(index < m_dictionary.size()){
+                frame.toggles = m_dictionary[index];
+            }
+            else{
+                throw std::runtime_error("Invalid dictionary index in step stream");
+            }
+
+            std::int64_t interval = m_frame_count > 0 ? history_at(1).interval : 0;
+            if(op & interval_flag){
+                interval += unzigzag(get_varint());
+            }
+            frame.interval = static_cast<std::uint32_t>(interval);
+            push_history(frame);
+            return true;
+        }
+
+        frame = history_at(m_run_period);
+        push_history(frame);
+        m_run_remaining--;
+        return true;
+    }
+
+/******************************************************************************/
+/*                            Compiling and Playback                          */
+/******************************************************************************/
+    std::uint64_t compile_step_stream(context& offline_context,
+            const tick_source& tick,
+            const std::string& path){
+        step_stream_writer writer(path, offline_context.written(), offline_context.state());
+
+        std::uint64_t ticks = 0;
+        pin_mask previous = offline_context.state();
+        std::uint32_t interval = 0;
+        while(tick(interval)){
+            pin_mask current = offline_context.state();
+            writer.append(step_frame{previous ^ current, interval});
+            previous = current;
+            ticks++;
+        }
+        writer.finish();
+        return ticks;
+    }
+
+    std::uint64_t play_step_stream(const std::string& path, context& target){
+        step_stream_reader reader(path);
+        target.write_mask(reader.initial_mask(), reader.initial_state());
+
+        auto deadline = std::chrono::steady_clock::now();
+        step_frame frame{};
+        while(reader.next(frame)){
+            deadline += std::chrono::microseconds(frame.interval);
+            wait_until(deadline);
+            if(frame.toggles != 0){
+                target.write_mask(frame.toggles, target.state() ^ frame.toggles);
+            }
+        }
+        return reader.frame_count();
+    }
+}
@@ -0,0 +1,251 @@
+#ifndef STEP_STREAM_HPP
+#define STEP_STREAM_HPP
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "wiringPiContext.hpp"
+
+namespace plotter{
+
+    /**
+     * A single tick of a compiled job: the pins that change on this tick and
+     * how long to wait after the previous tick before changing them
+     */
+    struct step_frame{
+        /**
+         * Pins that toggle on this tick
+         */
+        pin_mask toggles;
+
+        /**
+         * Microseconds between the previous tick and this one
+         */
+        std::uint32_t interval;
+
+        bool operator==(const step_frame& other) const{
+            return toggles == other.toggles && interval == other.interval;
+        }
+        bool operator!=(const step_frame& other) const{
+            return !(*this == other);
+        }
+    };
+
+    /**
+     * Shared state of the step stream encoding. Both the writer and the reader
+     * keep an identical copy of this so that frames can be encoded relative
+     * to what the reader has already decoded.
+     *
+     * File layout:
+     *      "PLSS" | version | initial mask (u64) | initial state (u64) | ops
+     *
+     * Every op starts with a single byte:
+     *      bits 0-5: dictionary index of the toggle mask, 62 for a literal
+     *                mask that follows as a varint and is appended to the
+     *                dictionary, or 63 for a run/end op
+     *      bit 6:    the interval differs from the previous frame and a
+     *                zigzag varint delta follows
+     * A run op is followed by the varint period P and the varint frame count
+     * N, and repeats the frame P frames back N times. A period of zero marks
+     * the end of the stream.
+     */
+    class step_stream_format{
+        public:
+            static constexpr std::uint8_t version = 1;
+            static constexpr std::size_t max_dictionary_size = 62;
+            static constexpr std::uint8_t literal_op = 62;
+            static constexpr std::uint8_t run_op = 63;
+            static constexpr std::uint8_t index_bits = 0x3F;
+            static constexpr std::uint8_t interval_flag = 0x40;
+
+            /**
+             * Longest repeating pattern the encoder searches for, in frames
+             */
+            static constexpr std::size_t max_period = 32;
+
+        protected:
+            static constexpr std::size_t history_size = 64;
+
+            /**
+             * Recently encoded/decoded frames, used by run ops
+             */
+            std::array<step_frame, history_size> m_history{};
+
+            /**
+             * Total number of frames pushed through m_history
+             */
+            std::uint64_t m_frame_count = 0;
+
+            /**
+             * Toggle masks that can be referenced by index
+             */
+            std::vector<pin_mask> m_dictionary;
+
+            void push_history(const step_frame& frame){
+                m_history[m_frame_count % history_size] = frame;
+                m_frame_count++;
+            }
+
+            /**
+             * @param distance: how many frames back to look, 1 is the newest
+             * @return: the frame at the given distance
+             */
+            const step_frame& history_at(std::size_t distance) const{
+                return m_history[(m_frame_count - distance) % history_size];
+            }
+
+        public:
+            /**
+             * @return: number of frames encoded or decoded so far
+             */
+            std::uint64_t frame_count() const{return m_frame_count;}
+    };
+
+    /**
+     * Writes a run-length/delta compressed stream of step frames to a file
+     */
+    class step_stream_writer : public step_stream_format{
+        private:
+            std::ofstream m_out;
+
+            /**
+             * Period of the repeating pattern currently being matched,
+             * zero if no run is pending
+             */
+            std::size_t m_run_period;
+
+            /**
+             * Number of frames matched by the pending run. These are in the
+             * history but have not been written yet.
+             */
+            std::uint64_t m_run_length;
+
+            /**
+             * Time carried over from frames that didn't toggle any pins
+             */
+            std::uint64_t m_carried_interval;
+
+            bool m_finished;
+
+            void put_varint(std::uint64_t value);
+            void emit(const step_frame& frame, std::uint32_t previous_interval);
+            void flush_run();
+            bool matches_period(std::size_t period, std::uint64_t length) const;
+            void push(const step_frame& frame);
+
+        public:
+            /**
+             * Open a new stream
+             *
+             * @param path: file to write to
+             * @param initial_mask: pins that must be set before playback
+             * @param initial_state: values of those pins
+             */
+            step_stream_writer(const std::string& path,
+                    pin_mask initial_mask,
+                    pin_mask initial_state);
+            ~step_stream_writer();
+
+            step_stream_writer(const step_stream_writer&) = delete;
+            step_stream_writer& operator=(const step_stream_writer&) = delete;
+
+            /**
+             * Append a frame. Frames that don't toggle any pins are folded
+             * into the interval of the next frame.
+             *
+             * @param frame: frame to append
+             */
+            void append(const step_frame& frame);
+
+            /**
+             * Flush any pending run and write the end of the stream
+             */
+            void finish();
+    };
+
+    /**
+     * Reads a stream written by step_stream_writer back one frame at a time
+     */
+    class step_stream_reader : public step_stream_format{
+        private:
+            std::ifstream m_in;
+            pin_mask m_initial_mask;
+            pin_mask m_initial_state;
+            std::size_t m_run_period;
+            std::uint64_t m_run_remaining;
+            bool m_ended;
+
+            std::uint8_t get_byte();
+            std::uint64_t get_varint();
+
+        public:
+            /**
+             * Open an existing stream
+             *
+             * @param path: file to read from
+             */
+            explicit step_stream_reader(const std::string& path);
+
+            /**
+             * @return: pins that must be set before playback starts
+             */
+            pin_mask initial_mask() const{return m_initial_mask;}
+
+            /**
+             * @return: values of the initial pins
+             */
+            pin_mask initial_state() const{return m_initial_state;}
+
+            /**
+             * Decode the next frame
+             *
+             * @param frame: receives the decoded frame
+             * @return: false once the end of the stream is reached
+             */
+            bool next(step_frame& frame);
+    };
+
+    /**
+     * Advances a job by one tick. Sets the interval in microseconds since
+     * the previous tick and returns false once the job is complete.
+     */
+    using tick_source = std::function<bool(std::uint32_t& interval)>;
+
+    /**
+     * Run a job to completion against an offline context and record the pin
+     * changes of every tick into a step stream file
+     *
+     * @param offline_context: context the job writes its pins through
+     * @param tick: advances the job by a tick
+     * @param path: file to write the stream to
+     * @return: number of ticks compiled
+     */
+    std::uint64_t compile_step_stream(context& offline_context,
+            const tick_source& tick,
+            const std::string& path);
+
+    /**
+     * Sleep until shortly before the deadline and spin the rest of the
+     * way, since the scheduler can't wake us with microsecond accuracy
+     *
+     * @param deadline: time to return at
+     */
+    void wait_until(std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * Play a compiled step stream through the given context in real time
+     *
+     * @param path: step stream to play
+     * @param target: context to write the pins through
+     * @return: number of frames played
+     */
+    std::uint64_t play_step_stream(const std::string& path, context& target);
+}
+
+#endif
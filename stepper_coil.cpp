@@ -1,75 +1,87 @@
+#include <utility>
 #include <vector>
 #include "stepper_coil.hpp"
 
 namespace plotter{
-/******************************************************************************/
-/*                          Private Member Functions                          */
-/******************************************************************************/
-    const stepper_coil::coil_state& stepper_coil::get_current_state() const{
-        return m_coil_states.at(m_state_index);
-    }
-
-
-    void stepper_coil::apply_state(const coil_state& state){
-        for(unsigned long i = 0; i < state.size(); i++){
-            m_wiring_pi_context->write(m_coil_pins.at(i), state.at(i));
-        }
-    }
-
-
-    bool stepper_coil::is_state_index_valid(unsigned int index){
-        return (index < m_coil_states.size());
-    }
-
-
 /******************************************************************************/
 /*                               Public Interface                             */
 /******************************************************************************/
     stepper_coil::stepper_coil(
             std::shared_ptr<plotter::context>& wiring_pi_context,
-            std::vector<plotter::pin> pins,
-            std::vector<coil_state> states,
+            const std::vector<plotter::pin>& pins,
+            const std::vector<coil_state>& states,
+            unsigned int starting_index) :m_wiring_pi_context(wiring_pi_context),
+    m_outputs(),
+    m_driver(make_driver(context_backend(*wiring_pi_context),
+            runtime_sequence(pins, states),
+            starting_index)){}
+
+    stepper_coil::stepper_coil(
+            std::shared_ptr<plotter::context>& wiring_pi_context,
+            const runtime_sequence& sequence,
             unsigned int starting_index) :m_wiring_pi_context(wiring_pi_context),
-    m_coil_pins(pins),
-    m_coil_states(states),
-    m_state_index(starting_index){}
+    m_outputs(),
+    m_driver(make_driver(context_backend(*wiring_pi_context),
+            sequence,
+            starting_index)){}
+
+    stepper_coil::stepper_coil(
+            std::shared_ptr<gpio_outputs> outputs,
+            const runtime_sequence& sequence,
+            unsigned int starting_index) :m_wiring_pi_context(),
+    m_outputs(std::move(outputs)),
+    m_driver(m_outputs->visit_backend(sequence.pins(), [&](auto backend){
+                return make_driver(backend, sequence, starting_index);
+            })){}
+
+    stepper_coil::stepper_coil(
+            std::shared_ptr<gpio_outputs> outputs,
+            const runtime_sequence& sequence,
+            const step_mode_profile& profile,
+            unsigned int starting_index) :m_wiring_pi_context(),
+    m_outputs(std::move(outputs)),
+    m_driver(m_outputs->visit_backend(sequence.pins(), [&](auto backend){
+                return make_adaptive_driver(backend, sequence, profile, starting_index);
+            })){}
 
 
     void stepper_coil::enable(){
-        apply_state(get_current_state());
+        m_driver->enable();
     }
 
 
     void stepper_coil::disable(){
-        const coil_state& current_state = get_current_state();
-        coil_state zero_state{current_state.size(), false};
-        apply_state(zero_state);
+        m_driver->disable();
     }
 
 
     void stepper_coil::forward(){
-        m_state_index++;
-        if(!is_state_index_valid(m_state_index)){
-            m_state_index = 0;
-        }
-        enable();
+        m_driver->forward();
     }
 
 
     void stepper_coil::backward(){
-        m_state_index--;
-        if(!is_state_index_valid(m_state_index)){
-            m_state_index = m_coil_states.size()-1;
-        }
-        enable();
+        m_driver->backward();
     }
 
 
     void stepper_coil::set_state(unsigned int new_state_index){
-        if(is_state_index_valid(new_state_index)){
-                m_state_index = new_state_index;
-                enable();
-        }
+        m_driver->set_state(new_state_index);
+    }
+
+
+    void stepper_coil::set_step_rate(std::uint32_t steps_per_second){
+        m_driver->set_step_rate(steps_per_second);
+    }
+
+
+    unsigned int stepper_coil::state_index() const{
+        return m_driver->state_index();
+    }
+
+
+    step_mode stepper_coil::mode() const{
+        return m_driver->mode();
     }
 
 }
@@ -2,11 +2,16 @@
 #ifndef STEPPER_COIL_HPP
 #define STEPPER_COIL_HPP
 
+#include <cstdint>
 #include <vector>
 #include <memory>
 
 #include "wiringPiContext.hpp"
 #include "units.hpp"
+#include "coil_sequence.hpp"
+#include "gpio_backend.hpp"
+#include "basic_stepper.hpp"
+#include "steppers/stepper.hpp"
 
 namespace plotter{
 
@@ -14,6 +19,14 @@ namespace plotter{
      * Represents the configuration and state of a set of stepper coils.
      * This allows the separation of the soft concept of a stepper and the
      * hardware itself.
+     *
+     * This is the runtime configured adapter over basic_stepper_coil, for
+     * coils whose pins and states aren't known until run time. The coil
+     * behind it is chosen once, when it is built: sequences of the lengths
+     * shipped with the stepper library get a fixed-size table through
+     * visit_sequence, anything else keeps the runtime_sequence. An
+     * adaptive coil half steps its sequence when slow and full steps it
+     * when fast, see adaptive_stepper_coil.
      */
     struct stepper_coil{
         //Types
@@ -26,62 +39,112 @@ namespace plotter{
              */
             using coil_state = std::vector<plotter::bool_t>;
 
-        //Member Variables
-        private:
             /**
-             * Valid context to the wiring pi library. This also allows for
-             * a default library interface for simulation or adapting to an
-             * alternative library
+             * Coil implementation this adapter forwards to
              */
-            std::shared_ptr<plotter::context> m_wiring_pi_context;
+            class driver{
+                public:
+                    virtual ~driver() = default;
+                    virtual void enable() = 0;
+                    virtual void disable() = 0;
+                    virtual void forward() = 0;
+                    virtual void backward() = 0;
+                    virtual void set_state(unsigned int new_state_index) = 0;
+                    virtual void set_step_rate(std::uint32_t steps_per_second) = 0;
+                    virtual unsigned int state_index() const = 0;
+                    virtual step_mode mode() const = 0;
+            };
 
             /**
-             * A vector with the same size as the number of coils this 
-             * configuration represents that maps the coil to a specific GPIO
-             * pin.
+             * Driver over a coil of any backend and sequence
+             *
+             * @param Coil: a basic_stepper_coil or adaptive_stepper_coil
              */
-            std::vector<plotter::pin> m_coil_pins;
+            template<class Coil>
+            class coil_driver : public driver{
+                private:
+                    Coil m_coil;
+
+                    template<class C>
+                    static auto mode_of(const C& coil, int) -> decltype(coil.mode()){return coil.mode();}
+
+                    template<class C>
+                    static step_mode mode_of(const C&, long){return step_mode::half;}
+
+                public:
+                    explicit coil_driver(Coil coil) :m_coil(std::move(coil)){}
+
+                    void enable() override{m_coil.enable();}
+                    void disable() override{m_coil.disable();}
+                    void forward() override{m_coil.forward();}
+                    void backward() override{m_coil.backward();}
+                    void set_state(unsigned int new_state_index) override{m_coil.set_state(new_state_index);}
+                    void set_step_rate(std::uint32_t steps_per_second) override{
+                        detail::forward_step_rate(m_coil, steps_per_second, 0);
+                    }
+                    unsigned int state_index() const override{
+                        return static_cast<unsigned int>(m_coil.state_index());
+                    }
+                    step_mode mode() const override{return mode_of(m_coil, 0);}
+            };
 
             /**
-             * The sequential states that the coils, as a set, can have. 
-             * This will be stepped through as the stepper_coil is instructed
-             * to step forward and backward.
+             * Build the driver for a sequence, with a fixed-size table if
+             * visit_sequence has one for its length
+             *
+             * @param backend: writes the coil pins
+             * @param sequence: packed states and the pins they drive
+             * @param starting_index: state to initialize the coil to
+             * @return: driver
              */
-            std::vector<coil_state> m_coil_states;
+            template<class Backend>
+            static std::unique_ptr<driver> make_driver(Backend backend, const runtime_sequence& sequence,
+                    unsigned int starting_index){
+                return visit_sequence(sequence, [&](auto packed) -> std::unique_ptr<driver>{
+                    using coil = basic_stepper_coil<Backend, decltype(packed)>;
+                    return std::make_unique<coil_driver<coil>>(coil(backend, std::move(packed), starting_index));
+                });
+            }
 
             /**
-             * The index of the current state that this stepper_coil is at
-             * that reflects the state of the coils it governs as defined
-             * by m_coil_pins
+             * Build the driver of an adaptive coil for a half-step sequence
+             *
+             * @param backend: writes the coil pins
+             * @param sequence: packed half-step states and the pins they drive
+             * @param profile: step rates at which the coil changes mode
+             * @param starting_index: state to initialize the coil to
+             * @return: driver
+             * @throw: invalid_argument if the sequence has an odd number of
+             *         states
              */
-            unsigned int m_state_index;
+            template<class Backend>
+            static std::unique_ptr<driver> make_adaptive_driver(Backend backend, const runtime_sequence& sequence,
+                    const step_mode_profile& profile, unsigned int starting_index){
+                return visit_sequence(sequence, [&](auto packed) -> std::unique_ptr<driver>{
+                    using coil = adaptive_stepper_coil<Backend, decltype(packed)>;
+                    return std::make_unique<coil_driver<coil>>(coil(backend, std::move(packed), profile, starting_index));
+                });
+            }
 
-        //Private Member Functions
+        //Member Variables
         private:
-
             /**
-             * Retrieve the current coil state of this stepper_coil 
-             *
-             * @return: current coil state of these stepper coils
+             * Valid context to the wiring pi library. This also allows for
+             * a default library interface for simulation or adapting to an
+             * alternative library. Only held to keep the context alive, the
+             * driver writes through a plain pointer.
              */
-            const coil_state& get_current_state() const;
+            std::shared_ptr<plotter::context> m_wiring_pi_context;
 
             /**
-             * Apply the given state to the hardware that this stepper_coil 
-             * is connected to via the wiring_pi context
-             *
-             * @param state: coil state to apply to the hardware coils
+             * Outputs the driver writes through, held alive like the context
              */
-            void apply_state(const coil_state& state);
+            std::shared_ptr<gpio_outputs> m_outputs;
 
             /**
-             * Checks if the current index is a valid index into the set of 
-             * coil states
-             *
-             * @param index: index to check
-             * @return: true if the index is valid, false otherwise.
+             * Packed coil states and the index of the current state
              */
-            bool is_state_index_valid(unsigned int index);
+            std::unique_ptr<driver> m_driver;
 
         //Public Interface
         public:
@@ -99,8 +162,54 @@ namespace plotter{
              */
             stepper_coil(
                     std::shared_ptr<plotter::context>& wiring_pi_context,
-                    std::vector<plotter::pin> pins,
-                    std::vector<coil_state> states,
+                    const std::vector<plotter::pin>& pins,
+                    const std::vector<coil_state>& states,
+                    unsigned int starting_index=0);
+
+            /**
+             * Initialize stepper_coil with states already packed into pin
+             * levels, as a machine description compiles them
+             *
+             * @param wiring_pi_context: hardware interface
+             * @param sequence: packed states and the pins they drive
+             * @param starting_index: Optional index to initialize the stepper
+             *                        to
+             */
+            stepper_coil(
+                    std::shared_ptr<plotter::context>& wiring_pi_context,
+                    const runtime_sequence& sequence,
+                    unsigned int starting_index=0);
+
+            /**
+             * Initialize stepper_coil on outputs chosen by a machine
+             * description, writing through the backend they select
+             *
+             * @param outputs: output pins of the controller
+             * @param sequence: packed states and the pins they drive
+             * @param starting_index: Optional index to initialize the stepper
+             *                        to
+             */
+            stepper_coil(
+                    std::shared_ptr<gpio_outputs> outputs,
+                    const runtime_sequence& sequence,
+                    unsigned int starting_index=0);
+
+            /**
+             * Initialize an adaptive stepper_coil on outputs chosen by a
+             * machine description. Steps count as half steps in either mode.
+             *
+             * @param outputs: output pins of the controller
+             * @param sequence: packed half-step states and the pins they drive
+             * @param profile: step rates at which the coil changes mode
+             * @param starting_index: Optional index to initialize the stepper
+             *                        to
+             * @throw: invalid_argument if the sequence has an odd number of
+             *         states
+             */
+            stepper_coil(
+                    std::shared_ptr<gpio_outputs> outputs,
+                    const runtime_sequence& sequence,
+                    const step_mode_profile& profile,
                     unsigned int starting_index=0);
 
             /**
@@ -132,6 +241,25 @@ namespace plotter{
              * @param new_state_index: state to set the coils to
              */
             void set_state(unsigned int new_state_index);
+
+            /**
+             * Tell an adaptive coil how fast it is being stepped, ignored by
+             * any other
+             *
+             * @param steps_per_second: current planned step rate
+             */
+            void set_step_rate(std::uint32_t steps_per_second);
+
+            /**
+             * @return: index of the current coil state
+             */
+            unsigned int state_index() const;
+
+            /**
+             * @return: mode an adaptive coil is stepping in, half for any
+             *          other coil
+             */
+            step_mode mode() const;
     };
 }
 
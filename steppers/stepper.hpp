@@ -1,15 +1,23 @@
-#ifndef STEPPER_HPP
-#define STEPPER_HPP
+#ifndef STEPPERS_STEPPER_HPP
+#define STEPPERS_STEPPER_HPP
 
 /**
  *  Stepper motor library for interfacing between software and a physical motor
+ *
+ *  Motor sequences are declared here as compile-time tables and packed for a
+ *  set of pins with plotter::make_fixed_sequence. Sequences loaded at run
+ *  time use plotter::runtime_sequence. Both drive the same engine,
+ *  plotter::basic_stepper, which provides targets, teleport, homing and
+ *  stepping. plotter::adaptive_stepper walks bipolar_high_res_motor and
+ *  switches to bipolar_high_torgue_motor when driven fast.
  */
 
-#include "../wiringPiContext.hpp"
-
-#include "../i_wiringPi.hpp"
-#include "../cyclic_iterator/cyclic_iterator.hpp"
+#include "../coil_sequence.hpp"
+#include "../basic_stepper.hpp"
+#include "../adaptive_coil.hpp"
 #include <array>
+#include <cstddef>
+#include <utility>
 
 template <int PinCount>
 using motor_state = std::array<int, PinCount>;
@@ -17,7 +25,7 @@ using motor_state = std::array<int, PinCount>;
 template <int StateCount, int PinCount>
 using motor_sequence = std::array<motor_state<PinCount>, StateCount>;
 
-const motor_sequence<4,4> bipolar_average_motor
+constexpr motor_sequence<4,4> bipolar_average_motor
 {{
     motor_state<4>{{1,0,0,0}},
     motor_state<4>{{0,1,0,0}},
@@ -25,7 +33,7 @@ const motor_sequence<4,4> bipolar_average_motor
     motor_state<4>{{0,0,0,1}}
  }};
 
-const motor_sequence<4,4> bipolar_high_torgue_motor
+constexpr motor_sequence<4,4> bipolar_high_torgue_motor
 {{
     motor_state<4>{{1,1,0,0}},
     motor_state<4>{{0,1,1,0}},
@@ -33,7 +41,7 @@ const motor_sequence<4,4> bipolar_high_torgue_motor
     motor_state<4>{{1,0,0,1}}
  }};
 
-const motor_sequence<8,4> bipolar_high_res_motor
+constexpr motor_sequence<8,4> bipolar_high_res_motor
 {{
     motor_state<4>{{1,0,0,0}},
     motor_state<4>{{1,1,0,0}},
@@ -45,72 +53,88 @@ const motor_sequence<8,4> bipolar_high_res_motor
     motor_state<4>{{1,0,0,1}}
  }};
 
-class sequence_interface
-{
-    public:
-        /** Default virtual destructor for proper memory management */
-        virtual ~sequence_interface()=default;
-
-        /**
-         * Get the value of the current step this stepper is on
-         *
-         * @return value of the current step
-         */
-        virtual int get_current_step() = 0;
-        /**
-         * Override the current step value, this effectively "relocates" the
-         * stepper motor without actually moving it.
-         *
-         * @param new_value new position of the stepper motor
-         */
-        virtual void set_current_step(int new_value) = 0;
-
-        /**
-         * Get the target step that this stepper is trying to get to.
-         * Can be positive or negative
-         *
-         * @return value of the current target step
-         */
-        virtual int get_target_step() = 0;
-        /**
-         * Set the current target of this stepper motor. Every time it is
-         * stepped it will move the current_step toward this value;
-         */
-        virtual void set_target_step(int new_value) = 0;
-
-        virtual int get_target_step_difference(){
-            return get_target_step() - get_current_step();
+/**
+ * The full-step table must be the odd states of the half-step table for an
+ * adaptive coil to switch between them without losing its phase
+ */
+constexpr bool is_full_step_of(const motor_sequence<4,4>& full, const motor_sequence<8,4>& half){
+    for(std::size_t i = 0; i < full.size(); i++){
+        for(std::size_t coil = 0; coil < full[i].size(); coil++){
+            if(full[i][coil] != half[2 * i + 1][coil]){
+                return false;
+            }
         }
-
-        virtual void step() = 0;
-};
-
-template <int StateCount, int PinCount>
-class sequence_instance : public sequence_interface
-{
-    using motor_iterator = cyclic_iterator<motor_sequence<StateCount,PinCount>>;
-    private:
-        int m_current_step;
-        int m_target_step;
-        const motor_sequence<StateCount, PinCount> m_sequence;
-        motor_iterator m_current_sequence;
-
-    public:
-        sequence_instance() = delete;
-        sequence_instance(const motor_sequence<StateCount,PinCount> sequence)
-            : m_current_step(0), m_sequence(sequence), 
-            m_current_sequence(make_cyclic_iterator(std::begin(m_sequence), std::end(m_sequence))){}
-
-        sequence_instance(motor_sequence<StateCount,PinCount>&& sequence)
-            : m_current_step(0), m_sequence(sequence),m_current_sequence(
-                    make_cyclic_iterator(std::begin(m_sequence), std::end(m_sequence)))
-        {}
-
-        //sequence_interface implementation
-        virtual int get_current_step() override;
-        virtual void set_current_step(int new_step) override;
-        virtual int get_target_step() override;
-        virtual void set_target_step(int new_target_step) override;
-        virtual void step() override;
-};
+    }
+    return true;
+}
+static_assert(is_full_step_of(bipolar_high_torgue_motor, bipolar_high_res_motor),
+        "Full-step table is out of phase with the half-step table");
+
+namespace plotter{
+
+    /**
+     * Stepper with a sequence length fixed at compile time
+     *
+     * @param Backend: policy used to write the coil pins
+     * @param StateCount: number of states in the motor sequence
+     */
+    template<class Backend, std::size_t StateCount>
+    using sequence_stepper = static_stepper<Backend, fixed_sequence<StateCount>>;
+
+    /**
+     * Stepper with a sequence loaded at run time
+     *
+     * @param Backend: policy used to write the coil pins
+     */
+    template<class Backend>
+    using runtime_stepper = static_stepper<Backend, runtime_sequence>;
+
+    /**
+     * Stepper that half steps when slow and full steps when fast. Positions
+     * are counted in half steps.
+     *
+     * @param Backend: policy used to write the coil pins
+     */
+    template<class Backend>
+    using adaptive_stepper = basic_stepper<adaptive_stepper_coil<Backend, fixed_sequence<8>>>;
+
+    /**
+     * Copy a runtime sequence into a fixed-size table
+     *
+     * @param sequence: sequence with exactly StateCount states
+     * @return: packed fixed-size sequence
+     */
+    template<std::size_t StateCount>
+    fixed_sequence<StateCount> to_fixed_sequence(const runtime_sequence& sequence){
+        std::array<pin_mask, StateCount> states{};
+        for(std::size_t i = 0; i < StateCount; i++){
+            states[i] = sequence[i];
+        }
+        return fixed_sequence<StateCount>(states, sequence.pins());
+    }
+
+    /**
+     * Call the visitor with the fastest representation of a sequence that
+     * was loaded at run time. The lengths of the tables shipped with this
+     * library get a fixed_sequence, anything else falls back to the
+     * runtime_sequence. Intended to be called once at setup so that the
+     * stepping code is instantiated for the fixed-size table.
+     *
+     * @param sequence: sequence loaded at run time
+     * @param visitor: callable taking either sequence type and returning
+     *                 the same type for each
+     * @return: result of the visitor
+     */
+    template<class Visitor>
+    decltype(auto) visit_sequence(const runtime_sequence& sequence, Visitor&& visitor){
+        switch(sequence.size()){
+            case 4:
+                return std::forward<Visitor>(visitor)(to_fixed_sequence<4>(sequence));
+            case 8:
+                return std::forward<Visitor>(visitor)(to_fixed_sequence<8>(sequence));
+            default:
+                return std::forward<Visitor>(visitor)(sequence);
+        }
+    }
+}
 #endif
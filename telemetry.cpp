@@ -0,0 +1,225 @@
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "local_socket.hpp"
+
+namespace plotter{
+
+/******************************************************************************/
+/*                                   Channel                                  */
+/******************************************************************************/
+    telemetry_channel::telemetry_channel()
+        :   m_sequence(0),
+            m_words(){
+        for(auto& word : m_words){
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void telemetry_channel::publish(const telemetry_snapshot& snapshot){
+        std::array<std::uint64_t, word_count> words;
+        std::memcpy(words.data(), &snapshot, sizeof(snapshot));
+
+        std::uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(std::size_t i = 0; i < word_count; i++){
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        }
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    bool telemetry_channel::try_read(telemetry_snapshot& snapshot) const{
+        std::uint64_t before = m_sequence.load(std::memory_order_acquire);
+        if(before & 1){
+            return false;
+        }
+        std::array<std::uint64_t, word_count> words;
+        for(std::size_t i = 0; i < word_count; i++){
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(m_sequence.load(std::memory_order_relaxed) != before){
+            return false;
+        }
+        std::memcpy(&snapshot, words.data(), sizeof(snapshot));
+        return true;
+    }
+
+    telemetry_snapshot telemetry_channel::read() const{
+        telemetry_snapshot snapshot;
+        while(!try_read(snapshot)){
+            std::this_thread::yield();
+        }
+        return snapshot;
+    }
+
+/******************************************************************************/
+/*                                  Publisher                                 */
+/******************************************************************************/
+    telemetry_publisher::telemetry_publisher(telemetry_channel& channel, std::uint32_t every_ticks)
+        :   m_channel(channel),
+            m_interval(std::max<std::uint32_t>(1, every_ticks)),
+            m_countdown(m_interval),
+            m_time(0),
+            m_ticks(0),
+            m_direction_bits(0),
+            m_pen_down(false){}
+
+    void telemetry_publisher::publish(const motion_executor& executor, std::size_t buffer_depth){
+        m_countdown = m_interval;
+
+        telemetry_snapshot snapshot{};
+        snapshot.time_us = m_time;
+        snapshot.ticks = m_ticks;
+        bool idle = executor.is_idle();
+        for(std::size_t axis = 0; axis < max_axes; axis++){
+            snapshot.position[axis] = executor.position()[axis];
+            std::int32_t rate = idle ? 0 : static_cast<std::int32_t>(executor.axis_rate(axis));
+            snapshot.velocity[axis] = ((m_direction_bits >> axis) & 1) ? -rate : rate;
+        }
+        snapshot.buffer_depth = static_cast<std::uint32_t>(buffer_depth);
+        snapshot.line = executor.line();
+        snapshot.flags = (idle ? telemetry_snapshot::idle : 0)
+            | (executor.is_paused() ? telemetry_snapshot::paused : 0)
+            | (executor.is_halted() ? telemetry_snapshot::halted : 0)
+            | (m_pen_down ? telemetry_snapshot::pen_down : 0)
+            | (executor.is_swapping() ? telemetry_snapshot::tool_change : 0)
+            | static_cast<std::uint32_t>(executor.tool()) << telemetry_snapshot::tool_shift;
+        snapshot.feed_override = executor.feed_override();
+        m_channel.publish(snapshot);
+    }
+
+/******************************************************************************/
+/*                                   Server                                   */
+/******************************************************************************/
+    telemetry_server::telemetry_server(const telemetry_channel& channel,
+            const std::string& socket_path,
+            std::uint32_t rate_hz)
+        :   m_channel(channel),
+            m_path(socket_path),
+            m_period_ms(1000 / std::max<std::uint32_t>(1, std::min<std::uint32_t>(rate_hz, 1000))),
+            m_listen_fd(-1),
+            m_wake_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+            m_stopping(false),
+            m_clients(),
+            m_thread(){
+        if(m_wake_fd < 0){
+            throw std::system_error(errno, std::generic_category(), "Unable to create telemetry server");
+        }
+        try{
+            m_listen_fd = listen_local(socket_path, SOCK_SEQPACKET);
+        }
+        catch(...){
+            ::close(m_wake_fd);
+            throw;
+        }
+    }
+
+    telemetry_server::~telemetry_server(){
+        stop();
+        for(int client : m_clients){
+            ::close(client);
+        }
+        ::close(m_listen_fd);
+        ::close(m_wake_fd);
+        ::unlink(m_path.c_str());
+    }
+
+    void telemetry_server::start(){
+        if(!m_thread.joinable()){
+            m_stopping.store(false, std::memory_order_relaxed);
+            m_thread = std::thread(&telemetry_server::run, this);
+        }
+    }
+
+    void telemetry_server::stop(){
+        if(m_thread.joinable()){
+            // The thread polls at least once a period, so it sees the flag
+            // even if the wake write fails. Skipping the join would destroy
+            // a joinable thread.
+            m_stopping.store(true, std::memory_order_release);
+            std::uint64_t wake = 1;
+            (void)::write(m_wake_fd, &wake, sizeof(wake));
+            m_thread.join();
+            while(::read(m_wake_fd, &wake, sizeof(wake)) > 0){
+            }
+        }
+    }
+
+    void telemetry_server::broadcast(const telemetry_snapshot& snapshot){
+        auto write_snapshot = [&snapshot](int client){
+            if(::send(client, &snapshot, sizeof(snapshot), MSG_DONTWAIT | MSG_NOSIGNAL) >= 0
+                    || errno == EAGAIN || errno == EWOULDBLOCK){
+                return false;
+            }
+            ::close(client);
+            return true;
+        };
+        m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(), write_snapshot), m_clients.end());
+    }
+
+    void telemetry_server::run(){
+        auto period = std::chrono::milliseconds(m_period_ms);
+        auto deadline = std::chrono::steady_clock::now() + period;
+        for(;;){
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+            pollfd fds[2] = {{m_wake_fd, POLLIN, 0}, {m_listen_fd, POLLIN, 0}};
+            int count = ::poll(fds, 2, static_cast<int>(std::max<long long>(0, remaining)));
+            if(count < 0 && errno != EINTR){
+                return;
+            }
+            if((fds[0].revents & POLLIN) || m_stopping.load(std::memory_order_acquire)){
+                return;
+            }
+            if(fds[1].revents & POLLIN){
+                int client;
+                while((client = ::accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0){
+                    m_clients.push_back(client);
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if(now >= deadline){
+                broadcast(m_channel.read());
+                // Skip missed periods rather than sending a burst
+                deadline += period * ((now - deadline) / period + 1);
+            }
+        }
+    }
+
+/******************************************************************************/
+/*                                   Client                                   */
+/******************************************************************************/
+    telemetry_client::telemetry_client(const std::string& socket_path)
+        :   m_fd(connect_local(socket_path, SOCK_SEQPACKET)){}
+
+    telemetry_client::~telemetry_client(){
+        ::close(m_fd);
+    }
+
+    bool telemetry_client::next(telemetry_snapshot& snapshot){
+        while(true){
+            ssize_t received = ::recv(m_fd, &snapshot, sizeof(snapshot), 0);
+            if(received == static_cast<ssize_t>(sizeof(snapshot))){
+                return true;
+            }
+            if(received < 0 && errno == EINTR){
+                continue;
+            }
+            return false;
+        }
+    }
+}
@@ -0,0 +1,254 @@
+#ifndef TELEMETRY_HPP
+#define TELEMETRY_HPP
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "motion.hpp"
+
+namespace plotter{
+
+    /**
+     * State of the machine at one moment of a job
+     */
+    struct telemetry_snapshot{
+        /**
+         * Bits of flags
+         */
+        static constexpr std::uint32_t idle = 1;
+        static constexpr std::uint32_t paused = 2;
+        static constexpr std::uint32_t halted = 4;
+        static constexpr std::uint32_t pen_down = 8;
+        static constexpr std::uint32_t tool_change = 16;
+
+        /**
+         * The pen fitted, or asked for while tool_change is set, is in the
+         * flags above this bit
+         */
+        static constexpr unsigned int tool_shift = 16;
+
+        /**
+         * Microseconds of motion executed and step events produced
+         */
+        std::uint64_t time_us;
+        std::uint64_t ticks;
+
+        /**
+         * Steps executed on each axis
+         */
+        std::array<std::int64_t, max_axes> position;
+
+        /**
+         * Steps per second of each axis, negative toward negative
+         */
+        std::array<std::int32_t, max_axes> velocity;
+
+        /**
+         * Blocks waiting in the planner
+         */
+        std::uint32_t buffer_depth;
+
+        /**
+         * Tag of the block in progress, see motion_planner::set_line()
+         */
+        std::uint32_t line;
+
+        std::uint32_t flags;
+        std::uint32_t feed_override;
+    };
+
+    /**
+     * Latest telemetry snapshot, written by one thread and read by any
+     * number of others through a seqlock. The writer never waits: it makes
+     * the sequence odd, stores the snapshot and makes the sequence even
+     * again. A reader retries if the sequence was odd or changed while it
+     * copied. The snapshot is held as relaxed atomic words so the racing
+     * copies stay well defined.
+     */
+    class telemetry_channel{
+        private:
+            static constexpr std::size_t word_count = sizeof(telemetry_snapshot) / sizeof(std::uint64_t);
+            static_assert(sizeof(telemetry_snapshot) % sizeof(std::uint64_t) == 0,
+                    "Telemetry snapshot must be a whole number of words");
+
+            std::atomic<std::uint64_t> m_sequence;
+            std::array<std::atomic<std::uint64_t>, word_count> m_words;
+
+        public:
+            telemetry_channel();
+
+            telemetry_channel(const telemetry_channel&) = delete;
+            telemetry_channel& operator=(const telemetry_channel&) = delete;
+
+            /**
+             * Replace the snapshot. Only one thread may publish.
+             *
+             * @param snapshot: new state
+             */
+            void publish(const telemetry_snapshot& snapshot);
+
+            /**
+             * Copy the snapshot if no publish is in progress
+             *
+             * @param snapshot: receives the state
+             * @return: false if a publish interfered, try again
+             */
+            bool try_read(telemetry_snapshot& snapshot) const;
+
+            /**
+             * @return: a consistent copy of the snapshot
+             */
+            telemetry_snapshot read() const;
+
+            /**
+             * @return: changes every time a snapshot is published
+             */
+            std::uint64_t sequence() const{return m_sequence.load(std::memory_order_acquire);}
+    };
+
+    /**
+     * Fills the telemetry channel from the real-time loop. on_tick() only
+     * counts down until the next snapshot is due, and the snapshot itself is
+     * built from the executor's plain accessors, so nothing blocks or
+     * allocates.
+     */
+    class telemetry_publisher{
+        private:
+            telemetry_channel& m_channel;
+            std::uint32_t m_interval;
+            std::uint32_t m_countdown;
+            std::uint64_t m_time;
+            std::uint64_t m_ticks;
+
+            /**
+             * Direction of the last step of each axis and the pen state,
+             * followed from the ticks
+             */
+            std::uint32_t m_direction_bits;
+            bool m_pen_down;
+
+        public:
+            /**
+             * @param channel: channel to publish to
+             * @param every_ticks: step events between snapshots
+             */
+            telemetry_publisher(telemetry_channel& channel, std::uint32_t every_ticks=64);
+
+            /**
+             * Account for a tick the executor produced, publishing when a
+             * snapshot is due
+             *
+             * @param executor: executor that produced the tick
+             * @param tick: the tick
+             * @param buffer_depth: blocks waiting in the planner
+             */
+            void on_tick(const motion_executor& executor, const step_tick& tick, std::size_t buffer_depth){
+                m_time += tick.interval;
+                m_ticks++;
+                m_direction_bits = (m_direction_bits & ~tick.step_bits) | (tick.direction_bits & tick.step_bits);
+                if(tick.pen == pen_action::lift || tick.pen == pen_action::lower){
+                    m_pen_down = tick.pen == pen_action::lower;
+                }
+                if(--m_countdown == 0){
+                    publish(executor, buffer_depth);
+                }
+            }
+
+            /**
+             * Publish a snapshot now, i.e. when the executor goes idle
+             *
+             * @param executor: executor to describe
+             * @param buffer_depth: blocks waiting in the planner
+             */
+            void publish(const motion_executor& executor, std::size_t buffer_depth);
+    };
+
+    /**
+     * Streams the telemetry snapshot to every client of a UNIX socket at a
+     * fixed rate, from its own thread. Each message is one raw
+     * telemetry_snapshot. A client that doesn't keep up misses snapshots
+     * rather than slowing the stream.
+     */
+    class telemetry_server{
+        private:
+            const telemetry_channel& m_channel;
+            std::string m_path;
+            std::uint32_t m_period_ms;
+            int m_listen_fd;
+
+            /**
+             * eventfd used to wake the server thread when stopping
+             */
+            int m_wake_fd;
+
+            /**
+             * Set when stopping, so the thread still exits at its next period
+             * if the wake write fails
+             */
+            std::atomic<bool> m_stopping;
+
+            std::vector<int> m_clients;
+            std::thread m_thread;
+
+            void run();
+            void broadcast(const telemetry_snapshot& snapshot);
+
+        public:
+            /**
+             * @param channel: channel to stream
+             * @param socket_path: path to listen on, replaced if it exists
+             * @param rate_hz: snapshots sent per second
+             */
+            telemetry_server(const telemetry_channel& channel,
+                    const std::string& socket_path,
+                    std::uint32_t rate_hz=20);
+            ~telemetry_server();
+
+            telemetry_server(const telemetry_server&) = delete;
+            telemetry_server& operator=(const telemetry_server&) = delete;
+
+            /**
+             * Start the server thread
+             */
+            void start();
+
+            /**
+             * Stop and join the server thread
+             */
+            void stop();
+    };
+
+    /**
+     * Receives the telemetry stream of a running controller
+     */
+    class telemetry_client{
+        private:
+            int m_fd;
+
+        public:
+            /**
+             * @param socket_path: path the telemetry server listens on
+             */
+            explicit telemetry_client(const std::string& socket_path);
+            ~telemetry_client();
+
+            telemetry_client(const telemetry_client&) = delete;
+            telemetry_client& operator=(const telemetry_client&) = delete;
+
+            /**
+             * Wait for the next snapshot
+             *
+             * @param snapshot: receives the state
+             * @return: false once the controller has gone away
+             */
+            bool next(telemetry_snapshot& snapshot);
+    };
+}
+
+#endif
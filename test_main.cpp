@@ -1,52 +1,1426 @@
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <new>
+#include <thread>
 #include <vector>
 #include <memory>
+#include <string>
 
 #include "wiringPiContext.hpp"
 #include "units.hpp"
-#include "stepper_coil.hpp"
 #include "stepper.hpp"
+#include "step_stream.hpp"
+#include "job_pipeline.hpp"
+#include "job_estimate.hpp"
+#include "job_batch.hpp"
+#include "job_client.hpp"
+#include "job_server.hpp"
+#include "input_shaper.hpp"
+#include "job_import.hpp"
+#include "job_hatch.hpp"
+#include "logging.hpp"
+#include "kinematics.hpp"
+#include "text.hpp"
+#include "machine_config.hpp"
+#include "shard.hpp"
 
-template<class T>
-std::initializer_list<T> make_init_list(std::initializer_list<T>&& l){
-    return l;
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace{
+    /**
+     * Allocations made on threads being watched, see job_options::strict
+     */
+    std::atomic<std::uint64_t> watched_allocations(0);
+    thread_local bool watch_allocations = false;
+}
+
+/**
+ * Counts the allocations of watched threads, everything else is as the
+ * library's operator new. The array and nothrow forms go through these.
+ */
+void* operator new(std::size_t size){
+    if(watch_allocations){
+        watched_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if(void* memory = std::malloc(size == 0 ? 1 : size)){
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment){
+    if(watch_allocations){
+        watched_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    // aligned_alloc wants a whole number of alignments
+    std::size_t align = static_cast<std::size_t>(alignment);
+    std::size_t rounded = size == 0 ? align : (size + align - 1) / align * align;
+    if(void* memory = std::aligned_alloc(align, rounded)){
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept{
+    std::free(memory);
+}
+
+/**
+ * Runs the demo job once against an offline context and writes the result
+ * to a step stream that can be played back without re-planning
+ */
+int compile_job(const std::string& path){
+    std::shared_ptr<plotter::context> context =
+        std::make_shared<plotter::context>(plotter::context::mode::offline);
+    plotter::machine_config machine = plotter::default_machine_config();
+    std::unique_ptr<plotter::stepper> stepper = machine.make_stepper(machine.make_outputs(context), 0);
+
+    constexpr int ticks_per_leg = 240;
+    int tick_count = 0;
+    stepper->set_target(plotter::millimeters(2.0));
+    plotter::tick_source job = [&](std::uint32_t& interval){
+        if(tick_count == ticks_per_leg){
+            stepper->set_target(plotter::millimeters(0.0));
+        }
+        else if(tick_count == 2 * ticks_per_leg){
+            return false;
+        }
+        stepper->tick();
+        tick_count++;
+        interval = 1000;
+        return true;
+    };
+
+    std::uint64_t ticks = plotter::compile_step_stream(*context, job, path);
+    std::cout << "Compiled " << ticks << " ticks to " << path << std::endl;
+    return 0;
 }
 
-int main(){
+int play_job(const std::string& path){
+    plotter::context context;
+    std::uint64_t frames = plotter::play_step_stream(path, context);
+    std::cout << "Played " << frames << " frames from " << path << std::endl;
+    return 0;
+}
+
+/**
+ * Words that may follow the job file of simulate and estimate
+ */
+struct job_options{
+    bool batch = false;     // "batch" groups the job's strokes by pen first
+    bool cache = false;     // "cache" plans through the cache in ./plan_cache
+    bool resume = false;    // "resume" carries on from ./job.checkpoint
+    bool strict = false;    // "strict" fails if the running job allocates
+    std::string machine;    // "machine=FILE" reads the machine description
+    std::uint32_t feed_override = 100;  // "override=PERCENT" runs at that feed
+};
+
+job_options parse_options(int argc, char** argv, int first){
+    job_options options;
+    for(int i = first; i < argc; i++){
+        options.batch = options.batch || std::string(argv[i]) == "batch";
+        options.cache = options.cache || std::string(argv[i]) == "cache";
+        options.resume = options.resume || std::string(argv[i]) == "resume";
+        options.strict = options.strict || std::string(argv[i]) == "strict";
+        if(std::string(argv[i]).compare(0, 8, "machine=") == 0){
+            options.machine = std::string(argv[i]).substr(8);
+        }
+        if(std::string(argv[i]).compare(0, 9, "override=") == 0){
+            options.feed_override = static_cast<std::uint32_t>(std::stoul(std::string(argv[i]).substr(9)));
+        }
+    }
+    return options;
+}
+
+/**
+ * Open a job file, hatching filled shapes 0.5 mm apart and grouping its
+ * strokes by pen if asked to
+ */
+plotter::command_source open_job(const std::string& path, bool batch){
+    plotter::import_config config;
+    config.hatch.spacing = 500000;
+    plotter::command_source source = plotter::open_job(path, config);
+    return batch ? plotter::batch_by_tool(std::move(source)) : source;
+}
+
+/**
+ * Machine used to simulate and estimate jobs, the built in plotter unless
+ * a description is given
+ */
+plotter::machine_config test_machine(const job_options& options){
+    return options.machine.empty()
+        ? plotter::default_machine_config()
+        : plotter::load_machine_config(options.machine);
+}
+
+plotter::pipeline_config test_pipeline(const job_options& options, const plotter::machine_config& machine){
+    plotter::pipeline_config config;
+    config.motion = machine.motion;
+    config.machine = machine.machine;
+    config.timing = machine.timing;
+    config.shapers = machine.shapers();
+    if(options.cache){
+        config.cache = std::make_shared<plotter::plan_cache>("plan_cache");
+    }
+    return config;
+}
+
+void print_cache(const plotter::pipeline_config& config){
+    if(config.cache){
+        std::cout << "Plan cache: " << config.cache->hits() << " hits, "
+            << config.cache->misses() << " misses" << std::endl;
+    }
+}
+
+/**
+ * Runs a job file through the whole pipeline and the steppers and pen of
+ * an offline context, and reports how long it would take and where the
+ * stages spent their time. Pen swaps are taken as done at once. A
+ * checkpoint is kept in ./job.checkpoint until the job is done.
+ *
+ * Strict runs count the allocations every stage but import makes once it
+ * has started, and fail if there are any. Planning through the cache
+ * reads and writes files, so doesn't pass.
+ */
+int simulate_job(const std::string& path, const job_options& options){
+    plotter::machine_config machine = test_machine(options);
+    plotter::pipeline_config config = test_pipeline(options, machine);
+    config.checkpoint_path = "job.checkpoint";
+
+    std::shared_ptr<plotter::context> context =
+        std::make_shared<plotter::context>(plotter::context::mode::offline);
+    std::shared_ptr<plotter::gpio_outputs> outputs = machine.make_outputs(context);
+    std::vector<std::unique_ptr<plotter::stepper>> steppers;
+    for(std::size_t axis = 0; axis < machine.axes.size(); axis++){
+        steppers.push_back(machine.make_stepper(outputs, axis));
+    }
+    plotter::pen_actuator pen = machine.make_pen(context);
+    config.on_checkpoint = [&](plotter::job_checkpoint& checkpoint){
+        plotter::save_coil_phases(checkpoint, steppers, steppers.size());
+    };
+    if(options.strict){
+        config.on_stage_start = [](const char* stage){
+            watch_allocations = std::strcmp(stage, "import") != 0;
+        };
+    }
+
+    std::uint64_t job_us = 0;
+    std::uint64_t swaps = 0;
+    plotter::job_pipeline pipeline(open_job(path, options.batch), config,
+            [&](const plotter::step_tick& tick, plotter::motion_executor& executor){
+                if(job_us == 0){
+                    // As if the operator had set it before starting
+                    executor.set_feed_override(options.feed_override);
+                }
+                plotter::apply_step_rates(executor, steppers, steppers.size());
+                plotter::apply_step_tick(tick, steppers);
+                plotter::apply_pen_action(tick, pen);
+                job_us += tick.interval;
+                if(tick.pen == plotter::pen_action::swap){
+                    swaps++;
+                    executor.resume();
+                }
+            });
+    plotter::job_checkpoint checkpoint;
+    if(options.resume && plotter::load_checkpoint(config.checkpoint_path, checkpoint)){
+        // Nothing moves the simulated machine, so it is still there
+        std::cout << "Resuming after " << checkpoint.offset << " commands, "
+            << checkpoint.time_us / 1e6 << " s into the job" << std::endl;
+        plotter::teleport_steppers(checkpoint, steppers, steppers.size());
+        pipeline.resume(checkpoint, false);
+    }
+    pipeline.start();
+    pipeline.wait();
+
+    std::cout << "Job takes " << job_us / 1e6 << " s, " << swaps << " pen swaps, "
+        << pipeline.rejected() << " moves rejected" << std::endl;
+    for(const plotter::stage_stats& stage : pipeline.stats()){
+        std::cout << stage.name << ": " << stage.items << " out, "
+            << stage.starved_ns / 1e6 << " ms starved, "
+            << stage.blocked_ns / 1e6 << " ms blocked" << std::endl;
+    }
+    print_cache(config);
+    if(options.strict){
+        std::uint64_t allocations = watched_allocations.load(std::memory_order_relaxed);
+        std::cout << allocations << " allocations while the job ran" << std::endl;
+        return allocations == 0 ? 0 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Runs the part of a job for one shard of the machine in its own process,
+ * against an offline context standing in for that controller's pins
+ */
+int run_shard_process(const plotter::machine_config& machine, std::size_t shard, plotter::shard_ring& ring){
+    std::shared_ptr<plotter::context> context =
+        std::make_shared<plotter::context>(plotter::context::mode::offline);
+    std::shared_ptr<plotter::gpio_outputs> outputs = machine.make_outputs(context);
+    std::vector<std::unique_ptr<plotter::stepper>> steppers;
+    for(std::size_t axis = 0; axis < machine.axes.size(); axis++){
+        if(machine.axes[axis].shard == shard){
+            steppers.push_back(machine.make_stepper(outputs, axis));
+        }
+    }
+    std::unique_ptr<plotter::pen_actuator> pen;
+    if(machine.pen_shard == shard){
+        pen = std::make_unique<plotter::pen_actuator>(machine.make_pen(context));
+    }
+    plotter::run_shard(ring, steppers, steppers.size(), pen.get());
+    return 0;
+}
+
+/**
+ * What a job run on a sharded machine did
+ */
+struct sharded_run{
+    std::vector<plotter::shard_report> reports;
+    bool finished = false;
+    bool coordinated = false;
+    std::uint64_t job_us = 0;
+};
+
+/**
+ * Runs a job in real time on a sharded machine, with a process per shard
+ * fed by the one planner of this process through shared memory, and
+ * checks that every shard ends where the planner does. A pen swap holds
+ * every shard and is taken as done once they have all stopped for it.
+ *
+ * @param disturb: called with the shard processes once the job is under
+ *                 way, i.e. to hold one up
+ */
+sharded_run run_sharded(plotter::command_source job, const plotter::machine_config& machine, const job_options& options,
+        const std::function<void(const std::vector<pid_t>&)>& disturb){
+    sharded_run run;
+    plotter::pipeline_config config = test_pipeline(options, machine);
+    plotter::shard_distributor distributor(machine, 1 << 16);
+
+    // Before the pipeline has any threads
+    std::vector<pid_t> children;
+    for(std::size_t shard = 0; shard < distributor.shard_count(); shard++){
+        pid_t child = ::fork();
+        if(child < 0){
+            std::cerr << "Unable to start shard " << shard << std::endl;
+            for(pid_t started : children){
+                ::kill(started, SIGKILL);
+                ::waitpid(started, nullptr, 0);
+            }
+            return run;
+        }
+        if(child == 0){
+            std::_Exit(run_shard_process(machine, shard, distributor.ring(shard)));
+        }
+        children.push_back(child);
+    }
+
+    plotter::axis_steps position{};
+    plotter::job_pipeline pipeline(std::move(job), config,
+            [&](const plotter::step_tick& tick, plotter::motion_executor& executor){
+                distributor.on_tick(tick);
+                run.job_us += tick.interval;
+                position = executor.position();
+                if(tick.pen == plotter::pen_action::swap){
+                    if(distributor.release(std::chrono::milliseconds(200), std::chrono::seconds(30))){
+                        executor.resume();
+                    }
+                    else{
+                        executor.halt();
+                    }
+                }
+            });
+    distributor.start(std::chrono::milliseconds(200), std::chrono::seconds(5));
+    pipeline.start();
+    if(disturb){
+        disturb(children);
+    }
+    try{
+        pipeline.wait();
+        distributor.finish();
+        run.finished = distributor.wait_finished(run.reports, std::chrono::milliseconds(run.job_us / 1000 + 5000));
+    }
+    catch(const std::runtime_error& error){
+        std::cout << "The job stopped: " << error.what() << std::endl;
+    }
+    for(pid_t child : children){
+        if(!run.finished){
+            ::kill(child, SIGKILL);
+        }
+        ::waitpid(child, nullptr, 0);
+    }
+    if(!run.finished){
+        std::cout << "A shard didn't finish" << std::endl;
+        return run;
+    }
+
+    run.coordinated = true;
+    for(std::size_t shard = 0; shard < run.reports.size(); shard++){
+        const plotter::shard_report& report = run.reports[shard];
+        std::cout << "Shard " << shard << ": " << report.events << " events, " << report.late << " late, worst "
+            << report.worst_late_us << " us late, time base moved " << report.shift_us << " us" << std::endl;
+    }
+    for(std::size_t axis = 0; axis < machine.axes.size(); axis++){
+        const plotter::machine_axis& described = machine.axes[axis];
+        std::int64_t steps = run.reports[described.shard].position[described.shard_axis];
+        if(steps != position[axis]){
+            std::cout << "Axis " << described.name << " ends at step " << steps
+                << " instead of " << position[axis] << std::endl;
+            run.coordinated = false;
+        }
+    }
+    std::cout << "Job takes " << run.job_us / 1e6 << " s on " << run.reports.size() << " shards" << std::endl;
+    return run;
+}
+
+/**
+ * Runs a job file in real time on a sharded machine. Fails unless every
+ * shard ends where the planner does and keeps to the time base throughout.
+ */
+int shard_job(const std::string& path, const job_options& options){
+    sharded_run run = run_sharded(open_job(path, options.batch), test_machine(options), options, nullptr);
+    bool on_time = true;
+    for(const plotter::shard_report& report : run.reports){
+        on_time = on_time && report.late == 0;
+    }
+    if(run.finished && !on_time){
+        std::cout << "A shard fell behind" << std::endl;
+    }
+    return run.finished && run.coordinated && on_time ? 0 : 1;
+}
+
+/**
+ * Plans a job file without stepping it and reports how long it will take
+ */
+int estimate_job(const std::string& path, const job_options& options){
+    plotter::pipeline_config config = test_pipeline(options, test_machine(options));
+
+    plotter::job_estimate estimate = plotter::estimate_job(open_job(path, options.batch), config);
+    std::cout << "Job takes " << estimate.total_us() / 1e6 << " s: "
+        << estimate.drawing_us / 1e6 << " s drawing, "
+        << estimate.travel_us / 1e6 << " s travelling, "
+        << estimate.pen_us / 1e6 << " s waiting for the pen" << std::endl;
+    std::cout << "Draws " << estimate.drawing_length / 1e3 << " mm and travels "
+        << estimate.travel_length / 1e3 << " mm, lifting the pen "
+        << estimate.pen_lifts << " times and swapping it "
+        << estimate.tool_changes << " times" << std::endl;
+    for(std::size_t axis = 0; axis < config.motion.axis_count; axis++){
+        std::cout << "Axis " << axis << " moves " << estimate.axis_travel[axis].count() / 1e6 << " mm" << std::endl;
+    }
+    print_cache(config);
+    return 0;
+}
+
+/**
+ * Compiles the resonance test pattern of a machine into a step stream to
+ * draw with play. Axis 0 swings 0.1 mm either side while its frequency
+ * sweeps from 5 to 100 Hz over 100 mm of axis 1; the frame resonates where
+ * the drawn swing is widest, and the frequency there is the
+ * shaper_frequency of the axis. Streams only hold pin levels, so a servo
+ * pen has to be lowered by hand.
+ */
+int sweep_job(const std::string& path, const job_options& options){
+    constexpr double start_hz = 5;
+    constexpr double end_hz = 100;
+    plotter::machine_config machine = test_machine(options);
+    if(machine.axes.size() < 2){
+        std::cerr << "The sweep needs two axes" << std::endl;
+        return 1;
+    }
+    // Streams record the pins of the context
+    machine.gpio = plotter::gpio_outputs::type::context;
+
+    std::shared_ptr<plotter::context> context =
+        std::make_shared<plotter::context>(plotter::context::mode::offline);
+    std::shared_ptr<plotter::gpio_outputs> outputs = machine.make_outputs(context);
+    std::vector<std::unique_ptr<plotter::stepper>> steppers;
+    for(std::size_t axis = 0; axis < machine.axes.size(); axis++){
+        steppers.push_back(machine.make_stepper(outputs, axis));
+    }
+    plotter::pen_actuator pen = machine.make_pen(context);
+
+    std::int64_t advance = machine.axes[1].scale.to_steps(plotter::position::from<std::milli>(100));
+    plotter::resonance_sweep sweep(0, 1, machine.axes[0].scale.to_steps(plotter::position::from<std::micro>(100)),
+            start_hz, end_hz, 20, advance);
+    bool lowered = false;
+    bool lifted = false;
+    plotter::tick_source job = [&](std::uint32_t& interval){
+        plotter::step_tick tick;
+        if(!lowered){
+            pen.lower();
+            lowered = true;
+            interval = 0;
+        }
+        else if(sweep.next(tick)){
+            plotter::apply_step_tick(tick, steppers);
+            interval = tick.interval;
+        }
+        else if(!lifted){
+            pen.lift();
+            lifted = true;
+            interval = 0;
+        }
+        else{
+            return false;
+        }
+        return true;
+    };
+
+    std::uint64_t ticks = plotter::compile_step_stream(*context, job, path);
+    std::cout << "Compiled " << ticks << " ticks to " << path << std::endl;
+    for(int millimeter = 0; millimeter <= 100; millimeter += 10){
+        std::cout << millimeter << " mm: " << sweep.frequency_at(advance * millimeter / 100) << " Hz" << std::endl;
+    }
+    return 0;
+}
+
+/**
+ * Plans a run of numbered labels in 5 mm text and reports how long it
+ * will take to plot
+ */
+int estimate_labels(const std::string& text, int count){
+    plotter::pipeline_config config;
+    for(std::size_t axis = 0; axis < config.motion.axis_count; axis++){
+        config.motion.axes[axis].scale = plotter::step_scale::from_steps_per_millimeter(120.0);
+    }
+
+    plotter::stroke_font font;
+    plotter::text_style style;
+    std::vector<plotter::text_line> lines;
+    for(int i = 0; i < count; i++){
+        lines.push_back({text + " " + std::to_string(i + 1),
+                plotter::position::from<std::milli>(10 + 60 * (i % 4)),
+                plotter::position::from<std::milli>(280 - 10 * (i / 4 % 27))});
+    }
+    plotter::job_estimate estimate = plotter::estimate_job(plotter::text_source(font, std::move(lines), style), config);
+    std::cout << count << " labels take " << estimate.total_us() / 1e6 << " s, drawing "
+        << estimate.drawing_length / 1e3 << " mm" << std::endl;
+    return 0;
+}
+
+/******************************************************************************/
+/*                                   Checks                                   */
+/******************************************************************************/
+/**
+ * Commands of a job given as G-code text
+ */
+plotter::command_source gcode_text(const std::string& text){
+    auto in = std::make_shared<std::istringstream>(text);
+    auto importer = std::make_shared<plotter::gcode_importer>(*in);
+    return [in, importer](plotter::move_command& command){
+        return importer->next(command);
+    };
+}
+
+/**
+ * Batching must draw everything the job draws, including the rest of a
+ * stroke after its pen is swapped while down
+ */
+int check_batch(){
+    const std::string job =
+        "G21 G90\n"
+        "T1\n"
+        "G0 X10 Y10\n"
+        "M3\n"
+        "G1 X40 Y10 F1200\n"
+        "T2\n"
+        "G1 X40 Y40\n"
+        "G1 X10 Y40\n"
+        "M5\n"
+        "T1\n"
+        "G0 X60 Y10\n"
+        "M3\n"
+        "G1 X90 Y10\n"
+        "M5\n";
+    plotter::pipeline_config config = test_pipeline(job_options(), plotter::default_machine_config());
+    plotter::job_estimate plain = plotter::estimate_job(gcode_text(job), config);
+    plotter::job_estimate batched = plotter::estimate_job(plotter::batch_by_tool(gcode_text(job)), config);
+    std::cout << "Draws " << plain.drawing_length / 1e3 << " mm with " << plain.tool_changes << " swaps, "
+        << batched.drawing_length / 1e3 << " mm with " << batched.tool_changes << " swaps batched" << std::endl;
+    return std::llabs(plain.drawing_length - batched.drawing_length) <= 1
+        && batched.tool_changes < plain.tool_changes ? 0 : 1;
+}
+
+/**
+ * Strict runs must see every allocation, over-aligned ones included
+ */
+int check_allocations(){
+    struct alignas(64) padded{
+        std::uint64_t value;
+    };
+    std::uint64_t before = watched_allocations.load(std::memory_order_relaxed);
+    watch_allocations = true;
+    std::unique_ptr<std::uint64_t> plain = std::make_unique<std::uint64_t>(0);
+    std::unique_ptr<padded> aligned = std::make_unique<padded>();
+    std::unique_ptr<padded[]> array = std::make_unique<padded[]>(4);
+    watch_allocations = false;
+    std::uint64_t counted = watched_allocations.load(std::memory_order_relaxed) - before;
+    bool is_aligned = reinterpret_cast<std::uintptr_t>(aligned.get()) % alignof(padded) == 0
+        && reinterpret_cast<std::uintptr_t>(array.get()) % alignof(padded) == 0;
+    std::cout << counted << " of 3 allocations counted" << std::endl;
+    return counted == 3 && is_aligned ? 0 : 1;
+}
+
+/**
+ * Zig-zag job of many short strokes, long enough to fill every queue of
+ * the pipeline
+ */
+std::string zigzag_job(int strokes){
+    std::string job = "G21 G90\n";
+    for(int i = 0; i < strokes; i++){
+        job += "G0 X" + std::to_string(i % 100) + " Y0\nM3\nG1 X" + std::to_string(i % 100)
+            + " Y20 F3000\nM5\n";
+    }
+    return job;
+}
+
+/**
+ * A halt, as from a stall, must stop every stage and fail the job instead
+ * of leaving the planner waiting on a queue nobody empties
+ */
+int check_halt(){
+    plotter::pipeline_config config = test_pipeline(job_options(), plotter::default_machine_config());
+    std::uint64_t ticks = 0;
+    plotter::job_pipeline pipeline(gcode_text(zigzag_job(2000)), config,
+            [&](const plotter::step_tick&, plotter::motion_executor& executor){
+                if(++ticks == 1000){
+                    executor.halt();
+                }
+            });
+    pipeline.start();
+    try{
+        pipeline.wait();
+    }
+    catch(const std::runtime_error& error){
+        std::cout << "Halted after " << ticks << " ticks: " << error.what() << std::endl;
+        return ticks == 1000 ? 0 : 1;
+    }
+    std::cout << "The job finished despite the halt" << std::endl;
+    return 1;
+}
+
+/**
+ * A polargraph move that bends a lot must be split into every piece the
+ * tolerance needs, however many batches that takes
+ */
+int check_polargraph(){
+    plotter::kinematics machine = plotter::kinematics::polargraph(plotter::position::from<std::milli>(1000),
+            plotter::position::from<std::milli>(500), plotter::position::from<std::milli>(600));
+    plotter::motion_planner planner(plotter::default_machine_config().motion);
+    plotter::kinematic_planner kinematic(planner, machine);
+
+    // From home to 10 mm from the left anchor
+    plotter::axis_positions target{};
+    target[0] = plotter::position::from<std::milli>(-490);
+    target[1] = plotter::position::from<std::milli>(-590);
+    std::size_t pieces = machine.segment_count(plotter::position(0), plotter::position(0), target[0], target[1]);
+    kinematic.add_move(target, 50000);
+
+    std::size_t blocks = 0;
+    plotter::planned_block block;
+    while(true){
+        bool done = kinematic.pump();
+        if(done){
+            planner.flush();
+        }
+        while(planner.pop(block)){
+            blocks++;
+        }
+        if(done && planner.is_empty()){
+            break;
+        }
+    }
+
+    plotter::position::rep x = target[0].count();
+    plotter::position::rep y = target[1].count();
+    plotter::position::rep a;
+    plotter::position::rep b;
+    machine.to_motors(&x, &y, &a, &b, 1);
+    std::cout << "Planned " << blocks << " of " << pieces << " pieces" << std::endl;
+    return blocks == pieces && pieces > plotter::kinematic_planner::max_segments
+        && planner.target()[0].count() == a && planner.target()[1].count() == b ? 0 : 1;
+}
+
+/**
+ * Stepper with a limit switch at a fixed step, whose edges are injected
+ * into a pipe as the stepper crosses it
+ */
+struct switched_stepper{
+    plotter::stepper& motor;
+    plotter::pipe_edge_source& source;
+    plotter::pin line;
+    int toward;         // Direction of the switch, -1 or 1
+    int at;             // Steps from the start to the switch
+    bool active;
+
+    void step(int direction){
+        motor.step(direction);
+        bool now = motor.get_current_step() * toward >= at;
+        if(now != active){
+            active = now;
+            source.inject(line, now);
+        }
+    }
+
+    void teleport(plotter::step target){
+        motor.teleport(target);
+    }
+};
+
+/**
+ * Axes described with a limit switch must seek it, back off and find it
+ * again slowly, ending on the switch at step 0
+ */
+int check_homing(){
+    std::istringstream description(
+        "[axis x]\n"
+        "pins = 0 2 3 12\n"
+        "steps_per_mm = 120\n"
+        "limit_pin = 5\n"
+        "[axis y]\n"
+        "pins = 13 14 21 22\n"
+        "steps_per_mm = 120\n"
+        "limit_pin = 6\n"
+        "home_direction = 1\n"
+        "home_backoff = 20\n"
+        "[machine]\n"
+        "homing_tick_us = 100\n");
+    plotter::machine_config machine = plotter::parse_machine_config(description, "homing check");
+
+    std::shared_ptr<plotter::context> context =
+        std::make_shared<plotter::context>(plotter::context::mode::offline);
+    std::shared_ptr<plotter::gpio_outputs> outputs = machine.make_outputs(context);
+    std::vector<std::unique_ptr<plotter::stepper>> motors;
+    for(std::size_t axis = 0; axis < machine.axes.size(); axis++){
+        motors.push_back(machine.make_stepper(outputs, axis));
+    }
+    auto source = std::make_shared<plotter::pipe_edge_source>();
+    switched_stepper x{*motors[0], *source, 5, -1, 300, false};
+    switched_stepper y{*motors[1], *source, 6, 1, 150, false};
+    std::vector<switched_stepper*> steppers{&x, &y};
+
+    plotter::edge_monitor monitor;
+    std::vector<std::shared_ptr<plotter::limit_switch>> switches = machine.connect_inputs(monitor, source).switches;
+    monitor.start();
+    bool homed = plotter::home_steppers(steppers, switches, machine.homing_profiles(), steppers.size(),
+            std::chrono::microseconds(machine.homing_tick_us));
+    monitor.stop();
+
+    std::cout << "Homed " << (homed ? "" : "un") << "successfully, switches triggered "
+        << switches[0]->trigger_count() << " and " << switches[1]->trigger_count() << " times" << std::endl;
+    return homed && x.active && y.active
+        && motors[0]->get_current_step() == 0 && motors[1]->get_current_step() == 0
+        && switches[0]->trigger_count() == 2 && switches[1]->trigger_count() == 2 ? 0 : 1;
+}
+
+/**
+ * Encoder disc turned by hand, injecting the quadrature edges of every
+ * count it passes into a pipe
+ */
+struct quadrature_wheel{
+    plotter::pipe_edge_source& source;
+    plotter::pin line_a;
+    plotter::pin line_b;
+    std::int64_t count;
+
+    /**
+     * (A << 1) | B at a count, the forward sequence is 00, 01, 11, 10
+     */
+    static std::uint8_t state(std::int64_t at){
+        constexpr std::uint8_t states[4] = {0, 1, 3, 2};
+        return states[((at % 4) + 4) % 4];
+    }
+
+    void turn_to(std::int64_t target){
+        while(count != target){
+            std::uint8_t before = state(count);
+            count += target > count ? 1 : -1;
+            std::uint8_t after = state(count);
+            if(((before ^ after) & 2) != 0){
+                source.inject(line_a, (after & 2) != 0);
+            }
+            else{
+                source.inject(line_b, (after & 1) != 0);
+            }
+        }
+    }
+};
+
+/**
+ * An axis whose encoder stops following its steps must halt the job once
+ * it is more than the tolerance behind, and not before
+ */
+int check_stall(){
+    std::istringstream description(
+        "[axis x]\n"
+        "pins = 0 2 3 12\n"
+        "steps_per_mm = 120\n"
+        "encoder_pins = 7 8\n"
+        "encoder_counts = 400\n"
+        "encoder_steps = 200\n"
+        "stall_tolerance = 8\n"
+        "[axis y]\n"
+        "pins = 13 14 21 22\n"
+        "steps_per_mm = 120\n");
+    plotter::machine_config machine = plotter::parse_machine_config(description, "stall check");
+
+    auto source = std::make_shared<plotter::pipe_edge_source>();
+    plotter::edge_monitor monitor;
+    plotter::machine_inputs inputs = machine.connect_inputs(monitor, source);
+    monitor.start();
+
+    constexpr std::uint64_t slips_at = 20000;
+    std::uint64_t ticks = 0;
+    std::uint64_t stalled_at = 0;
+    std::int64_t stalled_steps = 0;
+    plotter::pipeline_config config = test_pipeline(job_options(), machine);
+    config.stall_monitors = machine.make_stall_monitors(inputs, [&](const plotter::stall_event& stall){
+        stalled_at = ticks;
+        stalled_steps = stall.commanded_steps - stall.measured_steps;
+    });
+
+    quadrature_wheel wheel{*source, 7, 8, 0};
+    const plotter::quadrature_encoder& encoder = *inputs.encoders[0];
+    plotter::job_pipeline pipeline(gcode_text(zigzag_job(200)), config,
+            [&](const plotter::step_tick&, plotter::motion_executor& executor){
+                ticks++;
+                if(ticks >= slips_at){
+                    return;
+                }
+                // Two counts a step, and the edges reach the encoder on
+                // the monitor's thread
+                wheel.turn_to(2 * executor.position()[0]);
+                auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+                while(encoder.count() != wheel.count && std::chrono::steady_clock::now() < give_up){
+                    std::this_thread::yield();
+                }
+            });
+    pipeline.start();
+    bool halted = false;
+    try{
+        pipeline.wait();
+    }
+    catch(const std::runtime_error&){
+        halted = true;
+    }
+    monitor.stop();
+
+    std::cout << "Encoder slipped at tick " << slips_at << ", stall seen at tick " << stalled_at
+        << " " << stalled_steps << " steps behind" << std::endl;
+    return halted && stalled_at > slips_at && (stalled_steps > 8 || stalled_steps < -8) ? 0 : 1;
+}
+
+/**
+ * The shadow backend must record exactly the levels the context backend
+ * writes for the same job
+ */
+int check_shadow(){
+    plotter::machine_config machine = plotter::default_machine_config();
+    plotter::machine_config shadowed = machine;
+    shadowed.gpio = plotter::gpio_outputs::type::shadow;
+
+    std::shared_ptr<plotter::context> context =
+        std::make_shared<plotter::context>(plotter::context::mode::offline);
+    std::shared_ptr<plotter::gpio_outputs> outputs = machine.make_outputs(context);
+    std::shared_ptr<plotter::gpio_outputs> shadow = shadowed.make_outputs(context);
+    std::vector<std::unique_ptr<plotter::stepper>> steppers;
+    std::vector<std::unique_ptr<plotter::stepper>> shadow_steppers;
+    plotter::pin_mask coil_pins = 0;
+    for(std::size_t axis = 0; axis < machine.axes.size(); axis++){
+        steppers.push_back(machine.make_stepper(outputs, axis));
+        shadow_steppers.push_back(shadowed.make_stepper(shadow, axis));
+        coil_pins |= machine.axes[axis].sequence.pins();
+    }
+
+    std::uint64_t ticks = 0;
+    std::uint64_t mismatches = 0;
+    plotter::job_pipeline pipeline(gcode_text(zigzag_job(50)), test_pipeline(job_options(), machine),
+            [&](const plotter::step_tick& tick, plotter::motion_executor&){
+                plotter::apply_step_tick(tick, steppers);
+                plotter::apply_step_tick(tick, shadow_steppers);
+                ticks++;
+                if((context->state() & coil_pins) != shadow->shadow_state()){
+                    mismatches++;
+                }
+            });
+    pipeline.start();
+    pipeline.wait();
+    std::cout << ticks << " ticks, " << mismatches << " with the shadow levels differing" << std::endl;
+    return ticks > 0 && mismatches == 0 && shadow->shadow_state() != 0 ? 0 : 1;
+}
+
+/**
+ * Adaptive axes must full step the fast strokes, half step again as they
+ * slow down, and keep the coil in phase with the step count throughout
+ */
+int check_adaptive(){
+    std::istringstream description(
+            "[machine]\n"
+            "gpio = shadow\n"
+            "[axis x]\n"
+            "pins = 0 2 3 12\n"
+            "sequence = half\n"
+            "steps_per_mm = 240\n"
+            "step_mode = adaptive\n"
+            "[axis y]\n"
+            "pins = 13 14 21 22\n"
+            "sequence = half\n"
+            "steps_per_mm = 240\n"
+            "step_mode = adaptive\n");
+    plotter::machine_config machine = plotter::parse_machine_config(description, "adaptive machine");
+
+    std::shared_ptr<plotter::context> context =
+        std::make_shared<plotter::context>(plotter::context::mode::offline);
+    std::shared_ptr<plotter::gpio_outputs> outputs = machine.make_outputs(context);
+    std::vector<std::unique_ptr<plotter::stepper>> steppers;
+    for(std::size_t axis = 0; axis < machine.axes.size(); axis++){
+        steppers.push_back(machine.make_stepper(outputs, axis));
+    }
+
+    std::uint64_t full_ticks = 0;
+    std::uint64_t back_to_half = 0;
+    std::uint64_t out_of_phase = 0;
+    std::vector<plotter::step_mode> modes(steppers.size(), plotter::step_mode::half);
+    plotter::job_pipeline pipeline(gcode_text(zigzag_job(20)), test_pipeline(job_options(), machine),
+            [&](const plotter::step_tick& tick, plotter::motion_executor& executor){
+                plotter::apply_step_rates(executor, steppers, steppers.size());
+                plotter::apply_step_tick(tick, steppers);
+                for(std::size_t axis = 0; axis < steppers.size(); axis++){
+                    const plotter::stepper_coil& coil = steppers[axis]->coil();
+                    if(coil.mode() == plotter::step_mode::full){
+                        full_ticks++;
+                    }
+                    else if(modes[axis] == plotter::step_mode::full){
+                        back_to_half++;
+                    }
+                    modes[axis] = coil.mode();
+                    int phase = steppers[axis]->get_current_step() % 8;
+                    if(static_cast<unsigned int>(phase < 0 ? phase + 8 : phase) != coil.state_index()){
+                        out_of_phase++;
+                    }
+                }
+            });
+    pipeline.start();
+    pipeline.wait();
+    std::cout << full_ticks << " axis ticks full stepped, " << back_to_half << " returns to half steps, "
+        << out_of_phase << " out of phase" << std::endl;
+    return full_ticks > 0 && back_to_half > 0 && out_of_phase == 0 ? 0 : 1;
+}
+
+/**
+ * Time a pen-free square takes at a feed override, holding a pause of
+ * pause_ticks from the middle of the job if that isn't 0
+ */
+std::uint64_t override_job_us(std::uint32_t percent, std::uint64_t pause_ticks){
+    const std::string job =
+        "G21 G90\n"
+        "G1 X100 Y0 F3000\n"
+        "G1 X100 Y100\n"
+        "G1 X0 Y100\n"
+        "G1 X0 Y0\n";
+    std::uint64_t job_us = 0;
+    std::uint64_t ticks = 0;
+    std::uint64_t held = 0;
+    plotter::job_pipeline pipeline(gcode_text(job), test_pipeline(job_options(), plotter::default_machine_config()),
+            [&](const plotter::step_tick& tick, plotter::motion_executor& executor){
+                if(ticks == 0){
+                    executor.set_feed_override(percent);
+                }
+                ticks++;
+                job_us += tick.interval;
+                if(pause_ticks != 0 && ticks == 12000){
+                    executor.pause();
+                }
+                if(executor.is_paused() && ++held == pause_ticks){
+                    executor.resume();
+                }
+            });
+    pipeline.start();
+    pipeline.wait();
+    return job_us;
+}
+
+std::string check_socket_path(){
+    return "/tmp/plotter-check-" + std::to_string(::getpid()) + ".sock";
+}
+
+/**
+ * Connect a client to a server listening on path
+ */
+std::unique_ptr<plotter::job_client> connect_client(plotter::job_server& server, const std::string& path){
+    std::unique_ptr<plotter::job_client> client;
+    std::thread connect([&]{
+        client = std::make_unique<plotter::job_client>(path);
+    });
+    while(server.accept_clients() == 0){
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    connect.join();
+    return client;
+}
+
+/**
+ * The feed override must stretch the time base by its inverse and a pause
+ * must hold for as long as it lasts, whether set on the executor or by a
+ * client of the controller
+ */
+int check_override(){
+    double planned = static_cast<double>(override_job_us(100, 0));
+    double slow = override_job_us(50, 0) / planned;
+    double fast = override_job_us(200, 0) / planned;
+    double paused = (override_job_us(100, 100) - planned) / 1e6;
+    std::cout << "Job takes " << planned / 1e6 << " s, " << slow << " times that at 50%, " << fast
+        << " at 200% and " << paused << " s more with a 1 s pause" << std::endl;
+
+    std::string path = check_socket_path();
+    plotter::job_server server(path);
+    std::unique_ptr<plotter::job_client> client = connect_client(server, path);
+
+    plotter::machine_config machine = plotter::default_machine_config();
+    plotter::motion_planner planner(machine.motion);
+    plotter::motion_executor executor(plotter::drain_planner(planner), machine.timing);
+    plotter::step_tick tick;
+    client->set_feed_override(50);
+    client->pause();
+    server.apply_controls(executor);
+    bool held = executor.next(tick) && executor.is_paused() && executor.feed_override() == 50;
+    client->resume();
+    server.apply_controls(executor);
+    bool released = !executor.next(tick) && !executor.is_paused();
+    std::cout << "Client " << (held ? "paused" : "didn't pause") << " the controller and "
+        << (released ? "resumed it" : "didn't resume it") << std::endl;
+
+    return slow > 1.9 && slow <= 2.0 && fast >= 0.5 && fast < 0.55 && paused >= 1.0 && paused < 1.2
+        && held && released ? 0 : 1;
+}
+
+/**
+ * A client must see the controller hold for a pen swap and which pen it
+ * waits for, and carry it on by confirming the swap; a confirmation with
+ * no swap in progress or while paused must not.
+ */
+int check_swap(){
+    std::string path = check_socket_path();
+    plotter::job_server server(path);
+    std::unique_ptr<plotter::job_client> client = connect_client(server, path);
+
+    plotter::machine_config machine = plotter::default_machine_config();
+    plotter::motion_planner planner(machine.motion);
+    plotter::motion_executor executor(plotter::drain_planner(planner), machine.timing);
+    bool early = client->confirm_swap();
+    plotter::axis_positions target{};
+    target[0] = plotter::position::from<std::milli>(10);
+    client->move(target, 50000);
+    client->tool(2);
+    target[0] = plotter::position::from<std::milli>(20);
+    client->move(target, 50000);
+    server.feed(planner);
+
+    plotter::step_tick tick;
+    auto run = [&](std::uint64_t ticks){
+        for(std::uint64_t i = 0; i < ticks; i++){
+            server.apply_controls(executor);
+            if(!executor.next(tick)){
+                return true;
+            }
+        }
+        return false;
+    };
+    for(std::uint64_t i = 0; i < 1000000 && !executor.is_swapping(); i++){
+        executor.next(tick);
+    }
+    run(100);
+    bool reported = executor.is_swapping() && client->is_swapping() && client->swap_tool() == 2;
+    std::int64_t held_at = executor.position()[0];
+
+    client->pause();
+    bool confirmed = client->confirm_swap();
+    run(100);
+    bool held = executor.is_swapping() && executor.position()[0] == held_at;
+    client->resume();
+    bool finished = run(1000000);
+    server.apply_controls(executor);
+    std::int64_t end = machine.axes[0].scale.to_steps(target[0]);
+    std::cout << "Client " << (reported ? "saw" : "didn't see") << " the swap, "
+        << (held ? "held it while paused" : "didn't hold it while paused") << " and "
+        << (finished ? "carried on" : "didn't carry on") << " to step " << executor.position()[0]
+        << " of " << end << std::endl;
+    return !early && reported && confirmed && held && finished && !client->is_swapping()
+        && executor.position()[0] == end ? 0 : 1;
+}
+
+/**
+ * Steps on a shaped axis must add up to the unshaped ones and end the
+ * longest delay later, a source that runs dry must carry on where the
+ * output left off, and a shaped machine must plot a job to the same place
+ */
+int check_shaper(){
+    constexpr double period_us = 1e6 / (40 * 0.99498743710662);   // 40 Hz, damping 0.1
+    const std::array<std::pair<plotter::shaper_type, double>, 3> shapers{{
+        {plotter::shaper_type::zv, 0.5},
+        {plotter::shaper_type::mzv, 0.75},
+        {plotter::shaper_type::ei, 1.0}
+    }};
+    bool designed = true;
+    for(const auto& shaper : shapers){
+        plotter::shaper_impulses impulses = plotter::design_shaper(plotter::shaper_config{shaper.first, 40, 0.1});
+        std::int64_t sum = 0;
+        for(std::size_t i = 0; i < impulses.count; i++){
+            sum += impulses.weight[i];
+        }
+        std::int64_t delay = impulses.delay_us[impulses.count - 1];
+        std::cout << "Weights add up to " << sum << " of 65536, last impulse at " << delay << " us" << std::endl;
+        designed = designed && sum == 65536 && std::llabs(delay - std::llround(shaper.second * period_us)) <= 1;
+    }
+
+    // Two bursts of 200 steps, the second once everything delayed from
+    // the first has been output, then a lift
+    std::array<plotter::shaper_config, plotter::max_axes> configs{};
+    configs[0] = plotter::shaper_config{plotter::shaper_type::ei, 40, 0.1};
+    int input = 0;
+    bool dry = true;
+    plotter::input_shaper shaper([&](plotter::step_tick& tick){
+        if((input == 200 && dry) || input == 401){
+            return false;
+        }
+        input++;
+        tick = plotter::step_tick{1000, input == 401 ? 0u : 1u, 0,
+            input == 401 ? plotter::pen_action::lift : plotter::pen_action::none};
+        return true;
+    }, configs, 2);
+    std::int64_t steps = 0;
+    std::uint64_t time = 0;
+    std::uint64_t first_run_us = 0;
+    std::uint64_t lift_at = 0;
+    plotter::step_tick tick;
+    for(int run = 0; run < 2; run++){
+        while(shaper.next(tick)){
+            time += tick.interval;
+            steps += (tick.step_bits & 1) != 0 ? ((tick.direction_bits & 1) != 0 ? -1 : 1) : 0;
+            if(tick.pen == plotter::pen_action::lift){
+                lift_at = time;
+            }
+        }
+        if(run == 0){
+            first_run_us = time;
+            dry = false;
+        }
+    }
+    // The second burst starts where the first one's output ended
+    std::int64_t lift_delay = static_cast<std::int64_t>(lift_at - first_run_us) - 200000;
+    std::cout << steps << " of 400 steps, first burst output over " << first_run_us << " us, lift "
+        << lift_delay << " us after the second" << std::endl;
+    bool streamed = steps == 400 && shaper.output_steps(0) == 400
+        && first_run_us >= 200000 && std::llabs(lift_delay - std::llround(period_us)) <= 1;
+
+    plotter::machine_config machine = plotter::default_machine_config();
+    plotter::machine_config shaped = machine;
+    for(plotter::machine_axis& axis : shaped.axes){
+        axis.shaper = plotter::shaper_config{plotter::shaper_type::mzv, 30, 0.05};
+    }
+    auto plot = [](const plotter::machine_config& plotted){
+        plotter::axis_steps position{};
+        plotter::job_pipeline pipeline(gcode_text(zigzag_job(30)), test_pipeline(job_options(), plotted),
+                [&](const plotter::step_tick& tick, plotter::motion_executor&){
+                    for(std::uint32_t bits = tick.step_bits; bits != 0; bits &= bits - 1){
+                        unsigned int axis = static_cast<unsigned int>(__builtin_ctz(bits));
+                        position[axis] += ((tick.direction_bits >> axis) & 1) ? -1 : 1;
+                    }
+                });
+        pipeline.start();
+        pipeline.wait();
+        return position;
+    };
+    plotter::axis_steps plain = plot(machine);
+    plotter::axis_steps smooth = plot(shaped);
+    std::cout << "Plain job ends at " << plain[0] << ", " << plain[1] << " and shaped at "
+        << smooth[0] << ", " << smooth[1] << std::endl;
+    return designed && streamed && plain == smooth ? 0 : 1;
+}
+
+/**
+ * Even-odd test of a point against one ring
+ */
+bool inside_ring(const plotter::hatch_path& ring, const plotter::hatch_point& point){
+    bool inside = false;
+    for(std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++){
+        if((ring[i][1] > point[1]) != (ring[j][1] > point[1])
+                && point[0] < ring[j][0] + (point[1] - ring[j][1]) * (ring[i][0] - ring[j][0]) / (ring[i][1] - ring[j][1])){
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+/**
+ * Hatching must stay inside a shape whose outline cuts in between two
+ * scanlines, lifting the pen rather than linking across the notch, and
+ * must still draw a plain square as one serpentine stroke
+ */
+int check_hatch(){
+    // A square whose right side saws in between every pair of lines
+    const plotter::hatch_path sawtooth{{{0, 0}}, {{10, 0}}, {{4, 1}}, {{10, 2}}, {{4, 3}}, {{10, 4}}, {{0, 4}}};
+    const plotter::hatch_path square{{{0, 0}}, {{10, 0}}, {{10, 4}}, {{0, 4}}};
+    std::vector<plotter::hatch_path> sawn = plotter::hatch_polygon({sawtooth}, plotter::fill_rule::nonzero, 0, 1);
+    std::vector<plotter::hatch_path> plain = plotter::hatch_polygon({square}, plotter::fill_rule::nonzero, 0, 1);
+
+    std::size_t outside = 0;
+    std::size_t lines = 0;
+    for(const plotter::hatch_path& path : sawn){
+        lines += path.size() / 2;
+        for(std::size_t i = 1; i < path.size(); i++){
+            for(double along : {0.25, 0.5, 0.75}){
+                plotter::hatch_point point{{path[i - 1][0] + (path[i][0] - path[i - 1][0]) * along,
+                        path[i - 1][1] + (path[i][1] - path[i - 1][1]) * along}};
+                outside += inside_ring(sawtooth, point) ? 0 : 1;
+            }
+        }
+    }
+    std::cout << "Notched shape hatched in " << sawn.size() << " strokes of " << lines << " lines, "
+        << outside << " points outside, square in " << plain.size() << " strokes" << std::endl;
+    return lines == 4 && outside == 0 && sawn.size() > 1 && plain.size() == 1 ? 0 : 1;
+}
+
+/**
+ * A shard held up mid-job must move the time base of every shard on
+ * rather than catch up in a burst, a pen swap must stop every shard until
+ * they are all let go together, and the shards must still end where the
+ * planner does
+ */
+int check_shards(){
+    plotter::machine_config machine = plotter::default_machine_config();
+    machine.axes[1].shard = 1;
+    machine.axes[1].shard_axis = 0;
+    machine.pen_shard = 1;
+    machine.shard_count = 2;
+    const std::string job =
+        "G21 G90\n"
+        "M3\n"
+        "G1 X20 Y20 F3000\n"
+        "T2\n"
+        "G1 X0 Y10\n"
+        "M5\n";
+
+    const std::chrono::microseconds held(30000);
+    sharded_run run = run_sharded(gcode_text(job), machine, job_options(),
+            [held](const std::vector<pid_t>& shards){
+                // 100 ms into the moves, past the lead of the start tick
+                std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                ::kill(shards[0], SIGSTOP);
+                std::this_thread::sleep_for(held);
+                ::kill(shards[0], SIGCONT);
+            });
+    // The held shard wakes up to find itself behind by most of the time it
+    // was stopped, and the release moves the time base on by its lead
+    std::uint64_t behind = run.finished ? run.reports[0].worst_late_us : 0;
+    bool followed = behind >= static_cast<std::uint64_t>(held.count()) / 2;
+    for(const plotter::shard_report& report : run.reports){
+        followed = followed && report.shift_us >= behind + 200000;
+    }
+    return run.finished && run.coordinated && followed ? 0 : 1;
+}
+
+/**
+ * A simulated job, pen swaps included, must run without a single heap
+ * allocation once its stages have started. The job goes through a file so
+ * that it takes the same path as plotter simulate.
+ */
+int check_strict(){
+    const std::string path = "strict_check.gcode";
+    {
+        std::ofstream job(path);
+        job << zigzag_job(100) << "T2\n" << zigzag_job(100);
+        if(!job){
+            std::cerr << "Unable to write " << path << std::endl;
+            return 1;
+        }
+    }
+    job_options options;
+    options.strict = true;
+    int result = simulate_job(path, options);
+    std::remove(path.c_str());
+    return result;
+}
+
+/**
+ * A thread that logs faster than the drain keeps up drops what doesn't fit
+ * its buffer and counts it, and everything it did record is written by the
+ * time the process exits. The logging runs in a child whose output comes
+ * back through a pipe, so that its exit is the shutdown being checked.
+ */
+int check_logging(){
+    constexpr std::uint64_t sent = 16 * plotter::logger::buffer_capacity;
+    int output[2];
+    int result[2];
+    if(::pipe(output) < 0 || ::pipe(result) < 0){
+        std::cerr << "Unable to create pipes" << std::endl;
+        return 1;
+    }
+    // Before anything has logged, so the drain thread starts in the child
+    pid_t child = ::fork();
+    if(child < 0){
+        std::cerr << "Unable to start the logging child" << std::endl;
+        return 1;
+    }
+    if(child == 0){
+        ::dup2(output[1], STDOUT_FILENO);
+        ::close(output[0]);
+        ::close(output[1]);
+        ::close(result[0]);
+        for(std::uint64_t i = 0; i < sent; i++){
+            plotter::log_error("Logging check {}", i);
+        }
+        std::uint64_t dropped = plotter::logger::dropped();
+        bool reported = ::write(result[1], &dropped, sizeof(dropped)) == sizeof(dropped);
+        // Exit without flushing, the drain writes the rest as it is destroyed
+        std::exit(reported ? 0 : 1);
+    }
+    ::close(output[1]);
+    ::close(result[1]);
+
+    std::uint64_t written = 0;
+    std::string text;
+    char buffer[4096];
+    ssize_t count;
+    while((count = ::read(output[0], buffer, sizeof(buffer))) > 0){
+        text.append(buffer, static_cast<std::size_t>(count));
+    }
+    for(std::size_t at = text.find("Logging check"); at != std::string::npos; at = text.find("Logging check", at + 1)){
+        written++;
+    }
+    std::uint64_t dropped = 0;
+    bool reported = ::read(result[0], &dropped, sizeof(dropped)) == sizeof(dropped);
+    ::close(output[0]);
+    ::close(result[0]);
+    int status = 0;
+    ::waitpid(child, &status, 0);
+
+    std::cout << written << " of " << sent << " messages written, " << dropped << " dropped" << std::endl;
+    return reported && WIFEXITED(status) && WEXITSTATUS(status) == 0 && dropped > 0
+        && written >= plotter::logger::buffer_capacity && written + dropped == sent ? 0 : 1;
+}
+
+int run_check(const std::string& name){
+    if(name == "batch"){
+        return check_batch();
+    }
+    if(name == "allocations"){
+        return check_allocations();
+    }
+    if(name == "halt"){
+        return check_halt();
+    }
+    if(name == "polargraph"){
+        return check_polargraph();
+    }
+    if(name == "homing"){
+        return check_homing();
+    }
+    if(name == "stall"){
+        return check_stall();
+    }
+    if(name == "shadow"){
+        return check_shadow();
+    }
+    if(name == "adaptive"){
+        return check_adaptive();
+    }
+    if(name == "override"){
+        return check_override();
+    }
+    if(name == "shaper"){
+        return check_shaper();
+    }
+    if(name == "swap"){
+        return check_swap();
+    }
+    if(name == "hatch"){
+        return check_hatch();
+    }
+    if(name == "shards"){
+        return check_shards();
+    }
+    if(name == "strict"){
+        return check_strict();
+    }
+    if(name == "logging"){
+        return check_logging();
+    }
+    std::cerr << "No check called " << name << std::endl;
+    return 1;
+}
+
+int main(int argc, char** argv){
 #ifdef HAS_WIRING_PI
     std::cout << "Wiring Pi found" << std::endl;
 #else
     std::cout << "Wiring Pi not found" << std::endl;
 #endif
-    
+
+    if(argc == 3 && std::string(argv[1]) == "compile"){
+        return compile_job(argv[2]);
+    }
+    if(argc == 3 && std::string(argv[1]) == "play"){
+        return play_job(argv[2]);
+    }
+    if(argc >= 3 && argc <= 9 && std::string(argv[1]) == "simulate"){
+        return simulate_job(argv[2], parse_options(argc, argv, 3));
+    }
+    if(argc >= 3 && argc <= 7 && std::string(argv[1]) == "shards"){
+        return shard_job(argv[2], parse_options(argc, argv, 3));
+    }
+    if(argc >= 3 && argc <= 7 && std::string(argv[1]) == "estimate"){
+        return estimate_job(argv[2], parse_options(argc, argv, 3));
+    }
+    if(argc >= 3 && argc <= 4 && std::string(argv[1]) == "sweep"){
+        return sweep_job(argv[2], parse_options(argc, argv, 3));
+    }
+    if(argc == 4 && std::string(argv[1]) == "labels"){
+        return estimate_labels(argv[2], std::stoi(argv[3]));
+    }
+    if(argc == 3 && std::string(argv[1]) == "check"){
+        return run_check(argv[2]);
+    }
+
     std::shared_ptr<plotter::context> context = std::make_shared<plotter::context>();
 
     context->write(4, true);
     context->write(2, false);
     context->write(30, true);
 
-
-    using pin_list = std::initializer_list<plotter::pin>;
-    using coil_state_list = std::initializer_list<plotter::stepper_coil::coil_state>;
-
-    std::unique_ptr<plotter::stepper_coil> coil = 
-        std::make_unique<plotter::stepper_coil>(context,
-            pin_list({0,2,3,12}),
-            coil_state_list({{0,0,0,0},{0,1,0,1},{1,0,1,0}})
-        );
-
-    plotter::stepper stepper(std::move(coil), 120.0);
+    plotter::machine_config machine = plotter::default_machine_config();
+    std::unique_ptr<plotter::stepper> stepper = machine.make_stepper(machine.make_outputs(context), 0);
 
     plotter::travel<std::milli> travel(2.0);
-    //stepper.set_target(plotter::step(10));
-    stepper.set_target(plotter::millimeters(2.0));
+    //stepper->set_target(plotter::step(10));
+    stepper->set_target(plotter::millimeters(2.0));
 
     for(int i = 0; i < 10; i++){
-        stepper.tick();
+        stepper->tick();
     }
     std::cout << std::endl;
-    stepper.set_target(plotter::millimeters(0.0));
+    stepper->set_target(plotter::millimeters(0.0));
     for(int i = 0; i < 5; i++){
-        stepper.tick();
+        stepper->tick();
     }
 }
@@ -0,0 +1,442 @@
+#include "text.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+namespace plotter{
+    namespace{
+        /**
+         * Hershey simplex Roman, from the public domain Hershey fonts. For
+         * each glyph from ' ' to '~': the number of vertices, the advance and
+         * the vertices, where -1,-1 lifts the pen. A capital is 21 units high
+         * on a baseline at 0.
+         */
+        constexpr std::int8_t simplex[stroke_font::glyph_count][112] = {
+            /* ' ' */ { 0, 16},
+            /* '!' */ { 8, 10,  5, 21,  5,  7, -1, -1,  5,  2,  4,  1,  5,  0,  6,  1,  5,  2},
+            /* '"' */ { 5, 16,  4, 21,  4, 14, -1, -1, 12, 21, 12, 14},
+            /* '#' */ {11, 21, 11, 25,  4, -7, -1, -1, 17, 25, 10, -7, -1, -1,  4, 12, 18, 12,
+                      -1, -1,  3,  6, 17,  6},
+            /* '$' */ {26, 20,  8, 25,  8, -4, -1, -1, 12, 25, 12, -4, -1, -1, 17, 18, 15, 20,
+                      12, 21,  8, 21,  5, 20,  3, 18,  3, 16,  4, 14,  5, 13,  7, 12, 13, 10,
+                      15,  9, 16,  8, 17,  6, 17,  3, 15,  1, 12,  0,  8,  0,  5,  1,  3,  3},
+            /* '%' */ {31, 24, 21, 21,  3,  0, -1, -1,  8, 21, 10, 19, 10, 17,  9, 15,  7, 14,
+                       5, 14,  3, 16,  3, 18,  4, 20,  6, 21,  8, 21, 10, 20, 13, 19, 16, 19,
+                      19, 20, 21, 21, -1, -1, 17,  7, 15,  6, 14,  4, 14,  2, 16,  0, 18,  0,
+                      20,  1, 21,  3, 21,  5, 19,  7, 17,  7},
+            /* '&' */ {34, 26, 23, 12, 23, 13, 22, 14, 21, 14, 20, 13, 19, 11, 17,  6, 15,  3,
+                      13,  1, 11,  0,  7,  0,  5,  1,  4,  2,  3,  4,  3,  6,  4,  8,  5,  9,
+                      12, 13, 13, 14, 14, 16, 14, 18, 13, 20, 11, 21,  9, 20,  8, 18,  8, 16,
+                       9, 13, 11, 10, 16,  3, 18,  1, 20,  0, 22,  0, 23,  1, 23,  2},
+            /* ''' */ { 7, 10,  5, 19,  4, 20,  5, 21,  6, 20,  6, 18,  5, 16,  4, 15},
+            /* '(' */ {10, 14, 11, 25,  9, 23,  7, 20,  5, 16,  4, 11,  4,  7,  5,  2,  7, -2,
+                       9, -5, 11, -7},
+            /* ')' */ {10, 14,  3, 25,  5, 23,  7, 20,  9, 16, 10, 11, 10,  7,  9,  2,  7, -2,
+                       5, -5,  3, -7},
+            /* '*' */ { 8, 16,  8, 21,  8,  9, -1, -1,  3, 18, 13, 12, -1, -1, 13, 18,  3, 12},
+            /* '+' */ { 5, 26, 13, 18, 13,  0, -1, -1,  4,  9, 22,  9},
+            /* ',' */ { 8, 10,  6,  1,  5,  0,  4,  1,  5,  2,  6,  1,  6, -1,  5, -3,  4, -4},
+            /* '-' */ { 2, 26,  4,  9, 22,  9},
+            /* '.' */ { 5, 10,  5,  2,  4,  1,  5,  0,  6,  1,  5,  2},
+            /* '/' */ { 2, 22, 20, 25,  2, -7},
+            /* '0' */ {17, 20,  9, 21,  6, 20,  4, 17,  3, 12,  3,  9,  4,  4,  6,  1,  9,  0,
+                      11,  0, 14,  1, 16,  4, 17,  9, 17, 12, 16, 17, 14, 20, 11, 21,  9, 21},
+            /* '1' */ { 4, 20,  6, 17,  8, 18, 11, 21, 11,  0},
+            /* '2' */ {14, 20,  4, 16,  4, 17,  5, 19,  6, 20,  8, 21, 12, 21, 14, 20, 15, 19,
+                      16, 17, 16, 15, 15, 13, 13, 10,  3,  0, 17,  0},
+            /* '3' */ {15, 20,  5, 21, 16, 21, 10, 13, 13, 13, 15, 12, 16, 11, 17,  8, 17,  6,
+                      16,  3, 14,  1, 11,  0,  8,  0,  5,  1,  4,  2,  3,  4},
+            /* '4' */ { 6, 20, 13, 21,  3,  7, 18,  7, -1, -1, 13, 21, 13,  0},
+            /* '5' */ {17, 20, 15, 21,  5, 21,  4, 12,  5, 13,  8, 14, 11, 14, 14, 13, 16, 11,
+                      17,  8, 17,  6, 16,  3, 14,  1, 11,  0,  8,  0,  5,  1,  4,  2,  3,  4},
+            /* '6' */ {23, 20, 16, 18, 15, 20, 12, 21, 10, 21,  7, 20,  5, 17,  4, 12,  4,  7,
+                       5,  3,  7,  1, 10,  0, 11,  0, 14,  1, 16,  3, 17,  6, 17,  7, 16, 10,
+                      14, 12, 11, 13, 10, 13,  7, 12,  5, 10,  4,  7},
+            /* '7' */ { 5, 20, 17, 21,  7,  0, -1, -1,  3, 21, 17, 21},
+            /* '8' */ {29, 20,  8, 21,  5, 20,  4, 18,  4, 16,  5, 14,  7, 13, 11, 12, 14, 11,
+                      16,  9, 17,  7, 17,  4, 16,  2, 15,  1, 12,  0,  8,  0,  5,  1,  4,  2,
+                       3,  4,  3,  7,  4,  9,  6, 11,  9, 12, 13, 13, 15, 14, 16, 16, 16, 18,
+                      15, 20, 12, 21,  8, 21},
+            /* '9' */ {23, 20, 16, 14, 15, 11, 13,  9, 10,  8,  9,  8,  6,  9,  4, 11,  3, 14,
+                       3, 15,  4, 18,  6, 20,  9, 21, 10, 21, 13, 20, 15, 18, 16, 14, 16,  9,
+                      15,  4, 13,  1, 10,  0,  8,  0,  5,  1,  4,  3},
+            /* ':' */ {11, 10,  5, 14,  4, 13,  5, 12,  6, 13,  5, 14, -1, -1,  5,  2,  4,  1,
+                       5,  0,  6,  1,  5,  2},
+            /* ';' */ {14, 10,  5, 14,  4, 13,  5, 12,  6, 13,  5, 14, -1, -1,  6,  1,  5,  0,
+                       4,  1,  5,  2,  6,  1,  6, -1,  5, -3,  4, -4},
+            /* '<' */ { 3, 24, 20, 18,  4,  9, 20,  0},
+            /* '=' */ { 5, 26,  4, 12, 22, 12, -1, -1,  4,  6, 22,  6},
+            /* '>' */ { 3, 24,  4, 18, 20,  9,  4,  0},
+            /* '?' */ {20, 18,  3, 16,  3, 17,  4, 19,  5, 20,  7, 21, 11, 21, 13, 20, 14, 19,
+                      15, 17, 15, 15, 14, 13, 13, 12,  9, 10,  9,  7, -1, -1,  9,  2,  8,  1,
+                       9,  0, 10,  1,  9,  2},
+            /* '@' */ {55, 27, 18, 13, 17, 15, 15, 16, 12, 16, 10, 15,  9, 14,  8, 11,  8,  8,
+                       9,  6, 11,  5, 14,  5, 16,  6, 17,  8, -1, -1, 12, 16, 10, 14,  9, 11,
+                       9,  8, 10,  6, 11,  5, -1, -1, 18, 16, 17,  8, 17,  6, 19,  5, 21,  5,
+                      23,  7, 24, 10, 24, 12, 23, 15, 22, 17, 20, 19, 18, 20, 15, 21, 12, 21,
+                       9, 20,  7, 19,  5, 17,  4, 15,  3, 12,  3,  9,  4,  6,  5,  4,  7,  2,
+                       9,  1, 12,  0, 15,  0, 18,  1, 20,  2, 21,  3, -1, -1, 19, 16, 18,  8,
+                      18,  6, 19,  5},
+            /* 'A' */ { 8, 18,  9, 21,  1,  0, -1, -1,  9, 21, 17,  0, -1, -1,  4,  7, 14,  7},
+            /* 'B' */ {23, 21,  4, 21,  4,  0, -1, -1,  4, 21, 13, 21, 16, 20, 17, 19, 18, 17,
+                      18, 15, 17, 13, 16, 12, 13, 11, -1, -1,  4, 11, 13, 11, 16, 10, 17,  9,
+                      18,  7, 18,  4, 17,  2, 16,  1, 13,  0,  4,  0},
+            /* 'C' */ {18, 21, 18, 16, 17, 18, 15, 20, 13, 21,  9, 21,  7, 20,  5, 18,  4, 16,
+                       3, 13,  3,  8,  4,  5,  5,  3,  7,  1,  9,  0, 13,  0, 15,  1, 17,  3,
+                      18,  5},
+            /* 'D' */ {15, 21,  4, 21,  4,  0, -1, -1,  4, 21, 11, 21, 14, 20, 16, 18, 17, 16,
+                      18, 13, 18,  8, 17,  5, 16,  3, 14,  1, 11,  0,  4,  0},
+            /* 'E' */ {11, 19,  4, 21,  4,  0, -1, -1,  4, 21, 17, 21, -1, -1,  4, 11, 12, 11,
+                      -1, -1,  4,  0, 17,  0},
+            /* 'F' */ { 8, 18,  4, 21,  4,  0, -1, -1,  4, 21, 17, 21, -1, -1,  4, 11, 12, 11},
+            /* 'G' */ {22, 21, 18, 16, 17, 18, 15, 20, 13, 21,  9, 21,  7, 20,  5, 18,  4, 16,
+                       3, 13,  3,  8,  4,  5,  5,  3,  7,  1,  9,  0, 13,  0, 15,  1, 17,  3,
+                      18,  5, 18,  8, -1, -1, 13,  8, 18,  8},
+            /* 'H' */ { 8, 22,  4, 21,  4,  0, -1, -1, 18, 21, 18,  0, -1, -1,  4, 11, 18, 11},
+            /* 'I' */ { 2,  8,  4, 21,  4,  0},
+            /* 'J' */ {10, 16, 12, 21, 12,  5, 11,  2, 10,  1,  8,  0,  6,  0,  4,  1,  3,  2,
+                       2,  5,  2,  7},
+            /* 'K' */ { 8, 21,  4, 21,  4,  0, -1, -1, 18, 21,  4,  7, -1, -1,  9, 12, 18,  0},
+            /* 'L' */ { 5, 17,  4, 21,  4,  0, -1, -1,  4,  0, 16,  0},
+            /* 'M' */ {11, 24,  4, 21,  4,  0, -1, -1,  4, 21, 12,  0, -1, -1, 20, 21, 12,  0,
+                      -1, -1, 20, 21, 20,  0},
+            /* 'N' */ { 8, 22,  4, 21,  4,  0, -1, -1,  4, 21, 18,  0, -1, -1, 18, 21, 18,  0},
+            /* 'O' */ {21, 22,  9, 21,  7, 20,  5, 18,  4, 16,  3, 13,  3,  8,  4,  5,  5,  3,
+                       7,  1,  9,  0, 13,  0, 15,  1, 17,  3, 18,  5, 19,  8, 19, 13, 18, 16,
+                      17, 18, 15, 20, 13, 21,  9, 21},
+            /* 'P' */ {13, 21,  4, 21,  4,  0, -1, -1,  4, 21, 13, 21, 16, 20, 17, 19, 18, 17,
+                      18, 14, 17, 12, 16, 11, 13, 10,  4, 10},
+            /* 'Q' */ {24, 22,  9, 21,  7, 20,  5, 18,  4, 16,  3, 13,  3,  8,  4,  5,  5,  3,
+                       7,  1,  9,  0, 13,  0, 15,  1, 17,  3, 18,  5, 19,  8, 19, 13, 18, 16,
+                      17, 18, 15, 20, 13, 21,  9, 21, -1, -1, 12,  4, 18, -2},
+            /* 'R' */ {16, 21,  4, 21,  4,  0, -1, -1,  4, 21, 13, 21, 16, 20, 17, 19, 18, 17,
+                      18, 15, 17, 13, 16, 12, 13, 11,  4, 11, -1, -1, 11, 11, 18,  0},
+            /* 'S' */ {20, 20, 17, 18, 15, 20, 12, 21,  8, 21,  5, 20,  3, 18,  3, 16,  4, 14,
+                       5, 13,  7, 12, 13, 10, 15,  9, 16,  8, 17,  6, 17,  3, 15,  1, 12,  0,
+                       8,  0,  5,  1,  3,  3},
+            /* 'T' */ { 5, 16,  8, 21,  8,  0, -1, -1,  1, 21, 15, 21},
+            /* 'U' */ {10, 22,  4, 21,  4,  6,  5,  3,  7,  1, 10,  0, 12,  0, 15,  1, 17,  3,
+                      18,  6, 18, 21},
+            /* 'V' */ { 5, 18,  1, 21,  9,  0, -1, -1, 17, 21,  9,  0},
+            /* 'W' */ {11, 24,  2, 21,  7,  0, -1, -1, 12, 21,  7,  0, -1, -1, 12, 21, 17,  0,
+                      -1, -1, 22, 21, 17,  0},
+            /* 'X' */ { 5, 20,  3, 21, 17,  0, -1, -1, 17, 21,  3,  0},
+            /* 'Y' */ { 6, 18,  1, 21,  9, 11,  9,  0, -1, -1, 17, 21,  9, 11},
+            /* 'Z' */ { 8, 20, 17, 21,  3,  0, -1, -1,  3, 21, 17, 21, -1, -1,  3,  0, 17,  0},
+            /* '[' */ {11, 14,  4, 25,  4, -7, -1, -1,  5, 25,  5, -7, -1, -1,  4, 25, 11, 25,
+                      -1, -1,  4, -7, 11, -7},
+            /* '\' */ { 2, 14,  0, 21, 14, -3},
+            /* ']' */ {11, 14,  9, 25,  9, -7, -1, -1, 10, 25, 10, -7, -1, -1,  3, 25, 10, 25,
+                      -1, -1,  3, -7, 10, -7},
+            /* '^' */ {10, 16,  6, 15,  8, 18, 10, 15, -1, -1,  3, 12,  8, 17, 13, 12, -1, -1,
+                       8, 17,  8,  0},
+            /* '_' */ { 2, 16,  0, -2, 16, -2},
+            /* '`' */ { 7, 10,  6, 21,  5, 20,  4, 18,  4, 16,  5, 15,  6, 16,  5, 17},
+            /* 'a' */ {17, 19, 15, 14, 15,  0, -1, -1, 15, 11, 13, 13, 11, 14,  8, 14,  6, 13,
+                       4, 11,  3,  8,  3,  6,  4,  3,  6,  1,  8,  0, 11,  0, 13,  1, 15,  3},
+            /* 'b' */ {17, 19,  4, 21,  4,  0, -1, -1,  4, 11,  6, 13,  8, 14, 11, 14, 13, 13,
+                      15, 11, 16,  8, 16,  6, 15,  3, 13,  1, 11,  0,  8,  0,  6,  1,  4,  3},
+            /* 'c' */ {14, 18, 15, 11, 13, 13, 11, 14,  8, 14,  6, 13,  4, 11,  3,  8,  3,  6,
+                       4,  3,  6,  1,  8,  0, 11,  0, 13,  1, 15,  3},
+            /* 'd' */ {17, 19, 15, 21, 15,  0, -1, -1, 15, 11, 13, 13, 11, 14,  8, 14,  6, 13,
+                       4, 11,  3,  8,  3,  6,  4,  3,  6,  1,  8,  0, 11,  0, 13,  1, 15,  3},
+            /* 'e' */ {17, 18,  3,  8, 15,  8, 15, 10, 14, 12, 13, 13, 11, 14,  8, 14,  6, 13,
+                       4, 11,  3,  8,  3,  6,  4,  3,  6,  1,  8,  0, 11,  0, 13,  1, 15,  3},
+            /* 'f' */ { 8, 12, 10, 21,  8, 21,  6, 20,  5, 17,  5,  0, -1, -1,  2, 14,  9, 14},
+            /* 'g' */ {22, 19, 15, 14, 15, -2, 14, -5, 13, -6, 11, -7,  8, -7,  6, -6, -1, -1,
+                      15, 11, 13, 13, 11, 14,  8, 14,  6, 13,  4, 11,  3,  8,  3,  6,  4,  3,
+                       6,  1,  8,  0, 11,  0, 13,  1, 15,  3},
+            /* 'h' */ {10, 19,  4, 21,  4,  0, -1, -1,  4, 10,  7, 13,  9, 14, 12, 14, 14, 13,
+                      15, 10, 15,  0},
+            /* 'i' */ { 8,  8,  3, 21,  4, 20,  5, 21,  4, 22,  3, 21, -1, -1,  4, 14,  4,  0},
+            /* 'j' */ {11, 10,  5, 21,  6, 20,  7, 21,  6, 22,  5, 21, -1, -1,  6, 14,  6, -3,
+                       5, -6,  3, -7,  1, -7},
+            /* 'k' */ { 8, 17,  4, 21,  4,  0, -1, -1, 14, 14,  4,  4, -1, -1,  8,  8, 15,  0},
+            /* 'l' */ { 2,  8,  4, 21,  4,  0},
+            /* 'm' */ {18, 30,  4, 14,  4,  0, -1, -1,  4, 10,  7, 13,  9, 14, 12, 14, 14, 13,
+                      15, 10, 15,  0, -1, -1, 15, 10, 18, 13, 20, 14, 23, 14, 25, 13, 26, 10,
+                      26,  0},
+            /* 'n' */ {10, 19,  4, 14,  4,  0, -1, -1,  4, 10,  7, 13,  9, 14, 12, 14, 14, 13,
+                      15, 10, 15,  0},
+            /* 'o' */ {17, 19,  8, 14,  6, 13,  4, 11,  3,  8,  3,  6,  4,  3,  6,  1,  8,  0,
+                      11,  0, 13,  1, 15,  3, 16,  6, 16,  8, 15, 11, 13, 13, 11, 14,  8, 14},
+            /* 'p' */ {17, 19,  4, 14,  4, -7, -1, -1,  4, 11,  6, 13,  8, 14, 11, 14, 13, 13,
+                      15, 11, 16,  8, 16,  6, 15,  3, 13,  1, 11,  0,  8,  0,  6,  1,  4,  3},
+            /* 'q' */ {17, 19, 15, 14, 15, -7, -1, -1, 15, 11, 13, 13, 11, 14,  8, 14,  6, 13,
+                       4, 11,  3,  8,  3,  6,  4,  3,  6,  1,  8,  0, 11,  0, 13,  1, 15,  3},
+            /* 'r' */ { 8, 13,  4, 14,  4,  0, -1, -1,  4,  8,  5, 11,  7, 13,  9, 14, 12, 14},
+            /* 's' */ {17, 17, 14, 11, 13, 13, 10, 14,  7, 14,  4, 13,  3, 11,  4,  9,  6,  8,
+                      11,  7, 13,  6, 14,  4, 14,  3, 13,  1, 10,  0,  7,  0,  4,  1,  3,  3},
+            /* 't' */ { 8, 12,  5, 21,  5,  4,  6,  1,  8,  0, 10,  0, -1, -1,  2, 14,  9, 14},
+            /* 'u' */ {10, 19,  4, 14,  4,  4,  5,  1,  7,  0, 10,  0, 12,  1, 15,  4, -1, -1,
+                      15, 14, 15,  0},
+            /* 'v' */ { 5, 16,  2, 14,  8,  0, -1, -1, 14, 14,  8,  0},
+            /* 'w' */ {11, 22,  3, 14,  7,  0, -1, -1, 11, 14,  7,  0, -1, -1, 11, 14, 15,  0,
+                      -1, -1, 19, 14, 15,  0},
+            /* 'x' */ { 5, 17,  3, 14, 14,  0, -1, -1, 14, 14,  3,  0},
+            /* 'y' */ { 9, 16,  2, 14,  8,  0, -1, -1, 14, 14,  8,  0,  6, -4,  4, -6,  2, -7,
+                       1, -7},
+            /* 'z' */ { 8, 17, 14, 14,  3,  0, -1, -1,  3, 14, 14, 14, -1, -1,  3,  0, 14,  0},
+            /* '{' */ {39, 14,  9, 25,  7, 24,  6, 23,  5, 21,  5, 19,  6, 17,  7, 16,  8, 14,
+                       8, 12,  6, 10, -1, -1,  7, 24,  6, 22,  6, 20,  7, 18,  8, 17,  9, 15,
+                       9, 13,  8, 11,  4,  9,  8,  7,  9,  5,  9,  3,  8,  1,  7,  0,  6, -2,
+                       6, -4,  7, -6, -1, -1,  6,  8,  8,  6,  8,  4,  7,  2,  6,  1,  5, -1,
+                       5, -3,  6, -5,  7, -6,  9, -7},
+            /* '|' */ { 2,  8,  4, 25,  4, -7},
+            /* '}' */ {39, 14,  5, 25,  7, 24,  8, 23,  9, 21,  9, 19,  8, 17,  7, 16,  6, 14,
+                       6, 12,  8, 10, -1, -1,  7, 24,  8, 22,  8, 20,  7, 18,  6, 17,  5, 15,
+                       5, 13,  6, 11, 10,  9,  6,  7,  5,  5,  5,  3,  6,  1,  7,  0,  8, -2,
+                       8, -4,  7, -6, -1, -1,  8,  8,  6,  6,  6,  4,  7,  2,  8,  1,  9, -1,
+                       9, -3,  8, -5,  7, -6,  5, -7},
+            /* '~' */ {23, 24,  3,  6,  3,  8,  4, 11,  6, 12,  8, 12, 10, 11, 14,  8, 16,  7,
+                      18,  7, 20,  8, 21, 10, -1, -1,  3,  8,  4, 10,  6, 11,  8, 11, 10, 10,
+                      14,  7, 16,  6, 18,  6, 20,  7, 21, 10, 21, 12}
+        };
+
+        /**
+         * Kerning looks at how close two glyphs come within bands of this
+         * many font units, from below the descenders to above the capitals
+         */
+        constexpr int band_height = 3;
+        constexpr int band_bottom = -8;
+        constexpr int band_count = 12;
+
+        /**
+         * Most a pair is closed up, in font units
+         */
+        constexpr double max_kerning = 5;
+
+        /**
+         * Leftmost and rightmost ink of a glyph in each band
+         */
+        struct glyph_profile{
+            std::array<double, band_count> left;
+            std::array<double, band_count> right;
+            double min_left;
+            double max_right;
+
+            glyph_profile()
+                :   left(),
+                    right(),
+                    min_left(std::numeric_limits<double>::infinity()),
+                    max_right(-std::numeric_limits<double>::infinity()){
+                left.fill(std::numeric_limits<double>::infinity());
+                right.fill(-std::numeric_limits<double>::infinity());
+            }
+
+            void add(double x, double y){
+                int band = std::min(band_count - 1, std::max(0, static_cast<int>(std::floor((y - band_bottom) / band_height))));
+                left[band] = std::min(left[band], x);
+                right[band] = std::max(right[band], x);
+                min_left = std::min(min_left, x);
+                max_right = std::max(max_right, x);
+            }
+
+            bool has_ink(int band) const{return left[band] <= right[band];}
+        };
+
+        glyph_profile profile_of(const std::int8_t* glyph){
+            glyph_profile profile;
+            const std::int8_t* vertex = glyph + 2;
+            bool drawing = false;
+            double last_x = 0;
+            double last_y = 0;
+            for(int i = 0; i < glyph[0]; i++, vertex += 2){
+                if(vertex[0] == -1 && vertex[1] == -1){
+                    drawing = false;
+                    continue;
+                }
+                double x = vertex[0];
+                double y = vertex[1];
+                if(drawing){
+                    // Sample the segment finely enough to catch every band
+                    int samples = static_cast<int>(std::ceil(std::max(std::fabs(x - last_x), std::fabs(y - last_y)) * 2));
+                    for(int sample = 1; sample <= samples; sample++){
+                        double t = static_cast<double>(sample) / samples;
+                        profile.add(last_x + (x - last_x) * t, last_y + (y - last_y) * t);
+                    }
+                }
+                profile.add(x, y);
+                drawing = true;
+                last_x = x;
+                last_y = y;
+            }
+            return profile;
+        }
+    }
+
+    stroke_font::stroke_font()
+        :   m_kerning(glyph_count * glyph_count, 0),
+            m_sizes(){
+        std::vector<glyph_profile> profiles;
+        profiles.reserve(glyph_count);
+        for(std::size_t glyph = 0; glyph < glyph_count; glyph++){
+            profiles.push_back(profile_of(simplex[glyph]));
+        }
+        // A pair is closed up by half of however much wider the narrowest
+        // gap between the two glyphs, band against neighbouring band, is
+        // than the gap between their boxes
+        for(std::size_t first = 0; first < glyph_count; first++){
+            const glyph_profile& left = profiles[first];
+            double width = simplex[first][1];
+            for(std::size_t second = 0; second < glyph_count; second++){
+                const glyph_profile& right = profiles[second];
+                double gap = std::numeric_limits<double>::infinity();
+                for(int band = 0; band < band_count; band++){
+                    if(!left.has_ink(band)){
+                        continue;
+                    }
+                    for(int other = std::max(0, band - 1); other <= std::min(band_count - 1, band + 1); other++){
+                        if(right.has_ink(other)){
+                            gap = std::min(gap, width - left.right[band] + right.left[other]);
+                        }
+                    }
+                }
+                if(gap == std::numeric_limits<double>::infinity()){
+                    continue;
+                }
+                double box_gap = width - left.max_right + right.min_left;
+                double closing = std::min(max_kerning, (gap - box_gap) / 2);
+                m_kerning[first * glyph_count + second] = static_cast<std::int8_t>(-std::lround(closing));
+            }
+        }
+    }
+
+    std::size_t stroke_font::glyph_index(char character){
+        if(character < first_glyph || character > '~'){
+            character = '?';
+        }
+        return static_cast<std::size_t>(character - first_glyph);
+    }
+
+    int stroke_font::kerning(char first, char second) const{
+        return m_kerning[glyph_index(first) * glyph_count + glyph_index(second)];
+    }
+
+    const stroke_font::sized_glyphs& stroke_font::glyphs(position height){
+        auto found = m_sizes.find(height.count());
+        if(found != m_sizes.end()){
+            return found->second;
+        }
+        sized_glyphs& sized = m_sizes[height.count()];
+        sized.scale = static_cast<double>(height.count()) / 21;
+        for(std::size_t glyph = 0; glyph < glyph_count; glyph++){
+            sized.first_stroke[glyph] = static_cast<std::uint32_t>(sized.stroke_starts.size());
+            sized.advance[glyph] = std::llround(simplex[glyph][1] * sized.scale);
+            const std::int8_t* vertex = simplex[glyph] + 2;
+            bool drawing = false;
+            for(int i = 0; i < simplex[glyph][0]; i++, vertex += 2){
+                if(vertex[0] == -1 && vertex[1] == -1){
+                    drawing = false;
+                    continue;
+                }
+                if(!drawing){
+                    sized.stroke_starts.push_back(static_cast<std::uint32_t>(sized.points.size()));
+                    drawing = true;
+                }
+                sized.points.push_back(text_point{{std::llround(vertex[0] * sized.scale), std::llround(vertex[1] * sized.scale)}});
+            }
+        }
+        sized.first_stroke[glyph_count] = static_cast<std::uint32_t>(sized.stroke_starts.size());
+        sized.stroke_starts.push_back(static_cast<std::uint32_t>(sized.points.size()));
+        return sized;
+    }
+
+    std::size_t stroke_font::render(std::string_view text, position x, position y, const text_style& style, const text_sink& sink){
+        const sized_glyphs& sized = glyphs(style.height);
+        position::rep line_advance = std::llround(static_cast<double>(style.height.count()) * style.line_spacing);
+        text_point origin{{x.count(), y.count()}};
+        std::size_t previous = glyph_count;
+        std::size_t strokes = 0;
+        for(char character : text){
+            if(character == '\n'){
+                origin[0] = x.count();
+                origin[1] -= line_advance;
+                previous = glyph_count;
+                continue;
+            }
+            std::size_t glyph = glyph_index(character);
+            if(style.kerning && previous != glyph_count){
+                origin[0] += std::llround(m_kerning[previous * glyph_count + glyph] * sized.scale);
+            }
+            for(std::uint32_t stroke = sized.first_stroke[glyph]; stroke < sized.first_stroke[glyph + 1]; stroke++){
+                std::uint32_t first = sized.stroke_starts[stroke];
+                sink(text_stroke{&sized.points[first], sized.stroke_starts[stroke + 1] - first, origin});
+            }
+            strokes += sized.first_stroke[glyph + 1] - sized.first_stroke[glyph];
+            origin[0] += sized.advance[glyph] + style.tracking.count();
+            previous = glyph;
+        }
+        return strokes;
+    }
+
+    position stroke_font::measure(std::string_view text, const text_style& style){
+        const sized_glyphs& sized = glyphs(style.height);
+        position::rep width = 0;
+        std::size_t previous = glyph_count;
+        for(char character : text){
+            std::size_t glyph = glyph_index(character);
+            if(style.kerning && previous != glyph_count){
+                width += std::llround(m_kerning[previous * glyph_count + glyph] * sized.scale);
+            }
+            width += sized.advance[glyph] + style.tracking.count();
+            previous = glyph;
+        }
+        return position(width);
+    }
+
+    command_source text_source(stroke_font& font, std::vector<text_line> lines, const text_style& style,
+            const import_config& config){
+        struct state{
+            std::vector<text_line> lines;
+            std::size_t next_line = 0;
+            std::vector<move_command> pending;
+            std::size_t pending_next = 0;
+            text_sink sink;
+        };
+        auto shared = std::make_shared<state>();
+        shared->lines = std::move(lines);
+        state* raw = shared.get();
+        shared->sink = [raw, config](const text_stroke& stroke){
+            move_command command{};
+            command.line = static_cast<std::uint32_t>(raw->next_line);
+            command.type = move_command::kind::move;
+            command.feed_rate = config.travel_feed;
+            text_point at = stroke.at(0);
+            command.target[0] = at[0];
+            command.target[1] = at[1];
+            raw->pending.push_back(command);
+
+            move_command pen{};
+            pen.line = command.line;
+            pen.type = move_command::kind::pen;
+            pen.pen_down = true;
+            raw->pending.push_back(pen);
+
+            command.feed_rate = config.draw_feed;
+            for(std::size_t i = 1; i < stroke.count; i++){
+                at = stroke.at(i);
+                command.target[0] = at[0];
+                command.target[1] = at[1];
+                raw->pending.push_back(command);
+            }
+            pen.pen_down = false;
+            raw->pending.push_back(pen);
+        };
+        return [shared, &font, style](move_command& command){
+            while(shared->pending_next == shared->pending.size()){
+                if(shared->next_line == shared->lines.size()){
+                    return false;
+                }
+                shared->pending.clear();
+                shared->pending_next = 0;
+                const text_line& line = shared->lines[shared->next_line++];
+                font.render(line.text, line.x, line.y, style, shared->sink);
+            }
+            command = shared->pending[shared->pending_next++];
+            return true;
+        };
+    }
+}
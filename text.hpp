@@ -0,0 +1,163 @@
+#ifndef TEXT_HPP
+#define TEXT_HPP
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "job_import.hpp"
+#include "units.hpp"
+
+namespace plotter{
+
+    /**
+     * X and Y in nanometers
+     */
+    using text_point = std::array<position::rep, 2>;
+
+    /**
+     * One stroke of a laid out glyph. The points are those of the cached
+     * glyph and the origin says where the glyph goes, so laying out text
+     * copies nothing.
+     */
+    struct text_stroke{
+        const text_point* points;
+        std::size_t count;
+        text_point origin;
+
+        text_point at(std::size_t index) const{
+            return text_point{{points[index][0] + origin[0], points[index][1] + origin[1]}};
+        }
+    };
+
+    /**
+     * Receives the strokes of laid out text in drawing order
+     */
+    using text_sink = std::function<void(const text_stroke&)>;
+
+    struct text_style{
+        /**
+         * Height of a capital letter
+         */
+        position height = position::from<std::micro>(5000);
+
+        /**
+         * Space added between letters, on top of kerning
+         */
+        position tracking = position(0);
+
+        /**
+         * Distance between baselines, as a multiple of the height
+         */
+        double line_spacing = 1.6;
+
+        bool kerning = true;
+    };
+
+    /**
+     * Single stroke font for plotting text, the Hershey simplex Roman face
+     * covering printable ASCII. Anything else is drawn as '?'.
+     *
+     * The glyphs of each text height are scaled to whole nanometers once and
+     * cached, so laying out a string is a single pass of additions with no
+     * allocation. Kerning pairs are worked out when the font is built from
+     * how close the outlines of two glyphs come across their height.
+     *
+     * Not thread safe: layout fills the cache.
+     */
+    class stroke_font{
+        public:
+            static constexpr char first_glyph = ' ';
+            static constexpr std::size_t glyph_count = 95;
+
+        private:
+            /**
+             * The glyphs scaled to one height
+             */
+            struct sized_glyphs{
+                double scale;
+                std::vector<text_point> points;
+
+                /**
+                 * First point of each stroke, and one past the last point
+                 */
+                std::vector<std::uint32_t> stroke_starts;
+
+                /**
+                 * First stroke of each glyph, and one past the last stroke
+                 */
+                std::array<std::uint32_t, glyph_count + 1> first_stroke;
+                std::array<position::rep, glyph_count> advance;
+            };
+
+            /**
+             * Pairs of glyphs, first glyph major, in font units
+             */
+            std::vector<std::int8_t> m_kerning;
+            std::unordered_map<position::rep, sized_glyphs> m_sizes;
+
+            const sized_glyphs& glyphs(position height);
+            static std::size_t glyph_index(char character);
+
+        public:
+            stroke_font();
+
+            /**
+             * Lay out text, starting each line at the origin and going down
+             * a line at every newline
+             *
+             * @param text: characters to draw
+             * @param x: left end of the first baseline
+             * @param y: first baseline
+             * @param style: size and spacing
+             * @param sink: receives every stroke
+             * @return: number of strokes
+             */
+            std::size_t render(std::string_view text, position x, position y, const text_style& style, const text_sink& sink);
+
+            /**
+             * @param text: one line of characters
+             * @param style: size and spacing
+             * @return: advance of the line
+             */
+            position measure(std::string_view text, const text_style& style);
+
+            /**
+             * @return: kerning of a pair in font units, where a capital is
+             *          21 units high, negative to close up
+             */
+            int kerning(char first, char second) const;
+
+            std::size_t cached_sizes() const{return m_sizes.size();}
+    };
+
+    /**
+     * Line of a text job
+     */
+    struct text_line{
+        std::string text;
+        position x;
+        position y;
+    };
+
+    /**
+     * Turn text into a job, laying out one line at a time as the commands
+     * are taken
+     *
+     * @param font: font to draw with, must outlive the source
+     * @param lines: text and where each line starts
+     * @param style: size and spacing
+     * @param config: draw and travel speeds
+     * @return: commands drawing the text
+     */
+    command_source text_source(stroke_font& font, std::vector<text_line> lines, const text_style& style,
+            const import_config& config=import_config());
+}
+
+#endif
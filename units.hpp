@@ -1,7 +1,9 @@
 #pragma once
-#ifndef PLOTTER_UNITS_HPP 
+#ifndef PLOTTER_UNITS_HPP
 #define PLOTTER_UNITS_HPP
 
+#include <cmath>
+#include <cstdint>
 #include <ratio>
 
 namespace plotter{
@@ -39,12 +41,12 @@ namespace plotter{
     };
 
     using millimeters = travel<std::milli>;
-    using centimeters = travel<std::milli>;
-    using decimeters = travel<std::milli>;
-    using meters = travel<std::milli>;
-    using decameters = travel<std::milli>;
-    using hectometers = travel<std::milli>;
-    using kilometers = travel<std::milli>;
+    using centimeters = travel<std::centi>;
+    using decimeters = travel<std::deci>;
+    using meters = travel<std::ratio<1>>;
+    using decameters = travel<std::deca>;
+    using hectometers = travel<std::hecto>;
+    using kilometers = travel<std::kilo>;
 
     class bool_t{
         private:
@@ -56,6 +58,299 @@ namespace plotter{
             bool* operator&(){return &m_value;}
             const bool* operator&() const{return &m_value;}
     };
+
+/******************************************************************************/
+/*                             Fixed-Point Units                              */
+/******************************************************************************/
+
+    /**
+     * How a fixed-point conversion resolves a remainder
+     */
+    enum class rounding{
+        nearest,        // Half away from zero
+        toward_zero,
+        down,           // Toward negative infinity
+        up              // Toward positive infinity
+    };
+
+    /**
+     * Integer division with an explicit rounding mode
+     *
+     * @param numerator: value to divide
+     * @param denominator: positive divisor
+     * @param mode: how to round the quotient
+     * @return: rounded quotient
+     */
+    constexpr std::int64_t divide(std::int64_t numerator, std::int64_t denominator, rounding mode){
+        std::int64_t quotient = numerator / denominator;
+        std::int64_t remainder = numerator % denominator;
+        if(remainder == 0){
+            return quotient;
+        }
+        bool negative = remainder < 0;
+        switch(mode){
+            case rounding::nearest:{
+                std::int64_t magnitude = negative ? -remainder : remainder;
+                if(magnitude >= denominator - magnitude){
+                    return negative ? quotient - 1 : quotient + 1;
+                }
+                return quotient;
+            }
+            case rounding::down:
+                return negative ? quotient - 1 : quotient;
+            case rounding::up:
+                return negative ? quotient : quotient + 1;
+            default:
+                return quotient;
+        }
+    }
+
+    /**
+     * Integer square root, rounded down. Works a bit pair at a time from
+     * the highest set pair, without branching on the value so the loop
+     * doesn't mispredict.
+     *
+     * @param value: value to take the root of
+     * @return: largest r where r * r <= value
+     */
+    constexpr std::uint64_t isqrt(std::uint64_t value){
+        if(value == 0){
+            return 0;
+        }
+        std::uint64_t root = 0;
+        std::uint64_t bit = std::uint64_t{1} << ((63 - __builtin_clzll(value)) & ~1);
+        while(bit != 0){
+            std::uint64_t trial = root + bit;
+            std::uint64_t fits = 0 - static_cast<std::uint64_t>(value >= trial);
+            value -= trial & fits;
+            root = (root >> 1) + (bit & fits);
+            bit >>= 2;
+        }
+        return root;
+    }
+
+    /**
+     * Computes value * numerator / denominator with a 128-bit intermediate
+     * so the product can't overflow, without relying on a native 128-bit
+     * type (32-bit ARM doesn't have one)
+     *
+     * @param value: value to scale
+     * @param numerator: non-negative multiplier
+     * @param denominator: positive divisor
+     * @param mode: how to round the result
+     * @return: rounded result, which must fit in 64 bits
+     */
+    constexpr std::int64_t scale(std::int64_t value, std::int64_t numerator, std::int64_t denominator, rounding mode){
+        bool negative = value < 0;
+        std::uint64_t magnitude = negative ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+        std::uint64_t multiplier = static_cast<std::uint64_t>(numerator);
+        std::uint64_t divisor = static_cast<std::uint64_t>(denominator);
+
+        // 64x64 -> 128 multiply on 32-bit limbs
+        std::uint64_t a_lo = magnitude & 0xFFFFFFFFu;
+        std::uint64_t a_hi = magnitude >> 32;
+        std::uint64_t b_lo = multiplier & 0xFFFFFFFFu;
+        std::uint64_t b_hi = multiplier >> 32;
+        std::uint64_t lo_lo = a_lo * b_lo;
+        std::uint64_t hi_lo = a_hi * b_lo;
+        std::uint64_t lo_hi = a_lo * b_hi;
+        std::uint64_t hi_hi = a_hi * b_hi;
+        std::uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+        std::uint64_t high = hi_hi + (hi_lo >> 32) + (cross >> 32);
+        std::uint64_t low = (cross << 32) | (lo_lo & 0xFFFFFFFFu);
+
+        // 128 / 64 restoring division, unless the product fits in 64 bits
+        // as it nearly always does
+        std::uint64_t quotient = 0;
+        std::uint64_t remainder = 0;
+        if(high == 0){
+            quotient = low / divisor;
+            remainder = low % divisor;
+        }
+        for(int bit = high == 0 ? -1 : 127; bit >= 0; bit--){
+            bool carry = (remainder >> 63) != 0;
+            remainder = (remainder << 1) | ((bit >= 64 ? (high >> (bit - 64)) : (low >> bit)) & 1);
+            quotient <<= 1;
+            if(carry || remainder >= divisor){
+                remainder -= divisor;
+                quotient |= 1;
+            }
+        }
+
+        if(remainder != 0){
+            bool round_away = false;
+            switch(mode){
+                case rounding::nearest:
+                    round_away = remainder >= divisor - remainder;
+                    break;
+                case rounding::down:
+                    round_away = negative;
+                    break;
+                case rounding::up:
+                    round_away = !negative;
+                    break;
+                default:
+                    break;
+            }
+            if(round_away){
+                quotient++;
+            }
+        }
+        return negative ? -static_cast<std::int64_t>(quotient) : static_cast<std::int64_t>(quotient);
+    }
+
+    /**
+     * Fixed-point length counted in whole nanometers. Units are converted
+     * with exact compile-time ratios, so positions can be added up over
+     * a long job without accumulating rounding drift.
+     */
+    class position{
+        public:
+            using rep = std::int64_t;
+            using resolution = std::nano;
+
+        private:
+            rep m_count;
+
+        public:
+            constexpr position() :m_count(0){}
+            constexpr explicit position(rep nanometers) :m_count(nanometers){}
+
+            /**
+             * Exact conversion from a whole number of a unit
+             *
+             * @param R: unit ratio relative to meters, no finer than nanometers
+             * @param value: number of units
+             */
+            template<class R>
+            static constexpr position from(rep value){
+                using factor = std::ratio_divide<R, resolution>;
+                static_assert(factor::den == 1, "Unit is finer than the position resolution");
+                return position(value * factor::num);
+            }
+
+            /**
+             * Conversion from a floating point travel, rounded to the nearest
+             * nanometer. Intended for the input boundary only.
+             *
+             * @param R: unit ratio relative to meters
+             * @param value: travel to convert
+             */
+            template<class R>
+            static position from(travel<R> value){
+                return position(static_cast<rep>(std::llround(convert<R, resolution>(value.value))));
+            }
+
+            /**
+             * Convert to a whole number of a coarser unit
+             *
+             * @param R: unit ratio relative to meters
+             * @param mode: how to round a partial unit
+             */
+            template<class R>
+            constexpr rep to(rounding mode=rounding::nearest) const{
+                using factor = std::ratio_divide<R, resolution>;
+                static_assert(factor::den == 1, "Unit is finer than the position resolution");
+                return divide(m_count, factor::num, mode);
+            }
+
+            /**
+             * @return: position in nanometers
+             */
+            constexpr rep count() const{return m_count;}
+
+            constexpr position operator+(position other) const{return position(m_count + other.m_count);}
+            constexpr position operator-(position other) const{return position(m_count - other.m_count);}
+            constexpr position operator-() const{return position(-m_count);}
+            constexpr position operator*(rep factor) const{return position(m_count * factor);}
+            position& operator+=(position other){m_count += other.m_count; return *this;}
+            position& operator-=(position other){m_count -= other.m_count; return *this;}
+
+            constexpr bool operator==(position other) const{return m_count == other.m_count;}
+            constexpr bool operator!=(position other) const{return m_count != other.m_count;}
+            constexpr bool operator<(position other) const{return m_count < other.m_count;}
+            constexpr bool operator<=(position other) const{return m_count <= other.m_count;}
+            constexpr bool operator>(position other) const{return m_count > other.m_count;}
+            constexpr bool operator>=(position other) const{return m_count >= other.m_count;}
+    };
+
+    /**
+     * Exact rational number of steps per length, used to convert positions
+     * to integer steps
+     */
+    class step_scale{
+        private:
+            /**
+             * m_steps steps occur every m_length nanometers, kept reduced
+             */
+            std::int64_t m_steps;
+            std::int64_t m_length;
+
+            static constexpr std::int64_t gcd(std::int64_t a, std::int64_t b){
+                while(b != 0){
+                    std::int64_t t = a % b;
+                    a = b;
+                    b = t;
+                }
+                return a;
+            }
+
+        public:
+            /**
+             * One step per nanometer, until configured
+             */
+            constexpr step_scale() :m_steps(1), m_length(1){}
+
+            /**
+             * @param steps: number of steps
+             * @param length: distance covered by those steps
+             */
+            constexpr step_scale(std::int64_t steps, position length)
+                :   m_steps(steps / gcd(steps, length.count())),
+                    m_length(length.count() / gcd(steps, length.count())){}
+
+            /**
+             * Build a scale from a configured steps/mm value. The value is
+             * taken to a millionth of a step per millimeter.
+             *
+             * @param steps_per_mm: resolution of the axis
+             */
+            static step_scale from_steps_per_millimeter(double steps_per_mm){
+                return step_scale(std::llround(steps_per_mm * 1e6), position::from<std::kilo>(1));
+            }
+
+            /**
+             * Convert a position to a whole number of steps
+             *
+             * @param value: position to convert
+             * @param mode: how to round a partial step
+             * @return: steps from the origin
+             */
+            constexpr std::int64_t to_steps(position value, rounding mode=rounding::nearest) const{
+                return scale(value.count(), m_steps, m_length, mode);
+            }
+
+            /**
+             * Convert a number of steps back to a position
+             *
+             * @param steps: steps from the origin
+             * @param mode: how to round a partial nanometer
+             * @return: position of that step
+             */
+            constexpr position to_position(std::int64_t steps, rounding mode=rounding::nearest) const{
+                return position(scale(steps, m_length, m_steps, mode));
+            }
+
+            /**
+             * @return: approximate steps per millimeter, for display
+             */
+            double steps_per_millimeter() const{
+                return static_cast<double>(m_steps) * 1e6 / static_cast<double>(m_length);
+            }
+
+            constexpr std::int64_t steps() const{return m_steps;}
+            constexpr std::int64_t length() const{return m_length;}
+    };
 }
 
 constexpr double operator""_mm(long double v){return plotter::convert<std::milli>(v);}
@@ -1,31 +1,77 @@
-#include <iostream> 
 #include "wiringPiContext.hpp"
+#include "logging.hpp"
 
 #ifdef HAS_WIRING_PI
 #include "wiringPi.h"
 #endif
 
 namespace plotter{
-    context::context(){
+    context::context() :context(mode::hardware){}
+
+    context::context(mode context_mode)
+        :   m_mode(context_mode),
+            m_state(0),
+            m_written(0){
+        if(is_offline()){
+            return;
+        }
 #ifdef HAS_WIRING_PI
         wiringPiSetupGpio();
 #else
-        std::cout << "Initializing WiringPi Context..." << std::endl;
+        log_info("Initializing WiringPi Context...");
 #endif
     }
 
     context::~context(){
+        if(is_offline()){
+            return;
+        }
 #ifdef HAS_WIRING_PI
 #else
-        std::cout << "...Destroying WiringPi Context" << std::endl;
+        log_info("...Destroying WiringPi Context");
 #endif
     }
 
     void context::write(pin pin_number, bool value){
+        write_mask(to_mask(pin_number), value ? to_mask(pin_number) : 0);
+    }
+
+    void context::configure_pwm(pin pin_number, unsigned int range, int divisor){
+        if(is_offline()){
+            return;
+        }
+#ifdef HAS_WIRING_PI
+        pinMode(static_cast<int>(pin_number), PWM_OUTPUT);
+        pwmSetMode(PWM_MODE_MS);
+        pwmSetRange(range);
+        pwmSetClock(divisor);
+#else
+        log_info("Configuring PWM on pin #{} with range {} and divisor {}", pin_number, range, divisor);
+#endif
+    }
+
+    void context::write_pwm(pin pin_number, int value){
+        if(is_offline()){
+            return;
+        }
+#ifdef HAS_WIRING_PI
+        pwmWrite(static_cast<int>(pin_number), value);
+#else
+        log_debug("Writing PWM {} to pin #{}", value, pin_number);
+#endif
+    }
+
+    void context::write_hardware(pin_mask mask, pin_mask values){
 #ifdef HAS_WIRING_PI
-        digitalWrite(static_cast<int>(pin_number), static_cast<int>(value));
+        for(pin_mask remaining = mask; remaining != 0; remaining &= remaining - 1){
+            int pin_number = __builtin_ctzll(remaining);
+            digitalWrite(pin_number, static_cast<int>((values >> pin_number) & 1));
+        }
 #else
-        std::cout << "Writing " << value << " to pin #" << pin_number << std::endl;
+        for(pin_mask remaining = mask; remaining != 0; remaining &= remaining - 1){
+            int pin_number = __builtin_ctzll(remaining);
+            log_debug("Writing {} to pin #{}", (values >> pin_number) & 1, pin_number);
+        }
 #endif
     }
 }
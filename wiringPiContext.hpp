@@ -1,22 +1,104 @@
 #ifndef WIRINGPICONTEXT_HPP
 #define WIRINGPICONTEXT_HPP
 
+#include <cstdint>
+
 namespace plotter{
     using pin = unsigned int;
 
+    /**
+     * Set of GPIO pins where bit N represents BCM pin N
+     */
+    using pin_mask = std::uint64_t;
+
+    /**
+     * Convert a single pin into its pin_mask representation
+     *
+     * @param pin_number: pin to convert
+     * @return: mask with only the given pin set
+     */
+    constexpr pin_mask to_mask(pin pin_number){
+        return pin_mask{1} << pin_number;
+    }
+
     class context{
+        /*Types*/
+        public:
+            /**
+             * A hardware context drives the GPIO pins while an offline
+             * context only tracks the pin state, which allows a job to be
+             * run without touching the hardware
+             */
+            enum class mode{
+                hardware,
+                offline
+            };
+
         /*Interface*/
         private:
         public:
             context(const context&) = delete;               // Delete the copy constructor
             context& operator=(const context&) = delete;    // Delete the default copy assignment
             context();
+            explicit context(mode context_mode);
             ~context();
 
             void write(pin pin_number, bool value);
-        
+
+            /**
+             * Write every pin in the mask to its bit in values
+             *
+             * @param mask: pins to write
+             * @param values: new pin values, bits outside of mask are ignored
+             */
+            void write_mask(pin_mask mask, pin_mask values){
+                m_state = (m_state & ~mask) | (values & mask);
+                m_written |= mask;
+                if(!is_offline()){
+                    write_hardware(mask, values);
+                }
+            }
+
+            /**
+             * Set a pin up as a hardware PWM output in mark:space mode
+             *
+             * @param pin_number: PWM capable pin
+             * @param range: counts in one PWM period
+             * @param divisor: PWM clock divisor from 19.2MHz
+             */
+            void configure_pwm(pin pin_number, unsigned int range, int divisor);
+
+            /**
+             * Write a duty cycle to a PWM pin
+             *
+             * @param pin_number: pin set up with configure_pwm()
+             * @param value: counts the output is high for, up to the range
+             */
+            void write_pwm(pin pin_number, int value);
+
+            /**
+             * @return: last value written to each pin
+             */
+            pin_mask state() const{return m_state;}
+
+            /**
+             * @return: every pin that has been written through this context
+             */
+            pin_mask written() const{return m_written;}
+
+            /**
+             * @return: true if this context does not touch the hardware
+             */
+            bool is_offline() const{return m_mode == mode::offline;}
+
+        private:
+            void write_hardware(pin_mask mask, pin_mask values);
+
         /*Members*/
         private:
+            mode m_mode;
+            pin_mask m_state;
+            pin_mask m_written;
         public:
 
     };